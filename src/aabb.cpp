@@ -19,6 +19,7 @@
 
 #include "aabb.h"
 #include "mathvector.h"
+#include "raypacket.h"
 #include "unittest.h"
 
 static void distribute(float frustum[][4])
@@ -111,3 +112,28 @@ QT_TEST(aabb_test)
 		QT_CHECK(!box1.Intersect(Frustum(plane)));
 	}
 }
+
+QT_TEST(raypacket_test)
+{
+	Aabb <float> box;
+	Vec3 c1(-1, -1, -1);
+	Vec3 c2(1, 1, 1);
+	box.SetFromCorners(c1, c2);
+
+	RayPacket packet;
+	packet.Add(Vec3(0, 0, 4), Vec3(0, 0, -1), 4); // hit
+	packet.Add(Vec3(0, 0, 4), Vec3(0, 0, 1), 4); // pointing away
+	packet.Add(Vec3(0, 0, 4), Vec3(0, 0, -1), 1); // too short
+	packet.Add(Vec3(0.5, 3, 0.5), Vec3(0, -1, 0), 10); // hit from the side
+	QT_CHECK_EQUAL(packet.Size(), 4);
+
+	QT_CHECK_EQUAL(packet.Intersect(box, packet.GetMask()), 1 | 8);
+	QT_CHECK_EQUAL(packet.Intersect(box, 8), 8);
+	QT_CHECK_EQUAL(packet.Intersect(box, 2 | 4), 0);
+
+	// packet bounds of the first and last ray
+	Aabb <float> bounds = packet.GetAabb(1 | 8);
+	QT_CHECK_CLOSE(bounds.GetPos()[1], -7, 0.0001);
+	QT_CHECK_CLOSE(bounds.GetPos()[2], 0, 0.0001);
+	QT_CHECK_CLOSE(bounds.GetSize()[2], 4, 0.0001);
+}
@@ -0,0 +1,436 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _AABBBVH_H
+#define _AABBBVH_H
+
+#include "aabb.h"
+#include "frustum.h"
+#include "mathvector.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <ostream>
+#include <vector>
+
+/// Bounding volume hierarchy stored as a flat array of 32 byte nodes in depth-first order.
+/// The left child of an interior node is the next node, the right child is referenced by index.
+/// Objects are reordered at build time so that every leaf references a contiguous range.
+/// Built with a binned surface area heuristic, same interface as AabbTreeNode.
+template <typename DataType, unsigned int objects_per_leaf = 1>
+class AabbBvh
+{
+public:
+	void Add(const DataType & object, const Aabb <float> & box)
+	{
+		objects.push_back(std::pair <DataType, Aabb <float> > (object, box));
+		nodes.clear();
+	}
+
+	void Clear()
+	{
+		objects.clear();
+		nodes.clear();
+	}
+
+	bool Empty() const {return objects.empty();}
+
+	unsigned int size() const {return objects.size();}
+
+	/// build the hierarchy, has to be called after adding objects
+	void Optimize()
+	{
+		nodes.clear();
+		if (objects.empty())
+			return;
+
+		nodes.reserve(2 * objects.size() / objects_per_leaf + 1);
+		Build(0, objects.size(), 0);
+
+		// release build slack
+		std::vector <Node> (nodes).swap(nodes);
+		objectlist_type (objects).swap(objects);
+	}
+
+	/// run a query for objects that collide with the given shape
+	template <typename T, typename U>
+	void Query(const T & shape, U & outputlist) const
+	{
+		if (nodes.empty())
+			return;
+
+		// depth is bounded by the build, planes are the frustum planes the node's parent straddles,
+		// a node with no planes left is known to be fully inside
+		unsigned int stack[max_depth + 1];
+		unsigned char stack_planes[max_depth + 1];
+		int top = 0;
+		stack[0] = 0;
+		stack_planes[0] = all_planes;
+		while (top >= 0)
+		{
+			const unsigned int index = stack[top];
+			unsigned int planes = stack_planes[top];
+			--top;
+
+			const Node & node = nodes[index];
+			Aabb<float>::IntersectionEnum intersection = planes ? Intersect(node, shape, planes) : Aabb<float>::IN;
+			if (intersection == Aabb<float>::OUT)
+				continue;
+
+			if (intersection == Aabb<float>::IN)
+			{
+				// the subtree references a contiguous range of objects, no need to walk it
+				for (unsigned int i = GetFirstObject(index), e = GetEndObject(index); i < e; ++i)
+					outputlist.push_back(objects[i].first);
+			}
+			else if (node.count)
+			{
+				const bool test = node.count > 1;
+				for (unsigned int i = node.offset, e = node.offset + node.count; i < e; ++i)
+				{
+					if (!test || objects[i].second.Intersect(shape) != Aabb<float>::OUT)
+						outputlist.push_back(objects[i].first);
+				}
+			}
+			else
+			{
+				++top;
+				stack[top] = node.offset;
+				stack_planes[top] = planes;
+				++top;
+				stack[top] = index + 1;
+				stack_planes[top] = planes;
+			}
+		}
+	}
+
+	/// bytes used by nodes and objects
+	unsigned int GetMemoryUsage() const
+	{
+		return sizeof(*this) +
+			nodes.capacity() * sizeof(Node) +
+			objects.capacity() * sizeof(typename objectlist_type::value_type);
+	}
+
+	unsigned int GetNodeCount() const {return nodes.size();}
+
+	void DebugPrint(std::ostream & output) const
+	{
+		unsigned int leafs = 0;
+		for (typename std::vector <Node>::const_iterator i = nodes.begin(); i != nodes.end(); ++i)
+		{
+			if (i->count) ++leafs;
+		}
+		output << "objects: " << objects.size() << ", nodes: " << nodes.size() << ", leafs: " << leafs << std::endl;
+	}
+
+private:
+	struct Node
+	{
+		float min[3];
+		unsigned int offset; ///< leaf: first object, interior: right child
+		float max[3];
+		unsigned int count; ///< leaf: number of objects, interior: 0
+	};
+
+	struct Bin
+	{
+		Bin() : count(0) {}
+		float min[3];
+		float max[3];
+		unsigned int count;
+	};
+
+	typedef std::vector <std::pair <DataType, Aabb <float> > > objectlist_type;
+
+	static const int max_depth = 64;
+	static const unsigned int all_planes = (1 << 6) - 1;
+	static const int num_bins = 16;
+
+	std::vector <Node> nodes;
+	objectlist_type objects;
+
+	/// first object of the subtree, the leftmost leaf is reached by following the left children
+	unsigned int GetFirstObject(unsigned int index) const
+	{
+		while (!nodes[index].count)
+			++index;
+		return nodes[index].offset;
+	}
+
+	/// one past the last object of the subtree, found in the rightmost leaf
+	unsigned int GetEndObject(unsigned int index) const
+	{
+		while (!nodes[index].count)
+			index = nodes[index].offset;
+		return nodes[index].offset + nodes[index].count;
+	}
+
+	static float Center(const Aabb <float> & box, int axis)
+	{
+		return box.GetCenter()[axis];
+	}
+
+	static void Grow(float min[3], float max[3], const Aabb <float> & box)
+	{
+		const Vec3 & pos = box.GetPos();
+		const Vec3 & size = box.GetSize();
+		for (int k = 0; k < 3; ++k)
+		{
+			min[k] = std::min(min[k], pos[k]);
+			max[k] = std::max(max[k], pos[k] + size[k]);
+		}
+	}
+
+	static float HalfArea(const float min[3], const float max[3])
+	{
+		float dx = max[0] - min[0];
+		float dy = max[1] - min[1];
+		float dz = max[2] - min[2];
+		return dx * dy + dy * dz + dz * dx;
+	}
+
+	struct BinLess
+	{
+		BinLess(int axis, float cmin, float scale, int split) : axis(axis), cmin(cmin), scale(scale), split(split) {}
+		bool operator()(const typename objectlist_type::value_type & object) const
+		{
+			return BinIndex(Center(object.second, axis), cmin, scale) < split;
+		}
+		int axis;
+		float cmin;
+		float scale;
+		int split;
+	};
+
+	struct CenterLess
+	{
+		CenterLess(int axis) : axis(axis) {}
+		bool operator()(const typename objectlist_type::value_type & a, const typename objectlist_type::value_type & b) const
+		{
+			return Center(a.second, axis) < Center(b.second, axis);
+		}
+		int axis;
+	};
+
+	static int BinIndex(float center, float cmin, float scale)
+	{
+		int bin = int((center - cmin) * scale);
+		return std::min(std::max(bin, 0), num_bins - 1);
+	}
+
+	unsigned int Build(unsigned int begin, unsigned int end, int depth)
+	{
+		const unsigned int index = nodes.size();
+		nodes.push_back(Node());
+
+		// node bounds and centroid bounds
+		float bmin[3], bmax[3], cmin[3], cmax[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			bmin[k] = cmin[k] = 1E30f;
+			bmax[k] = cmax[k] = -1E30f;
+		}
+		for (unsigned int i = begin; i < end; ++i)
+		{
+			Grow(bmin, bmax, objects[i].second);
+			for (int k = 0; k < 3; ++k)
+			{
+				float c = Center(objects[i].second, k);
+				cmin[k] = std::min(cmin[k], c);
+				cmax[k] = std::max(cmax[k], c);
+			}
+		}
+		for (int k = 0; k < 3; ++k)
+		{
+			nodes[index].min[k] = bmin[k];
+			nodes[index].max[k] = bmax[k];
+		}
+
+		const unsigned int count = end - begin;
+		int axis = 0;
+		for (int k = 1; k < 3; ++k)
+		{
+			if (cmax[k] - cmin[k] > cmax[axis] - cmin[axis]) axis = k;
+		}
+		const float extent = cmax[axis] - cmin[axis];
+		if (count <= objects_per_leaf || depth >= max_depth - 1 || !(extent > 0))
+		{
+			nodes[index].offset = begin;
+			nodes[index].count = count;
+			return index;
+		}
+
+		// bin objects by centroid along the widest axis
+		const float scale = num_bins / extent;
+		Bin bins[num_bins];
+		for (int b = 0; b < num_bins; ++b)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				bins[b].min[k] = 1E30f;
+				bins[b].max[k] = -1E30f;
+			}
+		}
+		for (unsigned int i = begin; i < end; ++i)
+		{
+			Bin & bin = bins[BinIndex(Center(objects[i].second, axis), cmin[axis], scale)];
+			Grow(bin.min, bin.max, objects[i].second);
+			bin.count++;
+		}
+
+		// sweep from the right to get the area of all right partitions
+		float right_area[num_bins];
+		unsigned int right_count[num_bins];
+		Bin acc;
+		for (int k = 0; k < 3; ++k)
+		{
+			acc.min[k] = 1E30f;
+			acc.max[k] = -1E30f;
+		}
+		for (int b = num_bins - 1; b > 0; --b)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				acc.min[k] = std::min(acc.min[k], bins[b].min[k]);
+				acc.max[k] = std::max(acc.max[k], bins[b].max[k]);
+			}
+			acc.count += bins[b].count;
+			right_area[b] = acc.count ? HalfArea(acc.min, acc.max) : 0;
+			right_count[b] = acc.count;
+		}
+
+		// sweep from the left and pick the cheapest split
+		int best_split = -1;
+		float best_cost = 1E30f;
+		for (int k = 0; k < 3; ++k)
+		{
+			acc.min[k] = 1E30f;
+			acc.max[k] = -1E30f;
+		}
+		acc.count = 0;
+		for (int b = 1; b < num_bins; ++b)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				acc.min[k] = std::min(acc.min[k], bins[b - 1].min[k]);
+				acc.max[k] = std::max(acc.max[k], bins[b - 1].max[k]);
+			}
+			acc.count += bins[b - 1].count;
+			if (!acc.count || !right_count[b])
+				continue;
+
+			float cost = HalfArea(acc.min, acc.max) * acc.count + right_area[b] * right_count[b];
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best_split = b;
+			}
+		}
+
+		// partition, fall back to a median split if binning failed
+		unsigned int mid = begin + count / 2;
+		if (best_split > 0)
+		{
+			typename objectlist_type::iterator first = objects.begin() + begin;
+			typename objectlist_type::iterator last = objects.begin() + end;
+			mid = std::partition(first, last, BinLess(axis, cmin[axis], scale, best_split)) - objects.begin();
+		}
+		if (mid == begin || mid == end)
+		{
+			mid = begin + count / 2;
+			std::nth_element(objects.begin() + begin, objects.begin() + mid, objects.begin() + end, CenterLess(axis));
+		}
+
+		Build(begin, mid, depth + 1);
+		const unsigned int right = Build(mid, end, depth + 1);
+		nodes[index].offset = right;
+		nodes[index].count = 0;
+		return index;
+	}
+
+	/// only tests the given planes, clears the planes the node is fully inside of
+	static Aabb<float>::IntersectionEnum Intersect(const Node & node, const Frustum & frustum, unsigned int & planes)
+	{
+		float c[3], e[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			c[k] = (node.max[k] + node.min[k]) * 0.5f;
+			e[k] = (node.max[k] - node.min[k]) * 0.5f;
+		}
+
+		for (int i = 0; i < 6; ++i)
+		{
+			if (!(planes & (1 << i)))
+				continue;
+
+			const float * p = frustum.frustum[i];
+			float d = p[0] * c[0] + p[1] * c[1] + p[2] * c[2] + p[3];
+			float r = std::fabs(p[0]) * e[0] + std::fabs(p[1]) * e[1] + std::fabs(p[2]) * e[2];
+			if (d < -r)
+				return Aabb<float>::OUT;
+			if (d >= r)
+				planes &= ~(1 << i);
+		}
+		return planes ? Aabb<float>::INTERSECT : Aabb<float>::IN;
+	}
+
+	static Aabb<float>::IntersectionEnum Intersect(const Node & node, const Aabb <float> & box, unsigned int & /*planes*/)
+	{
+		const Vec3 & pos = box.GetPos();
+		const Vec3 & size = box.GetSize();
+		for (int k = 0; k < 3; ++k)
+		{
+			if (node.min[k] > pos[k] + size[k] || node.max[k] < pos[k])
+				return Aabb<float>::OUT;
+		}
+		return Aabb<float>::INTERSECT;
+	}
+
+	static Aabb<float>::IntersectionEnum Intersect(const Node & node, const Aabb<float>::Ray & ray, unsigned int & /*planes*/)
+	{
+		float tmin = 0;
+		float tmax = ray.seglen;
+		for (int k = 0; k < 3; ++k)
+		{
+			if (std::fabs(ray.dir[k]) < 1E-9f)
+			{
+				if (ray.orig[k] < node.min[k] || ray.orig[k] > node.max[k])
+					return Aabb<float>::OUT;
+				continue;
+			}
+			float inv = 1 / ray.dir[k];
+			float t0 = (node.min[k] - ray.orig[k]) * inv;
+			float t1 = (node.max[k] - ray.orig[k]) * inv;
+			tmin = std::max(tmin, std::min(t0, t1));
+			tmax = std::min(tmax, std::max(t0, t1));
+			if (tmin > tmax)
+				return Aabb<float>::OUT;
+		}
+		return Aabb<float>::INTERSECT;
+	}
+
+	static Aabb<float>::IntersectionEnum Intersect(const Node & /*node*/, Aabb<float>::IntersectAlways /*always*/, unsigned int & /*planes*/)
+	{
+		return Aabb<float>::IN;
+	}
+};
+
+#endif // _AABBBVH_H
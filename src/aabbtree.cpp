@@ -25,3 +25,91 @@ QT_TEST(aabb_space_partitioning_test)
 	AabbTreeNode <int> testnode;
 	QT_CHECK_EQUAL(testnode.size(), 0);
 }
+
+#include "aabbbvh.h"
+#include <algorithm>
+#include <cstdlib>
+
+QT_TEST(aabb_bvh_test)
+{
+	AabbBvh <int> bvh;
+	QT_CHECK_EQUAL(bvh.size(), 0);
+
+	// random boxes along a line, like road patches
+	std::vector <Aabb <float> > boxes(200);
+	srand(0);
+	for (unsigned i = 0; i < boxes.size(); ++i)
+	{
+		Vec3 c(i * 2.0f, (rand() % 100) * 0.1f, (rand() % 100) * 0.01f);
+		boxes[i].SetFromSphere(c, 0.5f + (rand() % 10) * 0.1f);
+		bvh.Add(i, boxes[i]);
+	}
+	bvh.Optimize();
+	QT_CHECK_EQUAL(bvh.size(), boxes.size());
+
+	// box queries have to match brute force
+	for (int n = 0; n < 50; ++n)
+	{
+		Aabb <float> query;
+		query.SetFromSphere(Vec3((rand() % 400) * 1.0f, (rand() % 100) * 0.1f, 0), 3);
+
+		std::vector <int> found;
+		bvh.Query(query, found);
+		std::sort(found.begin(), found.end());
+
+		std::vector <int> expected;
+		for (unsigned i = 0; i < boxes.size(); ++i)
+		{
+			if (boxes[i].Intersect(query) != Aabb<float>::OUT)
+				expected.push_back(i);
+		}
+		QT_CHECK(found == expected);
+	}
+
+	// vertical rays have to find the boxes they pass through
+	for (unsigned i = 0; i < boxes.size(); i += 10)
+	{
+		const Vec3 & c = boxes[i].GetCenter();
+		std::vector <int> found;
+		bvh.Query(Aabb<float>::Ray(Vec3(c[0], c[1], 10), Vec3(0, 0, -1), 20), found);
+		QT_CHECK(std::find(found.begin(), found.end(), int(i)) != found.end());
+	}
+
+	// frustum queries have to return every box that isn't outside of a plane, once
+	for (int n = 0; n < 20; ++n)
+	{
+		// keep the planes off the box edges, which are on a 0.1 grid
+		const float x = rand() % 300 + 0.05f;
+		const float planes[6][4] = {
+			{1, 0, 0, -x}, {-1, 0, 0, x + 100},
+			{0, 1, 0, -2.05f}, {0, -1, 0, 7.95f},
+			{0.6f, 0.8f, 0, -0.6f * x - 4}, {0, 0, -1, 5}};
+		Frustum frustum(planes);
+
+		std::vector <int> found;
+		bvh.Query(frustum, found);
+		std::sort(found.begin(), found.end());
+
+		std::vector <int> expected;
+		for (unsigned i = 0; i < boxes.size(); ++i)
+		{
+			const Vec3 c = boxes[i].GetCenter();
+			const Vec3 e = boxes[i].GetSize() * 0.5f;
+			bool out = false;
+			for (int k = 0; k < 6; ++k)
+			{
+				const float * p = planes[k];
+				float d = p[0] * c[0] + p[1] * c[1] + p[2] * c[2] + p[3];
+				float r = std::fabs(p[0]) * e[0] + std::fabs(p[1]) * e[1] + std::fabs(p[2]) * e[2];
+				out = out || d < -r;
+			}
+			if (!out)
+				expected.push_back(i);
+		}
+		QT_CHECK(found == expected);
+	}
+
+	std::vector <int> all;
+	bvh.Query(Aabb<float>::IntersectAlways(), all);
+	QT_CHECK_EQUAL(all.size(), boxes.size());
+}
@@ -186,6 +186,18 @@ public:
 
 	bool Empty() const {return (objects.empty() && children.empty());}
 
+	///bytes used by this node and its children
+	unsigned int GetMemoryUsage() const
+	{
+		unsigned int bytes = sizeof(*this) + objects.capacity() * sizeof(typename objectlist_type::value_type);
+		bytes += (children.capacity() - children.size()) * sizeof(AabbTreeNode);
+		for (typename childrenlist_type::const_iterator i = children.begin(); i != children.end(); ++i)
+		{
+			bytes += i->GetMemoryUsage();
+		}
+		return bytes;
+	}
+
 	void Clear() {objects.clear(); children.clear();}
 
 	///traverse the entire tree putting pointers to all DataType objects into the given outputlist
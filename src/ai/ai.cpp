@@ -25,7 +25,7 @@
 
 const std::string Ai::default_type = "aistd";
 
-Ai::Ai() : empty_input(CarInput::INVALID, 0.0)
+Ai::Ai() : empty_input(CarInput::INVALID, 0.0), jobs(0)
 {
 	AddFactory("aistd", new AiCarStandardFactory());
 	AddFactory("aiexp", new AiCarExperimentalFactory());
@@ -84,11 +84,34 @@ void Ai::clear_cars()
 
 void Ai::update(float dt, const std::list <Car> & othercars)
 {
+	car_index.Update(othercars);
+
+	const bool parallel = jobs && jobs->GetNumThreads() > 0;
+	update_jobs.resize(AI_Cars.size());
 	int size = AI_Cars.size();
 	for (int i = 0; i < size; i++)
 	{
-		AI_Cars[i]->Update(dt, othercars);
+		if (parallel && AI_Cars[i]->GetThreadSafe())
+		{
+			UpdateJob & job = update_jobs[i];
+			job.aicar = AI_Cars[i];
+			job.dt = dt;
+			job.cars = &car_index;
+			jobs->Submit(job);
+		}
+		else
+		{
+			AI_Cars[i]->Update(dt, car_index);
+		}
 	}
+
+	if (parallel)
+		jobs->Wait();
+}
+
+void Ai::setJobSystem(Parallel::JobSystem * value)
+{
+	jobs = value;
 }
 
 const std::vector <float> & Ai::GetInputs(Car * car) const
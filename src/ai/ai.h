@@ -21,8 +21,11 @@
 #define _AI_H
 
 #include "ai_car.h"
+#include "ai_car_index.h"
+#include "parallel_task.h"
 #include <string>
 #include <vector>
+#include <list>
 #include <map>
 
 class AiFactory;
@@ -35,6 +38,19 @@ private:
 	std::map <std::string, AiFactory*> AI_Factories;
 	std::vector <float> empty_input;
 
+	// car snapshot of the current tick
+	AiCarIndex car_index;
+
+	struct UpdateJob : public Parallel::Job
+	{
+		AiCar * aicar;
+		float dt;
+		const AiCarIndex * cars;
+		void Execute() {aicar->Update(dt, *cars);}
+	};
+	std::vector <UpdateJob> update_jobs;
+	Parallel::JobSystem * jobs;
+
 public:
 	Ai();
 	~Ai();
@@ -43,6 +59,7 @@ public:
 	void remove_car(Car * car);
 	void clear_cars();
 	void update(float dt, const std::list <Car> & othercars);
+	void setJobSystem(Parallel::JobSystem * value); ///< Thread safe ai cars are updated concurrently, null to disable.
 	const std::vector <float>& GetInputs(Car * car) const; ///< Returns an empty vector if the car isn't AI-controlled.
 
 	void AddFactory(const std::string& type_name, AiFactory* factory);
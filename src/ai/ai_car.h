@@ -21,9 +21,9 @@
 #define _AI_CAR_H
 
 #include "physics/carinput.h"
+#include "ai_car_index.h"
 
 #include <vector>
-#include <list>
 
 class Car;
 
@@ -48,7 +48,10 @@ public:
 	float						GetDifficulty() { return difficulty; }
 	const std::vector<float>&	GetInputs() { return inputs; }
 
-	virtual void Update(float dt, const std::list<Car>& othercars) = 0;
+	virtual void Update(float dt, const AiCarIndex & cars) = 0;
+
+	/// Update only writes to this ai car and can run concurrently with the other ai cars.
+	virtual bool GetThreadSafe() const { return false; }
 
 	/// This is optional for drawing debug stuff.
 	/// It will only be called, when VISUALIZE_AI_DEBUG macro is defined.
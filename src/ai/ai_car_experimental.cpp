@@ -111,7 +111,7 @@ float AiCarExperimental::RateLimit(float old_value, float new_value, float rate_
 		return new_value;
 }
 
-void AiCarExperimental::Update(float dt, const std::list <Car> & checkcars)
+void AiCarExperimental::Update(float dt, const AiCarIndex & checkcars)
 {
 	float lastThrottle = inputs[CarInput::THROTTLE];
 	float lastBreak = inputs[CarInput::BRAKE];
@@ -309,7 +309,6 @@ void AiCarExperimental::updateGasBrake()
 
 	float brake_value = 0.0;
 	float gas_value = 0.5;
-	const float speed_percent = 1.0;
 
 	if (car->GetEngineRPM() < car->GetEngineStallRPM())
 		inputs[CarInput::START_ENGINE] = 1.0;
@@ -340,18 +339,8 @@ void AiCarExperimental::updateGasBrake()
 	//float currentspeed = car->chassis().cm_velocity().magnitude();
 
 	//check speed against speed limit of current patch
-	float speed_limit = 0;
-	if (!curr_patch.GetNextPatch())
-	{
-		speed_limit = calcSpeedLimit(&curr_patch, NULL, lateral_mu, GetPatchWidthVector(*curr_patch_ptr).Magnitude())*speed_percent;
-	}
-	else
-	{
-		Bezier next_patch = RevisePatch(curr_patch.GetNextPatch(), use_racingline);
-		speed_limit = calcSpeedLimit(&curr_patch, &next_patch, lateral_mu, GetPatchWidthVector(*curr_patch_ptr).Magnitude())*speed_percent;
-	}
-
-	speed_limit *= difficulty;
+	const AiSpeedProfile::Limit & limit = getSpeedLimit(curr_patch_ptr);
+	float speed_limit = limit.speed * difficulty;
 
 	float speed_diff = speed_limit - currentspeed;
 
@@ -379,60 +368,15 @@ void AiCarExperimental::updateGasBrake()
 		brake_value = 0.0;
 	}
 
-	//check upto maxlookahead distance
-	float maxlookahead = calcBrakeDist(currentspeed, 0.0, longitude_mu)+10;
-	//maxlookahead = 0.1;
-	float dist_checked = 0.0;
-	float brake_dist = 0.0;
-	Bezier patch_to_check = curr_patch;
-
 #ifdef VISUALIZE_AI_DEBUG
-	brakelook.push_back(patch_to_check);
+	brakelook.push_back(curr_patch);
 #endif
 
-	while (dist_checked < maxlookahead)
+	//brake if the car can't slow down in time for the patches ahead
+	if (currentspeed > limit.brake)
 	{
-		Bezier * unmodified_patch_to_check = patch_to_check.GetNextPatch();
-
-		//if there is no next patch(probably a non-closed track, just let it roll
-		if (!patch_to_check.GetNextPatch())
-		{
-			brake_value = 0.0;
-			dist_checked = maxlookahead;
-			break;
-		}
-		else
-			patch_to_check = RevisePatch(patch_to_check.GetNextPatch(), use_racingline);
-
-#ifdef VISUALIZE_AI_DEBUG
-		brakelook.push_back(patch_to_check);
-#endif
-
-		//speed_limit = calcSpeedLimit(c, &patch_to_check, lateral_mu)*speed_percent;
-		if (!patch_to_check.GetNextPatch())
-		{
-			speed_limit = calcSpeedLimit(&patch_to_check, NULL, lateral_mu, GetPatchWidthVector(*unmodified_patch_to_check).Magnitude())*speed_percent;
-		}
-		else
-		{
-			Bezier next_patch = RevisePatch(patch_to_check.GetNextPatch(), use_racingline);
-			speed_limit = calcSpeedLimit(&patch_to_check, &next_patch, lateral_mu, GetPatchWidthVector(*unmodified_patch_to_check).Magnitude())*speed_percent;
-		}
-
-		dist_checked += GetPatchDirection(patch_to_check).Magnitude();
-		brake_dist = calcBrakeDist(currentspeed, speed_limit, longitude_mu) * 1.4;
-
-		//if (brake_dist + CORNER_BRAKE_OFFSET > dist_checked)
-		if (brake_dist > dist_checked)
-		{
-			//std::cout << "brake: limit " << speed_limit << ", cur " << currentspeed << ", brake " << brake_dist << ", dist " << dist_checked << std::endl;
-
-			/*brake_value = (brake_dist + CORNER_BRAKE_OFFSET - dist_checked)*CORNER_BRAKE_GAIN;
-			if (brake_value > 1.0) brake_value = 1.0;*/
-			brake_value = 1.0;
-			gas_value = 0.0;
-			break;
-		}
+		brake_value = 1.0;
+		gas_value = 0.0;
 	}
 
 	std::cout << speed_limit << std::endl;
@@ -475,59 +419,61 @@ void AiCarExperimental::calcMu()
 	if (!isnan(lat_mu)) lateral_mu = lat_mu;
 }
 
-float AiCarExperimental::calcSpeedLimit(const Bezier* patch, const Bezier * nextpatch, float friction, float extraradius=0)
+const AiSpeedProfile::Limit & AiCarExperimental::getSpeedLimit(const Bezier * patch)
 {
-	assert(patch);
+	AiSpeedProfile::Params params;
+	params.lateral_mu = lateral_mu;
+	params.longitude_mu = longitude_mu;
+	params.downforce = car->GetAerodynamicDownforceCoefficient() * car->GetInvMass();
+	params.drag = car->GetAeordynamicDragCoefficient() * car->GetInvMass();
+	params.brake_scale = 1.4;
+	params.brake_aero = false;
+	speed_profile.SetParams(params);
 
-	//adjust the radius at corner exit to allow a higher speed.
-	//this will get the car to accelerate out of corner
-	//double track_width = GetPatchWidthVector(*patch).Magnitude();
-	double adjusted_radius = GetPatchRadius(*patch);
-	if (nextpatch)
+	const AiSpeedProfile::Limit * limit = speed_profile.Get(patch);
+	if (!limit)
 	{
-		if (GetPatchRadius(*nextpatch) > adjusted_radius &&
-			GetPatchRadius(*patch) > LOOKAHEAD_MIN_RADIUS)
-		{
-			adjusted_radius += extraradius;
-		}
+		addProfileRoad(patch);
+		limit = speed_profile.Get(patch);
 	}
+	return *limit;
+}
 
-	//no downforce
-	//float v1 = sqrt(friction * GRAVITY * adjusted_radius);
-
-	//take into account downforce
-	double denom = (1.0 - std::min(1.01, adjusted_radius * -(car->GetAerodynamicDownforceCoefficient()) * friction * car->GetInvMass()));
-	double real = (friction * GRAVITY * adjusted_radius) / denom;
-	double v2 = 1000.0; //some really big number
-	if (real > 0)
-		v2 = sqrt(real);
+///add the patches from the given one up to the end of its road or a patch known already
+void AiCarExperimental::addProfileRoad(const Bezier * patch)
+{
+	std::vector <AiSpeedProfile::Patch> road;
+	const Bezier * p = patch;
+	do
+	{
+		Bezier revised = RevisePatch(p, use_racingline);
 
-	//std::cout << v2 << ", " << sqrt(friction * GRAVITY * adjusted_radius) << ", " << GetPatchRadius(*patch) << ", " << acos((-GetPatchDirection(*patch)).Normalize().dot(GetPatchDirection(*patch->GetNextPatch()).Normalize()))*180.0/3.141593 << " --- " << -GetPatchDirection(*patch) << " --- " << GetPatchDirection(*patch->GetNextPatch()) << std::endl;
+		//adjust the radius at corner exit to allow a higher speed.
+		//this will get the car to accelerate out of corner
+		double adjusted_radius = GetPatchRadius(revised);
+		if (revised.GetNextPatch())
+		{
+			Bezier next = RevisePatch(revised.GetNextPatch(), use_racingline);
+			if (GetPatchRadius(next) > adjusted_radius &&
+				GetPatchRadius(revised) > LOOKAHEAD_MIN_RADIUS)
+			{
+				adjusted_radius += GetPatchWidthVector(*p).Magnitude();
+			}
+		}
 
-	return v2;
-}
+		AiSpeedProfile::Patch entry;
+		entry.patch = p;
+		entry.radius = adjusted_radius;
+		entry.length = GetPatchDirection(revised).Magnitude();
+		road.push_back(entry);
 
-float AiCarExperimental::calcBrakeDist(float current_speed, float allowed_speed, float friction)
-{
-	// Old way, which returns very big breaking distances:
-	// float c = friction * GRAVITY;
-	// float d = (-(car->GetAerodynamicDownforceCoefficient()) * friction +
-	// 			car->GetAeordynamicDragCoefficient()) * car->GetInvMass();
-	// float v1sqr = current_speed * current_speed;
-	// float v2sqr = allowed_speed * allowed_speed;
-	// return (c + v2sqr*d)/(c + v1sqr*d)/(2.0*d);*/
-
-	if (allowed_speed < current_speed){
-		// equations used:
-		// mu * mass * gravity * distance = 0.5 * mass * (Initial_velocity^2 - Final_velocity^2)
-		// where distance is:
-		//  distance = (Initial_velocity^2 - Final_velocity^2) / (2 * mu * gravity)
-		return (current_speed*current_speed - allowed_speed*allowed_speed) / ( 2.0 * friction * GRAVITY);
-	} else {
-		//if allowed speed  is bigger then the current speed then break distance is 0.
-		return 0;
+		p = p->GetNextPatch();
 	}
+	while (p && p != patch && !speed_profile.Has(p));
+
+	speed_profile.AddRoad(road, p == patch);
 }
+
 float AiCarExperimental::RayCastDistance( Vec3 direction, float max_length){
 	btVector3 pos = car->GetCarDynamics().GetPosition();
 	btVector3 dir = car->GetCarDynamics().LocalToWorld(ToBulletVector(direction));
@@ -774,14 +720,14 @@ float AiCarExperimental::brakeFromOthers(float speed_diff)
 	float mineta = 1000;
 	float mindistance = 1000;
 
-	for (std::map <const Car *, OtherCarInfo>::iterator i = othercars.begin(); i != othercars.end(); ++i)
+	for (std::vector <OtherCarInfo>::const_iterator i = othercars.begin(); i != othercars.end(); ++i)
 	{
-		if (i->second.active && std::abs(i->second.horizontal_distance) < horizontal_care)
+		if (std::abs(i->horizontal_distance) < horizontal_care)
 		{
-			if (i->second.fore_distance < mindistance)
+			if (i->fore_distance < mindistance)
 			{
-				mindistance = i->second.fore_distance;
-				mineta = i->second.eta;
+				mindistance = i->fore_distance;
+				mineta = i->eta;
 			}
 		}
 	}
@@ -814,104 +760,71 @@ float AiCarExperimental::brakeFromOthers(float speed_diff)
 	return bias;
 }
 
-void AiCarExperimental::analyzeOthers(float dt, const std::list <Car> & checkcars)
+void AiCarExperimental::analyzeOthers(float dt, const AiCarIndex & checkcars)
 {
-	//const float speed = std::max(1.0f,car->GetVelocity().Magnitude());
 	const float half_carlength = 1.25; //in meters
-
-	//std::cout << speed << ": " << authority << std::endl;
+	const float lookahead_time = 10; //in seconds, brakeFromOthers starts to react at this eta
 
 	//const Vec3 steer_right_axis = direction::Right;
 	const Vec3 throttle_axis = Direction::Forward;
 
-#ifdef VISUALIZE_AI_DEBUG
-	//avoidancedraw->ClearLine();
-#endif
-
-	for (std::list <Car>::const_iterator i = checkcars.begin(); i != checkcars.end(); ++i)
-	{
-		if (&(*i) != car)
-		{
-			OtherCarInfo & info = othercars[&(*i)];
-
-			//find direction of other cars in our frame
-			Vec3 relative_position = i->GetCenterOfMassPosition() - car->GetCenterOfMassPosition();
-			(-car->GetOrientation()).RotateVector(relative_position);
-
-			//std::cout << relative_position.dot(throttle_axis) << ", " << relative_position.dot(steer_right_axis) << std::endl;
-
-			//only make a move if the other car is within our distance limit
-			float fore_position = relative_position.dot(throttle_axis);
-			//float speed_diff = i->GetVelocity().dot(throttle_axis) - car->GetVelocity().dot(throttle_axis); //positive if other car is faster
-
-			Vec3 myvel = car->GetVelocity();
-			Vec3 othervel = i->GetVelocity();
-			(-car->GetOrientation()).RotateVector(myvel);
-			(-i->GetOrientation()).RotateVector(othervel);
-			float speed_diff = othervel.dot(throttle_axis) - myvel.dot(throttle_axis); //positive if other car is faster
+	//only the cars in front of us are kept, the previous ones carry their eta over
+	othercars_prev.swap(othercars);
+	othercars.clear();
 
-			//std::cout << speed_diff << std::endl;
-			//float distancelimit = clamp(distancelimitcoeff*-speed_diff, distancelimitmin, distancelimitmax);
-			const float fore_position_offset = -half_carlength;
-			if (fore_position > fore_position_offset)// && fore_position < distancelimit) //only pay attention to cars roughly in front of us
-			{
-				//float horizontal_distance = relative_position.dot(steer_right_axis); //fallback method if not on a patch
-				//float orig_horiz = horizontal_distance;
-
-				const Bezier * othercarpatch = GetCurrentPatch(&(*i));
-				const Bezier * mycarpatch = GetCurrentPatch(car);
-
-				if (othercarpatch && mycarpatch)
-				{
-					float my_track_placement = GetHorizontalDistanceAlongPatch(*mycarpatch, car->GetCenterOfMassPosition());
-					float their_track_placement = GetHorizontalDistanceAlongPatch(*othercarpatch, i->GetCenterOfMassPosition());
+	const AiCarIndex::Entry * self = checkcars.Find(car);
+	if (!self || !self->patch)
+		return;
 
-					float speed_diff_denom = clamp(speed_diff, -100, -0.01);
-					float eta = (fore_position-fore_position_offset)/-speed_diff_denom;
+	const Quat inv_orientation = -self->orientation;
+	Vec3 myvel = self->velocity;
+	inv_orientation.RotateVector(myvel);
+	const float my_track_placement = GetHorizontalDistanceAlongPatch(*self->patch, self->position);
 
-					info.fore_distance = fore_position;
+	//only cars we could close in on within the lookahead time are of interest
+	const float distancelimit = lookahead_time * (self->velocity.Magnitude() + 10.0f);
+	nearby.clear();
+	checkcars.Query(self->position, distancelimit, nearby);
 
-					if (!info.active)
-						info.eta = eta;
-					else
-						info.eta = RateLimit(info.eta, eta, 10.f*dt, 10000.f*dt);
+	for (std::vector <unsigned>::const_iterator n = nearby.begin(); n != nearby.end(); ++n)
+	{
+		const AiCarIndex::Entry & other = checkcars[*n];
+		if (other.car == car || !other.patch)
+			continue;
 
-					float horizontal_distance = their_track_placement - my_track_placement;
-					//if (!info.active)
-						info.horizontal_distance = horizontal_distance;
-					/*else
-						info.horizontal_distance = RateLimit(info.horizontal_distance, horizontal_distance, spacingdistance*dt, spacingdistance*dt);*/
+		//find direction of other cars in our frame
+		Vec3 relative_position = other.position - self->position;
+		inv_orientation.RotateVector(relative_position);
 
-					//std::cout << info.horizontal_distance << ", " << info.eta << std::endl;
+		//only pay attention to cars roughly in front of us
+		const float fore_position = relative_position.dot(throttle_axis);
+		const float fore_position_offset = -half_carlength;
+		if (fore_position <= fore_position_offset)
+			continue;
 
-					info.active = true;
-				}
-				else
-					info.active = false;
+		Vec3 othervel = other.velocity;
+		(-other.orientation).RotateVector(othervel);
+		float speed_diff = othervel.dot(throttle_axis) - myvel.dot(throttle_axis); //positive if other car is faster
 
-				//std::cout << orig_horiz << ", " << horizontal_distance << ",    " << fore_position << ", " << speed_diff << std::endl;
+		float their_track_placement = GetHorizontalDistanceAlongPatch(*other.patch, other.position);
 
-				/*if (!min_horizontal_distance)
-					min_horizontal_distance = optional <float> (horizontal_distance);
-				else if (std::abs(min_horizontal_distance.get()) > std::abs(horizontal_distance))
-					min_horizontal_distance = optional <float> (horizontal_distance);*/
-			}
-			else
-				info.active = false;
+		float speed_diff_denom = clamp(speed_diff, -100, -0.01);
+		float eta = (fore_position-fore_position_offset)/-speed_diff_denom;
 
-/*#ifdef VISUALIZE_AI_DEBUG
-			if (info.active)
+		OtherCarInfo info;
+		info.car = other.car;
+		info.fore_distance = fore_position;
+		info.horizontal_distance = their_track_placement - my_track_placement;
+		info.eta = eta;
+		for (std::vector <OtherCarInfo>::const_iterator i = othercars_prev.begin(); i != othercars_prev.end(); ++i)
+		{
+			if (i->car == other.car)
 			{
-				avoidancedraw->AddLinePoint(car->GetCenterOfMassPosition());
-				Vec3 feeler1(speed*info.eta,0,0);
-				car->GetOrientation().RotateVector(feeler1);
-				Vec3 feeler2(0,-info.horizontal_distance,0);
-				car->GetOrientation().RotateVector(feeler2);
-				avoidancedraw->AddLinePoint(car->GetCenterOfMassPosition()+feeler1+feeler2);
-				avoidancedraw->AddLinePoint(car->GetCenterOfMassPosition());
+				info.eta = RateLimit(i->eta, eta, 10.f*dt, 10000.f*dt);
+				break;
 			}
-#endif*/
 		}
+		othercars.push_back(info);
 	}
 }
 
@@ -928,12 +841,12 @@ float AiCarExperimental::steerAwayFromOthers()
 	float eta = 1000;
 	float min_horizontal_distance = 1000;
 
-	for (std::map <const Car *, OtherCarInfo>::iterator i = othercars.begin(); i != othercars.end(); ++i)
+	for (std::vector <OtherCarInfo>::const_iterator i = othercars.begin(); i != othercars.end(); ++i)
 	{
-		if (i->second.active && std::abs(i->second.horizontal_distance) < std::abs(min_horizontal_distance))
+		if (std::abs(i->horizontal_distance) < std::abs(min_horizontal_distance))
 		{
-			min_horizontal_distance = i->second.horizontal_distance;
-			eta = i->second.eta;
+			min_horizontal_distance = i->horizontal_distance;
+			eta = i->eta;
 		}
 	}
 
@@ -22,6 +22,7 @@
 
 #include "ai_car.h"
 #include "ai_factory.h"
+#include "ai_speed_profile.h"
 #include "physics/carinput.h"
 #include "reseatable_reference.h"
 #include "graphics/scenenode.h"
@@ -47,10 +48,10 @@ private:
 
 	void updateGasBrake();
 	void calcMu();
-	float calcSpeedLimit(const Bezier* patch, const Bezier* nextpatch, float friction, float extraradius);
-	float calcBrakeDist(float current_speed, float allowed_speed, float friction);
+	const AiSpeedProfile::Limit & getSpeedLimit(const Bezier * patch);
+	void addProfileRoad(const Bezier * patch);
 	void updateSteer();
-	void analyzeOthers(float dt, const std::list <Car> & othercars);
+	void analyzeOthers(float dt, const AiCarIndex & othercars);
 	float steerAwayFromOthers(); ///< returns a float that should be added into the steering wheel command
 	float brakeFromOthers(float speed_diff); ///< returns a float that should be added into the brake command. speed_diff is the difference between the desired speed and speed limit of this area of the track
 	double Angle(double x1, double y1); ///< returns the angle in degrees of the normalized 2-vector
@@ -71,22 +72,24 @@ private:
 	std::map <const Car *, PathRevision> path_revisions;
 	*/
 
+	/// a car in front of us
 	struct OtherCarInfo
 	{
-		OtherCarInfo() : active(false) {}
-
+		const Car * car;
 		float horizontal_distance;
 		float fore_distance;
 		float eta;
-		bool active;
 	};
-	std::map <const Car *, OtherCarInfo> othercars;
+	std::vector <OtherCarInfo> othercars;
+	std::vector <OtherCarInfo> othercars_prev; ///< cars of the previous update, carry the eta over
+	std::vector <unsigned> nearby; ///< scratch buffer for the car index query
 
 	float shift_time;
 	float longitude_mu; ///<friction coefficient of the tire - longitude direction
 	float lateral_mu; ///<friction coefficient of the tire - lateral direction
 	const Bezier * last_patch; ///<last patch the car was on, used in case car is off track
 	bool use_racingline; ///<true allows the AI to take a proper racing line
+	AiSpeedProfile speed_profile; ///<speed limits along the roads driven so far
 	bool isRecovering; ///< tries to get back to the road.
 	time_t recoverStartTime;
 
@@ -131,7 +134,7 @@ private:
 public:
 	AiCarExperimental (Car * new_car, float newdifficulty);
 	~AiCarExperimental();
-	void Update(float dt, const std::list <Car> & checkcars);
+	void Update(float dt, const AiCarIndex & checkcars);
 
 #ifdef VISUALIZE_AI_DEBUG
 	void Visualize();
@@ -0,0 +1,180 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "ai_car_index.h"
+#include "car.h"
+#include "physics/carwheelposition.h"
+
+#include <algorithm>
+
+namespace
+{
+
+struct EntryLess
+{
+	bool operator()(const AiCarIndex::Entry & a, const AiCarIndex::Entry & b) const
+	{
+		return a.position[0] < b.position[0];
+	}
+	bool operator()(const AiCarIndex::Entry & a, float x) const
+	{
+		return a.position[0] < x;
+	}
+};
+
+}
+
+void AiCarIndex::Update(const std::list <Car> & cars)
+{
+	entries.resize(cars.size());
+	std::vector <Entry>::iterator e = entries.begin();
+	for (std::list <Car>::const_iterator i = cars.begin(); i != cars.end(); ++i, ++e)
+	{
+		e->car = &*i;
+		e->position = i->GetCenterOfMassPosition();
+		e->velocity = i->GetVelocity();
+		e->orientation = i->GetOrientation();
+		e->patch = i->GetCurPatch(WheelPosition(0));
+		if (!e->patch)
+			e->patch = i->GetCurPatch(WheelPosition(1));
+	}
+	Sort();
+}
+
+void AiCarIndex::Update(const std::vector <Entry> & cars)
+{
+	entries = cars;
+	Sort();
+}
+
+void AiCarIndex::Sort()
+{
+	std::sort(entries.begin(), entries.end(), EntryLess());
+
+	lookup.resize(entries.size());
+	for (unsigned i = 0; i < entries.size(); ++i)
+	{
+		lookup[i] = std::make_pair(entries[i].car, i);
+	}
+	std::sort(lookup.begin(), lookup.end());
+}
+
+void AiCarIndex::Query(const Vec3 & position, float radius, std::vector <unsigned> & output) const
+{
+	const float radius2 = radius * radius;
+	std::vector <Entry>::const_iterator i = std::lower_bound(
+		entries.begin(), entries.end(), position[0] - radius, EntryLess());
+	for (; i != entries.end() && i->position[0] <= position[0] + radius; ++i)
+	{
+		if ((i->position - position).MagnitudeSquared() <= radius2)
+			output.push_back(i - entries.begin());
+	}
+}
+
+const AiCarIndex::Entry * AiCarIndex::Find(const Car * car) const
+{
+	std::vector <std::pair <const Car *, unsigned> >::const_iterator i = std::lower_bound(
+		lookup.begin(), lookup.end(), std::make_pair(car, 0u));
+	if (i == lookup.end() || i->first != car)
+		return 0;
+	return &entries[i->second];
+}
+
+#include "unittest.h"
+
+QT_TEST(ai_car_index_test)
+{
+	// the cars are only used as keys, their states are captured separately
+	const unsigned count = 200;
+	std::vector <char> keys(count + 1);
+	std::vector <const Car *> cars(count + 1);
+	for (unsigned i = 0; i <= count; ++i)
+		cars[i] = reinterpret_cast <const Car *> (&keys[i]);
+	std::vector <AiCarIndex::Entry> snapshot(count);
+	unsigned seed = 1;
+	for (unsigned i = 0; i < count; ++i)
+	{
+		int r[3];
+		for (unsigned j = 0; j < 3; ++j)
+		{
+			seed = seed * 1103515245 + 12345;
+			r[j] = int(seed >> 16);
+		}
+		// integer positions on a small grid, so that many cars share x
+		// and distances land exactly on the query radius
+		AiCarIndex::Entry & e = snapshot[i];
+		e.car = cars[i];
+		e.position.Set(r[0] % 21 - 10, r[1] % 41 - 20, r[2] % 5);
+		e.patch = 0;
+	}
+
+	// cars at exactly the radius from the query position are found
+	snapshot[0].position.Set(3, 4, 0);
+	snapshot[1].position.Set(-5, 0, 0);
+	snapshot[2].position.Set(0, 5, 0);
+	snapshot[3].position.Set(0, 0, -5);
+	snapshot[4].position.Set(5, 0.01, 0);
+
+	AiCarIndex index;
+	index.Update(snapshot);
+	QT_CHECK_EQUAL(index.size(), count);
+
+	std::vector <unsigned> found;
+	index.Query(Vec3(0, 0, 0), 5, found);
+	std::vector <const Car *> found_cars;
+	for (unsigned i = 0; i < found.size(); ++i)
+		found_cars.push_back(index[found[i]].car);
+	for (unsigned i = 0; i < 4; ++i)
+		QT_CHECK(std::find(found_cars.begin(), found_cars.end(), cars[i]) != found_cars.end());
+	QT_CHECK(std::find(found_cars.begin(), found_cars.end(), cars[4]) == found_cars.end());
+
+	// queries match a brute force distance filter
+	int errors = 0;
+	for (int x = -12; x <= 12; x += 3)
+	{
+		for (int y = -20; y <= 20; y += 5)
+		{
+			for (float radius = 0; radius <= 8; radius += 2.5)
+			{
+				const Vec3 position(x, y, 2);
+				found.clear();
+				index.Query(position, radius, found);
+				std::sort(found.begin(), found.end());
+
+				std::vector <unsigned> expected;
+				for (unsigned i = 0; i < index.size(); ++i)
+				{
+					if ((index[i].position - position).MagnitudeSquared() <= radius * radius)
+						expected.push_back(i);
+				}
+				errors += (found != expected);
+			}
+		}
+	}
+	QT_CHECK_EQUAL(errors, 0);
+
+	// every car is found with its own state, cars outside the snapshot aren't
+	for (unsigned i = 0; i < count; ++i)
+	{
+		const AiCarIndex::Entry * e = index.Find(cars[i]);
+		QT_CHECK(e && e->car == cars[i] && e->position == snapshot[i].position);
+	}
+	QT_CHECK(!index.Find(cars[count]));
+	QT_CHECK(!index.Find(0));
+}
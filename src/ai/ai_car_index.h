@@ -0,0 +1,73 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _AI_CAR_INDEX_H
+#define _AI_CAR_INDEX_H
+
+#include "mathvector.h"
+#include "quaternion.h"
+
+#include <list>
+#include <vector>
+
+class Car;
+class Bezier;
+
+/// Snapshot of the car states of an ai tick, shared by all ai cars.
+/// The cars are sorted along the x axis, so that the cars near a position
+/// can be found without visiting all of them.
+class AiCarIndex
+{
+public:
+	struct Entry
+	{
+		const Car * car;
+		Vec3 position; ///< center of mass
+		Vec3 velocity;
+		Quat orientation;
+		const Bezier * patch; ///< patch under the front wheels, null if off track
+	};
+
+	/// take a new snapshot of the cars
+	void Update(const std::list <Car> & cars);
+
+	/// take a snapshot of already captured car states
+	void Update(const std::vector <Entry> & cars);
+
+	/// append the indices of the cars within radius of position to output
+	void Query(const Vec3 & position, float radius, std::vector <unsigned> & output) const;
+
+	/// return null if the car isn't in the snapshot
+	const Entry * Find(const Car * car) const;
+
+	const Entry & operator[](unsigned i) const {return entries[i];}
+
+	unsigned size() const {return entries.size();}
+
+private:
+	std::vector <Entry> entries;
+
+	/// sort the entries along the x axis and rebuild the lookup
+	void Sort();
+
+	// entry indices sorted by car pointer
+	std::vector <std::pair <const Car *, unsigned> > lookup;
+};
+
+#endif // _AI_CAR_INDEX_H
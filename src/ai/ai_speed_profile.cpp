@@ -0,0 +1,228 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "ai_speed_profile.h"
+#include "bezier.h"
+#include "unittest.h"
+
+#include <algorithm>
+#include <cmath>
+
+const float AiSpeedProfile::tolerance = 0.05;
+
+// speed used where there is no limit
+static const float max_speed = 1000;
+
+static const double gravity = 9.8;
+
+static bool Differs(float a, float b)
+{
+	return std::abs(a - b) > AiSpeedProfile::tolerance * std::max(std::abs(a), std::abs(b));
+}
+
+static float CorneringSpeed(float radius, const AiSpeedProfile::Params & p)
+{
+	// take into account downforce
+	const double r = radius;
+	const double denom = 1.0 - std::min(1.01, r * -p.downforce * p.lateral_mu);
+	const double real = p.lateral_mu * gravity * r / denom;
+	return real > 0 ? std::sqrt(real) : max_speed;
+}
+
+// highest speed the car can slow down from to the given speed within distance,
+// solves the brake distance -log((c + v2^2 d) / (c + v1^2 d)) / (2 d) for v1
+static float BrakeSpeed(float speed, float distance, const AiSpeedProfile::Params & p)
+{
+	const double c = p.longitude_mu * gravity;
+	const double d = p.brake_aero ? -p.downforce * p.longitude_mu + p.drag : 0;
+	const double s = distance / p.brake_scale;
+	const double v2sqr = double(speed) * speed;
+	double v1sqr;
+	if (std::abs(d) < 1E-9)
+	{
+		v1sqr = v2sqr + 2 * c * s;
+	}
+	else
+	{
+		const double e = c + v2sqr * d;
+		if (e <= 0)
+			return max_speed;
+		v1sqr = (e * std::exp(2 * d * s) - c) / d;
+	}
+	return v1sqr > 0 ? std::min(std::sqrt(v1sqr), double(max_speed)) : 0;
+}
+
+void AiSpeedProfile::SetParams(const Params & new_params)
+{
+	if (!Differs(params.lateral_mu, new_params.lateral_mu) &&
+		!Differs(params.longitude_mu, new_params.longitude_mu) &&
+		!Differs(params.downforce, new_params.downforce) &&
+		!Differs(params.drag, new_params.drag) &&
+		!Differs(params.brake_scale, new_params.brake_scale) &&
+		params.brake_aero == new_params.brake_aero)
+		return;
+
+	params = new_params;
+
+	// roads only continue into roads added before them
+	for (std::vector <Road>::const_iterator i = roads.begin(); i != roads.end(); ++i)
+	{
+		UpdateLimits(*i);
+	}
+}
+
+void AiSpeedProfile::AddRoad(const std::vector <Patch> & road, bool closed)
+{
+	if (road.empty())
+		return;
+
+	Road r;
+	r.begin = entries.size();
+	r.end = r.begin + road.size();
+	r.closed = closed;
+
+	entries.resize(r.end);
+	limits.resize(r.end);
+	for (unsigned i = 0; i < road.size(); ++i)
+	{
+		Entry & e = entries[r.begin + i];
+		e.radius = road[i].radius;
+		e.length = road[i].length;
+		e.next = r.begin + i + 1;
+		ids[road[i].patch] = r.begin + i;
+	}
+
+	Entry & last = entries.back();
+	if (closed)
+	{
+		last.next = r.begin;
+	}
+	else
+	{
+		std::tr1::unordered_map <const Bezier *, unsigned>::const_iterator i =
+			ids.find(road.back().patch->GetNextPatch());
+		last.next = (i != ids.end()) ? int(i->second) : -1;
+	}
+
+	roads.push_back(r);
+	UpdateLimits(r);
+}
+
+const AiSpeedProfile::Limit * AiSpeedProfile::Get(const Bezier * patch) const
+{
+	std::tr1::unordered_map <const Bezier *, unsigned>::const_iterator i = ids.find(patch);
+	if (i == ids.end())
+		return NULL;
+	return &limits[i->second];
+}
+
+void AiSpeedProfile::UpdateLimits(const Road & road)
+{
+	for (unsigned i = road.begin; i < road.end; ++i)
+	{
+		limits[i].speed = CorneringSpeed(entries[i].radius, params);
+		limits[i].brake = max_speed;
+	}
+
+	// the brake speed of a patch is the speed the car can brake from to the limits
+	// of the next patch within its length, a closed road needs a second pass to wrap
+	const int passes = road.closed ? 2 : 1;
+	for (int pass = 0; pass < passes; ++pass)
+	{
+		for (unsigned i = road.end; i-- > road.begin;)
+		{
+			const int next = entries[i].next;
+			if (next < 0)
+				continue;
+
+			const Limit & n = limits[next];
+			limits[i].brake = BrakeSpeed(std::min(n.speed, n.brake), entries[next].length, params);
+		}
+	}
+}
+
+QT_TEST(ai_speed_profile_test)
+{
+	// a closed road with a few corners
+	const int count = 60;
+	std::vector <Bezier> patches(count);
+	std::vector <AiSpeedProfile::Patch> road(count);
+	for (int i = 0; i < count; ++i)
+	{
+		road[i].patch = &patches[i];
+		road[i].radius = (i % 20 < 4) ? 15 + 10 * (i % 20) : 10000;
+		road[i].length = 4 + (i * 7) % 5;
+	}
+
+	AiSpeedProfile::Params params;
+	params.lateral_mu = 1.1;
+	params.longitude_mu = 1.0;
+	params.downforce = -0.0003;
+	params.drag = 0.0002;
+	params.brake_scale = 1.4;
+
+	AiSpeedProfile profile;
+	profile.SetParams(params);
+	profile.AddRoad(road, true);
+	QT_CHECK(profile.Has(&patches[0]));
+	QT_CHECK(!profile.Get(NULL));
+
+	// compare against walking the patches ahead until one can't be braked for
+	const float c = params.longitude_mu * gravity;
+	const float d = -params.downforce * params.longitude_mu + params.drag;
+	int mismatches = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		const AiSpeedProfile::Limit * limit = profile.Get(&patches[i]);
+		QT_CHECK(limit);
+		if (!limit)
+			continue;
+
+		QT_CHECK_CLOSE(limit->speed, CorneringSpeed(road[i].radius, params), 1E-3);
+
+		for (float speed = 5; speed < 90; speed += 0.5)
+		{
+			if (std::abs(speed - limit->brake) < 0.01)
+				continue;
+
+			bool brake = false;
+			float dist = 0;
+			for (int j = 1; j < 2 * count && !brake; ++j)
+			{
+				const int k = (i + j) % count;
+				const float v1sqr = speed * speed;
+				const float v2sqr = profile.Get(&patches[k])->speed * profile.Get(&patches[k])->speed;
+				const float brake_dist = -log((c + v2sqr * d) / (c + v1sqr * d)) / (2.0 * d) * params.brake_scale;
+				dist += road[k].length;
+				brake = brake_dist > dist;
+			}
+			mismatches += (brake != (speed > limit->brake));
+		}
+	}
+	QT_CHECK_EQUAL(mismatches, 0);
+
+	// small parameter changes keep the limits
+	const float speed = profile.Get(&patches[0])->speed;
+	params.lateral_mu *= 1.01;
+	profile.SetParams(params);
+	QT_CHECK_EQUAL(profile.Get(&patches[0])->speed, speed);
+	params.lateral_mu *= 1.2;
+	profile.SetParams(params);
+	QT_CHECK_GREATER(profile.Get(&patches[0])->speed, speed);
+}
@@ -0,0 +1,105 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _AI_SPEED_PROFILE_H
+#define _AI_SPEED_PROFILE_H
+
+#include "unordered_map.h"
+
+#include <vector>
+
+class Bezier;
+
+/// Speed limits along the roads for one car.
+/// The cornering limit of a patch follows from its racing line radius, the brake
+/// speed is the highest speed on a patch that still allows the car to slow down
+/// to the limits of all patches ahead. Brake speeds are found in a backward pass
+/// over the road, so looking them up is constant time.
+/// Roads are added when the car first reaches them, the limits are only
+/// recomputed when the car parameters drift away from the ones they were computed for.
+class AiSpeedProfile
+{
+public:
+	/// car parameters the limits are computed for
+	struct Params
+	{
+		Params() : lateral_mu(0), longitude_mu(0), downforce(0), drag(0), brake_scale(1), brake_aero(true) {}
+		float lateral_mu;
+		float longitude_mu;
+		float downforce; ///< aerodynamic downforce coefficient times inverse mass, negative
+		float drag; ///< aerodynamic drag coefficient times inverse mass
+		float brake_scale; ///< safety factor applied to brake distances
+		bool brake_aero; ///< take downforce and drag into account when braking
+	};
+
+	/// geometry of a patch, as seen by the ai
+	struct Patch
+	{
+		const Bezier * patch;
+		float radius; ///< racing line radius, adjusted for corner exits
+		float length; ///< distance covered on the patch
+	};
+
+	/// speeds of a patch
+	struct Limit
+	{
+		float speed; ///< cornering speed limit
+		float brake; ///< above this speed the car has to brake for the patches ahead
+	};
+
+	/// relative parameter change that triggers a recomputation of the limits
+	static const float tolerance;
+
+	/// set the parameters, the limits are recomputed if they changed by more than the tolerance
+	void SetParams(const Params & params);
+
+	/// add a road, patches in driving order, closed roads continue at their first patch
+	/// an open road continuing at a patch added earlier takes its limits into account
+	void AddRoad(const std::vector <Patch> & road, bool closed);
+
+	/// return null if the patch hasn't been added
+	const Limit * Get(const Bezier * patch) const;
+
+	bool Has(const Bezier * patch) const {return ids.find(patch) != ids.end();}
+
+private:
+	struct Entry
+	{
+		float radius;
+		float length;
+		int next; ///< entry of the patch ahead, -1 at the end of an open road
+	};
+
+	struct Road
+	{
+		unsigned begin;
+		unsigned end;
+		bool closed;
+	};
+
+	Params params;
+	std::vector <Entry> entries;
+	std::vector <Limit> limits;
+	std::vector <Road> roads;
+	std::tr1::unordered_map <const Bezier *, unsigned> ids;
+
+	void UpdateLimits(const Road & road);
+};
+
+#endif // _AI_SPEED_PROFILE_H
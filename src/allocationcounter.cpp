@@ -0,0 +1,189 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "definitions.h"
+#include "allocationcounter.h"
+
+#include <new>
+
+#if defined(DEBUG) || defined(PROFILING)
+#define ALLOCATION_COUNTER
+#endif
+
+#ifdef ALLOCATION_COUNTER
+
+#include <cstdlib>
+
+// per thread, so counting needs no atomics and other threads don't show up in the count
+// zero initialized before any dynamic initialization can allocate
+#ifdef _MSC_VER
+static __declspec(thread) unsigned int allocations;
+#else
+static __thread unsigned int allocations;
+#endif
+
+#if __cplusplus >= 201103L
+#define ALLOC_THROW
+#define ALLOC_NOTHROW noexcept
+#else
+#define ALLOC_THROW throw(std::bad_alloc)
+#define ALLOC_NOTHROW throw()
+#endif
+
+static void * Allocate(std::size_t size)
+{
+	++allocations;
+	if (size == 0)
+		size = 1;
+	void * p;
+	while ((p = std::malloc(size)) == 0)
+	{
+		std::new_handler handler = std::set_new_handler(0);
+		std::set_new_handler(handler);
+		if (!handler)
+			return 0;
+		handler();
+	}
+	return p;
+}
+
+bool AllocationCounter::Enabled()
+{
+	return true;
+}
+
+unsigned int AllocationCounter::Get()
+{
+	return allocations;
+}
+
+void * operator new(std::size_t size) ALLOC_THROW
+{
+	void * p = Allocate(size);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void * operator new[](std::size_t size) ALLOC_THROW
+{
+	void * p = Allocate(size);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void * operator new(std::size_t size, const std::nothrow_t &) ALLOC_NOTHROW
+{
+	return Allocate(size);
+}
+
+void * operator new[](std::size_t size, const std::nothrow_t &) ALLOC_NOTHROW
+{
+	return Allocate(size);
+}
+
+void operator delete(void * p) ALLOC_NOTHROW
+{
+	std::free(p);
+}
+
+void operator delete[](void * p) ALLOC_NOTHROW
+{
+	std::free(p);
+}
+
+void operator delete(void * p, const std::nothrow_t &) ALLOC_NOTHROW
+{
+	std::free(p);
+}
+
+void operator delete[](void * p, const std::nothrow_t &) ALLOC_NOTHROW
+{
+	std::free(p);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void * p, std::size_t) ALLOC_NOTHROW
+{
+	std::free(p);
+}
+
+void operator delete[](void * p, std::size_t) ALLOC_NOTHROW
+{
+	std::free(p);
+}
+#endif
+
+#else
+
+bool AllocationCounter::Enabled()
+{
+	return false;
+}
+
+unsigned int AllocationCounter::Get()
+{
+	return 0;
+}
+
+#endif // ALLOCATION_COUNTER
+
+#include "unittest.h"
+
+QT_TEST(allocationcounter_test)
+{
+	if (!AllocationCounter::Enabled())
+	{
+		QT_CHECK_EQUAL(AllocationCounter::Get(), 0u);
+		return;
+	}
+
+	// volatile so that the allocations can't be optimized away
+	int * volatile p;
+	unsigned int start = AllocationCounter::Get();
+
+	p = new int;
+	QT_CHECK_EQUAL(AllocationCounter::Get() - start, 1u);
+	delete p;
+	QT_CHECK_EQUAL(AllocationCounter::Get() - start, 1u);
+
+	p = new int[16];
+	QT_CHECK_EQUAL(AllocationCounter::Get() - start, 2u);
+	delete [] p;
+
+	p = new (std::nothrow) int;
+	QT_CHECK(p);
+	QT_CHECK_EQUAL(AllocationCounter::Get() - start, 3u);
+	delete p;
+
+	p = new (std::nothrow) int[16];
+	QT_CHECK(p);
+	QT_CHECK_EQUAL(AllocationCounter::Get() - start, 4u);
+	delete [] p;
+
+	// zero sized allocations are counted and distinct
+	start = AllocationCounter::Get();
+	int * a = new int[0];
+	int * b = new int[0];
+	QT_CHECK(a != b);
+	QT_CHECK_EQUAL(AllocationCounter::Get() - start, 2u);
+	delete [] a;
+	delete [] b;
+}
@@ -17,76 +17,24 @@
 /*                                                                      */
 /************************************************************************/
 
-#ifndef _TRIPPLEBUFFER_H
-#define _TRIPPLEBUFFER_H
-
-#include <cassert>
-
-template <class T>
-class TrippleBuffer
-{
-public:
-	TrippleBuffer();
-
-	T & getFirst();
-	
-	T & getSecond();
-	
-	T & getLast();
-
-	void swapFirst();
-
-	void swapLast();
-
-private:
-	T buffer1, buffer2, buffer3;
-	T * buffer1p, * buffer2p, * buffer3p;
-};
-
-
-template <class T>
-inline TrippleBuffer<T>::TrippleBuffer()
-{
-	buffer1p = &buffer1;
-	buffer2p = &buffer2;
-	buffer3p = &buffer3;
-}
-
-template <class T>
-inline T & TrippleBuffer<T>::getFirst()
+#ifndef _ALLOCATIONCOUNTER_H
+#define _ALLOCATIONCOUNTER_H
+
+/// Counts the heap allocations made through the global operator new by the calling thread.
+/// The counting operator new and new[] replace the default ones in allocationcounter.cpp,
+/// in debug and profiling builds only, so release builds don't pay for the counting.
+/// Take the difference of two counts to get the allocations made in between:
+/// unsigned int start = AllocationCounter::Get();
+/// ...
+/// unsigned int allocations = AllocationCounter::Get() - start;
+namespace AllocationCounter
 {
-	return *buffer1p;
-}
-
-template <class T>
-inline T & TrippleBuffer<T>::getSecond()
-{
-	return *buffer2p;
-}
-
-template <class T>
-inline T & TrippleBuffer<T>::getLast()
-{
-	return *buffer3p;
-}
-
-template <class T>
-inline void TrippleBuffer<T>::swapFirst()
-{
-	std::swap(buffer1p, buffer2p);
-	assert(buffer1p != buffer2p);
-	assert(buffer2p != buffer3p);
-	assert(buffer3p != buffer1p);
+	/// allocations are counted in this build
+	bool Enabled();
 
+	/// number of allocations of the calling thread since it started, wraps around
+	/// always 0 if the counter isn't enabled
+	unsigned int Get();
 }
 
-template <class T>
-inline void TrippleBuffer<T>::swapLast()
-{
-	std::swap(buffer2p, buffer3p);
-	assert(buffer1p != buffer2p);
-	assert(buffer2p != buffer3p);
-	assert(buffer3p != buffer1p);
-}
-
-#endif
+#endif // _ALLOCATIONCOUNTER_H
@@ -0,0 +1,577 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "archive.h"
+#include "endian_utility.h"
+#include "lz4.h"
+
+#include <SDL2/SDL.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// file layout, all values are 32 bit little endian
+// header: magic, file count, name table size
+// entries: name offset, name length, data offset, size, packed size (0 if stored)
+// name table, then the file data
+static const char archive_magic[] = "VDA01.00";
+static const unsigned int archive_magic_size = 8;
+static const unsigned int archive_header_size = archive_magic_size + 4 + 4;
+static const unsigned int archive_align = 16;
+
+struct Archive::Entry
+{
+	uint32_t name_offset;
+	uint32_t name_length;
+	uint32_t offset;
+	uint32_t size;
+	uint32_t packed_size;
+};
+
+static uint32_t ReadU32(const char * p)
+{
+	uint32_t value;
+	std::memcpy(&value, p, 4);
+	return ENDIAN_SWAP_32(value);
+}
+
+static void WriteU32(std::ostream & out, uint32_t value)
+{
+	value = ENDIAN_SWAP_32(value);
+	out.write((const char *)&value, 4);
+}
+
+// memory stream owning its buffer
+static int SDLCALL CloseOwnedMem(SDL_RWops * rw)
+{
+	if (rw)
+	{
+		std::free(rw->hidden.mem.base);
+		SDL_FreeRW(rw);
+	}
+	return 0;
+}
+
+Archive::Archive() :
+	data(0),
+	size(0),
+	entries(0),
+	names(0),
+	count(0),
+	mapping(0)
+{
+	// ctor
+}
+
+Archive::~Archive()
+{
+	Close();
+}
+
+bool Archive::Load(const std::string & newpath)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(newpath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	const DWORD file_size = GetFileSize(file, NULL);
+	HANDLE map = (file_size != INVALID_FILE_SIZE && file_size > 0) ?
+		CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+	CloseHandle(file);
+	if (!map)
+		return false;
+	const void * view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+	if (!view)
+	{
+		CloseHandle(map);
+		return false;
+	}
+	mapping = map;
+	data = (const char *)view;
+	size = file_size;
+#else
+	const int fd = open(newpath.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat file_stat;
+	void * view = MAP_FAILED;
+	if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+		view = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED)
+		return false;
+	data = (const char *)view;
+	size = file_stat.st_size;
+#endif
+	path = newpath;
+	stamp = ArchiveSet::GetFileStamp(newpath);
+
+	// validate the table of contents once, lookups use it in place
+	if (size < archive_header_size || std::memcmp(data, archive_magic, archive_magic_size) != 0)
+	{
+		Close();
+		return false;
+	}
+
+	const unsigned long num = ReadU32(data + archive_magic_size);
+	const unsigned long names_size = ReadU32(data + archive_magic_size + 4);
+	const unsigned long names_offset = archive_header_size + num * sizeof(Entry);
+	if (num > size / sizeof(Entry) || names_offset + names_size > size)
+	{
+		Close();
+		return false;
+	}
+
+	entries = (const Entry *)(data + archive_header_size);
+	names = data + names_offset;
+	count = num;
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		const unsigned long name_end = (unsigned long)ENDIAN_SWAP_32(entries[i].name_offset) + ENDIAN_SWAP_32(entries[i].name_length);
+		const unsigned long stored = ENDIAN_SWAP_32(entries[i].packed_size) ?
+			ENDIAN_SWAP_32(entries[i].packed_size) : ENDIAN_SWAP_32(entries[i].size);
+		const unsigned long data_end = (unsigned long)ENDIAN_SWAP_32(entries[i].offset) + stored;
+		if (name_end > names_size || data_end > size)
+		{
+			Close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void Archive::Close()
+{
+	if (data)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+		CloseHandle((HANDLE)mapping);
+#else
+		munmap((void *)data, size);
+#endif
+	}
+	path.clear();
+	stamp.clear();
+	data = 0;
+	size = 0;
+	entries = 0;
+	names = 0;
+	count = 0;
+	mapping = 0;
+}
+
+bool Archive::Has(const std::string & name) const
+{
+	return Find(name) != 0;
+}
+
+std::string Archive::GetStamp(const std::string & name) const
+{
+	const Entry * entry = Find(name);
+	if (!entry)
+		return std::string();
+
+	std::ostringstream s;
+	s << stamp << ":" << ENDIAN_SWAP_32(entry->offset) << "-" << ENDIAN_SWAP_32(entry->size) << "-" << ENDIAN_SWAP_32(entry->packed_size);
+	return s.str();
+}
+
+SDL_RWops * Archive::Open(const std::string & name) const
+{
+	const Entry * entry = Find(name);
+	if (!entry)
+		return 0;
+
+	const char * file = data + ENDIAN_SWAP_32(entry->offset);
+	const unsigned int file_size = ENDIAN_SWAP_32(entry->size);
+	const unsigned int packed_size = ENDIAN_SWAP_32(entry->packed_size);
+	if (!packed_size)
+		return SDL_RWFromConstMem(file, file_size);
+
+	unsigned char * buffer = (unsigned char *)std::malloc(std::max(file_size, 1u));
+	SDL_RWops * rw = 0;
+	if (Lz4Decompress((const unsigned char *)file, packed_size, buffer, file_size))
+		rw = SDL_RWFromConstMem(buffer, file_size);
+	if (!rw)
+	{
+		std::free(buffer);
+		return 0;
+	}
+	rw->close = CloseOwnedMem;
+	return rw;
+}
+
+const Archive::Entry * Archive::Find(const std::string & name) const
+{
+	// binary search, entries are sorted by name
+	unsigned int first = 0;
+	unsigned int last = count;
+	while (first < last)
+	{
+		const unsigned int mid = first + (last - first) / 2;
+		const Entry & entry = entries[mid];
+		const int order = name.compare(0, name.length(),
+			names + ENDIAN_SWAP_32(entry.name_offset),
+			ENDIAN_SWAP_32(entry.name_length));
+		if (order == 0)
+			return &entry;
+		if (order < 0)
+			last = mid;
+		else
+			first = mid + 1;
+	}
+	return 0;
+}
+
+bool Archive::Pack(
+	const std::string & dir,
+	const std::vector<std::string> & files,
+	const std::string & path,
+	bool compress,
+	std::ostream & error)
+{
+	std::vector<std::string> sorted(files);
+	std::sort(sorted.begin(), sorted.end());
+	sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+	std::ofstream out(path.c_str(), std::ios::binary);
+	if (!out)
+	{
+		error << "Couldn't create archive " << path << std::endl;
+		return false;
+	}
+
+	std::vector<Entry> toc(sorted.size());
+	std::string name_table;
+	for (unsigned int i = 0; i < sorted.size(); ++i)
+	{
+		toc[i].name_offset = name_table.length();
+		toc[i].name_length = sorted[i].length();
+		name_table += sorted[i];
+	}
+
+	// leave room for the table of contents, it is written last
+	unsigned long offset = archive_header_size + toc.size() * sizeof(Entry) + name_table.length();
+	out << std::string(offset, '\0');
+
+	std::vector<unsigned char> packed;
+	for (unsigned int i = 0; i < sorted.size(); ++i)
+	{
+		const std::string filepath = dir + "/" + sorted[i];
+		std::ifstream file(filepath.c_str(), std::ios::binary);
+		if (!file)
+		{
+			error << "Couldn't read " << filepath << std::endl;
+			return false;
+		}
+		std::ostringstream file_stream;
+		file_stream << file.rdbuf();
+		const std::string content = file_stream.str();
+
+		const unsigned long padding = (archive_align - offset % archive_align) % archive_align;
+		out << std::string(padding, '\0');
+		offset += padding;
+
+		toc[i].offset = offset;
+		toc[i].size = content.length();
+		toc[i].packed_size = 0;
+
+		const char * stored = content.data();
+		unsigned int stored_size = content.length();
+		if (compress && !content.empty())
+		{
+			packed.resize(Lz4Bound(content.length()));
+			const unsigned int packed_size = Lz4Compress(
+				(const unsigned char *)content.data(), content.length(), &packed[0]);
+			if (packed_size < content.length() - content.length() / 8)
+			{
+				toc[i].packed_size = packed_size;
+				stored = (const char *)&packed[0];
+				stored_size = packed_size;
+			}
+		}
+		out.write(stored, stored_size);
+		offset += stored_size;
+	}
+
+	out.seekp(0);
+	out.write(archive_magic, archive_magic_size);
+	WriteU32(out, toc.size());
+	WriteU32(out, name_table.length());
+	for (unsigned int i = 0; i < toc.size(); ++i)
+	{
+		WriteU32(out, toc[i].name_offset);
+		WriteU32(out, toc[i].name_length);
+		WriteU32(out, toc[i].offset);
+		WriteU32(out, toc[i].size);
+		WriteU32(out, toc[i].packed_size);
+	}
+	out.write(name_table.data(), name_table.length());
+
+	if (!out)
+	{
+		error << "Couldn't write archive " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+ArchiveSet::ArchiveSet() :
+	mutex(SDL_CreateMutex())
+{
+	// ctor
+}
+
+ArchiveSet::~ArchiveSet()
+{
+	for (ArchiveMap::iterator i = archives.begin(); i != archives.end(); ++i)
+	{
+		delete i->second;
+	}
+	SDL_DestroyMutex(mutex);
+}
+
+bool ArchiveSet::Exists(const std::string & path) const
+{
+	std::string name;
+	return Find(path, name) || std::ifstream(path.c_str());
+}
+
+SDL_RWops * ArchiveSet::Open(const std::string & path) const
+{
+	std::string name;
+	const Archive * archive = Find(path, name);
+	if (archive)
+		return archive->Open(name);
+
+	// SDL_RWFromFile sets an error for missing files, check first
+	if (!std::ifstream(path.c_str()))
+		return 0;
+	return SDL_RWFromFile(path.c_str(), "rb");
+}
+
+bool ArchiveSet::Read(const std::string & path, std::string & text) const
+{
+	std::string name;
+	const Archive * archive = Find(path, name);
+	if (!archive)
+	{
+		std::ifstream file(path.c_str(), std::ios::binary);
+		if (!file)
+			return false;
+		std::ostringstream file_stream;
+		file_stream << file.rdbuf();
+		text = file_stream.str();
+		return true;
+	}
+
+	SDL_RWops * rw = archive->Open(name);
+	if (!rw)
+		return false;
+	text.resize(SDL_RWsize(rw));
+	const bool success = text.empty() || SDL_RWread(rw, &text[0], text.size(), 1) == 1;
+	SDL_RWclose(rw);
+	return success;
+}
+
+std::string ArchiveSet::GetStamp(const std::string & path) const
+{
+	std::string name;
+	const Archive * archive = Find(path, name);
+	if (archive)
+		return archive->GetStamp(name);
+
+	return GetFileStamp(path);
+}
+
+std::string ArchiveSet::GetFileStamp(const std::string & path)
+{
+	struct stat file_stat;
+	if (stat(path.c_str(), &file_stat) != 0)
+		return std::string();
+
+	std::ostringstream s;
+	s << (Uint64)file_stat.st_size << "-" << (Sint64)file_stat.st_mtime;
+	return s.str();
+}
+
+const Archive * ArchiveSet::Find(const std::string & path, std::string & name) const
+{
+	// collapse repeated and current directory separators, content paths are joined naively
+	std::string file;
+	file.reserve(path.length());
+	for (unsigned int i = 0; i < path.length(); ++i)
+	{
+		if (path[i] == '/' && !file.empty() && file[file.length() - 1] == '/')
+			continue;
+		if (path[i] == '.' && i + 1 < path.length() && path[i + 1] == '/' &&
+			(file.empty() || file[file.length() - 1] == '/'))
+		{
+			++i;
+			continue;
+		}
+		file += path[i];
+	}
+
+	// innermost archive wins
+	size_t pos = file.rfind('/');
+	while (pos != std::string::npos && pos > 0)
+	{
+		const std::string dir = file.substr(0, pos);
+
+		SDL_LockMutex(mutex);
+		ArchiveMap::iterator i = archives.find(dir);
+		if (i == archives.end())
+		{
+			Archive * archive = new Archive();
+			if (!archive->Load(dir + ".vda"))
+			{
+				delete archive;
+				archive = 0;
+			}
+			i = archives.insert(std::make_pair(dir, archive)).first;
+		}
+		const Archive * archive = i->second;
+		SDL_UnlockMutex(mutex);
+
+		if (archive && archive->Has(file.substr(pos + 1)))
+		{
+			name = file.substr(pos + 1);
+			return archive;
+		}
+		pos = file.rfind('/', pos - 1);
+	}
+	return 0;
+}
+
+#include "unittest.h"
+#include "pathmanager.h"
+
+static std::string ReadAll(SDL_RWops * rw)
+{
+	std::string text;
+	if (rw)
+	{
+		text.resize(SDL_RWsize(rw));
+		if (!text.empty())
+			SDL_RWread(rw, &text[0], text.size(), 1);
+		SDL_RWclose(rw);
+	}
+	return text;
+}
+
+static void WriteFile(const std::string & path, const std::string & text)
+{
+	std::ofstream file(path.c_str(), std::ios::binary);
+	file << text;
+}
+
+QT_TEST(archive_test)
+{
+	// a repetitive file that compresses well, a random one that doesn't and an empty one
+	std::string repeated;
+	for (int i = 0; i < 1000; ++i)
+		repeated += "track object ";
+	std::string random(1000, ' ');
+	unsigned int seed = 1;
+	for (unsigned int i = 0; i < random.size(); ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		random[i] = char(seed >> 16);
+	}
+	std::string mixed = random.substr(0, 300) + repeated.substr(0, 700) + random.substr(300, 20);
+
+	// the fixtures go into a directory in the temporary folder
+	std::stringbuf log;
+	std::ostream info(&log), error(&log);
+	PathManager pathmanager;
+	pathmanager.Init(info, error);
+	const std::string dir = pathmanager.GetTemporaryFolder() + "/archive_test";
+	PathManager::MakeDir(dir);
+
+	std::vector<std::string> files;
+	files.push_back("archive_test_repeated.txt");
+	files.push_back("archive_test_random.bin");
+	files.push_back("archive_test_mixed.bin");
+	files.push_back("archive_test_empty.txt");
+	WriteFile(dir + "/" + files[0], repeated);
+	WriteFile(dir + "/" + files[1], random);
+	WriteFile(dir + "/" + files[2], mixed);
+	WriteFile(dir + "/" + files[3], "");
+
+	QT_CHECK(Archive::Pack(dir, files, dir + ".vda", true, error));
+
+	for (unsigned int i = 0; i < files.size(); ++i)
+	{
+		PathManager::RemoveFile(dir + "/" + files[i]);
+	}
+	PathManager::RemoveDir(dir);
+
+	{
+		Archive archive;
+		QT_CHECK(archive.Load(dir + ".vda"));
+		QT_CHECK(archive.Has("archive_test_random.bin"));
+		QT_CHECK(!archive.Has("archive_test_missing.txt"));
+		QT_CHECK(!archive.Open("archive_test_missing.txt"));
+		QT_CHECK(ReadAll(archive.Open("archive_test_repeated.txt")) == repeated);
+		QT_CHECK(ReadAll(archive.Open("archive_test_random.bin")) == random);
+		QT_CHECK(ReadAll(archive.Open("archive_test_mixed.bin")) == mixed);
+		QT_CHECK(ReadAll(archive.Open("archive_test_empty.txt")).empty());
+	}
+
+	{
+		// the archive stands in for the removed directory
+		ArchiveSet archives;
+		std::string text;
+		QT_CHECK(archives.Exists(dir + "/archive_test_mixed.bin"));
+		QT_CHECK(archives.Exists(dir + "//./archive_test_mixed.bin"));
+		QT_CHECK(!archives.Exists(dir + "/archive_test_missing.txt"));
+		QT_CHECK(archives.Read(dir + "/archive_test_repeated.txt", text));
+		QT_CHECK(text == repeated);
+
+		// entries are told apart by their stamps, missing files have none
+		const std::string stamp = archives.GetStamp(dir + "/archive_test_mixed.bin");
+		QT_CHECK(!stamp.empty());
+		QT_CHECK(stamp == archives.GetStamp(dir + "//./archive_test_mixed.bin"));
+		QT_CHECK(stamp != archives.GetStamp(dir + "/archive_test_random.bin"));
+		QT_CHECK(archives.GetStamp(dir + "/archive_test_missing.txt").empty());
+		QT_CHECK(archives.GetStamp(dir + ".vda") == ArchiveSet::GetFileStamp(dir + ".vda"));
+	}
+
+	PathManager::RemoveFile(dir + ".vda");
+}
@@ -0,0 +1,127 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _ARCHIVE_H
+#define _ARCHIVE_H
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+struct SDL_RWops;
+struct SDL_mutex;
+
+/// Read only, memory mapped file archive.
+/// The table of contents is sorted by name and used in place, files are
+/// stored 16 byte aligned, either as they are or lz4 block compressed.
+class Archive
+{
+public:
+	Archive();
+
+	~Archive();
+
+	const std::string & GetPath() const {return path;}
+
+	bool Load(const std::string & path);
+
+	void Close();
+
+	/// name is relative to the archive root, with '/' separators
+	bool Has(const std::string & name) const;
+
+	/// identifies the contents of a file in the archive without reading it,
+	/// from the archive's file stamp and the entry's position and sizes
+	/// return an empty string if the file isn't in the archive
+	std::string GetStamp(const std::string & name) const;
+
+	/// return null if the file isn't in the archive
+	/// stored files are read in place from the mapping, compressed files are unpacked into memory
+	/// the archive has to outlive the returned handle, close it with SDL_RWclose
+	SDL_RWops * Open(const std::string & name) const;
+
+	/// write the files (relative to dir) into a new archive at path
+	/// files that don't shrink by at least an eighth are stored uncompressed
+	static bool Pack(
+		const std::string & dir,
+		const std::vector<std::string> & files,
+		const std::string & path,
+		bool compress,
+		std::ostream & error);
+
+private:
+	struct Entry;
+
+	std::string path;
+	std::string stamp;
+	const char * data;
+	unsigned long size;
+	const Entry * entries;
+	const char * names;
+	unsigned int count;
+	void * mapping;
+
+	const Entry * Find(const std::string & name) const;
+
+	// no copies, the archive owns the mapping
+	Archive(const Archive & other);
+	Archive & operator=(const Archive & other);
+};
+
+/// Archives standing in for directories, "dir.vda" holds the files of "dir".
+/// Archives are found on first access and stay mapped until destruction.
+/// Files in an archive take precedence over files on disk.
+/// All methods are thread safe.
+class ArchiveSet
+{
+public:
+	ArchiveSet();
+
+	~ArchiveSet();
+
+	/// file is in an archive or on disk
+	bool Exists(const std::string & path) const;
+
+	/// open file from an archive or from disk, return null if it doesn't exist
+	SDL_RWops * Open(const std::string & path) const;
+
+	/// read the whole file from an archive or from disk
+	bool Read(const std::string & path, std::string & text) const;
+
+	/// identifies the contents of a file in an archive or on disk without reading it,
+	/// the stamp changes when the file does, return an empty string if it doesn't exist
+	std::string GetStamp(const std::string & path) const;
+
+	/// size and modification time of a file on disk, empty if it doesn't exist
+	static std::string GetFileStamp(const std::string & path);
+
+private:
+	typedef std::map<std::string, Archive *> ArchiveMap;
+	mutable ArchiveMap archives;
+	SDL_mutex * mutex;
+
+	// archive containing the file and the file name relative to it
+	const Archive * Find(const std::string & path, std::string & name) const;
+
+	ArchiveSet(const ArchiveSet & other);
+	ArchiveSet & operator=(const ArchiveSet & other);
+};
+
+#endif // _ARCHIVE_H
@@ -0,0 +1,385 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "batchsimulation.h"
+#include "performance_testing.h"
+#include "parallel_task.h"
+#include "pathmanager.h"
+#include "quickprof.h"
+#include "track.h"
+#include "car.h"
+#include "ai/ai.h"
+#include "physics/dynamicsworld.h"
+#include "content/contentmanager.h"
+#include "cfg/ptree.h"
+#include "LinearMath/btQuickprof.h"
+
+#include <SDL2/SDL_mutex.h>
+
+#include <algorithm>
+#include <list>
+#include <sstream>
+#include <iostream>
+
+// bullet's built-in profiler keeps a global call tree which isn't thread safe, profile
+// zones are bypassed while the worlds are stepped concurrently, older versions fall back
+// to a single thread unless bullet has been built with BT_NO_PROFILE
+#if !defined(BT_NO_PROFILE) && (BT_BULLET_VERSION >= 285)
+#define BATCH_PROFILE_HOOKS
+static void EnterProfileZone(const char *) {}
+static void LeaveProfileZone() {}
+#endif
+
+/// dynamics world with its own broadphase, dispatcher and solver
+struct SimulationWorld
+{
+	btDefaultCollisionConfiguration config;
+	btCollisionDispatcher dispatcher;
+	btDbvtBroadphase broadphase;
+	btSequentialImpulseConstraintSolver solver;
+	DynamicsWorld world;
+
+	SimulationWorld(btScalar timestep) :
+		dispatcher(&config),
+		world(&dispatcher, &broadphase, &solver, &config, timestep)
+	{
+		world.setContactAddedCallback(&CarDynamics::WheelContactCallback);
+	}
+};
+
+struct BatchResult
+{
+	PerformanceResults perf;
+	float lap_time;
+	bool tested;
+
+	BatchResult() : lap_time(-1), tested(false) {}
+};
+
+/// state shared by the workers, only next is modified concurrently
+struct BatchState
+{
+	const std::vector<std::string> * cars;
+	const PathManager * pathmanager;
+	ContentManager * content;
+	SDL_mutex * content_lock;
+	std::string trackname;
+	std::vector<BatchResult> results;
+	SDL_atomic_t next;
+};
+
+static const double timestep = 1 / 90.0;
+
+static void GetCarPath(
+	const PathManager & pathmanager,
+	const std::string & name,
+	std::string & cardir,
+	std::string & carname)
+{
+	const size_t n = name.find("/");
+	if (n == std::string::npos)
+	{
+		cardir = pathmanager.GetCarsDir() + "/" + name;
+		carname = name;
+	}
+	else
+	{
+		cardir = pathmanager.GetCarsDir() + "/" + name.substr(0, n);
+		carname = name.substr(n + 1);
+	}
+}
+
+static bool LoadTrack(
+	BatchState & state,
+	Track & track,
+	DynamicsWorld & world,
+	std::ostream & info_output,
+	std::ostream & error_output)
+{
+	SDL_LockMutex(state.content_lock);
+	const PathManager & pathmanager = *state.pathmanager;
+	bool success = track.DeferredLoad(
+		*state.content, world,
+		info_output, error_output,
+		pathmanager.GetTracksPath(state.trackname),
+		pathmanager.GetTracksDir() + "/" + state.trackname,
+		pathmanager.GetEffectsTextureDir(),
+		pathmanager.GetTrackPartsPath(),
+		0, false, false, false);
+	while (success && !track.Loaded())
+	{
+		success = track.ContinueDeferredLoad();
+	}
+	SDL_UnlockMutex(state.content_lock);
+
+	if (!success)
+	{
+		error_output << "Error loading track: " << state.trackname << std::endl;
+		return false;
+	}
+	if (!track.GetSectors())
+	{
+		error_output << "Track has no sectors, skipping lap tests: " << state.trackname << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// drive one timed lap with the standard ai, sector tracking follows Game::UpdateTimer
+// the clock starts when the car crosses the start line, returns -1 if no lap was completed
+static float TestLap(
+	BatchState & state,
+	Track & track,
+	DynamicsWorld & world,
+	const std::string & cardir,
+	const std::string & carname,
+	PerformanceResults & results,
+	std::ostream & error_output)
+{
+	std::list<Car> cars;
+	cars.push_back(Car());
+	Car & car = cars.back();
+
+	SDL_LockMutex(state.content_lock);
+	std::tr1::shared_ptr<PTree> cfg;
+	state.content->load(cfg, cardir, carname + ".car");
+	bool loaded = cfg->size() && car.LoadPhysics(
+		error_output, *state.content, world, *cfg, cardir, "",
+		track.GetStart(0).first, track.GetStart(0).second,
+		true, true, false);
+	SDL_UnlockMutex(state.content_lock);
+	if (!loaded)
+	{
+		error_output << "Failed to load physics for car " << carname << std::endl;
+		return -1;
+	}
+
+	Ai ai;
+	ai.add_car(&car, 1.0);
+
+	quickprof::Clock clock;
+	clock.reset();
+
+	const double maxtime = 600.0;
+	const int sectors = track.GetSectors();
+	double lapstart = -1;
+	double laptime = -1;
+	double t = 0;
+	while (t < maxtime && laptime < 0)
+	{
+		ai.update(timestep, cars);
+		car.Update(ai.GetInputs(&car));
+		world.update(timestep);
+		results.steps++;
+		results.sim_time += timestep;
+		t += timestep;
+
+		const int nextsector = (car.GetSector() + 1) % sectors;
+		for (int p = 0; p < 4; ++p)
+		{
+			if (car.GetCurPatch(WheelPosition(p)) == track.GetSectorPatch(nextsector))
+			{
+				if (nextsector == 0)
+				{
+					if (lapstart >= 0)
+						laptime = t - lapstart;
+					lapstart = t;
+				}
+				car.SetSector(nextsector);
+				break;
+			}
+		}
+	}
+
+	results.wall_time += clock.getTimeMicroseconds() * 1E-6;
+
+	if (laptime < 0)
+		error_output << carname << " didn't complete a lap in " << maxtime << " s" << std::endl;
+
+	return laptime;
+}
+
+/// a worker runs its cars one after the other, pulling them from the shared list
+class BatchJob : public Parallel::Job
+{
+public:
+	BatchState * state;
+	std::string info_log;
+	std::string error_log;
+
+	BatchJob() : state(0) {}
+
+	void Execute()
+	{
+		// logs are merged once all workers are done
+		std::ostringstream info_output;
+		std::ostringstream error_output;
+
+		// the track world is reused for all cars of this worker
+		SimulationWorld trackworld(timestep);
+		Track track;
+		bool lap = !state->trackname.empty() &&
+			LoadTrack(*state, track, trackworld.world, info_output, error_output);
+
+		const int count = state->cars->size();
+		int i;
+		while ((i = SDL_AtomicAdd(&state->next, 1)) < count)
+		{
+			std::string cardir, carname;
+			GetCarPath(*state->pathmanager, (*state->cars)[i], cardir, carname);
+
+			BatchResult & result = state->results[i];
+			{
+				SimulationWorld world(timestep);
+				PerformanceTesting perftest(world.world);
+
+				SDL_LockMutex(state->content_lock);
+				bool loaded = perftest.Load(cardir, carname, *state->content, info_output, error_output);
+				SDL_UnlockMutex(state->content_lock);
+				if (!loaded)
+				{
+					error_output << "Failed to load car: " << (*state->cars)[i] << std::endl;
+					continue;
+				}
+
+				perftest.Run(info_output, error_output);
+				result.perf = perftest.GetResults();
+				result.tested = true;
+			}
+
+			if (lap)
+			{
+				result.lap_time = TestLap(
+					*state, track, trackworld.world,
+					cardir, carname, result.perf, error_output);
+			}
+		}
+
+		info_log = info_output.str();
+		error_log = error_output.str();
+	}
+};
+
+static void WriteResults(const BatchState & state, std::ostream & out)
+{
+	out << "car,status,mass_kg,max_speed_mps,max_speed_time_s,downforce_n,lift_drag," <<
+		"time_0_60_s,quarter_mile_s,quarter_mile_speed_mps,stop_60_0_m,stop_60_0_abs_m," <<
+		"lap_time_s,steps,sim_time_s,wall_time_s,steps_per_s\n";
+	for (unsigned i = 0; i < state.results.size(); ++i)
+	{
+		const BatchResult & r = state.results[i];
+		const PerformanceResults & p = r.perf;
+		out << (*state.cars)[i] << "," << (r.tested ? "ok" : "failed") << "," <<
+			p.mass << "," << p.max_speed << "," << p.max_speed_time << "," <<
+			p.downforce << "," << p.lift_drag << "," << p.time_0_60 << "," <<
+			p.quarter_mile_time << "," << p.quarter_mile_speed << "," <<
+			p.stopping_distance << "," << p.stopping_distance_abs << "," <<
+			r.lap_time << "," << p.steps << "," << p.sim_time << "," << p.wall_time << "," <<
+			(p.wall_time > 0 ? p.steps / p.wall_time : 0) << "\n";
+	}
+	out << std::flush;
+}
+
+bool BatchSimulation(
+	const std::vector<std::string> & cars,
+	const std::string & trackname,
+	unsigned int num_threads,
+	const PathManager & pathmanager,
+	ContentManager & content,
+	std::ostream & results_output,
+	std::ostream & info_output,
+	std::ostream & error_output)
+{
+	if (cars.empty())
+	{
+		error_output << "No cars given for batch simulation" << std::endl;
+		return false;
+	}
+
+	if (num_threads < 1)
+		num_threads = 1;
+
+#ifdef BATCH_PROFILE_HOOKS
+	btEnterProfileZoneFunc * enter_profile = btGetCurrentEnterProfileZoneFunc();
+	btLeaveProfileZoneFunc * leave_profile = btGetCurrentLeaveProfileZoneFunc();
+	btSetCustomEnterProfileZoneFunc(&EnterProfileZone);
+	btSetCustomLeaveProfileZoneFunc(&LeaveProfileZone);
+#elif !defined(BT_NO_PROFILE)
+	if (num_threads > 1)
+	{
+		info_output << "Bullet profiling is enabled, running batch simulation on a single thread" << std::endl;
+		num_threads = 1;
+	}
+#endif
+
+	BatchState state;
+	state.cars = &cars;
+	state.pathmanager = &pathmanager;
+	state.content = &content;
+	state.content_lock = SDL_CreateMutex();
+	state.trackname = trackname;
+	state.results.resize(cars.size());
+	SDL_AtomicSet(&state.next, 0);
+
+	info_output << "Batch simulation of " << cars.size() << " cars on " << num_threads << " threads" << std::endl;
+
+	quickprof::Clock clock;
+	clock.reset();
+
+	// one job per worker, the calling thread is a worker too
+	std::vector<BatchJob> jobs(std::min<size_t>(num_threads, cars.size()));
+	Parallel::JobSystem system;
+	system.Init(jobs.size() > 0 ? jobs.size() - 1 : 0);
+	for (unsigned i = 0; i < jobs.size(); ++i)
+	{
+		jobs[i].state = &state;
+		system.Submit(jobs[i]);
+	}
+	system.Wait();
+	system.Deinit();
+
+	const double wall_time = clock.getTimeMicroseconds() * 1E-6;
+
+	SDL_DestroyMutex(state.content_lock);
+
+#ifdef BATCH_PROFILE_HOOKS
+	btSetCustomEnterProfileZoneFunc(enter_profile);
+	btSetCustomLeaveProfileZoneFunc(leave_profile);
+#endif
+
+	for (unsigned i = 0; i < jobs.size(); ++i)
+	{
+		info_output << jobs[i].info_log;
+		error_output << jobs[i].error_log;
+	}
+
+	WriteResults(state, results_output);
+
+	unsigned int tested = 0;
+	double steps = 0;
+	for (unsigned i = 0; i < state.results.size(); ++i)
+	{
+		tested += state.results[i].tested;
+		steps += state.results[i].perf.steps;
+	}
+	info_output << "Batch simulation complete: " << tested << "/" << cars.size() << " cars in " <<
+		wall_time << " s, " << steps / wall_time << " steps/s" << std::endl;
+
+	return tested > 0;
+}
@@ -0,0 +1,47 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _BATCHSIMULATION_H
+#define _BATCHSIMULATION_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+class PathManager;
+class ContentManager;
+
+/// Headless car testing for tuning sweeps and regression runs, no window, gl or audio required.
+/// Every car runs the acceleration and braking tests of PerformanceTesting and, if a track is
+/// given, a timed AI lap. Cars are named like in the car selection (CarDir/Variant or CarDir).
+/// They are distributed over num_threads workers, each simulating its own dynamics worlds.
+/// Content has to be initialized headless, loading is serialized, simulation runs in parallel.
+/// Results are written to results_output as CSV, one line per car in the given order.
+/// Returns false if none of the cars could be tested.
+bool BatchSimulation(
+	const std::vector<std::string> & cars,
+	const std::string & trackname,
+	unsigned int num_threads,
+	const PathManager & pathmanager,
+	ContentManager & content,
+	std::ostream & results_output,
+	std::ostream & info_output,
+	std::ostream & error_output);
+
+#endif // _BATCHSIMULATION_H
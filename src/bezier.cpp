@@ -20,7 +20,29 @@
 #include "bezier.h"
 #include "unittest.h"
 
+#include <algorithm>
 #include <cmath>
+#include <sstream>
+
+/// bernstein basis weights of the four points at the normalized coordinate u
+static inline void BernsteinWeights(float u, float w[4])
+{
+	float oneminusu(1.0f-u);
+	w[0] = u*u*u;
+	w[1] = 3*u*u*oneminusu;
+	w[2] = 3*u*oneminusu*oneminusu;
+	w[3] = oneminusu*oneminusu*oneminusu;
+}
+
+/// sum of the four points weighted by the bernstein weights w
+static inline Vec3 BernsteinSum(const float w[4], const Vec3 p[])
+{
+	Vec3 a = p[0]*w[0];
+	Vec3 b = p[1]*w[1];
+	Vec3 c = p[2]*w[2];
+	Vec3 d = p[3]*w[3];
+	return a+b+c+d;
+}
 
 std::ostream & operator << (std::ostream &os, const Bezier & b)
 {
@@ -398,12 +420,9 @@ void Bezier::Reverse()
 
 Vec3 Bezier::Bernstein(float u, const Vec3 p[]) const
 {
-	float oneminusu(1.0f-u);
-	Vec3 a = p[0]*(u*u*u);
-	Vec3 b = p[1]*(3*u*u*oneminusu);
-	Vec3 c = p[2]*(3*u*oneminusu*oneminusu);
-	Vec3 d = p[3]*(oneminusu*oneminusu*oneminusu);
-	return a+b+c+d;
+	float w[4];
+	BernsteinWeights(u, w);
+	return BernsteinSum(w, p);
 }
 
 Vec3 Bezier::BernsteinTangent(float u, const Vec3 p[]) const
@@ -428,32 +447,41 @@ Vec3 Bezier::SurfCoord(float px, float py) const
 }
 
 Vec3 Bezier::SurfNorm(float px, float py) const
+{
+	Vec3 coord, norm;
+	SurfCoordNorm(px, py, coord, norm);
+	return norm;
+}
+
+void Bezier::SurfCoordNorm(float px, float py, Vec3 & coord, Vec3 & norm) const
 {
 	Vec3 tempy[4];
 	Vec3 tempx[4];
 	Vec3 temp2[4];
 
 	//get splines along x axis
+	float w[4];
+	BernsteinWeights(px, w);
 	for (int j = 0; j < 4; ++j)
 	{
-		tempy[j] = Bernstein(px, points[j]);
+		tempy[j] = BernsteinSum(w, points[j]);
 	}
+	coord = Bernstein(py, tempy);
 
 	//get splines along y axis
+	BernsteinWeights(py, w);
 	for (int j = 0; j < 4; ++j)
 	{
 		for (int i = 0; i < 4; ++i)
 		{
 			temp2[i] = points[i][j];
 		}
-		tempx[j] = Bernstein(py, temp2);
+		tempx[j] = BernsteinSum(w, temp2);
 	}
 
 	Vec3 tx = BernsteinTangent(px, tempx);
 	Vec3 ty = BernsteinTangent(py, tempy);
-	Vec3 n = -tx.cross(ty).Normalize();
-
-	return n;
+	norm = -tx.cross(ty).Normalize();
 }
 
 Bezier & Bezier::CopyFrom(const Bezier &other)
@@ -533,6 +561,91 @@ bool Bezier::CollideSubDivQuadSimple(const Vec3 & origin, const Vec3 & direction
 }
 
 bool Bezier::CollideSubDivQuadSimpleNorm(const Vec3 & origin, const Vec3 & direction, Vec3 &outtri, Vec3 & normal) const
+{
+	return CollideSubDivQuad(origin, direction, NULL, outtri, normal);
+}
+
+bool Bezier::CollideSubDivQuadSimpleNorm(const Vec3 & origin, const Vec3 & direction, const Grid & grid, Vec3 &outtri, Vec3 & normal) const
+{
+	return CollideSubDivQuad(origin, direction, &grid, outtri, normal);
+}
+
+void Bezier::Tessellate(Grid & grid) const
+{
+	// same evaluation as the subdivision quad corners
+	const float scale = 1.0f / Grid::divs;
+	float wu[Grid::divs + 1][4], wv[4];
+	for (int a = 0; a <= Grid::divs; ++a)
+	{
+		BernsteinWeights(a * scale, wu[a]);
+	}
+	for (int a = 0; a <= Grid::divs; ++a)
+	{
+		Vec3 temp[4];
+		for (int j = 0; j < 4; ++j)
+		{
+			temp[j] = BernsteinSum(wu[a], points[j]);
+		}
+		for (int b = 0; b <= Grid::divs; ++b)
+		{
+			BernsteinWeights(b * scale, wv);
+			grid.points[a][b] = BernsteinSum(wv, temp);
+		}
+	}
+}
+
+bool Bezier::CollideGrid(
+	const Vec3 & origin,
+	const Vec3 & direction,
+	const Grid & grid,
+	float & su, float & sv,
+	float & umin, float & umax,
+	float & vmin, float & vmax) const
+{
+	const int ca = std::min(std::max(int(su * Grid::divs), 0), Grid::divs - 1);
+	const int cb = std::min(std::max(int(sv * Grid::divs), 0), Grid::divs - 1);
+
+	// the sub-quad around the coordinates is hit most of the time, the neighbors cover the rest
+	float tmin = 0;
+	int hita = -1, hitb = -1;
+	float hitu = 0, hitv = 0;
+	for (int n = 0; n < 9; ++n)
+	{
+		const int a = ca + (n == 0 ? 0 : (n - 1) % 3 - 1);
+		const int b = cb + (n == 0 ? 0 : (n - 1) / 3 - 1);
+		if (a < 0 || a >= Grid::divs || b < 0 || b >= Grid::divs || (n != 0 && a == ca && b == cb))
+			continue;
+
+		float t, u, v;
+		if (IntersectQuadrilateralF(origin, direction,
+			grid.points[a][b], grid.points[a + 1][b],
+			grid.points[a + 1][b + 1], grid.points[a][b + 1],
+			t, u, v) && (hita < 0 || t < tmin))
+		{
+			tmin = t;
+			hita = a;
+			hitb = b;
+			hitu = u;
+			hitv = v;
+		}
+
+		if (n == 0 && hita >= 0)
+			break;
+	}
+	if (hita < 0)
+		return false;
+
+	const float scale = 1.0f / Grid::divs;
+	umin = hita * scale;
+	umax = (hita + 1) * scale;
+	vmin = hitb * scale;
+	vmax = (hitb + 1) * scale;
+	su = hitu * scale + umin;
+	sv = hitv * scale + vmin;
+	return true;
+}
+
+bool Bezier::CollideSubDivQuad(const Vec3 & origin, const Vec3 & direction, const Grid * grid, Vec3 &outtri, Vec3 & normal) const
 {
 	bool col = false;
 	const int COLLISION_QUAD_DIVS = 6;
@@ -558,28 +671,41 @@ bool Bezier::CollideSubDivQuadSimpleNorm(const Vec3 & origin, const Vec3 & direc
 		float tu[2];
 		float tv[2];
 
-		//speedup for i == 0
-		//if (i != 0)
+		tu[0] = umin;
+		if (tu[0] < 0)
+			tu[0] = 0;
+		tu[1] = umax;
+		if (tu[1] > 1)
+			tu[1] = 1;
+
+		tv[0] = vmin;
+		if (tv[0] < 0)
+			tv[0] = 0;
+		tv[1] = vmax;
+		if (tv[1] > 1)
+			tv[1] = 1;
+
+		// the first quad is spanned by the corner points, which the surface passes through
+		if (i != 0)
 		{
-			tu[0] = umin;
-			if (tu[0] < 0)
-				tu[0] = 0;
-			tu[1] = umax;
-			if (tu[1] > 1)
-				tu[1] = 1;
-
-			tv[0] = vmin;
-			if (tv[0] < 0)
-				tv[0] = 0;
-			tv[1] = vmax;
-
-			if (tv[1] > 1)
-				tv[1] = 1;
-
-			ul = SurfCoord(tu[0], tv[0]);
-			ur = SurfCoord(tu[1], tv[0]);
-			br = SurfCoord(tu[1], tv[1]);
-			bl = SurfCoord(tu[0], tv[1]);
+			// the corners share their splines along x, evaluate each of them once
+			float wu0[4], wu1[4], wv0[4], wv1[4];
+			BernsteinWeights(tu[0], wu0);
+			BernsteinWeights(tu[1], wu1);
+			BernsteinWeights(tv[0], wv0);
+			BernsteinWeights(tv[1], wv1);
+
+			Vec3 temp0[4], temp1[4];
+			for (int j = 0; j < 4; ++j)
+			{
+				temp0[j] = BernsteinSum(wu0, points[j]);
+				temp1[j] = BernsteinSum(wu1, points[j]);
+			}
+
+			ul = BernsteinSum(wv0, temp0);
+			ur = BernsteinSum(wv0, temp1);
+			br = BernsteinSum(wv1, temp1);
+			bl = BernsteinSum(wv1, temp0);
 		}
 
 		col = IntersectQuadrilateralF(origin, direction, ul, ur, br, bl, t, u, v);
@@ -593,6 +719,10 @@ bool Bezier::CollideSubDivQuadSimpleNorm(const Vec3 & origin, const Vec3 & direc
 			su = u * (tu[1] - tu[0]) + tu[0];
 			sv = v * (tv[1] - tv[0]) + tv[0];
 
+			// a grid sub-quad is as large as the quad of the subdivision steps it stands in for
+			if (i == 0 && grid && CollideGrid(origin, direction, *grid, su, sv, umin, umax, vmin, vmax))
+				i += Grid::steps;
+
 			//place max and min according to area hit
 			vmax = sv + (0.5*areacut)*(vmax - vmin);
 			vmin = sv - (0.5*areacut)*(vmax - vmin);
@@ -606,8 +736,7 @@ bool Bezier::CollideSubDivQuadSimpleNorm(const Vec3 & origin, const Vec3 & direc
 		}
 	}
 
-	outtri = SurfCoord(su, sv);
-	normal = SurfNorm(su, sv);
+	SurfCoordNorm(su, sv, outtri, normal);
 	return true;
 }
 
@@ -810,3 +939,29 @@ QT_TEST(bezier_test)
 	b.SetFromCorners(Vec3(1,0,1),Vec3(-1,0,1),Vec3(1,0,-1),Vec3(-1,0,-1));
 	QT_CHECK(!b.CheckForProblems());
 }
+
+QT_TEST(bezier_grid_test)
+{
+	// a bumpy patch, rays through its inside have to hit it close to where the plain subdivision does
+	std::stringstream s;
+	for (int x = 0; x < 4; x++)
+	{
+		for (int y = 0; y < 4; y++)
+			s << x * 4 << " " << y * 3 << " " << ((x * 7 + y * 3) % 5) * 0.4f - 0.8f << " ";
+	}
+	Bezier b;
+	b.ReadFrom(s);
+	Bezier::Grid grid;
+	b.Tessellate(grid);
+
+	const Vec3 dir = Vec3(0.05, -0.05, -1).Normalize();
+	for (int i = 0; i < 400; i++)
+	{
+		Vec3 origin(1 + (i % 20) * 0.5f, 1 + (i / 20) * 0.35f, 5);
+		Vec3 p0, n0, p1, n1;
+		QT_CHECK(b.CollideSubDivQuadSimpleNorm(origin, dir, p0, n0));
+		QT_CHECK(b.CollideSubDivQuadSimpleNorm(origin, dir, grid, p1, n1));
+		QT_CHECK((p0 - p1).Magnitude() < 0.005);
+		QT_CHECK((n0 - n1).Magnitude() < 0.001);
+	}
+}
@@ -65,6 +65,20 @@ public:
 	bool CollideSubDivQuadSimple(const Vec3 & origin, const Vec3 & direction, Vec3 &outtri) const;
 	bool CollideSubDivQuadSimpleNorm(const Vec3 & origin, const Vec3 & direction, Vec3 &outtri, Vec3 & normal) const;
 
+	///surface points at uniform normalized coordinates, divs sub-quads along each side
+	struct Grid
+	{
+		static const int steps = 3; ///< subdivision steps a sub-quad stands in for
+		static const int divs = 1 << steps;
+		Vec3 points[divs + 1][divs + 1];
+	};
+
+	///evaluate the surface points of the grid, has to be repeated if the patch changes
+	void Tessellate(Grid & grid) const;
+
+	///same as above, the sub-quads of the grid replace the first subdivision steps
+	bool CollideSubDivQuadSimpleNorm(const Vec3 & origin, const Vec3 & direction, const Grid & grid, Vec3 &outtri, Vec3 & normal) const;
+
 	///read/write IO operations (ascii format)
 	void ReadFrom(std::istream & openfile);
 	void ReadFromYZX(std::istream & openfile);
@@ -110,6 +124,9 @@ public:
 	///return the normal of the bezier surface at the given normalized coordinates px and py
 	Vec3 SurfNorm(float px, float py) const;
 
+	///output the point and normal of the bezier surface at the given normalized coordinates px and py
+	void SurfCoordNorm(float px, float py, Vec3 & coord, Vec3 & norm) const;
+
 	Bezier* GetNextPatch() const
 	{
 		return next_patch;
@@ -137,6 +154,19 @@ private:
 	///return the bernstein tangent given the normalized coordinate u (zero to one) and an array of four points p
 	Vec3 BernsteinTangent(float u, const Vec3 p[]) const;
 
+	///subdivision ray test, uses the grid if it isn't NULL
+	bool CollideSubDivQuad(const Vec3 & origin, const Vec3 & direction, const Grid * grid, Vec3 &outtri, Vec3 & normal) const;
+
+	///return true if the ray hits the grid sub-quad around the surface coordinates su, sv or one of its neighbors.
+	/// update su, sv and the coordinate range of the sub-quad that was hit
+	bool CollideGrid(
+		const Vec3 & origin,
+		const Vec3 & direction,
+		const Grid & grid,
+		float & su, float & sv,
+		float & umin, float & umax,
+		float & vmin, float & vmax) const;
+
 	///return true if the ray at orig with direction dir intersects the given quadrilateral.
 	/// also put the collision depth in t and the collision coordinates in u,v
 	bool IntersectQuadrilateralF(
@@ -0,0 +1,342 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "bvhbenchmark.h"
+#include "aabbtree.h"
+#include "aabbbvh.h"
+#include "bezier.h"
+#include "random.h"
+#include "quaternion.h"
+#include "quickprof.h"
+#include "graphics/graphics_camera.h"
+#include "matrix4.h"
+
+#include <fstream>
+#include <vector>
+
+struct BenchmarkQueries
+{
+	std::vector <Aabb <float>::Ray> rays;
+	std::vector <Aabb <float> > boxes;
+	std::vector <Frustum> frustums;
+};
+
+struct BenchmarkResult
+{
+	double build_us;
+	double ray_us;
+	double box_us;
+	double frustum_us;
+	unsigned int memory;
+	unsigned int hits;
+};
+
+template <typename Tree>
+static BenchmarkResult RunBenchmark(
+	const std::vector <Aabb <float> > & objects,
+	const BenchmarkQueries & queries,
+	int repeats)
+{
+	BenchmarkResult result;
+	quickprof::Clock clock;
+	std::vector <unsigned> output;
+	output.reserve(objects.size());
+	result.hits = 0;
+
+	Tree tree;
+	clock.reset();
+	for (int n = 0; n < repeats; ++n)
+	{
+		tree.Clear();
+		for (unsigned i = 0; i < objects.size(); ++i)
+		{
+			tree.Add(i, objects[i]);
+		}
+		tree.Optimize();
+	}
+	result.build_us = double(clock.getTimeMicroseconds()) / repeats;
+	result.memory = tree.GetMemoryUsage();
+
+	clock.reset();
+	for (int n = 0; n < repeats; ++n)
+	{
+		for (unsigned i = 0; i < queries.rays.size(); ++i)
+		{
+			output.clear();
+			tree.Query(queries.rays[i], output);
+			result.hits += output.size();
+		}
+	}
+	result.ray_us = double(clock.getTimeMicroseconds()) / repeats;
+
+	clock.reset();
+	for (int n = 0; n < repeats; ++n)
+	{
+		for (unsigned i = 0; i < queries.boxes.size(); ++i)
+		{
+			output.clear();
+			tree.Query(queries.boxes[i], output);
+			result.hits += output.size();
+		}
+	}
+	result.box_us = double(clock.getTimeMicroseconds()) / repeats;
+
+	clock.reset();
+	for (int n = 0; n < repeats; ++n)
+	{
+		for (unsigned i = 0; i < queries.frustums.size(); ++i)
+		{
+			output.clear();
+			tree.Query(queries.frustums[i], output);
+			result.hits += output.size();
+		}
+	}
+	result.frustum_us = double(clock.getTimeMicroseconds()) / repeats;
+
+	return result;
+}
+
+static void PrintResult(
+	const std::string & name,
+	const BenchmarkResult & result,
+	const BenchmarkQueries & queries,
+	std::ostream & out)
+{
+	out << name << ":\n";
+	out << "  build: " << result.build_us << " us\n";
+	out << "  memory: " << result.memory << " bytes\n";
+	out << "  rays: " << queries.rays.size() / (result.ray_us * 1E-6) << " queries/s\n";
+	out << "  boxes: " << queries.boxes.size() / (result.box_us * 1E-6) << " queries/s\n";
+	out << "  frustums: " << queries.frustums.size() / (result.frustum_us * 1E-6) << " queries/s\n";
+	out << "  total hits: " << result.hits << std::endl;
+}
+
+struct MatrixResult
+{
+	double multiply_us;
+	double transform_us;
+	float checksum;
+};
+
+template <bool generic>
+static MatrixResult RunMatrixBenchmark(
+	const std::vector <Mat4> & views,
+	const std::vector <Mat4> & projections,
+	const std::vector <Bezier> & patches,
+	int repeats)
+{
+	MatrixResult result;
+	quickprof::Clock clock;
+	result.checksum = 0;
+
+	clock.reset();
+	for (int n = 0; n < repeats; ++n)
+	{
+		for (unsigned i = 0; i < views.size(); ++i)
+		{
+			const Mat4 clip = generic ?
+				views[i].MultiplyGeneric(projections[i]) :
+				views[i].Multiply(projections[i]);
+			result.checksum += clip.GetArray()[n % 16];
+		}
+	}
+	result.multiply_us = double(clock.getTimeMicroseconds()) / repeats;
+
+	clock.reset();
+	for (int n = 0; n < repeats; ++n)
+	{
+		for (unsigned i = 0; i < views.size(); ++i)
+		{
+			for (int x = 0; x < 4; ++x)
+			{
+				for (int y = 0; y < 4; ++y)
+				{
+					const Vec3 & point = patches[i].GetPoint(x, y);
+					float v[4] = {point[0], point[1], point[2], 1};
+					if (generic)
+						views[i].MultiplyVector4Generic(v);
+					else
+						views[i].MultiplyVector4(v);
+					result.checksum += v[2];
+				}
+			}
+		}
+	}
+	result.transform_us = double(clock.getTimeMicroseconds()) / repeats;
+
+	return result;
+}
+
+static void PrintResult(
+	const std::string & name,
+	const MatrixResult & result,
+	unsigned int count,
+	std::ostream & out)
+{
+	out << name << ":\n";
+	out << "  multiplies: " << count / (result.multiply_us * 1E-6) << " /s\n";
+	out << "  vector transforms: " << count * 16 / (result.transform_us * 1E-6) << " /s\n";
+	out << "  checksum: " << result.checksum << std::endl;
+}
+
+bool BvhBenchmark(
+	const std::string & trackpath,
+	std::ostream & info_output,
+	std::ostream & error_output)
+{
+	// read the road patch bounds, same file layout as Track::Loader::LoadRoads
+	std::string roadpath = trackpath + "/roads.trk";
+	std::ifstream trackfile(roadpath.c_str());
+	if (!trackfile.good())
+	{
+		error_output << "Error opening roads file: " << roadpath << std::endl;
+		return false;
+	}
+
+	std::vector <Bezier> patches;
+	std::vector <Aabb <float> > objects;
+	int numroads = 0;
+	trackfile >> numroads;
+	for (int i = 0; i < numroads && trackfile; ++i)
+	{
+		int numpatches = 0;
+		trackfile >> numpatches;
+		for (int j = 0; j < numpatches && trackfile; ++j)
+		{
+			Bezier patch;
+			patch.ReadFromYZX(trackfile);
+			patches.push_back(patch);
+			objects.push_back(patch.GetAABB());
+		}
+	}
+	if (objects.empty())
+	{
+		error_output << "No road patches found in " << roadpath << std::endl;
+		return false;
+	}
+
+	// generate deterministic queries: wheel-like rays, car sized boxes and cameras along the road
+	DeterministicRandom random;
+	random.ReSeed(0);
+	BenchmarkQueries queries;
+	const int queries_per_patch = 4;
+	std::vector <Mat4> views, projections;
+	for (unsigned i = 0; i < objects.size(); ++i)
+	{
+		const Vec3 & pos = objects[i].GetPos();
+		const Vec3 & size = objects[i].GetSize();
+		for (int n = 0; n < queries_per_patch; ++n)
+		{
+			Vec3 p(pos[0] + size[0] * random.Get(), pos[1] + size[1] * random.Get(), pos[2] + size[2] + 1);
+			queries.rays.push_back(Aabb <float>::Ray(p, Vec3(0, 0, -1), 4));
+
+			Aabb <float> box;
+			box.SetFromSphere(p, 2.5);
+			queries.boxes.push_back(box);
+		}
+
+		GraphicsCamera cam;
+		cam.pos = objects[i].GetCenter() + Vec3(0, 0, 2);
+		cam.rot.Rotate(random.Get() * 2 * M_PI, 0, 0, 1);
+		cam.view_distance = 500;
+		views.push_back(GetViewMatrix(cam));
+		projections.push_back(GetProjMatrix(cam));
+		Frustum frustum;
+		frustum.Extract(projections.back().GetArray(), views.back().GetArray());
+		queries.frustums.push_back(frustum);
+	}
+
+	const int repeats = 10;
+	info_output << "BVH benchmark on " << objects.size() << " road patches, " << repeats << " repeats" << std::endl;
+
+	BenchmarkResult tree1 = RunBenchmark <AabbTreeNode <unsigned> >(objects, queries, repeats);
+	PrintResult("AabbTreeNode", tree1, queries, info_output);
+
+	BenchmarkResult tree2 = RunBenchmark <AabbBvh <unsigned> >(objects, queries, repeats);
+	PrintResult("AabbBvh", tree2, queries, info_output);
+
+	// the leaf size of the static drawables
+	BenchmarkResult tree3 = RunBenchmark <AabbTreeNode <unsigned, 64> >(objects, queries, repeats);
+	PrintResult("AabbTreeNode, 64 objects per node", tree3, queries, info_output);
+
+	BenchmarkResult tree4 = RunBenchmark <AabbBvh <unsigned, 64> >(objects, queries, repeats);
+	PrintResult("AabbBvh, 64 objects per leaf", tree4, queries, info_output);
+
+	// narrow phase, the wheel rays against the patch they have been generated for
+	quickprof::Clock clock;
+	unsigned int patch_hits = 0;
+	clock.reset();
+	for (int n = 0; n < repeats; ++n)
+	{
+		for (unsigned i = 0; i < queries.rays.size(); ++i)
+		{
+			const Aabb <float>::Ray & ray = queries.rays[i];
+			Vec3 colpoint, colnormal;
+			if (patches[i / queries_per_patch].CollideSubDivQuadSimpleNorm(ray.orig, ray.dir, colpoint, colnormal))
+				patch_hits++;
+		}
+	}
+	const double patch_us = double(clock.getTimeMicroseconds()) / repeats;
+
+	// the same rays with the surface grids the road patches keep
+	std::vector <Bezier::Grid> grids(patches.size());
+	for (unsigned i = 0; i < patches.size(); ++i)
+	{
+		patches[i].Tessellate(grids[i]);
+	}
+	unsigned int grid_hits = 0;
+	clock.reset();
+	for (int n = 0; n < repeats; ++n)
+	{
+		for (unsigned i = 0; i < queries.rays.size(); ++i)
+		{
+			const Aabb <float>::Ray & ray = queries.rays[i];
+			const unsigned int patch = i / queries_per_patch;
+			Vec3 colpoint, colnormal;
+			if (patches[patch].CollideSubDivQuadSimpleNorm(ray.orig, ray.dir, grids[patch], colpoint, colnormal))
+				grid_hits++;
+		}
+	}
+	const double grid_us = double(clock.getTimeMicroseconds()) / repeats;
+
+	info_output << "Bezier:\n";
+	info_output << "  rays: " << queries.rays.size() / (patch_us * 1E-6) << " queries/s\n";
+	info_output << "  total hits: " << patch_hits << "\n";
+	info_output << "  rays with grid: " << queries.rays.size() / (grid_us * 1E-6) << " queries/s\n";
+	info_output << "  total hits with grid: " << grid_hits << std::endl;
+
+	// the matrix math of the frustum setup, combining the camera matrices,
+	// and of moving the patch control points into the view space of their camera,
+	// the generic implementation next to the one Mat4 uses
+	const int matrix_repeats = repeats * 100;
+	MatrixResult generic = RunMatrixBenchmark <true>(views, projections, patches, matrix_repeats);
+	PrintResult("Mat4 generic", generic, views.size(), info_output);
+
+#if defined(MATRIX4_SSE)
+	const char * mat4_name = "Mat4 SSE";
+#elif defined(MATRIX4_NEON)
+	const char * mat4_name = "Mat4 NEON";
+#else
+	const char * mat4_name = "Mat4 (no simd specialization)";
+#endif
+	MatrixResult specialized = RunMatrixBenchmark <false>(views, projections, patches, matrix_repeats);
+	PrintResult(mat4_name, specialized, views.size(), info_output);
+
+	return true;
+}
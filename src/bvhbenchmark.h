@@ -0,0 +1,39 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _BVHBENCHMARK_H
+#define _BVHBENCHMARK_H
+
+#include <iosfwd>
+#include <string>
+
+/// Compare build time, query throughput and memory of AabbTreeNode and AabbBvh
+/// on the road patches of a track (the roads.trk file in trackpath), with one
+/// object per leaf and with the 64 objects per node of the static drawables.
+/// Followed by the ray intersection throughput of the patches themselves, with
+/// and without their surface grids, and the Mat4 multiply and vector transform
+/// throughput of the camera setup, for the generic implementation and the simd
+/// specialization Mat4 uses.
+/// Returns false if the track data couldn't be loaded.
+bool BvhBenchmark(
+	const std::string & trackpath,
+	std::ostream & info_output,
+	std::ostream & error_output);
+
+#endif // _BVHBENCHMARK_H
@@ -152,6 +152,11 @@ public:
 		dynamics.SetAutoShift(value);
 	}
 
+	void SetTireTables(bool value)
+	{
+		dynamics.SetTireTables(value);
+	}
+
 	bool GetABSEnabled() const
 	{
 		return dynamics.GetABSEnabled();
@@ -19,8 +19,10 @@
 
 #include "configfactory.h"
 #include "contentmanager.h"
+#include "contentjob.h"
 #include "cfg/ptree.h"
-#include <fstream>
+#include "archive.h"
+#include <sstream>
 
 class ConfigInclude : public Include
 {
@@ -51,11 +53,89 @@ private:
 	const std::string & path;
 };
 
+// the content manager can't be used off the main thread, only note that there are includes
+class DeferredInclude : public Include
+{
+public:
+	DeferredInclude() : found(false)
+	{
+		// ctor
+	}
+
+	void operator()(PTree & node, std::string & value)
+	{
+		found = true;
+	}
+
+	bool found;
+};
+
+class ConfigJob : public ContentJob<PTree>
+{
+public:
+	ConfigJob(
+		const ArchiveSet & archives,
+		const std::string & basepath,
+		const std::string & path,
+		const std::string & name,
+		void (*read)(std::istream &, PTree &, Include *),
+		ContentManager * content) :
+		archives(archives),
+		basepath(basepath),
+		path(path),
+		abspath(basepath + "/" + path + "/" + name),
+		read(read),
+		content(content),
+		includes(false)
+	{
+		// ctor
+	}
+
+protected:
+	bool Decode(std::ostream & error)
+	{
+		if (!archives.Read(abspath, text))
+			return false;
+
+		std::istringstream in(text);
+		DeferredInclude include;
+		tree.reset(new PTree());
+		read(in, *tree, content ? &include : 0);
+		includes = include.found;
+		return true;
+	}
+
+	bool Create(std::tr1::shared_ptr<PTree> & sptr, std::ostream & error)
+	{
+		if (includes)
+		{
+			std::istringstream in(text);
+			ConfigInclude include(*content, basepath, path);
+			tree.reset(new PTree());
+			read(in, *tree, &include);
+		}
+		sptr = tree;
+		return true;
+	}
+
+private:
+	const ArchiveSet & archives;
+	std::string basepath;
+	std::string path;
+	std::string abspath;
+	std::string text;
+	std::tr1::shared_ptr<PTree> tree;
+	void (*read)(std::istream &, PTree &, Include *);
+	ContentManager * content;
+	bool includes;
+};
+
 Factory<PTree>::Factory() :
 	m_default(new PTree()),
 	m_read(&read_ini),
 	m_write(&write_ini),
-	m_content(0)
+	m_content(0),
+	m_archives(0)
 {
 	// ctor
 }
@@ -70,6 +150,11 @@ void Factory<PTree>::init(
 	m_content = &content;
 }
 
+void Factory<PTree>::setArchives(const ArchiveSet & archives)
+{
+	m_archives = &archives;
+}
+
 template <>
 bool Factory<PTree>::create(
 	std::tr1::shared_ptr<PTree> & sptr,
@@ -80,9 +165,10 @@ bool Factory<PTree>::create(
 	const empty&)
 {
 	const std::string abspath = basepath + "/" + path + "/" + name;
-	std::ifstream file(abspath.c_str());
-	if (file.good())
+	std::string text;
+	if (m_archives->Read(abspath, text))
 	{
+		std::istringstream file(text);
 		std::tr1::shared_ptr<PTree> temp(new PTree());
 		if (m_content)
 		{
@@ -101,6 +187,20 @@ bool Factory<PTree>::create(
 	return false;
 }
 
+template <>
+ContentJob<PTree> * Factory<PTree>::createAsync(
+	const std::string & basepath,
+	const std::string & path,
+	const std::string & name,
+	const empty&)
+{
+	const std::string abspath = basepath + "/" + path + "/" + name;
+	if (!m_archives->Exists(abspath))
+		return 0;
+
+	return new ConfigJob(*m_archives, basepath, path, name, m_read, m_content);
+}
+
 // replace file string with stream
 template <>
 bool Factory<PTree>::create(
@@ -25,6 +25,7 @@
 
 class PTree;
 class ContentManager;
+class ArchiveSet;
 struct Include;
 
 template <>
@@ -41,6 +42,9 @@ public:
 		void (&write)(const PTree &, std::ostream &),
 		ContentManager & content);
 
+	/// config files are looked up in archives first
+	void setArchives(const ArchiveSet & archives);
+
 	template <class P>
 	bool create(
 		std::tr1::shared_ptr<PTree> & sptr,
@@ -50,6 +54,14 @@ public:
 		const std::string & name,
 		const P & param);
 
+	/// parse config file asynchronously, files with includes are parsed again on the main thread
+	template <class P>
+	ContentJob<PTree> * createAsync(
+		const std::string & basepath,
+		const std::string & path,
+		const std::string & name,
+		const P & param);
+
 	const std::tr1::shared_ptr<PTree> & getDefault() const;
 
 private:
@@ -57,6 +69,7 @@ private:
 	void (*m_read)(std::istream &, PTree &, Include *);
 	void (*m_write)(const PTree &, std::ostream &);
 	ContentManager * m_content;
+	const ArchiveSet * m_archives;
 };
 
 #endif // _CONFIGFACTORY_H
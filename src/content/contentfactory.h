@@ -23,6 +23,9 @@
 #include "memory.h"
 #include <iosfwd>
 
+template <class Content>
+class ContentJob;
+
 template <class Content>
 class Factory
 {
@@ -36,6 +39,15 @@ public:
 		const std::string & name,
 		const P & param);
 
+	/// optional, start asynchronous loading, the job is owned by the caller
+	/// return null if the file doesn't exist or can't be loaded asynchronously
+	template <class P>
+	ContentJob<Content> * createAsync(
+		const std::string & basepath,
+		const std::string & path,
+		const std::string & name,
+		const P & param);
+
 	const std::tr1::shared_ptr<Content> & getDefault() const;
 };
 
@@ -0,0 +1,77 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+
+#ifndef _CONTENTJOB_H
+#define _CONTENTJOB_H
+
+#include "parallel_task.h"
+#include "memory.h"
+#include <cassert>
+#include <sstream>
+
+/// Asynchronous content loading is split into decoding (file reading, parsing),
+/// which doesn't touch shared state and runs on a loader thread, and creation
+/// of the content (gl objects, content manager access) on the main thread.
+template <class T>
+class ContentJob : public Parallel::Job
+{
+public:
+	ContentJob() : success(false)
+	{
+		SDL_AtomicSet(&done, 0);
+	}
+
+	virtual ~ContentJob() {}
+
+	/// loader thread
+	void Execute()
+	{
+		success = Decode(log);
+		SDL_MemoryBarrierRelease();
+		SDL_AtomicSet(&done, 1);
+	}
+
+	bool Done() const
+	{
+		bool value = SDL_AtomicGet(&done);
+		SDL_MemoryBarrierAcquire();
+		return value;
+	}
+
+	/// main thread, create decoded content, decoding errors are reported here
+	bool Finish(std::tr1::shared_ptr<T> & sptr, std::ostream & error)
+	{
+		assert(Done());
+		error << log.str();
+		return success && Create(sptr, error);
+	}
+
+protected:
+	virtual bool Decode(std::ostream & error) = 0;
+
+	virtual bool Create(std::tr1::shared_ptr<T> & sptr, std::ostream & error) = 0;
+
+private:
+	std::ostringstream log;
+	bool success;
+	mutable SDL_atomic_t done;
+};
+
+#endif // _CONTENTJOB_H
@@ -22,15 +22,68 @@
 ContentManager::ContentManager(std::ostream & error) :
 	error(error)
 {
-	// ctor
+	getFactory<SoundBuffer>().setArchives(archives);
+	getFactory<Texture>().setArchives(archives);
+	getFactory<Model>().setArchives(archives);
+	getFactory<PTree>().setArchives(archives);
 }
 
 ContentManager::~ContentManager()
 {
+	// drop pending loads
+	loader.Deinit();
+	for (size_t i = 0; i < factory_cached.m_caches.size(); ++i)
+	{
+		factory_cached.m_caches[i]->cancel();
+	}
+
 	sweep();
 	_logleaks();
 }
 
+void ContentManager::initLoader(unsigned int num_threads)
+{
+	loader.Deinit();
+	if (num_threads > 0)
+	{
+		loader.Init(num_threads);
+	}
+}
+
+bool ContentManager::update(unsigned int budget)
+{
+	const unsigned int start = SDL_GetTicks();
+	bool done = true;
+	for (size_t i = 0; i < factory_cached.m_caches.size(); ++i)
+	{
+		done = factory_cached.m_caches[i]->update(error, start, budget) && done;
+	}
+	return done;
+}
+
+void ContentManager::finish()
+{
+	for (size_t i = 0; i < factory_cached.m_caches.size(); ++i)
+	{
+		factory_cached.m_caches[i]->finish(error);
+	}
+}
+
+size_t ContentManager::getPending() const
+{
+	size_t n = 0;
+	for (size_t i = 0; i < factory_cached.m_caches.size(); ++i)
+	{
+		n += factory_cached.m_caches[i]->pending();
+	}
+	return n;
+}
+
+const ArchiveSet & ContentManager::getArchives() const
+{
+	return archives;
+}
+
 void ContentManager::addSharedPath(const std::string & path)
 {
 	sharedpaths.push_back(path);
@@ -85,3 +138,61 @@ bool ContentManager::_logerror(
 	error << std::endl;
 	return false;
 }
+
+#include "unittest.h"
+#include "cfg/ptree.h"
+#include "pathmanager.h"
+#include <fstream>
+
+QT_TEST(contentmanager_async_test)
+{
+	// the fixtures go into a directory in the temporary folder
+	std::stringbuf log;
+	std::ostream info(&log), error(&log);
+	PathManager pathmanager;
+	pathmanager.Init(info, error);
+	const std::string dir = pathmanager.GetTemporaryFolder() + "/contentmanager_test";
+	PathManager::MakeDir(dir);
+	{
+		std::ofstream f((dir + "/contentmanager_test.txt").c_str());
+		f << "a = 1\nb = &contentmanager_include.txt\n";
+	}
+	{
+		std::ofstream f((dir + "/contentmanager_include.txt").c_str());
+		f << "c = 2\n";
+	}
+
+	ContentManager content(error);
+	content.getFactory<PTree>().init(read_ini, write_ini, content);
+	content.addSharedPath(dir);
+	content.initLoader(2);
+
+	content.loadAsync<PTree>("", "contentmanager_test.txt");
+	content.loadAsync<PTree>("", "contentmanager_include.txt");
+	content.loadAsync<PTree>("", "contentmanager_missing.txt");
+	QT_CHECK_EQUAL(content.getPending(), 2u);
+
+	// load waits for the pending load, the include is resolved on this thread
+	std::tr1::shared_ptr<PTree> config;
+	QT_CHECK(content.load(config, "", "contentmanager_test.txt"));
+	int a = 0, c = 0;
+	QT_CHECK(config->get("a", a));
+	QT_CHECK(config->get("b.c", c));
+	QT_CHECK_EQUAL(a, 1);
+	QT_CHECK_EQUAL(c, 2);
+	QT_CHECK_EQUAL(content.getPending(), 0u);
+
+	content.loadAsync<PTree>("", "contentmanager_include.txt");
+	QT_CHECK_EQUAL(content.getPending(), 0u);
+
+	config.reset();
+	content.sweep();
+	content.loadAsync<PTree>("", "contentmanager_include.txt");
+	content.finish();
+	QT_CHECK_EQUAL(content.getPending(), 0u);
+	QT_CHECK(content.get(config, "", "contentmanager_include.txt"));
+
+	PathManager::RemoveFile(dir + "/contentmanager_test.txt");
+	PathManager::RemoveFile(dir + "/contentmanager_include.txt");
+	PathManager::RemoveDir(dir);
+}
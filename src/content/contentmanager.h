@@ -24,6 +24,9 @@
 #include "texturefactory.h"
 #include "modelfactory.h"
 #include "configfactory.h"
+#include "contentjob.h"
+#include "archive.h"
+#include "parallel_task.h"
 #include <vector>
 #include <map>
 
@@ -56,12 +59,41 @@ public:
 		const std::string & name,
 		const P & param);
 
+	/// start loading content on the loader threads, load waits for it if it isn't done yet
+	/// the content type factory has to support createAsync
+	template <class T>
+	void loadAsync(
+		const std::string & path,
+		const std::string & name);
+
+	template <class T, class P>
+	void loadAsync(
+		const std::string & path,
+		const std::string & name,
+		const P & param);
+
+	/// start loader threads, without threads asynchronous loads are decoded right away
+	void initLoader(unsigned int num_threads);
+
+	/// create decoded asynchronous content on the calling thread until budget milliseconds are used
+	/// return true if there are no pending loads left
+	bool update(unsigned int budget);
+
+	/// wait for and create all pending asynchronous content
+	void finish();
+
+	/// number of pending asynchronous loads
+	size_t getPending() const;
+
 	/// add shared content directory path
 	void addSharedPath(const std::string & path);
 
 	/// add content directory path
 	void addPath(const std::string & path);
 
+	/// packed directories, used by the factories to open files
+	const ArchiveSet & getArchives() const;
+
 	/// garbage collect unused content
 	void sweep();
 
@@ -70,19 +102,39 @@ public:
 	Factory<T> & getFactory();
 
 private:
+	/// declared first, factories and loader jobs read from it
+	ArchiveSet archives;
+
 	struct Cache
 	{
 		virtual void log(std::ostream & log) const = 0;
 		virtual size_t size() const = 0;
 		virtual void sweep() = 0;
+		virtual size_t pending() const = 0;
+		virtual bool update(std::ostream & error, unsigned int start, unsigned int budget) = 0;
+		virtual void finish(std::ostream & error) = 0;
+		virtual void cancel() = 0;
 	};
 
 	template <class T>
 	class CacheShared : public Cache, public std::map<std::string, std::tr1::shared_ptr<T> >
 	{
+	public:
+		/// asynchronous loads by cache key
+		typedef std::map<std::string, ContentJob<T> *> PendingMap;
+		PendingMap pending_jobs;
+
+		/// wait for job to finish, cache the content, return false if loading failed
+		bool finish(typename PendingMap::iterator it, std::ostream & error);
+
+	private:
 		void log(std::ostream & log) const;
 		size_t size() const;
 		void sweep();
+		size_t pending() const;
+		bool update(std::ostream & error, unsigned int start, unsigned int budget);
+		void finish(std::ostream & error);
+		void cancel();
 	};
 
 	/// register content factories
@@ -121,6 +173,9 @@ private:
 	/// error log
 	std::ostream & error;
 
+	/// decodes asynchronous loads
+	Parallel::JobSystem loader;
+
 	/// content leak logger
 	bool _logleaks();
 
@@ -144,6 +199,14 @@ private:
 		const std::string & name,
 		const P & param);
 
+	/// asynchronous load implementation
+	template <class T, class P>
+	bool _loadAsync(
+		const std::vector<std::string> & basepaths,
+		const std::string & relpath,
+		const std::string & name,
+		const P & param);
+
 	/// get default object instance
 	template <class T>
 	bool _getdefault(std::tr1::shared_ptr<T> & sptr);
@@ -185,6 +248,25 @@ inline bool ContentManager::load(
 			_logerror(path, name);
 }
 
+template <class T>
+inline void ContentManager::loadAsync(
+	const std::string & path,
+	const std::string & name)
+{
+	loadAsync<T>(path, name, typename Factory<T>::empty());
+}
+
+template <class T, class P>
+inline void ContentManager::loadAsync(
+	const std::string & path,
+	const std::string & name,
+	const P & param)
+{
+	// same lookup order as load, missing content is reported by load
+	_loadAsync<T>(basepaths, path, name, param) ||
+	_loadAsync<T>(sharedpaths, "", name, param);
+}
+
 template <class T>
 inline bool ContentManager::_get(
 	std::tr1::shared_ptr<T> & sptr,
@@ -215,6 +297,14 @@ inline bool ContentManager::_load(
 		return true;
 	}
 
+	// wait for asynchronous load
+	CacheShared<T> & cache_async = factory_cached;
+	typename CacheShared<T>::PendingMap::iterator it = cache_async.pending_jobs.find(relpath + name);
+	if (it != cache_async.pending_jobs.end() && cache_async.finish(it, error))
+	{
+		return _get(sptr, relpath + name);
+	}
+
 	// load from basepaths
 	Factory<T>& factory = getFactory<T>();
 	for (size_t i = 0; i < basepaths.size(); ++i)
@@ -231,6 +321,37 @@ inline bool ContentManager::_load(
 	return false;
 }
 
+template <class T, class P>
+inline bool ContentManager::_loadAsync(
+	const std::vector<std::string> & basepaths,
+	const std::string & relpath,
+	const std::string & name,
+	const P & param)
+{
+	// already loaded or loading
+	CacheShared<T> & cache = factory_cached;
+	const std::string key = relpath + name;
+	if (cache.find(key) != cache.end() ||
+		cache.pending_jobs.find(key) != cache.pending_jobs.end())
+	{
+		return true;
+	}
+
+	Factory<T>& factory = getFactory<T>();
+	for (size_t i = 0; i < basepaths.size(); ++i)
+	{
+		ContentJob<T> * job = factory.createAsync(basepaths[i], relpath, name, param);
+		if (job)
+		{
+			cache.pending_jobs[key] = job;
+			loader.Submit(*job);
+			return true;
+		}
+	}
+
+	return false;
+}
+
 template <class T>
 inline bool ContentManager::_getdefault(std::tr1::shared_ptr<T> & sptr)
 {
@@ -267,6 +388,79 @@ inline void ContentManager::CacheShared<T>::sweep()
 	}
 }
 
+template <class T>
+inline size_t ContentManager::CacheShared<T>::pending() const
+{
+	return pending_jobs.size();
+}
+
+template <class T>
+inline bool ContentManager::CacheShared<T>::finish(
+	typename PendingMap::iterator it,
+	std::ostream & error)
+{
+	ContentJob<T> * job = it->second;
+	while (!job->Done())
+	{
+		SDL_Delay(1);
+	}
+
+	std::tr1::shared_ptr<T> sptr;
+	bool success = job->Finish(sptr, error);
+	if (success)
+	{
+		(*this)[it->first] = sptr;
+	}
+	delete job;
+	pending_jobs.erase(it);
+	return success;
+}
+
+template <class T>
+inline bool ContentManager::CacheShared<T>::update(
+	std::ostream & error,
+	unsigned int start,
+	unsigned int budget)
+{
+	typename PendingMap::iterator it = pending_jobs.begin();
+	while (it != pending_jobs.end() && SDL_GetTicks() - start < budget)
+	{
+		if (it->second->Done())
+		{
+			// creating content can finish other pending loads (config includes)
+			const std::string key = it->first;
+			finish(it, error);
+			it = pending_jobs.upper_bound(key);
+		}
+		else
+		{
+			++it;
+		}
+	}
+	return pending_jobs.empty();
+}
+
+template <class T>
+inline void ContentManager::CacheShared<T>::finish(std::ostream & error)
+{
+	while (!pending_jobs.empty())
+	{
+		finish(pending_jobs.begin(), error);
+	}
+}
+
+template <class T>
+inline void ContentManager::CacheShared<T>::cancel()
+{
+	// jobs must not be running anymore
+	typename PendingMap::iterator it = pending_jobs.begin();
+	for (; it != pending_jobs.end(); ++it)
+	{
+		delete it->second;
+	}
+	pending_jobs.clear();
+}
+
 template <class T>
 inline Factory<T> & ContentManager::getFactory()
 {
@@ -18,26 +18,95 @@
 /************************************************************************/
 
 #include "modelfactory.h"
+#include "contentjob.h"
 #include "graphics/model_joe03.h"
-#include <fstream>
+#include "archive.h"
+#include <SDL2/SDL.h>
+
+class ModelJob : public ContentJob<Model>
+{
+public:
+	ModelJob(
+		const ArchiveSet & archives,
+		const std::string & path,
+		const std::string & cachepath,
+		bool vbo, bool headless) :
+		archives(archives),
+		path(path),
+		cachepath(cachepath),
+		model(new ModelJoe03()),
+		vbo(vbo),
+		headless(headless)
+	{
+		// ctor
+	}
+
+protected:
+	bool Decode(std::ostream & error)
+	{
+		return model->LoadMesh(archives, path, error, cachepath);
+	}
+
+	bool Create(std::tr1::shared_ptr<Model> & sptr, std::ostream & error)
+	{
+		// headless models only keep the mesh
+		if (!headless)
+		{
+			if (vbo)
+				model->GenerateVertexArrayObject(error);
+			else
+				model->GenerateListID(error);
+		}
+		else
+		{
+			model->ClearCacheData();
+		}
+		sptr = model;
+		return true;
+	}
+
+private:
+	const ArchiveSet & archives;
+	std::string path;
+	std::string cachepath;
+	std::tr1::shared_ptr<ModelJoe03> model;
+	bool vbo;
+	bool headless;
+};
 
 Factory<Model>::Factory() :
 	m_default(new Model()),
-	m_vbo(false)
+	m_vbo(false),
+	m_headless(false),
+	m_archives(0)
 {
 	// ctor
 }
 
-void Factory<Model>::init(bool use_vbo)
+void Factory<Model>::init(bool use_vbo, bool headless)
 {
 	m_vbo = use_vbo;
+	m_headless = headless;
 
 	// init default model
 	std::stringstream error;
 	VertexArray va;
 	va.SetToUnitCube();
 	va.Scale(0.5, 0.5, 0.5);
-	m_default->Load(va, error, !m_vbo);
+	if (m_headless)
+		m_default->LoadMesh(va);
+	else
+		m_default->Load(va, error, !m_vbo);
+}
+
+void Factory<Model>::setArchives(const ArchiveSet & archives)
+{
+	m_archives = &archives;
+}
+
+void Factory<Model>::setCachePath(const std::string & path)
+{
+	m_cachepath = path;
 }
 
 template <>
@@ -50,16 +119,40 @@ bool Factory<Model>::create(
 	const empty&)
 {
 	const std::string abspath = basepath + "/" + path + "/" + name;
-	if (std::ifstream(abspath.c_str()))
+	if (!m_archives->Exists(abspath))
+		return false;
+
+	std::tr1::shared_ptr<ModelJoe03> temp(new ModelJoe03());
+	if (!temp->LoadMesh(*m_archives, abspath, error, m_cachepath))
+		return false;
+
+	if (!m_headless)
 	{
-		std::tr1::shared_ptr<ModelJoe03> temp(new ModelJoe03());
-		if (temp->Load(abspath, error, !m_vbo))
-		{
-			sptr = temp;
-			return true;
-		}
+		if (m_vbo)
+			temp->GenerateVertexArrayObject(error);
+		else
+			temp->GenerateListID(error);
 	}
-	return false;
+	else
+	{
+		temp->ClearCacheData();
+	}
+	sptr = temp;
+	return true;
+}
+
+template <>
+ContentJob<Model> * Factory<Model>::createAsync(
+	const std::string& basepath,
+	const std::string& path,
+	const std::string& name,
+	const empty&)
+{
+	const std::string abspath = basepath + "/" + path + "/" + name;
+	if (!m_archives->Exists(abspath))
+		return 0;
+
+	return new ModelJob(*m_archives, abspath, m_cachepath, m_vbo, m_headless);
 }
 
 template <>
@@ -71,13 +164,24 @@ bool Factory<Model>::create(
 	const std::string& name,
 	const JoePack& pack)
 {
+	// the pack entry is read into memory and goes through the mesh cache
 	std::tr1::shared_ptr<ModelJoe03> temp(new ModelJoe03());
-	if (temp->Load(name, error, !m_vbo, &pack))
+	if (!temp->LoadMesh(name, error, &pack, m_cachepath))
+		return false;
+
+	if (!m_headless)
 	{
-		sptr = temp;
-		return true;
+		if (m_vbo)
+			temp->GenerateVertexArrayObject(error);
+		else
+			temp->GenerateListID(error);
 	}
-	return false;
+	else
+	{
+		temp->ClearCacheData();
+	}
+	sptr = temp;
+	return true;
 }
 
 template <>
@@ -90,6 +194,12 @@ bool Factory<Model>::create(
 	const VertexArray& varray)
 {
 	std::tr1::shared_ptr<Model> temp(new Model());
+	if (m_headless)
+	{
+		temp->LoadMesh(varray);
+		sptr = temp;
+		return true;
+	}
 	if (temp->Load(varray, error, !m_vbo))
 	{
 		sptr = temp;
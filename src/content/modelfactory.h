@@ -21,8 +21,10 @@
 #define _MODELFACTORY_H
 
 #include "contentfactory.h"
+#include <string>
 
 class Model;
+class ArchiveSet;
 
 template <>
 class Factory<Model>
@@ -33,7 +35,14 @@ public:
 	Factory();
 
 	/// use VBOs instead of draw lists for models
-	void init(bool use_vbo);
+	/// headless models only keep mesh data, no gl objects are generated
+	void init(bool use_vbo, bool headless = false);
+
+	/// model files are looked up in archives first
+	void setArchives(const ArchiveSet & archives);
+
+	/// directory for the pre-baked mesh cache, empty disables caching
+	void setCachePath(const std::string & path);
 
 	template <class P>
 	bool create(
@@ -44,11 +53,22 @@ public:
 		const std::string & name,
 		const P & param);
 
+	/// parse model file asynchronously, pack files are not supported
+	template <class P>
+	ContentJob<Model> * createAsync(
+		const std::string & basepath,
+		const std::string & path,
+		const std::string & name,
+		const P & param);
+
 	const std::tr1::shared_ptr<Model> & getDefault() const;
 
 private:
 	std::tr1::shared_ptr<Model> m_default;
 	bool m_vbo;
+	bool m_headless;
+	const ArchiveSet * m_archives;
+	std::string m_cachepath;
 };
 
 #endif // _MODELFACTORY_H
@@ -19,11 +19,17 @@
 
 #include "soundfactory.h"
 #include "sound/soundbuffer.h"
-#include <fstream>
+#include "archive.h"
+#include <SDL2/SDL.h>
+
+// long ogg files (music, ambience) are streamed instead of decoded into memory
+// 1 MB is about a minute of vorbis audio, several times the length of car sounds
+static const Sint64 stream_file_size = 1 << 20;
 
 Factory<SoundBuffer>::Factory() :
 	m_default(new SoundBuffer()),
-	m_info(0, 0, 0, 0)
+	m_info(0, 0, 0, 0),
+	m_archives(0)
 {
 	// ctor
 }
@@ -33,6 +39,11 @@ void Factory<SoundBuffer>::init(const SoundInfo& value)
 	m_info = value;
 }
 
+void Factory<SoundBuffer>::setArchives(const ArchiveSet & archives)
+{
+	m_archives = &archives;
+}
+
 template <>
 bool Factory<SoundBuffer>::create(
 	std::tr1::shared_ptr<SoundBuffer> & sptr,
@@ -44,18 +55,28 @@ bool Factory<SoundBuffer>::create(
 {
 	const std::string abspath = basepath + "/" + path + "/" + name;
 	std::string filepath = abspath + ".ogg";
-	if (!std::ifstream(filepath.c_str()))
+	SDL_RWops * file = m_archives->Open(filepath);
+	if (!file)
 	{
 		filepath = abspath + ".wav";
+		file = m_archives->Open(filepath);
 	}
-	if (std::ifstream(filepath.c_str()))
+	if (!file)
+	{
+		return false;
+	}
+
+	std::tr1::shared_ptr<SoundBuffer> temp(new SoundBuffer());
+	bool loaded;
+	if (filepath.find(".ogg") != std::string::npos && SDL_RWsize(file) > stream_file_size)
+		loaded = temp->LoadStream(file, filepath, m_info, error);
+	else
+		loaded = temp->Load(file, filepath, m_info, error);
+	SDL_RWclose(file);
+	if (loaded)
 	{
-		std::tr1::shared_ptr<SoundBuffer> temp(new SoundBuffer());
-		if (temp->Load(filepath, m_info, error))
-		{
-			sptr = temp;
-			return true;
-		}
+		sptr = temp;
+		return true;
 	}
 	return false;
 }
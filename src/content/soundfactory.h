@@ -24,6 +24,7 @@
 #include "sound/soundinfo.h"
 
 class SoundBuffer;
+class ArchiveSet;
 
 template <>
 class Factory<SoundBuffer>
@@ -36,6 +37,10 @@ public:
 	/// sound device setting
 	void init(const SoundInfo& value);
 
+	/// sound files are looked up in archives first
+	void setArchives(const ArchiveSet & archives);
+
+	/// ogg files larger than 1 MB are streamed
 	template <class P>
 	bool create(
 		std::tr1::shared_ptr<SoundBuffer> & sptr,
@@ -50,6 +55,7 @@ public:
 private:
 	std::tr1::shared_ptr<SoundBuffer> m_default;
 	SoundInfo m_info;
+	const ArchiveSet * m_archives;
 };
 
 #endif // _SOUNDFACTORY_H
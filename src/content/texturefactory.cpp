@@ -18,25 +18,72 @@
 /************************************************************************/
 
 #include "texturefactory.h"
+#include "contentjob.h"
 #include "graphics/texture.h"
-#include <fstream>
+#include "archive.h"
+#include <SDL2/SDL.h>
 #include <sstream>
 
+class TextureJob : public ContentJob<Texture>
+{
+public:
+	TextureJob(const ArchiveSet & archives, const std::string & path, const TextureInfo & info) :
+		archives(archives),
+		path(path),
+		info(info)
+	{
+		// ctor
+	}
+
+protected:
+	bool Decode(std::ostream & error)
+	{
+		SDL_RWops * file = archives.Open(path);
+		if (!file)
+			return false;
+		bool success = Texture::Decode(file, path, info, image, error);
+		SDL_RWclose(file);
+		return success;
+	}
+
+	bool Create(std::tr1::shared_ptr<Texture> & sptr, std::ostream & error)
+	{
+		std::tr1::shared_ptr<Texture> temp(new Texture());
+		if (temp->Upload(image, info, error))
+		{
+			sptr = temp;
+			return true;
+		}
+		return false;
+	}
+
+private:
+	const ArchiveSet & archives;
+	std::string path;
+	TextureInfo info;
+	Texture::Image image;
+};
+
 Factory<Texture>::Factory() :
 	m_default(new Texture()),
 	m_zero(new Texture()),
 	m_size(TextureInfo::LARGE),
 	m_compress(true),
-	m_srgb(false)
+	m_srgb(false),
+	m_headless(false),
+	m_archives(0)
 {
 	// ctor
 }
 
-void Factory<Texture>::init(int max_size, bool use_srgb, bool compress)
+void Factory<Texture>::init(int max_size, bool use_srgb, bool compress, bool headless)
 {
 	m_size = max_size;
 	m_srgb = use_srgb;
 	m_compress = compress;
+	m_headless = headless;
+	if (m_headless)
+		return;
 
 	// init default texture
 	std::stringstream error;
@@ -58,6 +105,11 @@ void Factory<Texture>::init(int max_size, bool use_srgb, bool compress)
 	m_zero->Load("", info, error);
 }
 
+void Factory<Texture>::setArchives(const ArchiveSet & archives)
+{
+	m_archives = &archives;
+}
+
 template <>
 bool Factory<Texture>::create(
 	std::tr1::shared_ptr<Texture> & sptr,
@@ -68,22 +120,59 @@ bool Factory<Texture>::create(
 	const TextureInfo& info)
 {
 	const std::string abspath = basepath + "/" + path + "/" + name;
-	if (info.data || std::ifstream(abspath.c_str()))
+	if (!info.data && !m_archives->Exists(abspath))
+		return false;
+
+	if (m_headless)
 	{
-		TextureInfo info_temp = info;
-		info_temp.srgb = info.compress && m_srgb; 			// non compressible means non color data
-		info_temp.compress = info.compress && m_compress;	// allow to disable compression
-		info_temp.maxsize = TextureInfo::Size(m_size);
-		std::tr1::shared_ptr<Texture> temp(new Texture());
-		if (temp->Load(abspath, info_temp, error))
-		{
-			sptr = temp;
-			return true;
-		}
+		sptr.reset(new Texture());
+		return true;
+	}
+
+	std::tr1::shared_ptr<Texture> temp(new Texture());
+	const TextureInfo texinfo = getInfo(info);
+	bool loaded;
+	if (info.data || info.cube)
+	{
+		// raw data and cube maps (several files) don't go through archives
+		loaded = temp->Load(abspath, texinfo, error);
+	}
+	else
+	{
+		SDL_RWops * file = m_archives->Open(abspath);
+		Texture::Image image;
+		loaded = file &&
+			Texture::Decode(file, abspath, texinfo, image, error) &&
+			temp->Upload(image, texinfo, error);
+		if (file)
+			SDL_RWclose(file);
+	}
+	if (loaded)
+	{
+		sptr = temp;
+		return true;
 	}
 	return false;
 }
 
+template <>
+ContentJob<Texture> * Factory<Texture>::createAsync(
+	const std::string & basepath,
+	const std::string & path,
+	const std::string & name,
+	const TextureInfo& info)
+{
+	// headless textures are only checked for existence, no need to do that asynchronously
+	if (m_headless || info.data || info.cube)
+		return 0;
+
+	const std::string abspath = basepath + "/" + path + "/" + name;
+	if (!m_archives->Exists(abspath))
+		return 0;
+
+	return new TextureJob(*m_archives, abspath, getInfo(info));
+}
+
 const std::tr1::shared_ptr<Texture> & Factory<Texture>::getDefault() const
 {
 	return m_default;
@@ -93,3 +182,12 @@ const std::tr1::shared_ptr<Texture> & Factory<Texture>::getZero() const
 {
 	return m_zero;
 }
+
+TextureInfo Factory<Texture>::getInfo(const TextureInfo & info) const
+{
+	TextureInfo info_temp = info;
+	info_temp.srgb = info.compress && m_srgb; 			// non compressible means non color data
+	info_temp.compress = info.compress && m_compress;	// allow to disable compression
+	info_temp.maxsize = TextureInfo::Size(m_size);
+	return info_temp;
+}
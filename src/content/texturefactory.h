@@ -24,6 +24,7 @@
 #include "graphics/textureinfo.h"
 
 class Texture;
+class ArchiveSet;
 
 template <>
 class Factory<Texture>
@@ -36,7 +37,11 @@ public:
 	/// in general all textures on disk will be in the SRGB colorspace, so if the renderer wants to do
 	/// gamma correct lighting, it will want all textures to be gamma corrected using the SRGB flag
 	/// limit texture size to max size
-	void init(int max_size, bool use_srgb, bool compress);
+	/// headless textures are not loaded, they only check that the texture file exists
+	void init(int max_size, bool use_srgb, bool compress, bool headless = false);
+
+	/// texture files are looked up in archives first
+	void setArchives(const ArchiveSet & archives);
 
 	template <class P>
 	bool create(
@@ -47,6 +52,14 @@ public:
 		const std::string & name,
 		const P & param);
 
+	/// decode texture file asynchronously, cube maps are not supported
+	template <class P>
+	ContentJob<Texture> * createAsync(
+		const std::string & basepath,
+		const std::string & path,
+		const std::string & name,
+		const P & param);
+
 	/// default texture is white: rgba (1, 1, 1, 1)
 	const std::tr1::shared_ptr<Texture> & getDefault() const;
 
@@ -59,6 +72,10 @@ private:
 	int m_size;
 	bool m_compress;
 	bool m_srgb;
+	bool m_headless;
+	const ArchiveSet * m_archives;
+
+	TextureInfo getInfo(const TextureInfo & info) const;
 };
 
 #endif // _TEXTUREFACTORY_H
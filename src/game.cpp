@@ -21,12 +21,16 @@
 #include "unittest.h"
 #include "definitions.h"
 #include "joepack.h"
+#include "archive.h"
 #include "matrix4.h"
 #include "physics/carwheelposition.h"
 #include "physics/tracksurface.h"
 #include "numprocessors.h"
 #include "performance_testing.h"
-#include "quickprof.h"
+#include "bvhbenchmark.h"
+#include "batchsimulation.h"
+#include "replaybenchmark.h"
+#include "profiler.h"
 #include "utils.h"
 #include "graphics/graphics_gl2.h"
 #include "graphics/graphics_gl3v.h"
@@ -74,6 +78,39 @@ static T cast(const std::string &str) {
 	return t;
 }
 
+// collect the files below dir, paths relative to dir
+static void ListFiles(
+	const PathManager & pathmanager,
+	const std::string & dir,
+	const std::string & subdir,
+	std::vector<std::string> & files)
+{
+	std::list<std::string> names;
+	pathmanager.GetFileList(subdir.empty() ? dir : dir + "/" + subdir, names);
+	for (std::list<std::string>::const_iterator i = names.begin(); i != names.end(); ++i)
+	{
+		const std::string name = subdir.empty() ? *i : subdir + "/" + *i;
+		std::list<std::string> children;
+		if (pathmanager.GetFileList(dir + "/" + name, children))
+			ListFiles(pathmanager, dir, name, files);
+		else
+			files.push_back(name);
+	}
+}
+
+// no window, gl or audio, content factories only load what the simulation needs
+static void InitHeadlessContent(const PathManager & pathmanager, ContentManager & content)
+{
+	content.getFactory<Texture>().init(TextureInfo::SMALL, false, false, true);
+	content.getFactory<Model>().init(false, true);
+	content.getFactory<Model>().setCachePath(pathmanager.GetModelCachePath());
+	content.getFactory<PTree>().init(read_ini, write_ini, content);
+	content.addPath(pathmanager.GetWriteableDataPath());
+	content.addPath(pathmanager.GetDataPath());
+	content.addSharedPath(pathmanager.GetCarPartsPath());
+	content.addSharedPath(pathmanager.GetTrackPartsPath());
+}
+
 Game::Game(std::ostream & info_out, std::ostream & error_out) :
 	info_output(info_out),
 	error_output(error_out),
@@ -164,6 +201,19 @@ void Game::Start(std::list <std::string> & args)
 		return;
 	}
 
+	// Start the worker pool, the main thread executes jobs too.
+	if (multithreaded)
+	{
+		jobs.Init(NUMPROCESSORS::GetNumProcessors() - 1);
+		dynamics.setJobSystem(&jobs);
+		graphics_interface->setJobSystem(&jobs);
+		ai.setJobSystem(&jobs);
+		info_output << "Job system started with " << jobs.GetNumThreads() << " worker threads" << std::endl;
+	}
+
+	// Content decoding runs on its own pool, physics jobs don't have to wait for it.
+	content.initLoader(std::max(1u, NUMPROCESSORS::GetNumProcessors() - 1));
+
 	// Load controls.
 	info_output << "Loading car controls from: " << pathmanager.GetCarControlsFile() << std::endl;
 	if (!carcontrols_local.second.Load(pathmanager.GetCarControlsFile(), info_output, error_output))
@@ -309,12 +359,26 @@ void Game::End()
 	}
 
 	if (profilingmode)
-		info_output << "Profiling summary:\n" << PROFILER.getSummary(quickprof::PERCENT) << std::endl;
+	{
+		info_output << "Profiling summary:\n" << PROFILER.GetSummary() << std::endl;
+		if (!profiling_trace.empty())
+		{
+			std::ofstream trace(profiling_trace.c_str());
+			PROFILER.WriteCapture(trace);
+			info_output << "Profiling trace written to: " << profiling_trace << std::endl;
+		}
+		PROFILER.Disable();
+	}
 
 	info_output << "Shutting down..." << std::endl;
 
 	LeaveGame();
 
+	dynamics.setJobSystem(0);
+	graphics_interface->setJobSystem(0);
+	ai.setJobSystem(0);
+	jobs.Deinit();
+
 	// Save settings first incase later deinits cause crashes.
 	settings.Save(pathmanager.GetSettingsFile(), error_output);
 
@@ -430,6 +494,8 @@ bool Game::InitCoreSubsystems()
 	// Init content factories
 	content.getFactory<Texture>().init(texture_size, using_gl3, settings.GetTextureCompress());
 	content.getFactory<Model>().init(using_gl3);
+	content.getFactory<Model>().setCachePath(pathmanager.GetModelCachePath());
+	track.SetCachePath(pathmanager.GetTrackCachePath());
 	content.getFactory<PTree>().init(read_ini, write_ini, content);
 
 	// Init content paths
@@ -554,6 +620,7 @@ bool Game::InitSound()
 	if (sound.Init(2048, info_output, error_output))
 	{
 		sound.SetVolume(settings.GetSoundVolume());
+		sound.SetCubicInterpolation(settings.GetSoundCubicInterpolation());
 		content.getFactory<SoundBuffer>().init(sound.GetDeviceInfo());
 	}
 	else
@@ -622,6 +689,122 @@ bool Game::ParseArguments(std::list <std::string> & args)
 	}
 	arghelp["-cartest CAR"] = "Run car performance testing on given CAR.";
 
+	if (!argmap["-bvhbenchmark"].empty())
+	{
+		pathmanager.Init(info_output, error_output);
+		const std::string trackpath = pathmanager.GetTracksDir() + "/" + argmap["-bvhbenchmark"];
+		BvhBenchmark(trackpath, info_output, error_output);
+		continue_game = false;
+	}
+	arghelp["-bvhbenchmark TRACK"] = "Compare road collision tree, patch query and camera matrix performance on given TRACK.";
+
+	if (!argmap["-batchsim"].empty())
+	{
+		pathmanager.Init(info_output, error_output);
+		InitHeadlessContent(pathmanager, content);
+
+		const std::vector<std::string> carnames = Tokenize(argmap["-batchsim"], ",");
+		unsigned int threads = NUMPROCESSORS::GetNumProcessors();
+		if (!argmap["-batchthreads"].empty())
+			threads = cast<unsigned int>(argmap["-batchthreads"]);
+		std::string resultsfile = "batchsim.csv";
+		if (!argmap["-batchout"].empty())
+			resultsfile = argmap["-batchout"];
+
+		std::ofstream results(resultsfile.c_str());
+		if (!results)
+		{
+			error_output << "Couldn't open batch results file: " << resultsfile << std::endl;
+		}
+		else
+		{
+			BatchSimulation(
+				carnames, argmap["-batchtrack"], threads,
+				pathmanager, content, results,
+				info_output, error_output);
+			info_output << "Batch results written to: " << resultsfile << std::endl;
+		}
+		continue_game = false;
+	}
+	arghelp["-batchsim CARS"] = "Run headless performance tests on comma separated CARS (CarDir/Variant).";
+	arghelp["-batchtrack TRACK"] = "Add a timed AI lap on TRACK to the -batchsim tests.";
+	arghelp["-batchthreads N"] = "Number of threads for -batchsim, defaults to the number of processors.";
+	arghelp["-batchout FILE"] = "Write -batchsim results as CSV to FILE, defaults to batchsim.csv.";
+
+	if (argmap.find("-benchmark") != argmap.end() && argmap.find("-headless") != argmap.end())
+	{
+		// sound buffers are prepared for the mixer running without a device
+		pathmanager.Init(info_output, error_output);
+		InitHeadlessContent(pathmanager, content);
+		content.getFactory<SoundBuffer>().init(SoundInfo(0, 44100, 2, 2));
+
+		std::string replayfile = argmap["-benchmark"];
+		if (replayfile.empty())
+			replayfile = pathmanager.GetReplayPath() + "/benchmark.vdr";
+		std::string reportfile = "benchmark.json";
+		if (!argmap["-benchmarkout"].empty())
+			reportfile = argmap["-benchmarkout"];
+
+		std::ofstream report(reportfile.c_str());
+		if (!report)
+		{
+			error_output << "Couldn't open benchmark report file: " << reportfile << std::endl;
+		}
+		else if (ReplayBenchmark(replayfile, pathmanager, content, report, info_output, error_output))
+		{
+			info_output << "Benchmark report written to: " << reportfile << std::endl;
+		}
+		continue_game = false;
+	}
+	arghelp["-headless"] = "Run -benchmark without window, graphics or sound device, as fast as possible.";
+	arghelp["-benchmarkout FILE"] = "Write the -headless -benchmark report as JSON to FILE, defaults to benchmark.json.";
+
+	if (!argmap["-soundbenchmark"].empty())
+	{
+		// mixing only, the sound device isn't opened
+		std::tr1::shared_ptr<SoundBuffer> buffer(new SoundBuffer());
+		if (buffer->Load(argmap["-soundbenchmark"], SoundInfo(0, 44100, 2, 2), error_output))
+		{
+			Sound::Benchmark(buffer, info_output);
+		}
+		continue_game = false;
+	}
+	arghelp["-soundbenchmark FILE"] = "Measure sound mixing cost per source with the given wav or ogg FILE.";
+
+	if (!argmap["-pack"].empty())
+	{
+		// dir.vda is used in place of dir from now on
+		std::string dir = argmap["-pack"];
+		while (dir.length() > 1 && (dir[dir.length() - 1] == '/' || dir[dir.length() - 1] == '\\'))
+			dir.erase(dir.length() - 1);
+
+		std::vector<std::string> files;
+		ListFiles(pathmanager, dir, "", files);
+		const std::string archivepath = dir + ".vda";
+		if (files.empty())
+		{
+			error_output << "No files to pack in " << dir << std::endl;
+		}
+		else if (Archive::Pack(dir, files, archivepath, argmap.find("-packstore") == argmap.end(), error_output))
+		{
+			info_output << "Packed " << files.size() << " files into " << archivepath << std::endl;
+		}
+		continue_game = false;
+	}
+	arghelp["-pack DIR"] = "Pack the files in DIR into the archive DIR.vda, which is then used instead of DIR.";
+	arghelp["-packstore"] = "Don't compress files packed with -pack.";
+
+	if (!argmap["-convertreplay"].empty())
+	{
+		const std::string replayfile = argmap["-convertreplay"];
+		if (replay.Convert(replayfile, replayfile, error_output))
+		{
+			info_output << "Converted replay " << replayfile << std::endl;
+		}
+		continue_game = false;
+	}
+	arghelp["-convertreplay FILE"] = "Rewrite the replay FILE in the current replay format.";
+
 	if (!argmap["-profile"].empty())
 	{
 		pathmanager.SetProfile(argmap["-profile"]);
@@ -630,10 +813,13 @@ bool Game::ParseArguments(std::list <std::string> & args)
 
 	if (argmap.find("-profiling") != argmap.end() || argmap.find("-benchmark") != argmap.end())
 	{
-		PROFILER.init(20);
+		PROFILER.Enable(0.95f);
 		profilingmode = true;
+		profiling_trace = argmap["-profiling"];
+		if (!profiling_trace.empty())
+			PROFILER.StartCapture(1 << 20);
 	}
-	arghelp["-profiling"] = "Display game performance data.";
+	arghelp["-profiling [FILE]"] = "Display game performance data, FILE captures the first events as chrome trace.";
 
 	if (argmap.find("-dumpfps") != argmap.end())
 	{
@@ -690,12 +876,12 @@ bool Game::ParseArguments(std::list <std::string> & args)
 		sound.Disable();
 	arghelp["-nosound"] = "Disable all sound.";
 
-	if (argmap.find("-benchmark") != argmap.end())
+	if (argmap.find("-benchmark") != argmap.end() && continue_game)
 	{
 		info_output << "Entering benchmark mode." << std::endl;
 		benchmode = true;
 	}
-	arghelp["-benchmark"] = "Run in benchmark mode.";
+	arghelp["-benchmark [REPLAY]"] = "Run in benchmark mode, -headless runs REPLAY instead of replays/benchmark.vdr.";
 
 	arghelp["-render FILE"] = "Load the specified render configuration file instead of the default gl3/deferred.conf.";
 	if (!argmap["-render"].empty())
@@ -755,56 +941,62 @@ void Game::Test()
 
 void Game::Draw(float dt)
 {
+	PROFILE_ZONE("draw");
+
 	// Send scene information to the graphics subsystem.
-	PROFILER.beginBlock("render setup");
-	if (active_camera)
 	{
-		float fov = active_camera->GetFOV() > 0 ? active_camera->GetFOV() : settings.GetFOV();
+		PROFILE_ZONE("render setup");
+		if (active_camera)
+		{
+			float fov = active_camera->GetFOV() > 0 ? active_camera->GetFOV() : settings.GetFOV();
 
-		Vec3 reflection_sample_location = active_camera->GetPosition();
-		if (carcontrols_local.first)
-			reflection_sample_location = carcontrols_local.first->GetCenterOfMassPosition();
+			Vec3 reflection_sample_location = active_camera->GetPosition();
+			if (carcontrols_local.first)
+				reflection_sample_location = carcontrols_local.first->GetCenterOfMassPosition();
 
-		Quat camlook;
-		camlook.Rotate(M_PI_2, 1, 0, 0);
-		Quat camorient = -(active_camera->GetOrientation() * camlook);
-		graphics_interface->SetupScene(fov, settings.GetViewDistance(), active_camera->GetPosition(), camorient, reflection_sample_location);
-	}
-	else
-		graphics_interface->SetupScene(settings.GetFOV(), settings.GetViewDistance(), Vec3 (), Quat (), Vec3 ());
+			Quat camlook;
+			camlook.Rotate(M_PI_2, 1, 0, 0);
+			Quat camorient = -(active_camera->GetOrientation() * camlook);
+			graphics_interface->SetupScene(fov, settings.GetViewDistance(), active_camera->GetPosition(), camorient, reflection_sample_location);
+		}
+		else
+			graphics_interface->SetupScene(settings.GetFOV(), settings.GetViewDistance(), Vec3 (), Quat (), Vec3 ());
 
-	graphics_interface->SetContrast(settings.GetContrast());
-	graphics_interface->UpdateScene(dt);
-	PROFILER.endBlock("render setup");
+		graphics_interface->SetContrast(settings.GetContrast());
+		graphics_interface->UpdateScene(dt);
+	}
 
-	PROFILER.beginBlock("scenegraph");
-	TraverseScene<true>(debugnode, graphics_interface->GetDynamicDrawlist());
-	TraverseScene<false>(gui.GetNode(), graphics_interface->GetDynamicDrawlist());
-	TraverseScene<false>(track.GetRacinglineNode(), graphics_interface->GetDynamicDrawlist());
-	TraverseScene<false>(dynamicsdraw.getNode(), graphics_interface->GetDynamicDrawlist());
+	{
+		PROFILE_ZONE("scenegraph");
+		TraverseScene<true>(debugnode, graphics_interface->GetDynamicDrawlist());
+		TraverseScene<false>(gui.GetNode(), graphics_interface->GetDynamicDrawlist());
+		TraverseScene<false>(track.GetRacinglineNode(), graphics_interface->GetDynamicDrawlist());
+		TraverseScene<false>(dynamicsdraw.getNode(), graphics_interface->GetDynamicDrawlist());
 #ifndef USE_STATIC_OPTIMIZATION_FOR_TRACK
-	TraverseScene<false>(track.GetTrackNode(), graphics_interface->GetDynamicDrawlist());
+		TraverseScene<false>(track.GetTrackNode(), graphics_interface->GetDynamicDrawlist());
 #endif
-	TraverseScene<false>(track.GetBodyNode(), graphics_interface->GetDynamicDrawlist());
-	TraverseScene<false>(hud.GetNode(), graphics_interface->GetDynamicDrawlist());
-	TraverseScene<false>(trackmap.GetNode(), graphics_interface->GetDynamicDrawlist());
-	TraverseScene<false>(inputgraph.GetNode(), graphics_interface->GetDynamicDrawlist());
-	TraverseScene<false>(tire_smoke.GetNode(), graphics_interface->GetDynamicDrawlist());
-	for (std::list <Car>::iterator i = cars.begin(); i != cars.end(); ++i)
-	{
-		TraverseScene<false>(i->GetNode(), graphics_interface->GetDynamicDrawlist());
+		TraverseScene<false>(track.GetBodyNode(), graphics_interface->GetDynamicDrawlist());
+		TraverseScene<false>(hud.GetNode(), graphics_interface->GetDynamicDrawlist());
+		TraverseScene<false>(trackmap.GetNode(), graphics_interface->GetDynamicDrawlist());
+		TraverseScene<false>(inputgraph.GetNode(), graphics_interface->GetDynamicDrawlist());
+		TraverseScene<false>(tire_smoke.GetNode(), graphics_interface->GetDynamicDrawlist());
+		for (std::list <Car>::iterator i = cars.begin(); i != cars.end(); ++i)
+		{
+			TraverseScene<false>(i->GetNode(), graphics_interface->GetDynamicDrawlist());
+		}
+		//gui.GetNode().DebugPrint(info_output);
 	}
-	//gui.GetNode().DebugPrint(info_output);
-	PROFILER.endBlock("scenegraph");
 
 	// Sync CPU and GPU (flip the page).
-	PROFILER.beginBlock("render sync");
-	window.SwapBuffers();
-	PROFILER.endBlock("render sync");
+	{
+		PROFILE_ZONE("render sync");
+		window.SwapBuffers();
+	}
 
-	PROFILER.beginBlock("render draw");
-	graphics_interface->DrawScene(error_output);
-	PROFILER.endBlock("render draw");
+	{
+		PROFILE_ZONE("render draw");
+		graphics_interface->DrawScene(error_output);
+	}
 }
 
 /* The main game loop... */
@@ -825,7 +1017,7 @@ void Game::MainLoop()
 
 		eventsystem.EndFrame();
 
-		PROFILER.endCycle();
+		PROFILER.EndFrame();
 
 		displayframe++;
 	}
@@ -834,6 +1026,8 @@ void Game::MainLoop()
 /* Deltat is in seconds... */
 void Game::Tick(float deltat)
 {
+	PROFILE_ZONE("tick");
+
 	// This is the minimum fps the game will run at before it starts slowing down time.
 	const float minfps = 10.0f;
 	// Slow the game down if we can't process fast enough.
@@ -882,75 +1076,83 @@ void Game::Tick(float deltat)
 /* Increment game logic by one frame... */
 void Game::AdvanceGameLogic()
 {
-	//PROFILER.beginBlock("input-processing");
-
-	eventsystem.ProcessEvents();
+	PROFILE_ZONE("logic");
 
-	float last_steer = 0;
-	float car_speed = 0;
-	if (carcontrols_local.first)
 	{
-		last_steer = carcontrols_local.first->GetLastSteer();
-		car_speed = carcontrols_local.first->GetSpeed();
-	}
-	carcontrols_local.second.ProcessInput(
-			settings.GetJoyType(),
-			eventsystem,
-			last_steer,
-			timestep,
-			settings.GetJoy200(),
-			car_speed,
-			settings.GetSpeedSensitivity(),
-			window.GetW(),
-			window.GetH(),
-			settings.GetButtonRamp(),
-			settings.GetHGateShifter());
+		PROFILE_ZONE("input");
 
-	ProcessGUIInputs();
+		eventsystem.ProcessEvents();
+
+		float last_steer = 0;
+		float car_speed = 0;
+		if (carcontrols_local.first)
+		{
+			last_steer = carcontrols_local.first->GetLastSteer();
+			car_speed = carcontrols_local.first->GetSpeed();
+		}
+		carcontrols_local.second.ProcessInput(
+				settings.GetJoyType(),
+				eventsystem,
+				last_steer,
+				timestep,
+				settings.GetJoy200(),
+				car_speed,
+				settings.GetSpeedSensitivity(),
+				window.GetW(),
+				window.GetH(),
+				settings.GetButtonRamp(),
+				settings.GetHGateShifter());
 
-	ProcessGameInputs();
+		ProcessGUIInputs();
 
-	//PROFILER.endBlock("input-processing");
+		ProcessGameInputs();
+	}
 
 	if (track.Loaded() && !pause && !gui.Active())
 	{
-		PROFILER.beginBlock("ai");
-		ai.Visualize();
-		ai.update(timestep, cars);
-		PROFILER.endBlock("ai");
+		{
+			PROFILE_ZONE("ai");
+			ai.Visualize();
+			ai.update(timestep, cars);
+		}
 
-		PROFILER.beginBlock("physics");
-		dynamics.update(timestep);
-		PROFILER.endBlock("physics");
+		{
+			PROFILE_ZONE("physics");
+			dynamics.update(timestep);
+		}
 
-		PROFILER.beginBlock("car");
-		unsigned carid = 0;
-		for (std::list <Car>::iterator i = cars.begin(); i != cars.end(); ++i)
 		{
-			UpdateCar(carid++, *i, timestep);
+			PROFILE_ZONE("car");
+			unsigned carid = 0;
+			for (std::list <Car>::iterator i = cars.begin(); i != cars.end(); ++i)
+			{
+				UpdateCar(carid++, *i, timestep);
+			}
 		}
-		PROFILER.endBlock("car");
 
 		// Update dynamic track objects.
 		track.Update();
 
-		//PROFILER.beginBlock("timer");
-		UpdateTimer();
-		//PROFILER.endBlock("timer");
+		{
+			PROFILE_ZONE("timer");
+			UpdateTimer();
+		}
 
-		//PROFILER.beginBlock("particles");
-		UpdateParticles(timestep);
-		//PROFILER.endBlock("particles");
+		{
+			PROFILE_ZONE("particles");
+			UpdateParticles(timestep);
+		}
 
-		//PROFILER.beginBlock("trackmap-update");
-		UpdateTrackMap();
-		//PROFILER.endBlock("trackmap-update");
+		{
+			PROFILE_ZONE("trackmap");
+			UpdateTrackMap();
+		}
 	}
 
 	if (sound.Enabled())
 	{
+		PROFILE_ZONE("sound");
 		bool pause_sound = pause || gui.Active();
-		PROFILER.beginBlock("sound");
 		Vec3 pos;
 		Quat rot;
 		if (active_camera)
@@ -961,12 +1163,12 @@ void Game::AdvanceGameLogic()
 		sound.SetListenerPosition(pos[0], pos[1], pos[2]);
 		sound.SetListenerRotation(rot[0], rot[1], rot[2], rot[3]);
 		sound.Update(pause_sound);
-		PROFILER.endBlock("sound");
 	}
 
-	//PROFILER.beginBlock("force-feedback");
-	UpdateForceFeedback(timestep);
-	//PROFILER.endBlock("force-feedback");
+	{
+		PROFILE_ZONE("force feedback");
+		UpdateForceFeedback(timestep);
+	}
 }
 
 /* Process inputs used only for higher level game functions... */
@@ -1030,6 +1232,45 @@ void Game::ProcessGameInputs()
 			pause = !pause;
 		}
 	}
+
+	// Replay seeking, also possible once the replay has finished.
+	if (replay.GetSeekable() && track.Loaded() && !gui.Active())
+	{
+		const unsigned step = 10 / timestep;
+		const unsigned frame = replay.GetFrame();
+		if (carcontrols_local.second.GetInput(GameInput::REPLAY_FF) == 1.0)
+		{
+			SeekReplay(std::min(frame + step, replay.GetLength()));
+		}
+		else if (carcontrols_local.second.GetInput(GameInput::REPLAY_RW) == 1.0)
+		{
+			SeekReplay(frame > step ? frame - step : 0);
+		}
+	}
+}
+
+/* Restore the closest replay state frame and simulate forward to the requested frame... */
+void Game::SeekReplay(unsigned frame)
+{
+	PROFILE_ZONE("replay seek");
+
+	replay.Seek(frame, cars);
+
+	// At most one state frame interval of physics, no graphics or sound updates.
+	std::vector <float> carinputs(CarInput::INVALID, 0.0f);
+	while (replay.GetPlaying() && replay.GetFrame() < frame)
+	{
+		dynamics.update(timestep);
+
+		unsigned carid = 0;
+		for (std::list <Car>::iterator i = cars.begin(); i != cars.end(); ++i)
+		{
+			const std::vector<float> & inputs = replay.PlayFrame(carid++, *i);
+			assert(inputs.size() <= carinputs.size());
+			std::copy(inputs.begin(), inputs.end(), carinputs.begin());
+			i->Update(carinputs);
+		}
+	}
 }
 
 void Game::UpdateTimer()
@@ -1604,7 +1845,8 @@ bool Game::NewGame(bool playreplay, bool addopponents, int num_laps)
 			}
 		}
 
-		replay.StartRecording(car_info, settings.GetTrack(), error_output);
+		const std::string recordingname = pathmanager.GetReplayPath() + "/recording.vdr.part";
+		replay.StartRecording(car_info, settings.GetTrack(), recordingname, error_output);
 	}
 
 	content.sweep();
@@ -1686,6 +1928,7 @@ bool Game::LoadCar(
 		error_output << "Failed to load physics for car " << info.name << std::endl;
 		return false;
 	}
+	car.SetTireTables(settings.GetTireTables());
 
 	info_output << "Car loading was successful: " << info.name << std::endl;
 	if (!isai)
@@ -1720,17 +1963,12 @@ bool Game::LoadTrack(const std::string & trackname)
 		return false;
 	}
 
+	// each call loads objects for a fixed time slice, so the screen can be updated every time
 	bool success = true;
-	int count = 0;
 	while (!track.Loaded() && success)
 	{
-		int displayevery = track.ObjectsNum() / 50;
-		if (displayevery == 0 || count % displayevery == 0)
-		{
-			ShowLoadingScreen(count, track.ObjectsNum(), false, "", 0.5, 0.5);
-		}
+		ShowLoadingScreen(track.ObjectsNumLoaded(), std::max(track.ObjectsNum(), 1), false, "", 0.5, 0.5);
 		success = track.ContinueDeferredLoad();
-		count++;
 	}
 
 	if (!success)
@@ -1801,17 +2039,12 @@ void Game::LoadGarage()
 		return;
 	}
 
+	// each call loads objects for a fixed time slice, so the screen can be updated every time
 	bool success = true;
-	int count = 0;
 	while (!track.Loaded() && success)
 	{
-		int displayevery = track.ObjectsNum() / 50;
-		if (displayevery == 0 || count % displayevery == 0)
-		{
-			ShowLoadingScreen(count, track.ObjectsNum(), false, "", 0.5, 0.5);
-		}
+		ShowLoadingScreen(track.ObjectsNumLoaded(), std::max(track.ObjectsNum(), 1), false, "", 0.5, 0.5);
 		success = track.ContinueDeferredLoad();
-		count++;
 	}
 
 	if (!success)
@@ -1938,9 +2171,8 @@ void Game::CalculateFPS()
 
 	if (profilingmode && frame % 10 == 0)
 	{
-		std::string cpuProfile = PROFILER.getAvgSummary(quickprof::MICROSECONDS);
 		std::stringstream summary;
-		summary << "CPU:\n" << cpuProfile << "\n\nGPU:\n";
+		summary << "CPU (ms):\n" << PROFILER.GetSummary() << "\nGPU:\n";
 		graphics_interface->printProfilingInfo(summary);
 		profiling_text.Revise(summary.str());
 	}
@@ -2249,6 +2481,7 @@ void Game::ProcessNewSettings()
 
 	sound.SetVolume(settings.GetSoundVolume());
 	sound.SetMaxActiveSources(settings.GetMaxSoundSources());
+	sound.SetCubicInterpolation(settings.GetSoundCubicInterpolation());
 }
 
 void Game::ShowHUD(bool value)
@@ -2435,7 +2668,9 @@ void Game::UpdateParticleGraphics()
 		Vec3 campos = active_camera->GetPosition();
 		float znear = 0.1f; // hardcoded in graphics
 		float zfar = settings.GetViewDistance();
-		tire_smoke.UpdateGraphics(camorient, campos, znear, zfar);
+		float fov = active_camera->GetFOV() > 0 ? active_camera->GetFOV() : settings.GetFOV();
+		float aspect = window.GetW() / float(window.GetH());
+		tire_smoke.UpdateGraphics(camorient, campos, znear, zfar, fov, aspect);
 	}
 }
 
@@ -2544,7 +2779,7 @@ void Game::LeaveGame()
 		gui.SetOptionValues("game.selected_replay", "", replaylist, error_output);
 	}
 
-	if (replay.GetPlaying())
+	if (replay.GetSeekable())
 		replay.Reset();
 
 	gui.SetInGame(false);
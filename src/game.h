@@ -109,6 +109,8 @@ private:
 
 	void ProcessGameInputs();
 
+	void SeekReplay(unsigned frame);
+
 	void UpdateStartList();
 
 	void UpdateCarPosList();
@@ -296,6 +298,7 @@ private:
 
 	bool multithreaded;
 	bool profilingmode;
+	std::string profiling_trace;
 	bool debugmode;
 	bool benchmode;
 	bool dumpfps;
@@ -328,6 +331,7 @@ private:
 	DynamicsDraw dynamicsdraw;
 	DynamicsWorld dynamics;
 	int dynamics_drawmode;
+	Parallel::JobSystem jobs;
 
 	ParticleSystem tire_smoke;
 	unsigned int particle_timer;
@@ -145,6 +145,31 @@ void GLWrapper::drawGeometry(GLuint vao, GLuint elementCount)
 	GLLOG(glDrawElements(GL_TRIANGLES, elementCount, GL_UNSIGNED_INT, 0));ERROR_CHECK2(vao,elementCount);
 }
 
+void GLWrapper::drawGeometryInstanced(GLuint vao, GLuint elementCount, GLuint transformAttribute, GLuint transformBuffer, GLuint firstInstance, GLuint instanceCount)
+{
+	GLLOG(glBindVertexArray(vao));ERROR_CHECK1(vao);
+
+	// A mat4 attribute takes four locations, one per column.
+	const GLsizei stride = 16*sizeof(GLfloat);
+	const char * offset = (const char *)0 + firstInstance*stride;
+	GLLOG(glBindBuffer(GL_ARRAY_BUFFER, transformBuffer));ERROR_CHECK;
+	for (GLuint i = 0; i < 4; i++)
+	{
+		GLLOG(glVertexAttribPointer(transformAttribute+i, 4, GL_FLOAT, GL_FALSE, stride, offset+i*4*sizeof(GLfloat)));ERROR_CHECK;
+		GLLOG(glVertexAttribDivisor(transformAttribute+i, 1));ERROR_CHECK;
+		GLLOG(glEnableVertexAttribArray(transformAttribute+i));ERROR_CHECK;
+	}
+	GLLOG(glBindBuffer(GL_ARRAY_BUFFER, 0));ERROR_CHECK;
+
+	GLLOG(glDrawElementsInstanced(GL_TRIANGLES, elementCount, GL_UNSIGNED_INT, 0, instanceCount));ERROR_CHECK2(vao,elementCount);
+
+	for (GLuint i = 0; i < 4; i++)
+	{
+		GLLOG(glDisableVertexAttribArray(transformAttribute+i));ERROR_CHECK;
+		GLLOG(glVertexAttribDivisor(transformAttribute+i, 0));ERROR_CHECK;
+	}
+}
+
 void GLWrapper::unbindFramebuffer()
 {
 	GLLOG(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0));ERROR_CHECK;
@@ -465,6 +490,12 @@ GLint GLWrapper::GetUniformLocation(GLuint shaderProgram, const std::string & un
 	return result;
 }
 
+GLint GLWrapper::GetAttribLocation(GLuint shaderProgram, const std::string & attributeName)
+{
+	GLint result = GLLOG(glGetAttribLocation(shaderProgram, attributeName.c_str()));ERROR_CHECK;
+	return result;
+}
+
 GLuint GLWrapper::GenFramebuffer()
 {
 	GLuint result(0);
@@ -584,6 +615,33 @@ void GLWrapper::DisableVertexAttribArray(GLuint i)
 	GLLOG(glDisableVertexAttribArray(i));ERROR_CHECK;
 }
 
+void GLWrapper::VertexAttrib4fv(GLuint i, const GLfloat * v)
+{
+	GLLOG(glVertexAttrib4fv(i, v));ERROR_CHECK;
+}
+
+GLuint GLWrapper::GenBuffer()
+{
+	GLuint result;
+	GLLOG(glGenBuffers(1, &result));ERROR_CHECK;
+	return result;
+}
+
+void GLWrapper::DeleteBuffer(GLuint handle)
+{
+	GLLOG(glDeleteBuffers(1, &handle));ERROR_CHECK;
+}
+
+void GLWrapper::BindBuffer(GLenum target, GLuint handle)
+{
+	GLLOG(glBindBuffer(target, handle));ERROR_CHECK;
+}
+
+void GLWrapper::BufferData(GLenum target, GLsizeiptr size, const GLvoid * data, GLenum usage)
+{
+	GLLOG(glBufferData(target, size, data, usage));ERROR_CHECK;
+}
+
 void GLWrapper::DrawElements(GLenum mode, GLsizei count, GLenum type, const void * indices)
 {
 	GLLOG(glDrawElements(mode, count, type, indices));ERROR_CHECK;
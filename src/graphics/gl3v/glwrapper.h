@@ -61,6 +61,11 @@ public:
 	/// Draws a vertex array object.
 	void drawGeometry(GLuint vao, GLuint elementCount);
 
+	/// Draws instanceCount instances of a vertex array object.
+	/// The mat4 vertex attribute at transformAttribute (and the three locations after it) is fed per instance from transformBuffer, starting at the firstInstance'th matrix.
+	/// The attribute arrays are disabled again afterwards, so the vertex array object is left as it was.
+	void drawGeometryInstanced(GLuint vao, GLuint elementCount, GLuint transformAttribute, GLuint transformBuffer, GLuint firstInstance, GLuint instanceCount);
+
 	void unbindFramebuffer();
 
 	void unbindTexture(GLenum target);
@@ -118,6 +123,7 @@ public:
 	GLuint CreateProgram();
 	void DeleteShader(GLuint handle);
 	GLint GetUniformLocation(GLuint shaderProgram, const std::string & uniformName);
+	GLint GetAttribLocation(GLuint shaderProgram, const std::string & attributeName);
 	GLuint GenFramebuffer();
 	void GetIntegerv(GLenum pname, GLint * params) const;
 	void DrawBuffers(GLsizei n, const GLenum * bufs);
@@ -140,6 +146,11 @@ public:
 	void VertexAttribPointer(GLuint i, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void * pointer);
 	void EnableVertexAttribArray(GLuint i);
 	void DisableVertexAttribArray(GLuint i);
+	void VertexAttrib4fv(GLuint i, const GLfloat * v);
+	GLuint GenBuffer();
+	void DeleteBuffer(GLuint handle);
+	void BindBuffer(GLenum target, GLuint handle);
+	void BufferData(GLenum target, GLsizeiptr size, const GLvoid * data, GLenum usage);
 	void DrawElements(GLenum mode, GLsizei count, GLenum type, const void * indices);
 	void DrawArrays(GLenum mode, GLint first, GLsizei count);
 	void DeleteQuery(GLuint handle);
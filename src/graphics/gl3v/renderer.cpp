@@ -167,6 +167,23 @@ void Renderer::render(unsigned int w, unsigned int h, StringIdMap & stringMap, c
 	}
 }
 
+void Renderer::render(unsigned int w, unsigned int h, StringIdMap & stringMap, const std::vector <std::vector <const std::vector <RenderModelExt*>*> > & externalModels, std::ostream & errorOutput)
+{
+	static const std::vector <const std::vector <RenderModelExt*>*> emptyDrawList;
+	for (unsigned int i = 0; i < passes.size(); i++)
+	{
+		const std::vector <const std::vector <RenderModelExt*>*> & drawList = (i < externalModels.size()) ? externalModels[i] : emptyDrawList;
+		if (passes[i].render(gl, w, h, stringMap, drawList, sharedTextures, errorOutput))
+		{
+			// Render targets have been recreated due to display dimension change.
+			// Call setGlobalTexture to update sharedTextures and let downstream passes know.
+			const std::map <StringId, RenderTexture> & passRTs = passes[i].getRenderTargets();
+			for (std::map <StringId, RenderTexture>::const_iterator rt = passRTs.begin(); rt != passRTs.end(); rt++)
+				setGlobalTexture(rt->first, RenderTextureEntry(rt->first, rt->second.handle, rt->second.target));
+		}
+	}
+}
+
 RenderModelHandle Renderer::addModel(const RenderModelEntry & entry)
 {
 	RenderModelHandle handle = models.insert(entry);
@@ -456,7 +473,7 @@ void Renderer::printRendererStatus(RendererStatusVerbosity verbosity, const Stri
 void Renderer::printProfilingInfo(std::ostream & out) const
 {
 	for (std::vector <RenderPass>::const_iterator i = passes.begin(); i != passes.end(); i++)
-		out << i->getName() << ": " << i->getLastTime()*1e6 << " us" << std::endl;
+		out << i->getName() << ": " << i->getLastTime()*1e6 << " us, " << i->getLastDrawCalls() << " draws, " << i->getLastDrawCallsSaved() << " saved by instancing" << std::endl;
 }
 
 bool Renderer::loadShader(const std::string & path, const std::string & name, const std::set <std::string> & defines, GLenum shaderType, std::ostream & errorOutput)
@@ -55,6 +55,12 @@ public:
 	/// externalModels is a map of pass ID to a map of draw group name ID and a pointer to a vector array of pointers to external models to be drawn along with models that have been added to the pass with addModel.
 	void render(unsigned int w, unsigned int h, StringIdMap & stringMap, const std::map <StringId, std::map <StringId, std::vector <RenderModelExt*> *> > & externalModels, std::ostream & errorOutput);
 
+	/// Render all passes.
+	/// w and h are the width and height of the application's window.
+	/// externalModels is indexed by pass index (the order of getPassNames) and holds the draw lists of each pass, to be drawn along with models that have been added to the pass with addModel.
+	/// Unlike the map versions, this doesn't allocate memory.
+	void render(unsigned int w, unsigned int h, StringIdMap & stringMap, const std::vector <std::vector <const std::vector <RenderModelExt*>*> > & externalModels, std::ostream & errorOutput);
+
 	/// Cleanup all data.
 	void clear();
 
@@ -18,6 +18,8 @@
 /************************************************************************/
 
 #include "rendermodelext.h"
+#include "unittest.h"
+#include <cstring>
 
 RenderModelExt::RenderModelExt() : vao(0), elementCount(0), enabled(false)
 {
@@ -53,6 +55,82 @@ void RenderModelExt::setVertexArrayObject(GLuint newVao, unsigned int newElement
 		enabled = true;
 }
 
+bool RenderModelExt::instanceable() const
+{
+	return vao != 0;
+}
+
+const RenderUniformEntry * RenderModelExt::getUniform(StringId name) const
+{
+	for (std::vector <RenderUniformEntry>::const_iterator u = uniforms.begin(); u != uniforms.end(); u++)
+		if (u->name == name)
+			return &*u;
+	return NULL;
+}
+
+// FNV-1a over the bytes of a value.
+template <typename T>
+static void hashCombine(std::size_t & hash, const T & value)
+{
+	const unsigned char * bytes = reinterpret_cast<const unsigned char *>(&value);
+	for (unsigned int i = 0; i < sizeof(T); i++)
+		hash = (hash ^ bytes[i]) * 16777619u;
+}
+
+std::size_t RenderModelExt::instanceHash(StringId transformName) const
+{
+	std::size_t hash = 2166136261u;
+	hashCombine(hash, vao);
+	hashCombine(hash, elementCount);
+	for (std::vector <RenderTextureEntry>::const_iterator t = textures.begin(); t != textures.end(); t++)
+	{
+		hashCombine(hash, StringId::hash()(t->name));
+		hashCombine(hash, t->handle);
+		hashCombine(hash, t->target);
+	}
+	for (std::vector <RenderUniformEntry>::const_iterator u = uniforms.begin(); u != uniforms.end(); u++)
+	{
+		if (u->name == transformName)
+			continue;
+		hashCombine(hash, StringId::hash()(u->name));
+		for (RenderUniformVector <float>::const_iterator f = u->data.begin(); f != u->data.end(); f++)
+			hashCombine(hash, *f);
+	}
+	return hash;
+}
+
+bool RenderModelExt::instanceMatch(const RenderModelExt & other, StringId transformName) const
+{
+	if (vao != other.vao || elementCount != other.elementCount || textures.size() != other.textures.size())
+		return false;
+
+	for (unsigned int i = 0; i < textures.size(); i++)
+	{
+		const RenderTextureEntry & a = textures[i];
+		const RenderTextureEntry & b = other.textures[i];
+		if (!(a.name == b.name) || a.handle != b.handle || a.target != b.target)
+			return false;
+	}
+
+	// Compare the uniforms in order, skipping the transform on both sides.
+	std::vector <RenderUniformEntry>::const_iterator a = uniforms.begin();
+	std::vector <RenderUniformEntry>::const_iterator b = other.uniforms.begin();
+	while (true)
+	{
+		while (a != uniforms.end() && a->name == transformName)
+			a++;
+		while (b != other.uniforms.end() && b->name == transformName)
+			b++;
+		if (a == uniforms.end() || b == other.uniforms.end())
+			return a == uniforms.end() && b == other.uniforms.end();
+		if (!(a->name == b->name) || a->data.size() != b->data.size() ||
+			std::memcmp(a->data.begin(), b->data.begin(), a->data.size()*sizeof(float)) != 0)
+			return false;
+		a++;
+		b++;
+	}
+}
+
 void RenderModelExt::clearTextureCache()
 {
 	perPassTextureCache.clear();
@@ -62,3 +140,59 @@ void RenderModelExt::clearUniformCache()
 {
 	perPassUniformCache.clear();
 }
+
+// Exposes the texture and uniform lists for testing.
+struct InstanceTestModel : public RenderModelExt
+{
+	InstanceTestModel(GLuint vao) {setVertexArrayObject(vao, 3);}
+	void addTexture(const RenderTextureEntry & t) {textures.push_back(t);}
+	void addUniform(const RenderUniformEntry & u) {uniforms.push_back(u);}
+};
+
+QT_TEST(rendermodelext_instance_test)
+{
+	StringIdMap stringMap;
+	StringId transform = stringMap.addStringId("modelMatrix");
+	StringId color = stringMap.addStringId("colorTint");
+	StringId diffuse = stringMap.addStringId("diffuseTexture");
+	float matrixA[16] = {1,0,0,0, 0,1,0,0, 0,0,1,0, 1,2,3,1};
+	float matrixB[16] = {1,0,0,0, 0,1,0,0, 0,0,1,0, 4,5,6,1};
+	float red[4] = {1,0,0,1};
+	float blue[4] = {0,0,1,1};
+
+	// only the transform differs, or is missing
+	InstanceTestModel a(1), b(1), c(1);
+	a.addTexture(RenderTextureEntry(diffuse, 7, GL_TEXTURE_2D));
+	b.addTexture(RenderTextureEntry(diffuse, 7, GL_TEXTURE_2D));
+	c.addTexture(RenderTextureEntry(diffuse, 7, GL_TEXTURE_2D));
+	a.addUniform(RenderUniformEntry(transform, matrixA, 16));
+	a.addUniform(RenderUniformEntry(color, red, 4));
+	b.addUniform(RenderUniformEntry(color, red, 4));
+	b.addUniform(RenderUniformEntry(transform, matrixB, 16));
+	c.addUniform(RenderUniformEntry(color, red, 4));
+	QT_CHECK(a.instanceMatch(b, transform));
+	QT_CHECK(b.instanceMatch(a, transform));
+	QT_CHECK(a.instanceMatch(c, transform));
+	QT_CHECK_EQUAL(a.instanceHash(transform), b.instanceHash(transform));
+	QT_CHECK_EQUAL(a.instanceHash(transform), c.instanceHash(transform));
+	QT_CHECK(a.getUniform(transform));
+	QT_CHECK(!c.getUniform(transform));
+
+	// any other difference prevents instancing
+	InstanceTestModel d(1), e(1), f(2);
+	d.addTexture(RenderTextureEntry(diffuse, 8, GL_TEXTURE_2D));
+	d.addUniform(RenderUniformEntry(color, red, 4));
+	e.addTexture(RenderTextureEntry(diffuse, 7, GL_TEXTURE_2D));
+	e.addUniform(RenderUniformEntry(color, blue, 4));
+	f.addTexture(RenderTextureEntry(diffuse, 7, GL_TEXTURE_2D));
+	f.addUniform(RenderUniformEntry(color, red, 4));
+	QT_CHECK(!a.instanceMatch(d, transform));
+	QT_CHECK(!a.instanceMatch(e, transform));
+	QT_CHECK(!a.instanceMatch(f, transform));
+	QT_CHECK(a.instanceHash(transform) != e.instanceHash(transform));
+
+	// without a vertex array object the model can't be instanced
+	InstanceTestModel g(0);
+	QT_CHECK(a.instanceable());
+	QT_CHECK(!g.instanceable());
+}
@@ -45,6 +45,17 @@ public:
 	bool drawEnabled() const;
 	void setVertexArrayObject(GLuint newVao, unsigned int newElementCount);
 
+	/// Returns true if draw only draws the vertex array object, which lets a pass draw the model instanced instead.
+	virtual bool instanceable() const;
+
+	/// Returns NULL if the model has no uniform with this name.
+	const RenderUniformEntry * getUniform(StringId name) const;
+
+	/// Models can be drawn as instances of each other if they only differ in the per-instance transform uniform.
+	/// instanceHash hashes everything else, instanceMatch does the full comparison.
+	std::size_t instanceHash(StringId transformName) const;
+	bool instanceMatch(const RenderModelExt & other, StringId transformName) const;
+
 protected:
 	GLuint vao;
 	int elementCount;
@@ -21,6 +21,7 @@
 #include <tr1/unordered_set>
 #endif
 #include <cassert>
+#include <algorithm>
 #include "utils.h"
 #include "renderpass.h"
 #include "glenums.h"
@@ -29,9 +30,18 @@
 
 #define WAIT_ON_TIMER_QUERY true
 
+// The vertex shader attribute that makes a pass draw instanced, and the model uniform it replaces.
+#define INSTANCE_TRANSFORM_ATTRIBUTE "instanceModelMatrix"
+#define INSTANCE_TRANSFORM_UNIFORM "modelMatrix"
+
+// Model VAOs use the attribute locations below this one, the instance transform is bound past them
+// so instanced draws never change a VAO attribute. Its four locations fit the 16 that GL 3 guarantees.
+#define INSTANCE_TRANSFORM_MIN_LOCATION 8
+#define MAX_VERTEX_ATTRIBUTES 16
+
 const GLEnums GLEnumHelper;
 
-RenderPass::RenderPass() : configured(false), enabled(true), shaderProgram(0), framebufferObject(0), renderbuffer(0), passIndex(0), timerQuery(0), lastTime(-1)
+RenderPass::RenderPass() : configured(false), enabled(true), shaderProgram(0), framebufferObject(0), renderbuffer(0), instanceTransformAttribute(-1), instanceTransformBuffer(0), instanceReorder(false), passIndex(0), timerQuery(0), lastTime(-1), lastDrawCalls(0), lastDrawCallsSaved(0)
 {
 	// Constructor.
 }
@@ -65,7 +75,14 @@ bool RenderPass::initialize(int passCount, const RealtimeExportPassInfo & config
 		drawGroups.insert(stringMap.addStringId(*i));
 
 	// The shader program.
-	if (!createShaderProgram(gl, config.shaderAttributeBindings, vertexShader, fragmentShader, config.renderTargets, errorOutput))
+	std::vector <std::string> attributeBindings(config.shaderAttributeBindings);
+	const unsigned int instanceTransformLocation = std::max(attributeBindings.size(), size_t(INSTANCE_TRANSFORM_MIN_LOCATION));
+	if (instanceTransformLocation + 4 <= MAX_VERTEX_ATTRIBUTES)
+	{
+		attributeBindings.resize(instanceTransformLocation);
+		attributeBindings.push_back(INSTANCE_TRANSFORM_ATTRIBUTE);
+	}
+	if (!createShaderProgram(gl, attributeBindings, vertexShader, fragmentShader, config.renderTargets, errorOutput))
 	{
 		errorOutput << "Unable to create shader program" << std::endl;
 		return false;
@@ -143,6 +160,45 @@ bool RenderPass::initialize(int passCount, const RealtimeExportPassInfo & config
 			defaultTextureBindings.push_back(RenderTexture(tu, defaultTexIter->second));
 	}
 
+	// Size the per-frame state tracking to the highest uniform location and TU.
+	unsigned int uniformSlots = 0;
+	for (NameIdMap::const_iterator i = variableNameToUniformLocation.begin(); i != variableNameToUniformLocation.end(); i++)
+		uniformSlots = std::max(uniformSlots, i->second + 1);
+	defaultUniforms.assign(uniformSlots, NULL);
+	uniformState.assign(uniformSlots, NULL);
+	defaultTextures.assign(samplers.size(), NULL);
+	textureState.assign(samplers.size(), NULL);
+	overriddenTextures.reserve(samplers.size());
+	lastOverriddenTextures.reserve(samplers.size());
+	overriddenUniforms.reserve(uniformSlots);
+	lastOverriddenUniforms.reserve(uniformSlots);
+
+	// Instancing is used if the vertex shader takes the model transform as a per-instance attribute.
+	instanceTransformName = stringMap.addStringId(INSTANCE_TRANSFORM_UNIFORM);
+	instanceTransformAttribute = gl.GetAttribLocation(shaderProgram, INSTANCE_TRANSFORM_ATTRIBUTE);
+	if (instanceTransformAttribute >= 0 && GLuint(instanceTransformAttribute) != instanceTransformLocation)
+	{
+		// The linker placed it where it could overlap a VAO attribute.
+		errorOutput << INSTANCE_TRANSFORM_ATTRIBUTE << " overlaps the vertex attributes, the pass has " << config.shaderAttributeBindings.size() << " attribute bindings" << std::endl;
+		return false;
+	}
+	if (instanceTransformAttribute >= 0)
+	{
+		instanceTransformBuffer = gl.GenBuffer();
+
+		// Matching models are only batched out of order if the pass is depth tested and not blended.
+		instanceReorder = std::find(stateEnable.begin(), stateEnable.end(), GLenum(GL_DEPTH_TEST)) != stateEnable.end() &&
+			std::find(stateEnable.begin(), stateEnable.end(), GLenum(GL_BLEND)) == stateEnable.end();
+
+		// Models without a transform uniform use the pass default, or the identity.
+		std::map <std::string, RealtimeExportPassInfo::UniformData>::const_iterator transformIter = config.uniforms.find(INSTANCE_TRANSFORM_UNIFORM);
+		if (transformIter != config.uniforms.end() && transformIter->second.data.size() == 16)
+			std::copy(transformIter->second.data.begin(), transformIter->second.data.end(), instanceDefaultTransform);
+		else
+			for (int i = 0; i < 16; i++)
+				instanceDefaultTransform[i] = (i % 5 == 0) ? 1 : 0;
+	}
+
 	// By default, assume we're rendering to the framebuffer at the window resolution.
 	framebufferDimensions = RenderDimensions(1,1,true);
 
@@ -204,6 +260,21 @@ void RenderPass::clear(GLWrapper & gl)
 	defaultUniformBindings.clear();
 	defaultTextureBindings.clear(); // Any GL state that we own in defaultTextureBindings were deleted when we deleted our render targets.
 
+	// Instancing.
+	if (instanceTransformBuffer)
+		gl.DeleteBuffer(instanceTransformBuffer);
+	instanceTransformBuffer = 0;
+	instanceTransformAttribute = -1;
+	instanceEntries.clear();
+	instanceBatches.clear();
+	instanceTransforms.clear();
+
+	// Per-frame state tracking.
+	defaultUniforms.clear();
+	defaultTextures.clear();
+	textureState.clear();
+	uniformState.clear();
+
 	// Render states.
 	stateEnable.clear();
 	stateDisable.clear();
@@ -225,6 +296,9 @@ void RenderPass::clear(GLWrapper & gl)
 
 bool RenderPass::render(GLWrapper & gl, unsigned int w, unsigned int h, StringIdMap & stringMap, const std::vector <const std::vector <RenderModelExt*>*> & externalModels, const NameTexMap & sharedTextures, std::ostream & errorOutput)
 {
+	lastDrawCalls = 0;
+	lastDrawCallsSaved = 0;
+
 	if (!enabled)
 		return false;
 
@@ -286,10 +360,9 @@ bool RenderPass::render(GLWrapper & gl, unsigned int w, unsigned int h, StringId
 	gl.Clear(clearMask);
 
 	// Apply default uniforms.
-	std::vector <const RenderUniform*> defaultUniforms; // Indexed by location, either NULL or a pointer to the RenderUniform bound to the location.
+	std::fill(defaultUniforms.begin(), defaultUniforms.end(), (const RenderUniform*)NULL);
 	for (std::vector <RenderUniform>::const_iterator u = defaultUniformBindings.begin(); u != defaultUniformBindings.end(); u++)
 	{
-		defaultUniforms.resize(std::max(defaultUniforms.size(),(size_t)(u->location+1)),NULL);
 		defaultUniforms[u->location] = &*u;
 		gl.applyUniform(u->location, u->data);
 	}
@@ -305,23 +378,25 @@ bool RenderPass::render(GLWrapper & gl, unsigned int w, unsigned int h, StringId
 	}
 
 	// Apply default textures, keeping track of which textures are in which TUs.
-	std::vector <const RenderTexture*> defaultTextures; // Indexed by TU, either NULL or a pointer to the RenderTexture bound to the TU.
+	std::fill(defaultTextures.begin(), defaultTextures.end(), (const RenderTexture*)NULL);
 	for (std::vector <RenderTexture>::const_iterator t = defaultTextureBindings.begin(); t != defaultTextureBindings.end(); t++)
 	{
-		defaultTextures.resize(std::max(defaultTextures.size(),(size_t)(t->tu+1)),NULL);
 		defaultTextures[t->tu] = &*t;
 		applyTexture(gl, *t);
 	}
 
-	typedef std::vector <GLuint> override_tracking_type;
-	std::vector <const RenderTextureBase*> textureState(defaultTextures.begin(), defaultTextures.end()); //Indexed by tu.
-	textureState.resize(std::max(textureState.size(),samplers.size()),NULL);
-	std::vector <const RenderUniformBase*> uniformState(defaultUniforms.begin(), defaultUniforms.end()); //Indexed by location.
+	std::copy(defaultTextures.begin(), defaultTextures.end(), textureState.begin());
+	std::copy(defaultUniforms.begin(), defaultUniforms.end(), uniformState.begin());
 
-	override_tracking_type overriddenTextures;
-	override_tracking_type lastOverriddenTextures;
-	override_tracking_type overriddenUniforms;
-	override_tracking_type lastOverriddenUniforms;
+	overriddenTextures.clear();
+	lastOverriddenTextures.clear();
+	overriddenUniforms.clear();
+	lastOverriddenUniforms.clear();
+
+	// Models added with addModel aren't instanced, in instanced passes they get the default transform as a constant attribute.
+	if (instanceTransformAttribute >= 0)
+		for (unsigned int c = 0; c < 4; c++)
+			gl.VertexAttrib4fv(instanceTransformAttribute + c, instanceDefaultTransform + c*4);
 
 	// For each model.
 	for (keyed_container <RenderModel>::const_iterator m = models.begin(); m != models.end(); m++)
@@ -346,183 +421,271 @@ bool RenderPass::render(GLWrapper & gl, unsigned int w, unsigned int h, StringId
 
 		// Draw geometry.
 		gl.drawGeometry(m->vao, m->elementCount);
+		lastDrawCalls++;
 
 		// Restore overridden uniforms.
 		for (override_tracking_type::const_iterator location = overriddenUniforms.begin(); location != overriddenUniforms.end(); location++)
 		{
-			if (*location < defaultUniforms.size())
-			{
-				const RenderUniform * u = defaultUniforms[*location];
-				if (u)
-					gl.applyUniform(u->location, u->data);
-			}
+			const RenderUniform * u = defaultUniforms[*location];
+			if (u)
+				gl.applyUniform(u->location, u->data);
 		}
 
 		// Restore overridden textures.
 		for (override_tracking_type::const_iterator tu = overriddenTextures.begin(); tu != overriddenTextures.end(); tu++)
 		{
-			if (*tu < defaultTextures.size()) // Sometimes we override sampler TUs that don't have defaults defined (think of diffuse textures).
-			{
-				const RenderTexture * t = defaultTextures[*tu];
-				if (t)
-					applyTexture(gl, *t);
-			}
+			// Sometimes we override sampler TUs that don't have defaults defined (think of diffuse textures).
+			const RenderTexture * t = defaultTextures[*tu];
+			if (t)
+				applyTexture(gl, *t);
 		}
 	}
 
 	// For each external model.
-	for (std::vector <const std::vector <RenderModelExt*>*>::const_iterator i = externalModels.begin(); i != externalModels.end(); i++)
+	if (instanceTransformAttribute >= 0)
+		renderInstanced(gl, externalModels);
+	else
 	{
-		// Loop through all models in the draw group.
-		for (std::vector <RenderModelExt*>::const_iterator n = (*i)->begin(); n != (*i)->end(); n++)
+		for (std::vector <const std::vector <RenderModelExt*>*>::const_iterator i = externalModels.begin(); i != externalModels.end(); i++)
 		{
-			RenderModelExt * m = *n;
-			assert(m);
-
-			if (m->drawEnabled())
+			// Loop through all models in the draw group.
+			for (std::vector <RenderModelExt*>::const_iterator n = (*i)->begin(); n != (*i)->end(); n++)
 			{
-				// Restore textures that were overridden the by the previous model.
-				for (override_tracking_type::const_iterator tu = lastOverriddenTextures.begin(); tu != lastOverriddenTextures.end(); tu++)
-					if (*tu < defaultTextures.size()) // Sometimes we override sampler TUs that don't have defaults defined (think of diffuse textures).
-						textureState[*tu] = defaultTextures[*tu];
-					else
-						textureState[*tu] = NULL;
-
-				// Apply texture overrides, keeping track of which TUs we've overridden.
-				overriddenTextures.clear();
+				RenderModelExt * m = *n;
+				assert(m);
 
-				// Check if we have cached information and if so use that.
-#ifdef USE_EXTERNAL_MODEL_CACHE
-				if (m->perPassTextureCache.size() > passIndex)
+				if (m->drawEnabled())
 				{
-					const std::vector <RenderTexture> & cache = m->perPassTextureCache[passIndex];
-					for (std::vector <RenderTexture>::const_iterator t = cache.begin(); t != cache.end(); t++)
-					{
-						// Get the TU associated with this texture name id.
-						GLuint tu = t->tu;
-						overriddenTextures.push_back(tu);
-						textureState[tu] = &*t;
-					}
+					applyModelOverrides(gl, m);
+
+					// Draw geometry.
+					m->draw(gl);
+					lastDrawCalls++;
 				}
-				else
+			}
+		}
+	}
+
+	// Unbind framebuffer.
+	gl.unbindFramebuffer();
+
+	// TODO: We only want to do this if the next pass is going to use these and not write to these.
+	// If autoMipmap then build mipmaps.
+	for (std::vector <RenderTexture>::const_iterator t = autoMipMapRenderTargets.begin(); t != autoMipMapRenderTargets.end(); t++)
+		gl.generateMipmaps(t->target, t->handle);
+
+	// Unbind samplers.
+	for (unsigned int tu = 0; tu < samplers.size(); tu++)
+		gl.unbindSampler(tu);
+
+	gl.EndQuery(GL_TIME_ELAPSED);
+
+	return changed;
+}
+
+void RenderPass::applyModelOverrides(GLWrapper & gl, RenderModelExt * m)
+{
+	// Restore textures that were overridden the by the previous model.
+	// Sometimes we override sampler TUs that don't have defaults defined (think of diffuse textures), those are reset to NULL.
+	for (override_tracking_type::const_iterator tu = lastOverriddenTextures.begin(); tu != lastOverriddenTextures.end(); tu++)
+		textureState[*tu] = defaultTextures[*tu];
+
+	// Apply texture overrides, keeping track of which TUs we've overridden.
+	overriddenTextures.clear();
+
+	// Check if we have cached information and if so use that.
+#ifdef USE_EXTERNAL_MODEL_CACHE
+	if (m->perPassTextureCache.size() > passIndex)
+	{
+		const std::vector <RenderTexture> & cache = m->perPassTextureCache[passIndex];
+		for (std::vector <RenderTexture>::const_iterator t = cache.begin(); t != cache.end(); t++)
+		{
+			// Get the TU associated with this texture name id.
+			GLuint tu = t->tu;
+			overriddenTextures.push_back(tu);
+			textureState[tu] = &*t;
+		}
+	}
+	else
 #endif
-				{
-					for (std::vector <RenderTextureEntry>::const_iterator t = m->textures.begin(); t != m->textures.end(); t++)
-					{
-						// Get the TU associated with this texture name id.
-						NameIdMap::iterator tui = textureNameToTextureUnit.find(t->name);
-						if (tui != textureNameToTextureUnit.end()) // if the texture isn't used in this pass, it might not be in textureNameToTextureUnit.
-						{
-							GLuint tu = tui->second;
-							overriddenTextures.push_back(tu);
-							textureState[tu] = &*t;
+	{
+		for (std::vector <RenderTextureEntry>::const_iterator t = m->textures.begin(); t != m->textures.end(); t++)
+		{
+			// Get the TU associated with this texture name id.
+			NameIdMap::iterator tui = textureNameToTextureUnit.find(t->name);
+			if (tui != textureNameToTextureUnit.end()) // if the texture isn't used in this pass, it might not be in textureNameToTextureUnit.
+			{
+				GLuint tu = tui->second;
+				overriddenTextures.push_back(tu);
+				textureState[tu] = &*t;
 #ifdef USE_EXTERNAL_MODEL_CACHE
-							m->perPassTextureCache[passIndex].push_back(RenderTexture(tu, *t)); // Make cache entry.
+				m->perPassTextureCache[passIndex].push_back(RenderTexture(tu, *t)); // Make cache entry.
 #endif
-						}
-					}
-				}
+			}
+		}
+	}
 
-				// Go through and actually apply the textures to the GL.
-				for (override_tracking_type::const_iterator tu = lastOverriddenTextures.begin(); tu != lastOverriddenTextures.end(); tu++)
-				{
-					const RenderTextureBase * texture = textureState[*tu];
-					if (texture)
-						applyTexture(gl, *tu, texture->target, texture->handle);
-					else
-					{
-						gl.ActiveTexture(*tu);
-						gl.unbindTexture(GL_TEXTURE_2D); //TODO: Determine target from sampler.
-					}
-				}
-				for (override_tracking_type::const_iterator tu = overriddenTextures.begin(); tu != overriddenTextures.end(); tu++)
-				{
-					const RenderTextureBase * texture = textureState[*tu];
+	// Go through and actually apply the textures to the GL.
+	for (override_tracking_type::const_iterator tu = lastOverriddenTextures.begin(); tu != lastOverriddenTextures.end(); tu++)
+	{
+		const RenderTextureBase * texture = textureState[*tu];
+		if (texture)
+			applyTexture(gl, *tu, texture->target, texture->handle);
+		else
+		{
+			gl.ActiveTexture(*tu);
+			gl.unbindTexture(GL_TEXTURE_2D); //TODO: Determine target from sampler.
+		}
+	}
+	for (override_tracking_type::const_iterator tu = overriddenTextures.begin(); tu != overriddenTextures.end(); tu++)
+	{
+		const RenderTextureBase * texture = textureState[*tu];
 
-					// We shouldn't need to null-check texture.
-					applyTexture(gl, *tu, texture->target, texture->handle);
-				}
+		// We shouldn't need to null-check texture.
+		applyTexture(gl, *tu, texture->target, texture->handle);
+	}
 
-				lastOverriddenTextures.swap(overriddenTextures);
+	lastOverriddenTextures.swap(overriddenTextures);
 
-				// Restore uniforms that were overridden the by the previous model.
-				for (override_tracking_type::const_iterator location = lastOverriddenUniforms.begin(); location != lastOverriddenUniforms.end(); location++)
-					if (*location < defaultUniforms.size())
-					{
-						const RenderUniform * u = defaultUniforms[*location];
-						uniformState[u->location] = u;
-					}
+	// Restore uniforms that were overridden the by the previous model.
+	for (override_tracking_type::const_iterator location = lastOverriddenUniforms.begin(); location != lastOverriddenUniforms.end(); location++)
+		uniformState[*location] = defaultUniforms[*location];
 
-				// Apply uniform overrides, keeping track of which locations we've overridden.
-				overriddenUniforms.clear();
+	// Apply uniform overrides, keeping track of which locations we've overridden.
+	overriddenUniforms.clear();
 
-				// Check if we have cached information and if so use that.
+	// Check if we have cached information and if so use that.
 #ifdef USE_EXTERNAL_MODEL_CACHE
-				if (m->perPassUniformCache.size() > passIndex)
-				{
-					const std::vector <RenderUniform> & cache = m->perPassUniformCache[passIndex];
-					for (std::vector <RenderUniform>::const_iterator u = cache.begin(); u != cache.end(); u++)
-					{
-						GLuint location = u->location;
-						overriddenUniforms.push_back(location);
-						uniformState[location] = &*u;
-					}
-				}
-				else
+	if (m->perPassUniformCache.size() > passIndex)
+	{
+		const std::vector <RenderUniform> & cache = m->perPassUniformCache[passIndex];
+		for (std::vector <RenderUniform>::const_iterator u = cache.begin(); u != cache.end(); u++)
+		{
+			GLuint location = u->location;
+			overriddenUniforms.push_back(location);
+			uniformState[location] = &*u;
+		}
+	}
+	else
 #endif
-				{
-					for (std::vector <RenderUniformEntry>::const_iterator u = m->uniforms.begin(); u != m->uniforms.end(); u++)
-					{
-						NameIdMap::const_iterator loci = variableNameToUniformLocation.find(u->name);
-						if (loci != variableNameToUniformLocation.end()) // If the texture isn't used in this pass, it might not be in variableNameToUniformLocation.
-						{
-							GLuint location = loci->second;
-							overriddenUniforms.push_back(location);
-							uniformState[location] = &*u;
+	{
+		for (std::vector <RenderUniformEntry>::const_iterator u = m->uniforms.begin(); u != m->uniforms.end(); u++)
+		{
+			NameIdMap::const_iterator loci = variableNameToUniformLocation.find(u->name);
+			if (loci != variableNameToUniformLocation.end()) // If the texture isn't used in this pass, it might not be in variableNameToUniformLocation.
+			{
+				GLuint location = loci->second;
+				overriddenUniforms.push_back(location);
+				uniformState[location] = &*u;
 #ifdef USE_EXTERNAL_MODEL_CACHE
-							m->perPassUniformCache[passIndex].push_back(RenderUniform(location, *u)); // Make cache entry.
+				m->perPassUniformCache[passIndex].push_back(RenderUniform(location, *u)); // Make cache entry.
 #endif
-						}
-					}
-				}
+			}
+		}
+	}
 
-				// Go through and actually apply the uniforms to the GL.
-				for (override_tracking_type::const_iterator location = lastOverriddenUniforms.begin(); location != lastOverriddenUniforms.end(); location++)
-				{
-					const RenderUniformBase * uniform = uniformState[*location];
-					if (uniform)
-						gl.applyUniform(*location, uniform->data);
-				}
-				for (override_tracking_type::const_iterator location = overriddenUniforms.begin(); location != overriddenUniforms.end(); location++)
-				{
-					const RenderUniformBase * uniform = uniformState[*location];
-					//if (uniform) // TODO: Review this...
-						gl.applyUniform(*location, uniform->data);
-				}
+	// Go through and actually apply the uniforms to the GL.
+	for (override_tracking_type::const_iterator location = lastOverriddenUniforms.begin(); location != lastOverriddenUniforms.end(); location++)
+	{
+		const RenderUniformBase * uniform = uniformState[*location];
+		if (uniform)
+			gl.applyUniform(*location, uniform->data);
+	}
+	for (override_tracking_type::const_iterator location = overriddenUniforms.begin(); location != overriddenUniforms.end(); location++)
+	{
+		const RenderUniformBase * uniform = uniformState[*location];
+		//if (uniform) // TODO: Review this...
+			gl.applyUniform(*location, uniform->data);
+	}
 
-				lastOverriddenUniforms.swap(overriddenUniforms);
+	lastOverriddenUniforms.swap(overriddenUniforms);
+}
 
-				// Draw geometry.
-				m->draw(gl);
+void RenderPass::renderInstanced(GLWrapper & gl, const std::vector <const std::vector <RenderModelExt*>*> & externalModels)
+{
+	// Gather the models. If the draw order doesn't matter, sort them so that matching models are next to each other.
+	instanceEntries.clear();
+	for (std::vector <const std::vector <RenderModelExt*>*>::const_iterator i = externalModels.begin(); i != externalModels.end(); i++)
+	{
+		for (std::vector <RenderModelExt*>::const_iterator n = (*i)->begin(); n != (*i)->end(); n++)
+		{
+			RenderModelExt * m = *n;
+			assert(m);
+
+			if (m->drawEnabled())
+			{
+				InstanceEntry entry;
+				entry.hash = (instanceReorder && m->instanceable()) ? m->instanceHash(instanceTransformName) : 0;
+				entry.order = instanceEntries.size();
+				entry.model = m;
+				instanceEntries.push_back(entry);
 			}
 		}
 	}
+	if (instanceReorder)
+		std::sort(instanceEntries.begin(), instanceEntries.end());
 
-	// Unbind framebuffer.
-	gl.unbindFramebuffer();
+	// Split runs of matching models into batches, the transforms are stored in entry order.
+	instanceBatches.clear();
+	instanceTransforms.clear();
+	for (unsigned int i = 0; i < instanceEntries.size(); i++)
+	{
+		RenderModelExt * m = instanceEntries[i].model;
+		if (instanceBatches.empty() ||
+			!m->instanceable() ||
+			!instanceBatches.back().model->instanceable() ||
+			instanceEntries[i].hash != instanceEntries[i-1].hash ||
+			!m->instanceMatch(*instanceBatches.back().model, instanceTransformName))
+		{
+			InstanceBatch batch;
+			batch.model = m;
+			batch.first = i;
+			batch.count = 0;
+			instanceBatches.push_back(batch);
+		}
+		instanceBatches.back().count++;
 
-	// TODO: We only want to do this if the next pass is going to use these and not write to these.
-	// If autoMipmap then build mipmaps.
-	for (std::vector <RenderTexture>::const_iterator t = autoMipMapRenderTargets.begin(); t != autoMipMapRenderTargets.end(); t++)
-		gl.generateMipmaps(t->target, t->handle);
+		const float * transform = getInstanceTransform(*m);
+		instanceTransforms.insert(instanceTransforms.end(), transform, transform + 16);
+	}
 
-	// Unbind samplers.
-	for (unsigned int tu = 0; tu < samplers.size(); tu++)
-		gl.unbindSampler(tu);
+	if (instanceTransforms.empty())
+		return;
 
-	gl.EndQuery(GL_TIME_ELAPSED);
+	// Upload the transforms of all batches at once.
+	gl.BindBuffer(GL_ARRAY_BUFFER, instanceTransformBuffer);
+	gl.BufferData(GL_ARRAY_BUFFER, instanceTransforms.size()*sizeof(float), &instanceTransforms[0], GL_STREAM_DRAW);
+	gl.BindBuffer(GL_ARRAY_BUFFER, 0);
 
-	return changed;
+	for (std::vector <InstanceBatch>::const_iterator b = instanceBatches.begin(); b != instanceBatches.end(); b++)
+	{
+		RenderModelExt * m = b->model;
+		applyModelOverrides(gl, m);
+
+		if (m->instanceable())
+		{
+			gl.drawGeometryInstanced(m->vao, m->elementCount, instanceTransformAttribute, instanceTransformBuffer, b->first, b->count);
+		}
+		else
+		{
+			// The model draws itself, feed the transform as a constant attribute.
+			const float * transform = &instanceTransforms[b->first*16];
+			for (unsigned int c = 0; c < 4; c++)
+				gl.VertexAttrib4fv(instanceTransformAttribute + c, transform + c*4);
+			m->draw(gl);
+		}
+
+		lastDrawCalls++;
+		lastDrawCallsSaved += b->count - 1;
+	}
+}
+
+const float * RenderPass::getInstanceTransform(const RenderModelExt & m) const
+{
+	const RenderUniformEntry * transform = m.getUniform(instanceTransformName);
+	if (transform && transform->data.size() == 16)
+		return transform->data.begin();
+	return instanceDefaultTransform;
 }
 
 void RenderPass::addModel(const RenderModelEntry & entry, RenderModelHandle handle)
@@ -997,6 +1160,16 @@ float RenderPass::getLastTime() const
 	return lastTime;
 }
 
+unsigned int RenderPass::getLastDrawCalls() const
+{
+	return lastDrawCalls;
+}
+
+unsigned int RenderPass::getLastDrawCallsSaved() const
+{
+	return lastDrawCallsSaved;
+}
+
 bool RenderPass::createFramebufferObject(GLWrapper & gl, unsigned int w, unsigned int h, StringIdMap & stringMap, const NameTexMap & sharedTextures, std::ostream & errorOutput)
 {
 	deleteFramebufferObject(gl);
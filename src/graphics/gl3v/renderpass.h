@@ -102,6 +102,10 @@ public:
 
 	float getLastTime() const;
 
+	/// Draw calls of the last frame, and the draw calls that instancing saved.
+	unsigned int getLastDrawCalls() const;
+	unsigned int getLastDrawCallsSaved() const;
+
 private:
 	/// Returns true on success.
 	bool createFramebufferObject(GLWrapper & gl, unsigned int w, unsigned int h, StringIdMap & stringMap, const NameTexMap & sharedTextures, std::ostream & errorOutput);
@@ -116,6 +120,13 @@ private:
 	/// Switches to the texture's TU and binds the texture.
 	void applyTexture(GLWrapper & gl, GLuint tu, GLenum target, GLuint handle);
 
+	/// Restores the previous external model's texture and uniform overrides and applies the ones of this model.
+	void applyModelOverrides(GLWrapper & gl, RenderModelExt * m);
+
+	/// Draws the external models, batching models that only differ in their transform into instanced draws.
+	void renderInstanced(GLWrapper & gl, const std::vector <const std::vector <RenderModelExt*>*> & externalModels);
+	const float * getInstanceTransform(const RenderModelExt & m) const;
+
 	bool configured;
 	bool enabled;
 
@@ -171,6 +182,40 @@ private:
 	/// Draw groups.
 	std::set <StringId> drawGroups;
 
+	// Per-frame state tracking, sized at initialization so rendering doesn't allocate.
+	typedef std::vector <GLuint> override_tracking_type;
+	std::vector <const RenderUniform*> defaultUniforms; // Indexed by location, either NULL or a pointer to the RenderUniform bound to the location.
+	std::vector <const RenderTexture*> defaultTextures; // Indexed by TU, either NULL or a pointer to the RenderTexture bound to the TU.
+	std::vector <const RenderTextureBase*> textureState; // Indexed by TU.
+	std::vector <const RenderUniformBase*> uniformState; // Indexed by location.
+	override_tracking_type overriddenTextures;
+	override_tracking_type lastOverriddenTextures;
+	override_tracking_type overriddenUniforms;
+	override_tracking_type lastOverriddenUniforms;
+
+	// Instancing, used if the vertex shader has a per-instance transform attribute.
+	GLint instanceTransformAttribute; // -1 if the pass doesn't draw instanced.
+	GLuint instanceTransformBuffer;
+	StringId instanceTransformName; // The model uniform replaced by the attribute.
+	float instanceDefaultTransform[16];
+	bool instanceReorder; // Whether matching models may be drawn out of order.
+	struct InstanceEntry
+	{
+		std::size_t hash;
+		unsigned int order;
+		RenderModelExt * model;
+		bool operator<(const InstanceEntry & other) const {return hash < other.hash || (hash == other.hash && order < other.order);}
+	};
+	struct InstanceBatch
+	{
+		RenderModelExt * model;
+		unsigned int first;
+		unsigned int count;
+	};
+	std::vector <InstanceEntry> instanceEntries;
+	std::vector <InstanceBatch> instanceBatches;
+	std::vector <float> instanceTransforms; // 16 floats per instance.
+
 	/// Our index in the renderer's list of passes.
 	unsigned int passIndex;
 
@@ -181,6 +226,10 @@ private:
 	GLuint timerQuery;
 	/// Timing query object.
 	float lastTime;
+
+	/// Draw call statistics of the last frame.
+	unsigned int lastDrawCalls;
+	unsigned int lastDrawCallsSaved;
 };
 
 #endif
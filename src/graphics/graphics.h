@@ -27,6 +27,7 @@
 #include <iosfwd>
 
 class SceneNode;
+namespace Parallel { class JobSystem; }
 
 /// an abstract base class that defines the graphics interface
 /// expects a valid OpenGL context with initialized extension entry points (glewInit)
@@ -93,6 +94,9 @@ public:
 
 	virtual void printProfilingInfo(std::ostream & /*out*/) const { }
 
+	/// optional job system for parallel scene work, null to disable
+	virtual void setJobSystem(Parallel::JobSystem * /*jobs*/) { }
+
 	virtual ~Graphics() {}
 };
 
@@ -24,6 +24,9 @@
 #include "uniforms.h"
 #include "sky.h"
 
+#include <algorithm>
+#include <cmath>
+
 /// array end ptr
 template <typename T, size_t N>
 static T * end(T (&ar)[N])
@@ -132,9 +135,91 @@ static bool SortDraworder(Drawable * d1, Drawable * d2)
 	return (d1->GetDrawOrder() < d2->GetDrawOrder());
 }
 
-static std::string BuildKey(const std::string & camera, const std::string & draw)
+/// static drawlists are culled with frustums enlarged by this distance and,
+/// for perspective cameras, this angle (radians)
+/// the results stay valid while the camera moves and turns less than that
+static const float cull_margin = 0.5f;
+static const float cull_angle = 2 * M_PI / 180;
+
+/// rotation angle between two orientations, from the chord between the quaternions
+static float RotationAngle(const Quat & a, const Quat & b)
+{
+	// q and -q are the same rotation
+	float chord2 = 0, opposite2 = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		chord2 += (a[i] - b[i]) * (a[i] - b[i]);
+		opposite2 += (a[i] + b[i]) * (a[i] + b[i]);
+	}
+	const float chord = sqrt(std::min(chord2, opposite2));
+	return 4 * asin(std::min(chord * 0.5f, 1.0f));
+}
+
+/// half angles of a perspective frustum containing the frustums of all cameras turned by up to cull_angle
+/// returns false if the camera is too wide for that
+static bool GetCullAngles(const GraphicsCamera & cam, float & tan_v, float & tan_h)
+{
+	const float v = 0.5f * cam.fov * float(M_PI / 180);
+	const float h = atan(tan(v) * cam.w / cam.h);
+
+	// a side plane is turned out around the edge through the camera, directions along the edge
+	// barely move, so the plane has to turn further the closer the frustum corner is to the edge
+	// corner_h is the angle between the forward direction and the corner within the top plane
+	const float corner_h = atan(tan(h + cull_angle) * cos(v));
+	const float corner_v = atan(tan(v + cull_angle) * cos(h));
+	const float max_angle = float(0.4 * M_PI);
+	if (corner_h + 2 * cull_angle > max_angle || corner_v + 2 * cull_angle > max_angle)
+		return false;
+
+	const float turn_v = atan(sin(cull_angle) / cos(corner_h + 2 * cull_angle));
+	const float turn_h = atan(sin(cull_angle) / cos(corner_v + 2 * cull_angle));
+	if (v + turn_v > max_angle || h + turn_h > max_angle)
+		return false;
+
+	tan_v = tan(v + turn_v);
+	tan_h = tan(h + turn_h);
+	return true;
+}
+
+/// camera of the culling frustum, the planes are moved out by cull_margin afterwards
+static GraphicsCamera GetCullCamera(const GraphicsCamera & cam)
 {
-	return camera + ";" + draw;
+	GraphicsCamera c = cam;
+	float tan_v, tan_h;
+	if (cam.orthomode || !GetCullAngles(cam, tan_v, tan_h))
+		return c;
+
+	c.fov = 2 * atan(tan_v) * float(180 / M_PI);
+	c.w = tan_h;
+	c.h = tan_v;
+
+	// turning tilts the far plane, the depth of a point at the frustum corner
+	// relative to the old view direction grows by up to sin(angle) * tan(corner angle)
+	c.view_distance = cam.view_distance * (1 + sin(cull_angle) * sqrt(tan_v * tan_v + tan_h * tan_h));
+	return c;
+}
+
+/// culling result of camera b can be reused for camera a
+static bool CullReusable(const GraphicsCamera & a, const GraphicsCamera & b)
+{
+	if (a.fov != b.fov ||
+		a.view_distance != b.view_distance ||
+		a.w != b.w || a.h != b.h ||
+		a.orthomode != b.orthomode ||
+		a.orthomin != b.orthomin ||
+		a.orthomax != b.orthomax)
+		return false;
+
+	const float distance = (a.pos - b.pos).Magnitude();
+	const float angle = RotationAngle(a.rot, b.rot);
+	float tan_v, tan_h;
+	if (!a.orthomode)
+		return distance < cull_margin && (angle == 0 || (angle < cull_angle && GetCullAngles(a, tan_v, tan_h)));
+
+	// the box of an orthographic camera turns around the camera position,
+	// a point at distance r from it moves up to r * angle
+	const float reach = std::max(a.orthomin.Magnitude(), a.orthomax.Magnitude());
+	return distance + reach * angle < cull_margin;
 }
 
 static Quat GetCubeSideOrientation(int i, const Quat & origorient, std::ostream & error_output)
@@ -225,6 +310,10 @@ GraphicsGL2::GraphicsGL2() :
 	contrast(1.0),
 	reflection_status(REFLECTION_DISABLED),
 	renderconfigfile("basic.conf"),
+	cull_frame(0),
+	cull_layers(0),
+	cull_layers_reused(0),
+	jobs(0),
 	sky_dynamic(false)
 {
 	// ctor
@@ -384,6 +473,11 @@ DrawableContainer <PtrVector> & GraphicsGL2::GetDynamicDrawlist()
 void GraphicsGL2::AddStaticNode(SceneNode & node, bool clearcurrent)
 {
 	static_drawlist.Generate(node, clearcurrent);
+
+	for (std::vector <CullSlot>::iterator i = cull_slots.begin(); i != cull_slots.end(); ++i)
+	{
+		i->valid = false;
+	}
 }
 
 void GraphicsGL2::SetupScene(
@@ -536,21 +630,27 @@ void GraphicsGL2::DrawScene(std::ostream & error_output)
 	// sort the two dimentional drawlist so we get correct ordering
 	std::sort(dynamic_drawlist.twodim.begin(), dynamic_drawlist.twodim.end(), &SortDraworder);
 
-	// do fast culling queries for static geometry per pass
-	std::map <std::string, PtrVector <Drawable> > culled_static_drawlist;
-	for (std::vector <GraphicsConfigPass>::const_iterator i = config.passes.begin(); i != config.passes.end(); i++)
-	{
-		CullScenePass(*i, culled_static_drawlist, error_output);
-	}
+	// do fast culling queries for static geometry per camera and layer
+	if (pass_cull_slots.size() != config.passes.size())
+		BuildCullSlots(error_output);
+	CullScenePasses(error_output);
 
 	// draw the passes
+	pass_stats.clear();
 	for (std::vector <GraphicsConfigPass>::const_iterator i = config.passes.begin(); i != config.passes.end(); i++)
 	{
 		assert(!i->draw.empty());
 		if (i->draw.back() != "postprocess")
-			DrawScenePass(*i, culled_static_drawlist, error_output);
+		{
+			renderscene.ResetStats();
+			DrawScenePass(*i, pass_cull_slots[i - config.passes.begin()], error_output);
+			if (renderscene.GetStats().draws > 0)
+				pass_stats.push_back(std::make_pair(i - config.passes.begin(), renderscene.GetStats()));
+		}
 		else
+		{
 			DrawScenePassPost(*i, error_output);
+		}
 	}
 
 	// reset texture and draw buffer
@@ -605,6 +705,26 @@ void GraphicsGL2::SetLocalTimeSpeed(float value)
 		sky->SetTimeSpeed(value);
 }
 
+void GraphicsGL2::printProfilingInfo(std::ostream & out) const
+{
+	for (std::vector <std::pair <unsigned, RenderInputScene::Stats> >::const_iterator i = pass_stats.begin(); i != pass_stats.end(); ++i)
+	{
+		const GraphicsConfigPass & pass = config.passes[i->first];
+		const RenderInputScene::Stats & stats = i->second;
+		out << pass.output << " " << pass.shader << ": " <<
+			stats.draws << " draws, " <<
+			stats.texture_changes << " textures, " <<
+			stats.flag_changes << " flags, " <<
+			stats.transform_changes << " transforms" << std::endl;
+	}
+	out << "Culling: " << cull_layers_reused << " of " << cull_layers << " culled layers reused the last result" << std::endl;
+}
+
+void GraphicsGL2::setJobSystem(Parallel::JobSystem * value)
+{
+	jobs = value;
+}
+
 GraphicsState & GraphicsGL2::GetState()
 {
 	return glstate;
@@ -886,116 +1006,148 @@ bool GraphicsGL2::EnableShaders(std::ostream & info_output, std::ostream & error
 		}
 	}
 
+	BuildCullSlots(error_output);
+
 	return true;
 }
 
-void GraphicsGL2::CullScenePass(
-	const GraphicsConfigPass & pass,
-	std::map <std::string, PtrVector <Drawable> > & culled_static_drawlist,
-	std::ostream & error_output)
+void GraphicsGL2::CullSlot::Execute()
 {
-	// for each pass, we have which camera and which draw layer to use
-	// we want to do culling for each unique camera and draw layer combination
-	// use camera/layer as the unique key
-	assert(!pass.draw.empty());
+	drawlist.clear();
+	if (cull)
+		container->Query(frustum, drawlist);
+	else
+		container->Query(Aabb<float>::IntersectAlways(), drawlist);
+}
 
-	if (pass.draw.back() == "postprocess" || !pass.conditions.Satisfied(conditions))
-		return;
+void GraphicsGL2::BuildCullSlots(std::ostream & error_output)
+{
+	cull_slots.clear();
+	pass_cull_slots.clear();
+	pass_cull_slots.resize(config.passes.size());
 
-	for (std::vector <std::string>::const_iterator d = pass.draw.begin(); d != pass.draw.end(); d++)
+	// passes with the same camera, draw layer and culling mode share a slot
+	std::map <std::string, unsigned> slot_ids;
+	for (unsigned p = 0; p < config.passes.size(); ++p)
 	{
+		const GraphicsConfigPass & pass = config.passes[p];
+		assert(!pass.draw.empty());
+
+		if (pass.draw.back() == "postprocess" || !pass.conditions.Satisfied(conditions))
+			continue;
+
 		// determine if we're dealing with a cubemap
 		render_output_map_type::iterator oi = render_outputs.find(pass.output);
 		if (oi == render_outputs.end())
 		{
 			ReportOnce(&pass, "Render output "+pass.output+" couldn't be found", error_output);
-			return;
+			continue;
 		}
 
 		const bool cubemap = (oi->second.IsFBO() && oi->second.RenderToFBO().IsCubemap());
 		const int cubesides = cubemap ? 6 : 1;
-		std::string cameraname = pass.camera;
+		std::vector <unsigned> & slots = pass_cull_slots[p];
+		slots.reserve(cubesides * pass.draw.size());
 		for (int cubeside = 0; cubeside < cubesides; cubeside++)
 		{
-			if (cubemap)
+			for (std::vector <std::string>::const_iterator d = pass.draw.begin(); d != pass.draw.end(); d++)
 			{
-				// build sub-camera
+				std::stringstream key;
+				key << pass.camera << ";" << *d << ";" << (cubemap ? cubeside : -1) << ";" << pass.cull;
 
-				// build a name for the sub camera
+				std::pair <std::map <std::string, unsigned>::iterator, bool> result =
+					slot_ids.insert(std::make_pair(key.str(), (unsigned)cull_slots.size()));
+				if (result.second)
 				{
-					std::stringstream converter;
-					converter << pass.camera << "_cubeside" << cubeside;
-					cameraname = converter.str();
-				}
-
-				// get the base camera
-				camera_map_type::iterator bci = cameras.find(pass.camera);
-
-				if (bci == cameras.end())
-				{
-					ReportOnce(&pass, "Camera "+pass.camera+" couldn't be found", error_output);
-					return;
+					CullSlot slot;
+					slot.camera_name = pass.camera;
+					slot.layer = *d;
+					slot.cull = pass.cull;
+					if (cubemap)
+					{
+						const FrameBufferObject & fbo = oi->second.RenderToFBO();
+						slot.cubeside = cubeside;
+						slot.cube_w = fbo.GetWidth();
+						slot.cube_h = fbo.GetHeight();
+					}
+					slot.container = static_drawlist.GetDrawlist().GetByName(*d);
+					if (!slot.container)
+						ReportOnce(&pass, "Drawable container "+*d+" couldn't be found", error_output);
+					cull_slots.push_back(slot);
 				}
-
-				// create our sub-camera
-				GraphicsCamera & cam = cameras[cameraname];
-				cam = bci->second;
-
-				// set the sub-camera's properties
-				cam.rot = GetCubeSideOrientation(cubeside, cam.rot, error_output);
-				cam.fov = 90;
-				assert(oi->second.IsFBO());
-				const FrameBufferObject & fbo = oi->second.RenderToFBO();
-				cam.w = fbo.GetWidth();
-				cam.h = fbo.GetHeight();
+				slots.push_back(result.first->second);
 			}
+		}
+	}
+}
 
-			std::string key = BuildKey(cameraname, *d);
-			if (pass.cull)
-			{
-				camera_map_type::iterator ci = cameras.find(cameraname);
-				if (ci == cameras.end())
-				{
-					ReportOnce(&pass, "Camera "+cameraname+" couldn't be found", error_output);
-					return;
-				}
+void GraphicsGL2::CullScenePasses(std::ostream & error_output)
+{
+	// unculled layers are queried once, culled layers whenever their camera
+	// leaves the margin of the last query, cubemap sides get requeried
+	// round-robin, one side per frame
+	const int cubeside_update = cull_frame++ % 6;
+	cull_layers = cull_layers_reused = 0;
+	const bool parallel = jobs && jobs->GetNumThreads() > 0;
+	for (std::vector <CullSlot>::iterator s = cull_slots.begin(); s != cull_slots.end(); ++s)
+	{
+		camera_map_type::const_iterator ci = cameras.find(s->camera_name);
+		if (ci == cameras.end())
+		{
+			ReportOnce(&*s, "Camera "+s->camera_name+" couldn't be found", error_output);
+			s->drawlist.clear();
+			s->valid = false;
+			continue;
+		}
 
-				GraphicsCamera & cam = ci->second;
-				if (culled_static_drawlist.find(key) == culled_static_drawlist.end())
-				{
-					Frustum frustum;
-					frustum.Extract(GetProjMatrix(cam).GetArray(), GetViewMatrix(cam).GetArray());
+		GraphicsCamera & cam = s->camera;
+		cam = ci->second;
+		if (s->cubeside >= 0)
+		{
+			cam.rot = GetCubeSideOrientation(s->cubeside, cam.rot, error_output);
+			cam.fov = 90;
+			cam.w = s->cube_w;
+			cam.h = s->cube_h;
+		}
 
-					reseatable_reference <AabbTreeNodeAdapter <Drawable> > container =
-						static_drawlist.GetDrawlist().GetByName(*d);
-					if (!container)
-					{
-						ReportOnce(&pass, "Drawable container "+*d+" couldn't be found", error_output);
-						return;
-					}
+		if (!s->container)
+			continue;
 
-					container->Query(frustum, culled_static_drawlist[key]);
-				}
-			}
-			else
-			{
-				reseatable_reference <AabbTreeNodeAdapter <Drawable> > container =
-					static_drawlist.GetDrawlist().GetByName(*d);
-				if (!container)
-				{
-					ReportOnce(&pass, "Drawable container "+*d+" couldn't be found", error_output);
-					return;
-				}
+		const bool reuse = s->valid && (!s->cull ||
+			(s->cubeside >= 0 && s->cubeside != cubeside_update) ||
+			CullReusable(cam, s->culled_camera));
+		if (s->cull)
+		{
+			cull_layers++;
+			cull_layers_reused += reuse;
+		}
+		if (reuse)
+			continue;
 
-				container->Query(Aabb<float>::IntersectAlways(), culled_static_drawlist[key]);
+		if (s->cull)
+		{
+			s->frustum.Extract(GetProjMatrix(GetCullCamera(cam)).GetArray(), GetViewMatrix(cam).GetArray());
+			for (int i = 0; i < 6; ++i)
+			{
+				s->frustum.frustum[i][3] += cull_margin;
 			}
 		}
+		s->culled_camera = cam;
+		s->valid = true;
+
+		if (parallel)
+			jobs->Submit(*s);
+		else
+			s->Execute();
 	}
+
+	if (parallel)
+		jobs->Wait();
 }
 
 void GraphicsGL2::DrawScenePass(
 	const GraphicsConfigPass & pass,
-	std::map <std::string, PtrVector <Drawable> > & culled_static_drawlist,
+	const std::vector <unsigned> & slots,
 	std::ostream & error_output)
 {
 	// log failure here?
@@ -1033,35 +1185,34 @@ void GraphicsGL2::DrawScenePass(
 	// handle the cubemap case
 	const bool cubemap = (output.IsFBO() && output.RenderToFBO().IsCubemap());
 	const int cubesides = cubemap ? 6 : 1;
-	std::string cameraname = pass.camera;
+	const unsigned layers = pass.draw.size();
+	if (slots.size() != cubesides * layers)
+	{
+		ReportOnce(&pass, "Couldn't find culled static drawlists for pass output " + pass.output, error_output);
+		return;
+	}
+
 	for (int cubeside = 0; cubeside < cubesides; cubeside++)
 	{
+		// attach the correct cube side on the render output
 		if (cubemap)
-		{
-			// build a name for the sub camera
-			std::stringstream converter;
-			converter << pass.camera << "_cubeside" << cubeside;
-			cameraname = converter.str();
-
-			// attach the correct cube side on the render output
 			AttachCubeSide(cubeside, output.RenderToFBO(), error_output);
-		}
 
-		// setup camera
-		camera_map_type::iterator ci = cameras.find(cameraname);
-		if (ci == cameras.end())
+		// setup camera, the layers of a cube side share it
+		const CullSlot & camera_slot = cull_slots[slots[cubeside * layers]];
+		if (cameras.find(camera_slot.camera_name) == cameras.end())
 		{
 			ReportOnce(&pass, "Camera " + pass.camera + " couldn't be found", error_output);
 			return;
 		}
-		renderscene.SetCamera(ci->second);
+		renderscene.SetCamera(camera_slot.camera);
 
 		// render pass draw layers
 		output.Begin(glstate, error_output);
 		renderscene.ClearOutput(glstate, pass.clear_color, pass.clear_depth);
-		for (std::vector <std::string>::const_iterator d = pass.draw.begin(); d != pass.draw.end(); d++)
+		for (unsigned d = 0; d < layers; d++)
 		{
-			const std::string & layer = *d;
+			const std::string & layer = pass.draw[d];
 
 			// setup dynamic drawlist
 			reseatable_reference <PtrVector <Drawable> > container_dynamic = dynamic_drawlist.GetByName(layer);
@@ -1072,17 +1223,11 @@ void GraphicsGL2::DrawScenePass(
 			}
 
 			// setup static drawlist
-			const std::string drawlist_key = BuildKey(cameraname, layer);
-			std::map <std::string, PtrVector <Drawable> >::const_iterator container_static = culled_static_drawlist.find(drawlist_key);
-			if (container_static == culled_static_drawlist.end())
-			{
-				ReportOnce(&pass, "Couldn't find culled static drawlist for camera/draw combination: " + drawlist_key, error_output);
-				return;
-			}
+			const PtrVector <Drawable> & container_static = cull_slots[slots[cubeside * layers + d]].drawlist;
 
-			if (!container_dynamic->empty() || !container_static->second.empty())
+			if (!container_dynamic->empty() || !container_static.empty())
 			{
-				renderscene.SetDrawLists(*container_dynamic, container_static->second);
+				renderscene.SetDrawLists(*container_dynamic, container_static);
 				renderscene.Render(glstate, error_output);
 			}
 		}
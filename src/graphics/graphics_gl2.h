@@ -28,9 +28,11 @@
 #include "render_input_postprocess.h"
 #include "render_input_scene.h"
 #include "render_output.h"
+#include "graphics_camera.h"
+#include "frustum.h"
+#include "parallel_task.h"
 #include "memory.h"
 
-struct GraphicsCamera;
 class Shader;
 class SceneNode;
 class Sky;
@@ -95,6 +97,12 @@ public:
 
 	virtual void SetLocalTimeSpeed(float value);
 
+	/// draw and state change counts of the scene passes of the last frame
+	virtual void printProfilingInfo(std::ostream & out) const;
+
+	/// run the static drawlist culling queries on the job system, null to run them inline
+	virtual void setJobSystem(Parallel::JobSystem * jobs);
+
 	// Allow external code to use gl state manager.
 	GraphicsState & GetState();
 
@@ -157,10 +165,41 @@ private:
 	RenderInputScene renderscene;
 	RenderInputPostprocess postprocess;
 
+	// scene pass index and draw statistics of the last frame
+	std::vector <std::pair <unsigned, RenderInputScene::Stats> > pass_stats;
+
 	// camera data
 	typedef std::map <std::string, GraphicsCamera> camera_map_type;
 	camera_map_type cameras;
 
+	// static drawlist culling result of a camera/layer combination, kept across frames
+	struct CullSlot : public Parallel::Job
+	{
+		std::string camera_name;
+		std::string layer;
+		int cubeside; ///< cubemap side of the camera or -1
+		float cube_w, cube_h; ///< cubemap side dimensions
+		bool cull;
+		bool valid; ///< drawlist holds the result of culled_camera
+		GraphicsCamera camera; ///< camera of the current frame
+		GraphicsCamera culled_camera;
+		Frustum frustum;
+		reseatable_reference <AabbTreeNodeAdapter <Drawable> > container;
+		PtrVector <Drawable> drawlist;
+
+		CullSlot() : cubeside(-1), cube_w(1), cube_h(1), cull(false), valid(false) {}
+		void Execute();
+	};
+	std::vector <CullSlot> cull_slots;
+
+	// cull slot ids per pass, indexed by cubeside * pass.draw.size() + layer
+	std::vector <std::vector <unsigned> > pass_cull_slots;
+
+	unsigned cull_frame;
+	unsigned cull_layers; ///< culled layers of the last frame
+	unsigned cull_layers_reused; ///< culled layers of the last frame that reused the previous result
+	Parallel::JobSystem * jobs;
+
 	Vec3 light_direction;
 	std::tr1::shared_ptr<Sky> sky;
 	bool sky_dynamic;
@@ -189,14 +228,15 @@ private:
 
 	void DisableShaders(std::ostream & error_output);
 
-	void CullScenePass(
-		const GraphicsConfigPass & pass,
-		std::map <std::string, PtrVector <Drawable> > & culled_static_drawlist,
-		std::ostream & error_output);
+	/// assign cull slots to the scene passes of the loaded configuration
+	void BuildCullSlots(std::ostream & error_output);
+
+	/// update the cameras of the cull slots and requery the outdated ones
+	void CullScenePasses(std::ostream & error_output);
 
 	void DrawScenePass(
 		const GraphicsConfigPass & pass,
-		std::map <std::string, PtrVector <Drawable> > & culled_static_drawlist,
+		const std::vector <unsigned> & slots,
 		std::ostream & error_output);
 
 	/// draw postprocess scene pass
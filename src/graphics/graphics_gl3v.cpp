@@ -17,7 +17,9 @@
 /*                                                                      */
 /************************************************************************/
 
+#include "definitions.h"
 #include "graphics_gl3v.h"
+#include "allocationcounter.h"
 #include "joeserialize.h"
 #include "unordered_map.h"
 #include "utils.h"
@@ -29,6 +31,9 @@
 
 #define enableContributionCull true
 
+// Frames drawn before scene allocations are reported in debug builds.
+static const unsigned int allocationWarmupFrames = 100;
+
 GraphicsGL3::GraphicsGL3(StringIdMap & map) :
 	stringMap(map), renderer(gl), logNextGlFrame(false), initialized(false),
 	closeshadow(5.f)
@@ -36,6 +41,31 @@ GraphicsGL3::GraphicsGL3(StringIdMap & map) :
 	// initialize the full screen quad
 	fullscreenquadVertices.SetTo2DQuad(0,0,1,1, 0,1,1,0, 0);
 	fullscreenquad.SetVertArray(&fullscreenquadVertices);
+	fullscreenquadList.push_back(&fullscreenquad);
+
+	// the cameras set up by SetupScene
+	cameras.resize(CAMERA_FIXED_COUNT);
+	cameraSlots["default"] = CAMERA_DEFAULT;
+	cameraSlots["skybox"] = CAMERA_SKYBOX;
+	cameraSlots["shadow1"] = CAMERA_SHADOW1;
+	cameraSlots["shadow2"] = CAMERA_SHADOW2;
+	cameraSlots["shadow3"] = CAMERA_SHADOW3;
+
+	uniformIds.viewMatrix = stringMap.addStringId("viewMatrix");
+	uniformIds.projectionMatrix = stringMap.addStringId("projectionMatrix");
+	uniformIds.shadowMatrix = stringMap.addStringId("shadowMatrix");
+	uniformIds.invProjectionMatrix = stringMap.addStringId("invProjectionMatrix");
+	uniformIds.invViewMatrix = stringMap.addStringId("invViewMatrix");
+	uniformIds.defaultViewMatrix = stringMap.addStringId("defaultViewMatrix");
+	uniformIds.defaultProjectionMatrix = stringMap.addStringId("defaultProjectionMatrix");
+	uniformIds.eyespaceLightDirection = stringMap.addStringId("eyespaceLightDirection");
+	uniformIds.reflectedLightColor = stringMap.addStringId("reflectedLightColor");
+	uniformIds.ambientLightColor = stringMap.addStringId("ambientLightColor");
+	uniformIds.directionalLightColor = stringMap.addStringId("directionalLightColor");
+
+	frameStartAllocations = sceneStartAllocations = AllocationCounter::Get();
+	frameAllocations = sceneAllocations = 0;
+	sceneFrames = sceneAllocationsLogged = 0;
 }
 
 bool GraphicsGL3::Init(
@@ -114,7 +144,19 @@ DrawableContainer <PtrVector> & GraphicsGL3::GetDynamicDrawlist()
 	return dynamic_drawlist;
 }
 
-GraphicsGL3::CameraMatrices & GraphicsGL3::setCameraPerspective(const std::string & name,
+unsigned int GraphicsGL3::getCameraSlot(const std::string & name)
+{
+	std::map <std::string, unsigned int>::const_iterator i = cameraSlots.find(name);
+	if (i != cameraSlots.end())
+		return i->second;
+
+	unsigned int slot = cameras.size();
+	cameras.push_back(CameraMatrices());
+	cameraSlots[name] = slot;
+	return slot;
+}
+
+GraphicsGL3::CameraMatrices & GraphicsGL3::setCameraPerspective(unsigned int slot,
 	const Vec3 & position,
 	const Quat & rotation,
 	float fov,
@@ -123,7 +165,7 @@ GraphicsGL3::CameraMatrices & GraphicsGL3::setCameraPerspective(const std::strin
 	float w,
 	float h)
 {
-	CameraMatrices & matrices = cameras[name];
+	CameraMatrices & matrices = cameras[slot];
 
 	// generate view matrix
 	rotation.GetMatrix4(matrices.viewMatrix);
@@ -143,13 +185,13 @@ GraphicsGL3::CameraMatrices & GraphicsGL3::setCameraPerspective(const std::strin
 	return matrices;
 }
 
-GraphicsGL3::CameraMatrices & GraphicsGL3::setCameraOrthographic(const std::string & name,
+GraphicsGL3::CameraMatrices & GraphicsGL3::setCameraOrthographic(unsigned int slot,
 	const Vec3 & position,
 	const Quat & rotation,
 	const Vec3 & orthoMin,
 	const Vec3 & orthoMax)
 {
-	CameraMatrices & matrices = cameras[name];
+	CameraMatrices & matrices = cameras[slot];
 
 	// generate view matrix
 	rotation.GetMatrix4(matrices.viewMatrix);
@@ -172,11 +214,17 @@ GraphicsGL3::CameraMatrices & GraphicsGL3::setCameraOrthographic(const std::stri
 void GraphicsGL3::SetupScene(float fov, float new_view_distance, const Vec3 cam_position, const Quat & cam_rotation,
 				const Vec3 & dynamic_reflection_sample_pos)
 {
+	// a frame starts with its scene setup
+	unsigned int allocations = AllocationCounter::Get();
+	frameAllocations = allocations - frameStartAllocations;
+	frameStartAllocations = allocations;
+	sceneStartAllocations = allocations;
+
 	lastCameraPosition = cam_position;
 
 	const float nearDistance = 0.1;
 
-	setCameraPerspective("default",
+	setCameraPerspective(CAMERA_DEFAULT,
 		cam_position,
 		cam_rotation,
 		fov,
@@ -186,7 +234,7 @@ void GraphicsGL3::SetupScene(float fov, float new_view_distance, const Vec3 cam_
 		h);
 
 	Vec3 skyboxCamPosition(0,0,0);
-	setCameraPerspective("skybox",
+	setCameraPerspective(CAMERA_SKYBOX,
 		skyboxCamPosition,
 		cam_rotation,
 		fov,
@@ -238,19 +286,15 @@ void GraphicsGL3::SetupScene(float fov, float new_view_distance, const Vec3 cam_
 		(-light_rotation).RotateVector(cameraSpaceShadowPosition);
 		shadowPosition = cameraSpaceShadowPosition;
 
-		std::string suffix = Utils::tostr(i+1);
-
-		CameraMatrices & shadowcam = setCameraOrthographic("shadow"+suffix,
+		CameraMatrices & shadowcam = setCameraOrthographic(CAMERA_SHADOW1+i,
 			shadowPosition,
 			light_rotation,
 			-shadowbox,
 			shadowbox);
 
-		std::string matrixName = "shadowMatrix";
-
 		// create and send shadow reconstruction matrices
 		// the reconstruction matrix should transform from view to world, then from world to shadow view, then from shadow view to shadow clip space
-		const CameraMatrices & defaultcam = cameras.find("default")->second;
+		const CameraMatrices & defaultcam = cameras[CAMERA_DEFAULT];
 		Mat4 shadowReconstruction = defaultcam.inverseViewMatrix.Multiply(shadowcam.viewMatrix).Multiply(shadowcam.projectionMatrix);
 		/*//Mat4 shadowReconstruction = shadowcam.projectionMatrix.Multiply(shadowcam.viewMatrix.Multiply(defaultcam.inverseViewMatrix));
 		std::cout << "shadowcam.projectionMatrix: " << std::endl;
@@ -261,37 +305,35 @@ void GraphicsGL3::SetupScene(float fov, float new_view_distance, const Vec3 cam_
 		shadowcam.viewMatrix.DebugPrint(std::cout);
 		std::cout << "defaultcam.inverseViewMatrix.Multiply(shadowcam.viewMatrix): " << std::endl;
 		defaultcam.inverseViewMatrix.Multiply(shadowcam.viewMatrix).DebugPrint(std::cout);
-		std::cout << matrixName << ":" << std::endl;
+		std::cout << "shadowMatrix:" << std::endl;
 		shadowReconstruction.DebugPrint(std::cout);*/
 
-		//renderer.setGlobalUniform(RenderUniformEntry(stringMap.addStringId(matrixName), shadowReconstruction.GetArray(),16));
+		//renderer.setGlobalUniform(RenderUniformEntry(uniformIds.shadowMatrix, shadowReconstruction.GetArray(),16));
 
-		// examine the user-defined fields to find out which shadow matrix to send to a pass
-		std::vector <StringId> passes = renderer.getPassNames();
-		for (std::vector <StringId>::const_iterator i = passes.begin(); i != passes.end(); i++)
+		// send the shadow matrix to the passes that use this shadow camera
+		for (std::vector <PassSlot>::const_iterator p = passSlots.begin(); p != passSlots.end(); p++)
 		{
-			std::map <std::string, std::string> fields = renderer.getUserDefinedFields(*i);
-			std::map <std::string, std::string>::const_iterator field = fields.find(matrixName);
-			if (field != fields.end() && field->second == suffix)
-			{
-				renderer.setPassUniform(*i, RenderUniformEntry(stringMap.addStringId(matrixName), shadowReconstruction.GetArray(),16));
-			}
+			if (p->shadowMatrix == i)
+				renderer.setPassUniform(p->name, RenderUniformEntry(uniformIds.shadowMatrix, shadowReconstruction.GetArray(),16));
 		}
 	}
 
 	// send cameras to passes
-	for (std::map <std::string, std::string>::const_iterator i = passNameToCameraName.begin(); i != passNameToCameraName.end(); i++)
+	for (std::vector <PassSlot>::const_iterator p = passSlots.begin(); p != passSlots.end(); p++)
 	{
-		renderer.setPassUniform(stringMap.addStringId(i->first), RenderUniformEntry(stringMap.addStringId("viewMatrix"), cameras[i->second].viewMatrix.GetArray(),16));
-		renderer.setPassUniform(stringMap.addStringId(i->first), RenderUniformEntry(stringMap.addStringId("projectionMatrix"), cameras[i->second].projectionMatrix.GetArray(),16));
+		if (p->camera < 0)
+			continue;
+		const CameraMatrices & camera = cameras[p->camera];
+		renderer.setPassUniform(p->name, RenderUniformEntry(uniformIds.viewMatrix, camera.viewMatrix.GetArray(),16));
+		renderer.setPassUniform(p->name, RenderUniformEntry(uniformIds.projectionMatrix, camera.projectionMatrix.GetArray(),16));
 	}
 
 	// send matrices for the default camera
-	const CameraMatrices & defaultCamera = cameras.find("default")->second;
-	renderer.setGlobalUniform(RenderUniformEntry(stringMap.addStringId("invProjectionMatrix"), defaultCamera.inverseProjectionMatrix.GetArray(),16));
-	renderer.setGlobalUniform(RenderUniformEntry(stringMap.addStringId("invViewMatrix"), defaultCamera.inverseViewMatrix.GetArray(),16));
-	renderer.setGlobalUniform(RenderUniformEntry(stringMap.addStringId("defaultViewMatrix"), defaultCamera.viewMatrix.GetArray(),16));
-	renderer.setGlobalUniform(RenderUniformEntry(stringMap.addStringId("defaultProjectionMatrix"), defaultCamera.projectionMatrix.GetArray(),16));
+	const CameraMatrices & defaultCamera = cameras[CAMERA_DEFAULT];
+	renderer.setGlobalUniform(RenderUniformEntry(uniformIds.invProjectionMatrix, defaultCamera.inverseProjectionMatrix.GetArray(),16));
+	renderer.setGlobalUniform(RenderUniformEntry(uniformIds.invViewMatrix, defaultCamera.inverseViewMatrix.GetArray(),16));
+	renderer.setGlobalUniform(RenderUniformEntry(uniformIds.defaultViewMatrix, defaultCamera.viewMatrix.GetArray(),16));
+	renderer.setGlobalUniform(RenderUniformEntry(uniformIds.defaultProjectionMatrix, defaultCamera.projectionMatrix.GetArray(),16));
 
 	// send sun light direction for the default camera
 
@@ -303,7 +345,7 @@ void GraphicsGL3::SetupScene(float fov, float new_view_distance, const Vec3 cam_
 	defaultCamera.viewMatrix.MultiplyVector4(&lightDirection4[0]);
 
 	// upload to the shaders
-	RenderUniformEntry lightDirectionUniform(stringMap.addStringId("eyespaceLightDirection"), &lightDirection4[0], 3);
+	RenderUniformEntry lightDirectionUniform(uniformIds.eyespaceLightDirection, &lightDirection4[0], 3);
 	renderer.setGlobalUniform(lightDirectionUniform);
 
 	// set the reflection strength
@@ -312,7 +354,7 @@ void GraphicsGL3::SetupScene(float fov, float new_view_distance, const Vec3 cam_
 	for (int i = 0; i < 3; i++)
 		reflectedLightColor[i] = 0.5;
 	reflectedLightColor[3] = 1.;
-	renderer.setGlobalUniform(RenderUniformEntry(stringMap.addStringId("reflectedLightColor"), reflectedLightColor, 4));
+	renderer.setGlobalUniform(RenderUniformEntry(uniformIds.reflectedLightColor, reflectedLightColor, 4));
 
 	// set the ambient strength
 	// TODO: read this from the track definition
@@ -320,7 +362,7 @@ void GraphicsGL3::SetupScene(float fov, float new_view_distance, const Vec3 cam_
 	for (int i = 0; i < 3; i++)
 		ambientLightColor[i] = 1.56;
 	ambientLightColor[3] = 1.;
-	renderer.setGlobalUniform(RenderUniformEntry(stringMap.addStringId("ambientLightColor"), ambientLightColor, 4));
+	renderer.setGlobalUniform(RenderUniformEntry(uniformIds.ambientLightColor, ambientLightColor, 4));
 
 	// set the sun strength
 	// TODO: read this from the track definition
@@ -328,7 +370,7 @@ void GraphicsGL3::SetupScene(float fov, float new_view_distance, const Vec3 cam_
 	for (int i = 0; i < 3; i++)
 		directionalLightColor[i] = 8.3;
 	directionalLightColor[3] = 1.;
-	renderer.setGlobalUniform(RenderUniformEntry(stringMap.addStringId("directionalLightColor"), directionalLightColor, 4));
+	renderer.setGlobalUniform(RenderUniformEntry(uniformIds.directionalLightColor, directionalLightColor, 4));
 }
 
 // returns true for cull, false for don't-cull
@@ -427,22 +469,6 @@ void GraphicsGL3::assembleDrawList(const AabbTreeNodeAdapter <Drawable> & adapte
 	}
 }
 
-// returns empty string if no camera
-std::string GraphicsGL3::getCameraForPass(StringId pass) const
-{
-	std::string passString = stringMap.getString(pass);
-	std::string cameraString;
-	std::map <std::string, std::string>::const_iterator camIter = passNameToCameraName.find(passString);
-	if (camIter != passNameToCameraName.end())
-		cameraString = camIter->second;
-	return cameraString;
-}
-
-std::string GraphicsGL3::getCameraDrawGroupKey(StringId pass, StringId group) const
-{
-	return getCameraForPass(pass)+"/"+stringMap.getString(group);
-}
-
 static bool SortDraworder(Drawable * d1, Drawable * d2)
 {
 	assert(d1 && d2);
@@ -456,111 +482,97 @@ void GraphicsGL3::DrawScene(std::ostream & error_output)
 
 	// for each pass, we have which camera and which draw groups to use
 	// we want to do culling for each unique camera and draw group combination
-	// use "camera/group" as a unique key string
-	// this is cached to avoid extra memory allocations each frame, so we need to clear old data
-	for (std::map <std::string, std::vector <RenderModelExt*> >::iterator i = cameraDrawGroupDrawLists.begin(); i != cameraDrawGroupDrawLists.end(); i++)
+	// the draw lists of the combinations are kept between frames to avoid memory allocations, so we need to clear old data
+	for (std::vector <DrawListSlot>::iterator i = drawListSlots.begin(); i != drawListSlots.end(); i++)
 	{
-		i->second.clear();
+		i->drawList.clear();
+		i->generated = false;
 	}
 
-	// because the cameraDrawGroupDrawLists are cached, this is how we keep track of which combinations
-	// we have already generated
-	std::set <std::string> cameraDrawGroupCombinationsGenerated;
-
-	// this maps passes to maps of draw groups and draw list vector pointers
-	// so drawMap[passName][drawGroup] is a pointer to a vector of RenderModelExternal pointers
-	// this is complicated but it lets us do culling per camera position and draw group combination
-	std::map <StringId, std::map <StringId, std::vector <RenderModelExt*> *> > drawMap;
-
-	// for each pass, do culling of the dynamic and static drawlists and put the results into the cameraDrawGroupDrawLists
-	std::vector <StringId> passes = renderer.getPassNames();
-	for (std::vector <StringId>::const_iterator i = passes.begin(); i != passes.end(); i++)
+	// for each enabled pass, do culling of the dynamic and static drawlists for the combinations that haven't been generated yet
+	for (unsigned int p = 0; p < passSlots.size(); p++)
 	{
-		if (renderer.getPassEnabled(*i))
+		const PassSlot & pass = passSlots[p];
+		if (!renderer.getPassEnabled(pass.name))
+			continue;
+
+		for (std::vector <unsigned int>::const_iterator d = pass.drawLists.begin(); d != pass.drawLists.end(); d++)
 		{
-			const std::set <StringId> & passDrawGroups = renderer.getDrawGroups(*i);
-			for (std::set <StringId>::const_iterator g = passDrawGroups.begin(); g != passDrawGroups.end(); g++)
+			DrawListSlot & slot = drawListSlots[*d];
+			if (slot.generated)
+				continue;
+			slot.generated = true;
+
+			std::vector <RenderModelExt*> & outDrawList = slot.drawList;
+
+			// extract frustum information
+			RenderUniform proj, view;
+			bool doCull = true;
+			doCull = !(!doCull || !renderer.getPassUniform(pass.name, uniformIds.viewMatrix, view));
+			doCull = !(!doCull || !renderer.getPassUniform(pass.name, uniformIds.projectionMatrix, proj));
+			Frustum frustum;
+			Frustum * frustumPtr = NULL;
+			if (doCull)
 			{
-				StringId passName = *i;
-				StringId drawGroupName = *g;
-				std::string drawGroupString = stringMap.getString(drawGroupName);
-				std::string cameraDrawGroupKey = getCameraDrawGroupKey(passName, drawGroupName);
-
-				std::vector <RenderModelExt*> & outDrawList = cameraDrawGroupDrawLists[cameraDrawGroupKey];
+				frustum.Extract(&proj.data[0], &view.data[0]);
+				frustumPtr = &frustum;
+			}
 
-				// see if we have already generated this combination
-				if (cameraDrawGroupCombinationsGenerated.find(cameraDrawGroupKey) == cameraDrawGroupCombinationsGenerated.end())
-				{
-					// we need to generate this combination
-
-					// extract frustum information
-					RenderUniform proj, view;
-					bool doCull = true;
-					/*if (getCameraForPass(passName).empty())
-					{
-						doCull = false;
-					}
-					else*/
-					{
-						doCull = !(!doCull || !renderer.getPassUniform(passName, stringMap.addStringId("viewMatrix"), view));
-						doCull = !(!doCull || !renderer.getPassUniform(passName, stringMap.addStringId("projectionMatrix"), proj));
-					}
-					Frustum frustum;
-					Frustum * frustumPtr = NULL;
-					if (doCull)
-					{
-						frustum.Extract(&proj.data[0], &view.data[0]);
-						frustumPtr = &frustum;
-					}
-
-					// assemble dynamic entries
-					reseatable_reference <PtrVector <Drawable> > dynamicDrawablesPtr = dynamic_drawlist.GetByName(drawGroupString);
-					if (dynamicDrawablesPtr)
-					{
-						const std::vector <Drawable*> & dynamicDrawables = *dynamicDrawablesPtr;
-						//assembleDrawList(dynamicDrawables, outDrawList, frustumPtr, lastCameraPosition);
-						assembleDrawList(dynamicDrawables, outDrawList, NULL, lastCameraPosition); // TODO: the above line is commented out because frustum culling dynamic drawables doesen't work at the moment; is the object center in the drawable for the car in the correct space??
-					}
-
-					// assemble static entries
-					reseatable_reference <AabbTreeNodeAdapter <Drawable> > staticDrawablesPtr = static_drawlist.GetDrawlist().GetByName(drawGroupString);
-					if (staticDrawablesPtr)
-					{
-						const AabbTreeNodeAdapter <Drawable> & staticDrawables = *staticDrawablesPtr;
-						assembleDrawList(staticDrawables, outDrawList, frustumPtr, lastCameraPosition);
-					}
-
-					// if it's requesting the full screen rect draw group, feed it our special drawable
-					if (drawGroupString == "full screen rect")
-					{
-						std::vector <Drawable*> rect;
-						rect.push_back(&fullscreenquad);
-						assembleDrawList(rect, outDrawList, NULL, lastCameraPosition);
-					}
-				}
+			// assemble dynamic entries
+			reseatable_reference <PtrVector <Drawable> > dynamicDrawablesPtr = dynamic_drawlist.GetByName(slot.drawGroupName);
+			if (dynamicDrawablesPtr)
+			{
+				const std::vector <Drawable*> & dynamicDrawables = *dynamicDrawablesPtr;
+				//assembleDrawList(dynamicDrawables, outDrawList, frustumPtr, lastCameraPosition);
+				assembleDrawList(dynamicDrawables, outDrawList, NULL, lastCameraPosition); // TODO: the above line is commented out because frustum culling dynamic drawables doesen't work at the moment; is the object center in the drawable for the car in the correct space??
+			}
 
-				// use the generated combination in our drawMap
-				drawMap[passName][drawGroupName] = &outDrawList;
+			// assemble static entries
+			reseatable_reference <AabbTreeNodeAdapter <Drawable> > staticDrawablesPtr = static_drawlist.GetDrawlist().GetByName(slot.drawGroupName);
+			if (staticDrawablesPtr)
+			{
+				const AabbTreeNodeAdapter <Drawable> & staticDrawables = *staticDrawablesPtr;
+				assembleDrawList(staticDrawables, outDrawList, frustumPtr, lastCameraPosition);
+			}
 
-				cameraDrawGroupCombinationsGenerated.insert(cameraDrawGroupKey);
+			// if it's requesting the full screen rect draw group, feed it our special drawable
+			if (slot.fullscreenRect)
+			{
+				assembleDrawList(fullscreenquadList, outDrawList, NULL, lastCameraPosition);
 			}
 		}
 	}
 
-	/*for (std::map <std::string, std::vector <RenderModelExternal*> >::iterator i = cameraDrawGroupDrawLists.begin(); i != cameraDrawGroupDrawLists.end(); i++)
-	{
-		std::cout << i->first << ": " << i->second.size() << std::endl;
-	}
-	std::cout << "----------" << std::endl;*/
 	//if (enableContributionCull) std::cout << "Contribution cull count: " << assembler.contributionCullCount << std::endl;
-	//std::cout << "normal_noblend: " << drawGroups[stringMap.addStringId("normal_noblend")].size() << "/" << static_drawlist.GetDrawlist().GetByName("normal_noblend")->size() << std::endl;
 
 	// render!
 	gl.logging(logNextGlFrame);
-	renderer.render(w, h, stringMap, drawMap, error_output);
+	renderer.render(w, h, stringMap, passDrawLists, error_output);
 	gl.logging(false);
 
 	logNextGlFrame = false;
+
+	sceneAllocations = AllocationCounter::Get() - sceneStartAllocations;
+	sceneFrames++;
+
+#ifdef DEBUG
+	// Once the draw lists have grown to their working size, the scene shouldn't allocate.
+	// Report each new high, so a regression shows up once instead of every frame.
+	if (sceneFrames > allocationWarmupFrames && sceneAllocations > sceneAllocationsLogged)
+	{
+		error_output << "Scene setup and draw made " << sceneAllocations << " heap allocations in frame " << sceneFrames << std::endl;
+		sceneAllocationsLogged = sceneAllocations;
+	}
+#endif
+}
+
+void GraphicsGL3::printProfilingInfo(std::ostream & out) const
+{
+	renderer.printProfilingInfo(out);
+	if (AllocationCounter::Enabled())
+		out << "Allocations: " << frameAllocations << " per frame, " << sceneAllocations << " in scene setup and draw" << std::endl;
+	else
+		out << "Allocations: only counted in debug and profiling builds" << std::endl;
 }
 
 int GraphicsGL3::GetMaxAnisotropy() const
@@ -616,15 +628,8 @@ bool GraphicsGL3::ReloadShaders(std::ostream & info_output, std::ostream & error
 		bool initSuccess = renderer.initialize(passInfos, stringMap, shaderpath, w, h, allcapsConditions, error_output);
 		if (initSuccess)
 		{
-			// assign cameras to each pass
-			std::vector <StringId> passes = renderer.getPassNames();
-			for (std::vector <StringId>::const_iterator i = passes.begin(); i != passes.end(); i++)
-			{
-				std::map <std::string, std::string> fields = renderer.getUserDefinedFields(*i);
-				std::map <std::string, std::string>::const_iterator field = fields.find("camera");
-				if (field != fields.end())
-					passNameToCameraName[stringMap.getString(*i)] = field->second;
-			}
+			// assign cameras, shadow matrices and draw lists to each pass
+			assignSlots();
 
 			// set viewport size
 			float viewportSize[2] = {float(w), float(h)};
@@ -660,6 +665,67 @@ bool GraphicsGL3::ReloadShaders(std::ostream & info_output, std::ostream & error
 	return true;
 }
 
+void GraphicsGL3::assignSlots()
+{
+	passSlots.clear();
+	drawListSlots.clear();
+
+	// draw list slot of each "camera/group" combination
+	std::map <std::pair <int, StringId>, unsigned int> combinations;
+
+	std::vector <StringId> passes = renderer.getPassNames();
+	passSlots.resize(passes.size());
+	for (unsigned int p = 0; p < passes.size(); p++)
+	{
+		PassSlot & pass = passSlots[p];
+		pass.name = passes[p];
+		pass.camera = -1;
+		pass.shadowMatrix = -1;
+
+		const std::map <std::string, std::string> & fields = renderer.getUserDefinedFields(pass.name);
+		std::map <std::string, std::string>::const_iterator field = fields.find("camera");
+		if (field != fields.end())
+			pass.camera = getCameraSlot(field->second);
+
+		// the shadowMatrix field names the shadow camera by number, starting at 1
+		field = fields.find("shadowMatrix");
+		if (field != fields.end())
+		{
+			int shadow = Utils::fromstr<int>(field->second) - 1;
+			if (shadow >= 0 && shadow < CAMERA_SHADOW3 - CAMERA_SHADOW1 + 1)
+				pass.shadowMatrix = shadow;
+		}
+
+		const std::set <StringId> & drawGroups = renderer.getDrawGroups(pass.name);
+		for (std::set <StringId>::const_iterator g = drawGroups.begin(); g != drawGroups.end(); g++)
+		{
+			std::pair <int, StringId> key(pass.camera, *g);
+			std::map <std::pair <int, StringId>, unsigned int>::const_iterator c = combinations.find(key);
+			if (c == combinations.end())
+			{
+				DrawListSlot slot;
+				slot.camera = pass.camera;
+				slot.drawGroupName = stringMap.getString(*g);
+				slot.fullscreenRect = (slot.drawGroupName == "full screen rect");
+				slot.generated = false;
+				c = combinations.insert(std::make_pair(key, (unsigned int)drawListSlots.size())).first;
+				drawListSlots.push_back(slot);
+			}
+			pass.drawLists.push_back(c->second);
+		}
+	}
+
+	// the draw list slots don't move from here on, so the renderer's per pass lists can point into them
+	passDrawLists.clear();
+	passDrawLists.resize(passSlots.size());
+	for (unsigned int p = 0; p < passSlots.size(); p++)
+	{
+		const std::vector <unsigned int> & drawLists = passSlots[p].drawLists;
+		for (std::vector <unsigned int>::const_iterator d = drawLists.begin(); d != drawLists.end(); d++)
+			passDrawLists[p].push_back(&drawListSlots[*d].drawList);
+	}
+}
+
 void GraphicsGL3::AddStaticNode(SceneNode & node, bool clearcurrent)
 {
 	static_drawlist.Generate(node, clearcurrent);
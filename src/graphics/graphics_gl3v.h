@@ -91,7 +91,7 @@ public:
 
 	virtual void SetContrast(float value);
 
-	virtual void printProfilingInfo(std::ostream & out) const {renderer.printProfilingInfo(out);}
+	virtual void printProfilingInfo(std::ostream & out) const;
 
 	GraphicsGL3(StringIdMap & map);
 
@@ -116,8 +116,22 @@ private:
 		Mat4 viewMatrix;
 		Mat4 inverseViewMatrix;
 	};
-	std::map <std::string, CameraMatrices> cameras;
-	CameraMatrices & setCameraPerspective(const std::string & name,
+
+	// cameras are indexed by slot, the fixed slots are updated by SetupScene
+	// cameras named by passes but unknown to SetupScene get a slot after these
+	enum CameraSlot
+	{
+		CAMERA_DEFAULT,
+		CAMERA_SKYBOX,
+		CAMERA_SHADOW1,
+		CAMERA_SHADOW2,
+		CAMERA_SHADOW3,
+		CAMERA_FIXED_COUNT
+	};
+	std::vector <CameraMatrices> cameras;
+	std::map <std::string, unsigned int> cameraSlots;
+	unsigned int getCameraSlot(const std::string & name);
+	CameraMatrices & setCameraPerspective(unsigned int slot,
 							  const Vec3 & position,
 							  const Quat & rotation,
 							  float fov,
@@ -125,15 +139,12 @@ private:
 							  float farDistance,
 							  float w,
 							  float h);
-	CameraMatrices & setCameraOrthographic(const std::string & name,
+	CameraMatrices & setCameraOrthographic(unsigned int slot,
 							   const Vec3 & position,
 							   const Quat & rotation,
 							   const Vec3 & orthoMin,
 							   const Vec3 & orthoMax);
 
-	std::string getCameraDrawGroupKey(StringId pass, StringId group) const;
-	std::string getCameraForPass(StringId pass) const;
-
 	// scenegraph output
 	DrawableContainer <PtrVector> dynamic_drawlist; //used for objects that move or change
 	StaticDrawables static_drawlist; //used for objects that will never change
@@ -141,16 +152,64 @@ private:
 	// a special drawable that's used for fullscreen quad passes
 	Drawable fullscreenquad;
 	VertexArray fullscreenquadVertices;
+	std::vector <Drawable*> fullscreenquadList;
+
+	// culling is done once per unique camera and draw group combination used by the enabled passes
+	// the combinations are found when the shaders are loaded, each gets a draw list slot
+	// the draw lists are cleared but never freed, so they serve as the frame arena
+	struct DrawListSlot
+	{
+		int camera; // camera slot, -1 if the passes have no camera
+		std::string drawGroupName;
+		bool fullscreenRect;
+		bool generated; // the draw list is up to date for this frame
+		std::vector <RenderModelExt*> drawList;
+	};
+	std::vector <DrawListSlot> drawListSlots;
+
+	// per pass data, indexed by pass index
+	struct PassSlot
+	{
+		StringId name;
+		int camera; // camera slot, -1 if the pass has no camera
+		int shadowMatrix; // shadow camera (0 to 2) of the pass's shadow reconstruction matrix, -1 if none
+		std::vector <unsigned int> drawLists; // draw list slots in draw group order
+	};
+	std::vector <PassSlot> passSlots;
+
+	// the draw lists handed to the renderer, indexed by pass index
+	std::vector <std::vector <const std::vector <RenderModelExt*>*> > passDrawLists;
 
-	// drawlist cache
-	std::map <std::string, std::vector <RenderModelExt*> > cameraDrawGroupDrawLists;
+	// build the camera, pass and draw list slots of the current renderer configuration
+	void assignSlots();
 
 	// drawlist assembly functions
 	void assembleDrawList(const std::vector <Drawable*> & drawables, std::vector <RenderModelExt*> & out, Frustum * frustum, const Vec3 & camPos);
 	void assembleDrawList(const AabbTreeNodeAdapter <Drawable> & adapter, std::vector <RenderModelExt*> & out, Frustum * frustum, const Vec3 & camPos);
 
-	// a map that stores which camera each pass uses
-	std::map <std::string, std::string> passNameToCameraName;
+	// uniform names sent every frame
+	struct UniformIds
+	{
+		StringId viewMatrix;
+		StringId projectionMatrix;
+		StringId shadowMatrix;
+		StringId invProjectionMatrix;
+		StringId invViewMatrix;
+		StringId defaultViewMatrix;
+		StringId defaultProjectionMatrix;
+		StringId eyespaceLightDirection;
+		StringId reflectedLightColor;
+		StringId ambientLightColor;
+		StringId directionalLightColor;
+	} uniformIds;
+
+	// heap allocation counts of the last frame, see AllocationCounter
+	unsigned int frameStartAllocations;
+	unsigned int sceneStartAllocations;
+	unsigned int frameAllocations;
+	unsigned int sceneAllocations;
+	unsigned int sceneFrames; // Frames drawn, the first ones allocate while the draw lists grow.
+	unsigned int sceneAllocationsLogged; // Highest scene allocation count reported in debug builds.
 
 	// a set storing all configuration option conditions (bloom enabled, etc)
 	std::set <std::string> conditions;
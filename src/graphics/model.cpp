@@ -21,7 +21,10 @@
 #include "utils.h"
 #include "vertexattribs.h"
 #include "glutil.h"
+#include <cstdio>
+#include <fstream>
 #include <limits>
+#include <sstream>
 
 using namespace VertexAttribs;
 
@@ -29,6 +32,15 @@ using namespace VertexAttribs;
 
 static const std::string file_magic = "OGLVARRAYV01";
 
+// cache layout: magic, byte order mark, key length, vertex and index counts,
+// aabb min, max and radius, the key padded to 4 bytes, then the interleaved
+// vertices (position, normal, texture coordinate) and the indices
+// bump the version if the layout or the loaders producing the cached meshes change
+static const std::string cache_magic = "VDMESH02";
+static const unsigned int cache_byte_order = 0x01020304;
+static const unsigned int cache_header_size = 8 + 4 * 4 + 7 * 4;
+static const unsigned int cache_vertex_size = 8;
+
 static const bool vaoDebug = false;
 
 Model::Model() :
@@ -36,6 +48,8 @@ Model::Model() :
 	elementVbo(0),
 	elementCount(0),
 	listid(0),
+	cachevertices(0),
+	cacheindices(0),
 	radius(0),
 	generatedmetrics(false),
 	generatedvao(false)
@@ -48,6 +62,8 @@ Model::Model(const std::string & filepath, std::ostream & error_output) :
 	elementVbo(0),
 	elementCount(0),
 	listid(0),
+	cachevertices(0),
+	cacheindices(0),
 	radius(0),
 	generatedmetrics(false),
 	generatedvao(false)
@@ -80,10 +96,7 @@ bool Model::Load(const std::string & strFileName, std::ostream & error_output, b
 
 bool Model::Load(const VertexArray & varray, std::ostream & error_output, bool genlist)
 {
-	Clear();
-
-	SetVertexArray(varray);
-	GenerateMeshMetrics();
+	LoadMesh(varray);
 
 	if (genlist)
 		GenerateListID(error_output);
@@ -93,6 +106,14 @@ bool Model::Load(const VertexArray & varray, std::ostream & error_output, bool g
 	return true;
 }
 
+void Model::LoadMesh(const VertexArray & varray)
+{
+	Clear();
+
+	SetVertexArray(varray);
+	GenerateMeshMetrics();
+}
+
 bool Model::Serialize(joeserialize::Serializer & s)
 {
 	_SERIALIZE_(s, m_mesh);
@@ -151,6 +172,161 @@ bool Model::ReadFromFile(const std::string & filepath, std::ostream & error_outp
 	return true;
 }
 
+static void WriteCacheData(std::ostream & out, const void * data, size_t size)
+{
+	if (size)
+		out.write(reinterpret_cast<const char *>(data), size);
+}
+
+bool Model::WriteCache(const std::string & filepath, const std::string & key) const
+{
+	const float * verts, * norms, * tcs = 0;
+	const int * faces;
+	const unsigned char * colors;
+	int vcount, ncount, fcount, ccount, tccount = 0;
+	m_mesh.GetVertices(verts, vcount);
+	m_mesh.GetNormals(norms, ncount);
+	m_mesh.GetFaces(faces, fcount);
+	m_mesh.GetColors(colors, ccount);
+	if (m_mesh.GetTexCoordSets() == 1)
+		m_mesh.GetTexCoords(0, tcs, tccount);
+
+	// only the vertex layout GenerateVertexArrayObject uploads from the cache, no vertex colors
+	const unsigned int vertexcount = vcount / 3;
+	if (!generatedmetrics || ccount || !vcount || !fcount || m_mesh.GetTexCoordSets() != 1 ||
+		(unsigned int)ncount != vertexcount * 3 || (unsigned int)tccount != vertexcount * 2)
+		return false;
+
+	std::vector<float> vertices(vertexcount * cache_vertex_size);
+	for (unsigned int i = 0; i < vertexcount; ++i)
+	{
+		float * v = &vertices[i * cache_vertex_size];
+		v[0] = verts[i * 3];
+		v[1] = verts[i * 3 + 1];
+		v[2] = verts[i * 3 + 2];
+		v[3] = norms[i * 3];
+		v[4] = norms[i * 3 + 1];
+		v[5] = norms[i * 3 + 2];
+		v[6] = tcs[i * 2];
+		v[7] = tcs[i * 2 + 1];
+	}
+
+	const unsigned int header[] = {cache_byte_order, (unsigned int)key.size(), vertexcount, (unsigned int)fcount};
+	const float metrics[] = {min[0], min[1], min[2], max[0], max[1], max[2], radius};
+	const char padding[4] = {0, 0, 0, 0};
+
+	// write into a temporary first, several loader threads might create the same cache file
+	std::stringstream tmpname;
+	tmpname << filepath << "." << this << ".tmp";
+	const std::string tmppath = tmpname.str();
+	std::ofstream out(tmppath.c_str(), std::ios_base::binary);
+	if (!out)
+		return false;
+
+	out.write(cache_magic.c_str(), cache_magic.size());
+	WriteCacheData(out, header, sizeof(header));
+	WriteCacheData(out, metrics, sizeof(metrics));
+	WriteCacheData(out, key.c_str(), key.size());
+	WriteCacheData(out, padding, (4 - key.size() % 4) % 4);
+	WriteCacheData(out, &vertices[0], vertices.size() * sizeof(float));
+	WriteCacheData(out, faces, fcount * sizeof(int));
+	out.close();
+
+	if (!out || std::rename(tmppath.c_str(), filepath.c_str()))
+	{
+		std::remove(tmppath.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool Model::ReadCache(const std::string & filepath, const std::string & key)
+{
+	// read the whole file at once, the buffer is kept for the vertex array object
+	std::ifstream in(filepath.c_str(), std::ios_base::binary);
+	if (!in)
+		return false;
+
+	in.seekg(0, std::ios_base::end);
+	const std::streamoff size = in.tellg();
+	in.seekg(0, std::ios_base::beg);
+	if (size < std::streamoff(cache_header_size) || size % 4)
+		return false;
+
+	std::vector<unsigned int> buffer(size / 4);
+	const char * data = reinterpret_cast<const char *>(&buffer[0]);
+	if (!in.read(reinterpret_cast<char *>(&buffer[0]), size))
+		return false;
+
+	if (cache_magic.compare(0, cache_magic.size(), data, cache_magic.size()))
+		return false;
+
+	const unsigned int * header = &buffer[cache_magic.size() / 4];
+	const float * metrics = reinterpret_cast<const float *>(header + 4);
+	if (header[0] != cache_byte_order || header[1] != key.size())
+		return false;
+
+	const unsigned int vertexcount = header[2];
+	const unsigned int indexcount = header[3];
+	if (!vertexcount || !indexcount || indexcount % 3)
+		return false;
+
+	// validate sizes and indices before touching the mesh
+	const unsigned int vertexoffset = (cache_header_size + key.size() + 3) / 4;
+	const unsigned int indexoffset = vertexoffset + vertexcount * cache_vertex_size;
+	if ((unsigned long)vertexcount * cache_vertex_size + indexcount + vertexoffset != buffer.size())
+		return false;
+
+	if (key.compare(0, key.size(), data + cache_header_size, key.size()))
+		return false;
+
+	for (unsigned int i = indexoffset; i < buffer.size(); ++i)
+	{
+		if (buffer[i] >= vertexcount)
+			return false;
+	}
+
+	Clear();
+
+	const float * vertices = reinterpret_cast<const float *>(&buffer[vertexoffset]);
+	std::vector<float> verts(vertexcount * 3), norms(vertexcount * 3), tcs(vertexcount * 2);
+	for (unsigned int i = 0; i < vertexcount; ++i)
+	{
+		const float * v = vertices + i * cache_vertex_size;
+		verts[i * 3] = v[0];
+		verts[i * 3 + 1] = v[1];
+		verts[i * 3 + 2] = v[2];
+		norms[i * 3] = v[3];
+		norms[i * 3 + 1] = v[4];
+		norms[i * 3 + 2] = v[5];
+		tcs[i * 2] = v[6];
+		tcs[i * 2 + 1] = v[7];
+	}
+	m_mesh.SetVertices(&verts[0], verts.size());
+	m_mesh.SetNormals(&norms[0], norms.size());
+	m_mesh.SetTexCoordSets(1);
+	m_mesh.SetTexCoords(0, &tcs[0], tcs.size());
+	m_mesh.SetFaces(reinterpret_cast<const int *>(&buffer[indexoffset]), indexcount);
+
+	min.Set(metrics[0], metrics[1], metrics[2]);
+	max.Set(metrics[3], metrics[4], metrics[5]);
+	radius = metrics[6];
+	generatedmetrics = true;
+
+	cachedata.swap(buffer);
+	cachevertices = vertexoffset;
+	cacheindices = indexoffset;
+
+	return true;
+}
+
+void Model::ClearCacheData()
+{
+	std::vector <unsigned int>().swap(cachedata);
+	cachevertices = 0;
+	cacheindices = 0;
+}
+
 void Model::GenerateListID(std::ostream & error_output)
 {
 	if (HaveListID())
@@ -195,6 +371,8 @@ void Model::GenerateListID(std::ostream & error_output)
 	glDisableClientState(GL_VERTEX_ARRAY);
 
 	CheckForOpenGLErrors("model list ID generation", error_output);
+
+	ClearCacheData();
 }
 
 template <typename T>
@@ -228,14 +406,15 @@ void Model::GenerateVertexArrayObject(std::ostream & error_output)
         std::cout << "created vao " << vao << std::endl;
 	glBindVertexArray(vao);ERROR_CHECK;
 
-	// Buffer object for faces.
+	// Buffer object for faces, a mesh read from the cache uploads the indices of the cache file.
 	const int * faces;
 	int facecount;
 	m_mesh.GetFaces(faces, facecount);
 	assert(faces && facecount > 0);
+	const void * indices = cachedata.empty() ? (const void *)faces : (const void *)&cachedata[cacheindices];
 	glGenBuffers(1, &elementVbo);ERROR_CHECK;
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementVbo);ERROR_CHECK;
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, facecount*sizeof(GLuint), faces, GL_STATIC_DRAW);ERROR_CHECK;
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, facecount*sizeof(GLuint), indices, GL_STATIC_DRAW);ERROR_CHECK;
 	elementCount = facecount;
 
 	// Calculate the number of vertices (vertcount is the size of the verts array).
@@ -245,52 +424,77 @@ void Model::GenerateVertexArrayObject(std::ostream & error_output)
 	assert(verts && vertcount > 0);
 	unsigned int vertexCount = vertcount/3;
 
-	// Generate buffer object for vertex positions.
-	vbos.push_back(GenerateBufferObject(error_output, VERTEX_POSITION, verts, vertexCount, 3));
-
-	// Generate buffer object for normals.
-	const float * norms;
-	int normcount;
-	m_mesh.GetNormals(norms, normcount);
-	if (!norms || normcount <= 0)
-		glDisableVertexAttribArray(VERTEX_NORMAL);
-	else
+	if (!cachedata.empty())
 	{
-		assert((unsigned int)normcount == vertexCount*3);
-		vbos.push_back(GenerateBufferObject(error_output, VERTEX_NORMAL, norms, vertexCount, 3));
+		// One buffer object for the interleaved positions, normals and texture coordinates of the cache file.
+		GLuint vboHandle;
+		const GLsizei stride = cache_vertex_size * sizeof(float);
+		glGenBuffers(1, &vboHandle);ERROR_CHECK;
+		glBindBuffer(GL_ARRAY_BUFFER, vboHandle);ERROR_CHECK;
+		glBufferData(GL_ARRAY_BUFFER, vertexCount*stride, &cachedata[cachevertices], GL_STATIC_DRAW);ERROR_CHECK;
+		glVertexAttribPointer(VERTEX_POSITION, 3, GL_FLOAT, GL_FALSE, stride, (const GLvoid *)0);ERROR_CHECK;
+		glEnableVertexAttribArray(VERTEX_POSITION);ERROR_CHECK;
+		glVertexAttribPointer(VERTEX_NORMAL, 3, GL_FLOAT, GL_FALSE, stride, (const GLvoid *)(3 * sizeof(float)));ERROR_CHECK;
+		glEnableVertexAttribArray(VERTEX_NORMAL);ERROR_CHECK;
+		glVertexAttribPointer(VERTEX_UV0, 2, GL_FLOAT, GL_FALSE, stride, (const GLvoid *)(6 * sizeof(float)));ERROR_CHECK;
+		glEnableVertexAttribArray(VERTEX_UV0);ERROR_CHECK;
+		vbos.push_back(vboHandle);
+
+		glDisableVertexAttribArray(VERTEX_TANGENT);
+		glDisableVertexAttribArray(VERTEX_BITANGENT);
+		glDisableVertexAttribArray(VERTEX_COLOR);
+		glDisableVertexAttribArray(VERTEX_UV1);
+		glDisableVertexAttribArray(VERTEX_UV2);
 	}
+	else
+	{
+		// Generate buffer object for vertex positions.
+		vbos.push_back(GenerateBufferObject(error_output, VERTEX_POSITION, verts, vertexCount, 3));
+
+		// Generate buffer object for normals.
+		const float * norms;
+		int normcount;
+		m_mesh.GetNormals(norms, normcount);
+		if (!norms || normcount <= 0)
+			glDisableVertexAttribArray(VERTEX_NORMAL);
+		else
+		{
+			assert((unsigned int)normcount == vertexCount*3);
+			vbos.push_back(GenerateBufferObject(error_output, VERTEX_NORMAL, norms, vertexCount, 3));
+		}
 
-	// TODO: Generate tangent and bitangent.
-	glDisableVertexAttribArray(VERTEX_TANGENT);
-	glDisableVertexAttribArray(VERTEX_BITANGENT);
+		// TODO: Generate tangent and bitangent.
+		glDisableVertexAttribArray(VERTEX_TANGENT);
+		glDisableVertexAttribArray(VERTEX_BITANGENT);
 
-	// Generate buffer object for colors.
-	const unsigned char * cols = 0;
-	int colcount = 0;
-	m_mesh.GetColors(cols, colcount);
-	if (cols && colcount)
-	{
-		assert((unsigned int)colcount == vertexCount*4);
-		vbos.push_back(GenerateBufferObject(error_output, VERTEX_COLOR, cols, vertexCount, 4, GL_UNSIGNED_BYTE, true));
-	}
-	else
-		glDisableVertexAttribArray(VERTEX_COLOR);
+		// Generate buffer object for colors.
+		const unsigned char * cols = 0;
+		int colcount = 0;
+		m_mesh.GetColors(cols, colcount);
+		if (cols && colcount)
+		{
+			assert((unsigned int)colcount == vertexCount*4);
+			vbos.push_back(GenerateBufferObject(error_output, VERTEX_COLOR, cols, vertexCount, 4, GL_UNSIGNED_BYTE, true));
+		}
+		else
+			glDisableVertexAttribArray(VERTEX_COLOR);
 
-	// Generate buffer object for texture coordinates.
-	const float * tc[1];
-	int tccount[1];
-	if (m_mesh.GetTexCoordSets() > 0)
-	{
-		// TODO: Make this work for UV1 and UV2.
-		m_mesh.GetTexCoords(0, tc[0], tccount[0]);
-		assert((unsigned int)tccount[0] == vertexCount*2);
-		vbos.push_back(GenerateBufferObject(error_output, VERTEX_UV0, tc[0], vertexCount, 2));
-	}
-	else
-		glDisableVertexAttribArray(VERTEX_UV0);
+		// Generate buffer object for texture coordinates.
+		const float * tc[1];
+		int tccount[1];
+		if (m_mesh.GetTexCoordSets() > 0)
+		{
+			// TODO: Make this work for UV1 and UV2.
+			m_mesh.GetTexCoords(0, tc[0], tccount[0]);
+			assert((unsigned int)tccount[0] == vertexCount*2);
+			vbos.push_back(GenerateBufferObject(error_output, VERTEX_UV0, tc[0], vertexCount, 2));
+		}
+		else
+			glDisableVertexAttribArray(VERTEX_UV0);
 
-	glDisableVertexAttribArray(VERTEX_UV1);
-	glDisableVertexAttribArray(VERTEX_UV2);
+		glDisableVertexAttribArray(VERTEX_UV1);
+		glDisableVertexAttribArray(VERTEX_UV2);
+	}
 
 	// Don't leave anything bound.
 	glBindVertexArray(0);
@@ -298,6 +502,8 @@ void Model::GenerateVertexArrayObject(std::ostream & error_output)
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
 
 	generatedvao = true;
+
+	ClearCacheData();
 }
 
 bool Model::HaveVertexArrayObject() const
@@ -374,6 +580,7 @@ void Model::GenerateMeshMetrics()
 void Model::ClearMeshData()
 {
 	m_mesh.Clear();
+	ClearCacheData();
 }
 
 unsigned Model::GetListID() const
@@ -459,3 +666,106 @@ void Model::ClearMetrics()
 {
 	generatedmetrics = false;
 }
+
+#include "unittest.h"
+#include "pathmanager.h"
+#include <cstring>
+
+template <typename T>
+static bool SameArray(const T * a, int acount, const T * b, int bcount)
+{
+	return acount == bcount && (acount == 0 || !std::memcmp(a, b, acount * sizeof(T)));
+}
+
+static bool SameMesh(const VertexArray & a, const VertexArray & b)
+{
+	const float * fa, * fb;
+	const int * ia, * ib;
+	int na, nb;
+	a.GetVertices(fa, na);
+	b.GetVertices(fb, nb);
+	bool same = SameArray(fa, na, fb, nb);
+	a.GetNormals(fa, na);
+	b.GetNormals(fb, nb);
+	same = same && SameArray(fa, na, fb, nb);
+	a.GetFaces(ia, na);
+	b.GetFaces(ib, nb);
+	same = same && SameArray(ia, na, ib, nb);
+	same = same && a.GetTexCoordSets() == b.GetTexCoordSets();
+	for (int i = 0; same && i < a.GetTexCoordSets(); ++i)
+	{
+		a.GetTexCoords(i, fa, na);
+		b.GetTexCoords(i, fb, nb);
+		same = SameArray(fa, na, fb, nb);
+	}
+	return same;
+}
+
+QT_TEST(model_cache_test)
+{
+	std::stringbuf log;
+	std::ostream info(&log), error(&log);
+	PathManager pathmanager;
+	pathmanager.Init(info, error);
+	const std::string cachefile = pathmanager.GetTemporaryFolder() + "/model_cache_test.vdm";
+
+	VertexArray va;
+	va.SetToUnitCube();
+	va.Scale(1.3, 0.7, 2.9);
+	va.Translate(0.1, -5.3, 1e3);
+
+	Model model;
+	model.LoadMesh(va);
+	QT_CHECK(model.WriteCache(cachefile, "0123456789abcdef-96"));
+
+	// the mesh and metrics come back bit identical
+	Model cached;
+	QT_CHECK(cached.ReadCache(cachefile, "0123456789abcdef-96"));
+	QT_CHECK(SameMesh(cached.GetVertexArray(), model.GetVertexArray()));
+	QT_CHECK(cached.GetSize() == model.GetSize());
+	QT_CHECK(cached.GetCenter() == model.GetCenter());
+	QT_CHECK(cached.GetRadius() == model.GetRadius());
+
+	// a cache written for other source data is rejected
+	Model stale;
+	QT_CHECK(!stale.ReadCache(cachefile, "0123456789abcdee-96"));
+	QT_CHECK(!stale.ReadCache(cachefile, "0123456789abcdef-960"));
+	QT_CHECK(!stale.HaveMeshData());
+
+	// truncated file
+	{
+		std::ifstream in(cachefile.c_str(), std::ios_base::binary);
+		std::stringstream data;
+		data << in.rdbuf();
+		in.close();
+		std::ofstream out(cachefile.c_str(), std::ios_base::binary);
+		out << data.str().substr(0, data.str().size() - 4);
+	}
+	QT_CHECK(!stale.ReadCache(cachefile, "0123456789abcdef-96"));
+
+	// index out of range
+	QT_CHECK(model.WriteCache(cachefile, "0123456789abcdef-96"));
+	{
+		std::ifstream in(cachefile.c_str(), std::ios_base::binary);
+		std::stringstream data;
+		data << in.rdbuf();
+		in.close();
+		std::string corrupt = data.str();
+		corrupt.replace(corrupt.size() - 4, 4, 4, char(0xff));
+		std::ofstream out(cachefile.c_str(), std::ios_base::binary);
+		out << corrupt;
+	}
+	QT_CHECK(!stale.ReadCache(cachefile, "0123456789abcdef-96"));
+
+	// vertex colors don't fit the cached vertex layout
+	const float * verts;
+	int vcount;
+	va.GetVertices(verts, vcount);
+	std::vector<unsigned char> colors(vcount / 3 * 4, 255);
+	va.SetColors(&colors[0], colors.size());
+	Model colored;
+	colored.LoadMesh(va);
+	QT_CHECK(!colored.WriteCache(cachefile, "0123456789abcdef-96"));
+
+	std::remove(cachefile.c_str());
+}
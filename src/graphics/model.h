@@ -45,12 +45,30 @@ public:
 
 	bool Load(const VertexArray & varray, std::ostream & error_output, bool genlist);
 
+	/// Set mesh data and metrics only, no gl objects are generated.
+	void LoadMesh(const VertexArray & varray);
+
 	bool Serialize(joeserialize::Serializer & s);
 
 	bool WriteToFile(const std::string & filepath);
 
 	bool ReadFromFile(const std::string & filepath, std::ostream & error_output, bool generatelistid=true);
 
+	/// Write mesh and metrics to a binary cache file, in native byte order.
+	/// The vertices are stored interleaved, the way GenerateVertexArrayObject uploads them.
+	/// Only meshes with normals and one texture coordinate set are cached.
+	/// The key identifies the source data the mesh was built from.
+	bool WriteCache(const std::string & filepath, const std::string & key) const;
+
+	/// Read mesh and metrics from a cache file written by WriteCache, with a single read.
+	/// The file contents are kept for GenerateVertexArrayObject until ClearCacheData.
+	/// Returns false if the file is missing, from another version or has a different key.
+	bool ReadCache(const std::string & filepath, const std::string & key);
+
+	/// Release the vertex and index buffers read from the cache.
+	/// Done by GenerateVertexArrayObject and GenerateListID.
+	void ClearCacheData();
+
 	void GenerateListID(std::ostream & error_output);
 
 	void GenerateVertexArrayObject(std::ostream & error_output);
@@ -102,6 +120,12 @@ private:
 	unsigned elementCount;
 	unsigned listid;			///< listid 0 is invalid, means no display list compiled
 
+	/// Contents of the cache file the mesh was read from, empty otherwise.
+	/// Offsets of the interleaved vertices and of the indices, in elements of cachedata.
+	std::vector <unsigned int> cachedata;
+	unsigned int cachevertices;
+	unsigned int cacheindices;
+
 	// Metrics.
 	Vec3 min;
 	Vec3 max;
@@ -19,9 +19,14 @@
 
 #include "model_joe03.h"
 #include "joepack.h"
+#include "archive.h"
 #include "mathvector.h"
 #include "endian_utility.h"
 
+#include <SDL2/SDL.h>
+
+#include <iomanip>
+#include <sstream>
 #include <vector>
 using std::vector;
 
@@ -119,18 +124,9 @@ static void CorrectEndian(std::vector<JoeTexCoord> & p)
 	}
 }
 
-static int BinaryRead ( void * buffer, unsigned int size, unsigned int count, FILE * f, const JoePack * pack )
+static int BinaryRead ( void * buffer, unsigned int size, unsigned int count, SDL_RWops * file )
 {
-	unsigned int bytesread = 0;
-
-	if ( pack == NULL )
-	{
-		bytesread = fread ( buffer, size, count, f );
-	}
-	else
-	{
-		bytesread = pack->fread ( buffer, size, count );
-	}
+	unsigned int bytesread = SDL_RWread ( file, buffer, size, count );
 
 	assert(bytesread == count);
 
@@ -180,15 +176,67 @@ static bool NeedsNormalSwap(JoeObject & Object)
 
 bool ModelJoe03::Load ( const std::string & filename, std::ostream & err_output, bool genlist, const JoePack * pack)
 {
-	Clear();
+	if (!LoadMesh(filename, err_output, pack))
+		return false;
+
+	if (genlist)
+	{
+		//optimize into a static display list
+		GenerateListID(err_output);
+	}
+	else
+	{
+		//optimize into vertex array/buffers
+		GenerateVertexArrayObject(err_output);
+	}
+
+	return true;
+}
+
+void ModelJoe03::GetCacheFile(
+	const std::string & cachepath,
+	const std::string & source,
+	const std::string & stamp,
+	std::string & cachefile,
+	std::string & key)
+{
+	cachefile.clear();
+	key.clear();
+	if (cachepath.empty() || stamp.empty())
+		return;
+
+	// one cache file per source, named by the fnv-1a hash of its path
+	Uint64 hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < source.size(); ++i)
+	{
+		hash ^= (unsigned char)source[i];
+		hash *= 1099511628211ULL;
+	}
+	std::ostringstream name;
+	name << cachepath << "/" << std::hex << std::setfill('0') << std::setw(16) << hash << ".vdm";
+	cachefile = name.str();
+	key = source + "\n" + stamp;
+}
 
-	FILE * m_FilePointer = NULL;
+bool ModelJoe03::LoadMesh ( const std::string & filename, std::ostream & err_output, const JoePack * pack, const std::string & cachepath )
+{
+	// pack entries are keyed by the stamp of the pack
+	std::string cachefile, key;
+	if (pack == NULL)
+		GetCacheFile(cachepath, filename, ArchiveSet::GetFileStamp(filename), cachefile, key);
+	else
+		GetCacheFile(cachepath, pack->GetPath() + "/" + filename, ArchiveSet::GetFileStamp(pack->GetPath()), cachefile, key);
+	if (!cachefile.empty() && ReadCache(cachefile, key))
+		return true;
+
+	SDL_RWops * file = NULL;
 
-	//open file
+	//open file, pack entries are read into memory
+	std::vector<char> packdata;
 	if ( pack == NULL )
 	{
-		m_FilePointer = fopen(filename.c_str(), "rb");
-		if (!m_FilePointer)
+		file = SDL_RWFromFile(filename.c_str(), "rb");
+		if (!file)
 		{
 			err_output << "MODEL_JOE03: Failed to open file " << filename << std::endl;
 			return false;
@@ -201,43 +249,70 @@ bool ModelJoe03::Load ( const std::string & filename, std::ostream & err_output,
 			err_output << "MODEL_JOE03: Failed to open file " << filename << " in " << pack->GetPath() << std::endl;
 			return false;
 		}
+		char buffer[4096];
+		int bytes;
+		while ((bytes = pack->fread(buffer, 1, sizeof(buffer))) > 0)
+		{
+			packdata.insert(packdata.end(), buffer, buffer + bytes);
+		}
+		pack->fclose();
+		file = SDL_RWFromConstMem(packdata.empty() ? NULL : &packdata[0], packdata.size());
 	}
 
-	bool val = LoadFromHandle ( m_FilePointer, pack, err_output );
+	bool val = LoadMesh ( file, filename, err_output );
 
-	// Clean up after everything
-	if ( pack == NULL )
-		fclose ( m_FilePointer );
-	else
-		pack->fclose();
+	SDL_RWclose ( file );
+
+	if (val && !cachefile.empty())
+		WriteCache(cachefile, key);
+
+	return val;
+}
+
+bool ModelJoe03::LoadMesh ( const ArchiveSet & archives, const std::string & path, std::ostream & err_output, const std::string & cachepath )
+{
+	std::string cachefile, key;
+	GetCacheFile(cachepath, path, archives.GetStamp(path), cachefile, key);
+	if (!cachefile.empty() && ReadCache(cachefile, key))
+		return true;
 
-	if (val)
+	SDL_RWops * file = archives.Open(path);
+	if (!file)
 	{
-		if (genlist)
-		{
-			//optimize into a static display list
-			GenerateListID(err_output);
-		}
-		else
-		{
-			//optimize into vertex array/buffers
-			GenerateVertexArrayObject(err_output);
-		}
+		err_output << "MODEL_JOE03: Failed to open file " << path << std::endl;
+		return false;
 	}
-	else
+
+	bool val = LoadMesh ( file, path, err_output );
+
+	SDL_RWclose ( file );
+
+	if (val && !cachefile.empty())
+		WriteCache(cachefile, key);
+
+	return val;
+}
+
+bool ModelJoe03::LoadMesh ( SDL_RWops * file, const std::string & name, std::ostream & err_output )
+{
+	Clear();
+
+	bool val = LoadFromHandle ( file, err_output );
+
+	if (!val)
 	{
-		err_output << "in " << filename << std::endl;
+		err_output << "in " << name << std::endl;
 	}
 
 	return val;
 }
 
-bool ModelJoe03::LoadFromHandle ( FILE * m_FilePointer, const JoePack * pack, std::ostream & err_output )
+bool ModelJoe03::LoadFromHandle ( SDL_RWops * file, std::ostream & err_output )
 {
 	JoeObject Object;
 
 	// Read the header data and store it in our variable
-	BinaryRead ( &Object.info, sizeof ( JoeHeader ), 1, m_FilePointer, pack );
+	BinaryRead ( &Object.info, sizeof ( JoeHeader ), 1, file );
 
 	Object.info.magic = ENDIAN_SWAP_32 ( Object.info.magic );
 	Object.info.version = ENDIAN_SWAP_32 ( Object.info.version );
@@ -259,7 +334,7 @@ bool ModelJoe03::LoadFromHandle ( FILE * m_FilePointer, const JoePack * pack, st
 	}
 
 	// Read in the model data
-	ReadData ( m_FilePointer, pack, Object );
+	ReadData ( file, Object );
 
 	//generate metrics such as bounding box, etc
 	GenerateMeshMetrics();
@@ -268,7 +343,7 @@ bool ModelJoe03::LoadFromHandle ( FILE * m_FilePointer, const JoePack * pack, st
 	return true;
 }
 
-void ModelJoe03::ReadData ( FILE * m_FilePointer, const JoePack * pack, JoeObject & Object )
+void ModelJoe03::ReadData ( SDL_RWops * file, JoeObject & Object )
 {
 	int num_frames = Object.info.num_frames;
 	int num_faces = Object.info.num_faces;
@@ -279,25 +354,25 @@ void ModelJoe03::ReadData ( FILE * m_FilePointer, const JoePack * pack, JoeObjec
 	{
 		Object.frames[i].faces.resize(num_faces);
 
-		BinaryRead ( &Object.frames[i].faces[0], sizeof ( JoeFace ), num_faces, m_FilePointer, pack );
+		BinaryRead ( &Object.frames[i].faces[0], sizeof ( JoeFace ), num_faces, file );
 		CorrectEndian ( Object.frames[i].faces );
 
-		BinaryRead ( &Object.frames[i].num_verts, sizeof ( int ), 1, m_FilePointer, pack );
+		BinaryRead ( &Object.frames[i].num_verts, sizeof ( int ), 1, file );
 		Object.frames[i].num_verts = ENDIAN_SWAP_32 ( Object.frames[i].num_verts );
-		BinaryRead ( &Object.frames[i].num_texcoords, sizeof ( int ), 1, m_FilePointer, pack );
+		BinaryRead ( &Object.frames[i].num_texcoords, sizeof ( int ), 1, file );
 		Object.frames[i].num_texcoords = ENDIAN_SWAP_32 ( Object.frames[i].num_texcoords );
-		BinaryRead ( &Object.frames[i].num_normals, sizeof ( int ), 1, m_FilePointer, pack );
+		BinaryRead ( &Object.frames[i].num_normals, sizeof ( int ), 1, file );
 		Object.frames[i].num_normals = ENDIAN_SWAP_32 ( Object.frames[i].num_normals );
 
 		Object.frames[i].verts.resize(Object.frames[i].num_verts);
 		Object.frames[i].normals.resize(Object.frames[i].num_normals);
 		Object.frames[i].texcoords.resize(Object.frames[i].num_texcoords);
 
-		BinaryRead ( &Object.frames[i].verts[0], sizeof ( JoeVertex ), Object.frames[i].num_verts, m_FilePointer, pack );
+		BinaryRead ( &Object.frames[i].verts[0], sizeof ( JoeVertex ), Object.frames[i].num_verts, file );
 		CorrectEndian ( Object.frames[i].verts );
-		BinaryRead ( &Object.frames[i].normals[0], sizeof ( JoeVertex ), Object.frames[i].num_normals, m_FilePointer, pack );
+		BinaryRead ( &Object.frames[i].normals[0], sizeof ( JoeVertex ), Object.frames[i].num_normals, file );
 		CorrectEndian ( Object.frames[i].normals );
-		BinaryRead ( &Object.frames[i].texcoords[0], sizeof ( JoeTexCoord ), Object.frames[i].num_texcoords, m_FilePointer, pack );
+		BinaryRead ( &Object.frames[i].texcoords[0], sizeof ( JoeTexCoord ), Object.frames[i].num_texcoords, file );
 		CorrectEndian ( Object.frames[i].texcoords );
 	}
 
@@ -23,8 +23,10 @@
 #include "model.h"
 #include <iosfwd>
 
+class ArchiveSet;
 class JoePack;
 struct JoeObject;
+struct SDL_RWops;
 
 // This class handles all of the loading code
 class ModelJoe03 : public Model
@@ -47,7 +49,28 @@ public:
 
 	bool Load(const std::string & strFileName, std::ostream & error_output, bool genlist, const JoePack * pack);
 
+	/// load mesh data and metrics only, no gl objects are generated
+	/// if cachepath is set, welded meshes are cached there, see below
+	bool LoadMesh(
+		const std::string & strFileName,
+		std::ostream & error_output,
+		const JoePack * pack,
+		const std::string & cachepath = std::string());
 
+	/// load mesh from a file in an archive or on disk
+	/// if cachepath is set, welded meshes are cached there keyed by the path and the file stamp,
+	/// a cache hit doesn't open the file
+	bool LoadMesh(
+		const ArchiveSet & archives,
+		const std::string & path,
+		std::ostream & error_output,
+		const std::string & cachepath = std::string());
+
+	/// load mesh from an open file, name is only used for messages
+	bool LoadMesh(
+		SDL_RWops * file,
+		const std::string & name,
+		std::ostream & error_output);
 
 private:
 	static const int JOE_MAX_FACES;
@@ -55,9 +78,17 @@ private:
 	static const float MODEL_SCALE;
 
 	// This reads in the data from the MD2 file and stores it in the member variable
-	void ReadData(FILE * m_FilePointer, const JoePack * pack, JoeObject & Object);
+	void ReadData(SDL_RWops * file, JoeObject & Object);
+
+	bool LoadFromHandle(SDL_RWops * file, std::ostream & error_output);
 
-	bool LoadFromHandle(FILE * f, const JoePack * pack, std::ostream & error_output);
+	/// cache file and key of the source, empty if there's no cache or the stamp is empty
+	static void GetCacheFile(
+		const std::string & cachepath,
+		const std::string & source,
+		const std::string & stamp,
+		std::string & cachefile,
+		std::string & key);
 };
 
 #endif
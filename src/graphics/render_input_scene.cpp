@@ -27,13 +27,76 @@
 #include "vertexarray.h"
 #include "glutil.h"
 
+#include <cstring>
+
+// queue sort key, most significant bits first
+// texture 0 (16 bits), texture 1 (12), texture 2 (12), decal, cull, cull front, depth (21)
+// texture ids are truncated, which only costs redundant binds on collisions
+// depth is the upper part of the positive float squared distance, front to back
+static inline uint64_t SortKey(const Drawable & d, float distance)
+{
+	uint32_t depth;
+	std::memcpy(&depth, &distance, 4);
+	return (uint64_t(d.GetTexture0() & 0xFFFF) << 48) |
+		(uint64_t(d.GetTexture1() & 0xFFF) << 36) |
+		(uint64_t(d.GetTexture2() & 0xFFF) << 24) |
+		(uint64_t(d.GetDecal()) << 23) |
+		(uint64_t(d.GetCull()) << 22) |
+		(uint64_t(d.GetCullFront()) << 21) |
+		(depth >> 11);
+}
+
+// stable radix sort by key, 8 passes over the key bytes from least to most significant,
+// skip passes where all keys share the byte, usually the texture id high bytes
+template <class Entry>
+static void RadixSort(std::vector <Entry> & entries, std::vector <Entry> & scratch)
+{
+	const unsigned count = entries.size();
+	if (count < 2)
+		return;
+
+	unsigned counters[8][256];
+	std::memset(counters, 0, sizeof(counters));
+	for (unsigned i = 0; i < count; ++i)
+	{
+		const uint64_t key = entries[i].key;
+		for (unsigned b = 0; b < 8; ++b)
+			counters[b][(key >> (b * 8)) & 255]++;
+	}
+
+	scratch.resize(count);
+	for (unsigned b = 0; b < 8; ++b)
+	{
+		const unsigned * counter = counters[b];
+		const unsigned shift = b * 8;
+		if (counter[(entries[0].key >> shift) & 255] == count)
+			continue;
+
+		unsigned offsets[256];
+		offsets[0] = 0;
+		for (unsigned i = 1; i < 256; ++i)
+			offsets[i] = offsets[i - 1] + counter[i - 1];
+
+		for (unsigned i = 0; i < count; ++i)
+			scratch[offsets[(entries[i].key >> shift) & 255]++] = entries[i];
+
+		entries.swap(scratch);
+	}
+}
+
 RenderInputScene::RenderInputScene():
 	last_transform_valid(false),
 	lod_far(1000),
 	shader(NULL),
 	fsaa(0),
-	contrast(1.0)
+	contrast(1.0),
+	depth_test(true),
+	depth_write(true),
+	blend(false),
+	sort_queue(true)
 {
+	ResetStats();
+
 	Vec3 front(1,0,0);
 	lightposition = front;
 	Quat ldir;
@@ -69,10 +132,19 @@ void RenderInputScene::SetColorMask(GraphicsState & glstate, bool write_color, b
 void RenderInputScene::SetDepthMode(GraphicsState & glstate, int mode, bool write_depth)
 {
 	glstate.DepthTest(mode, write_depth);
+
+	// without depth test or depth writes the draw order is visible
+	depth_test = (mode != GL_ALWAYS);
+	depth_write = write_depth;
+	sort_queue = depth_test && depth_write && !blend;
 }
 
 void RenderInputScene::SetBlendMode(GraphicsState & glstate, BlendMode::Enum mode)
 {
+	// blended drawables (2d, transparent layers) are drawn in drawlist order
+	blend = (mode != BlendMode::DISABLED);
+	sort_queue = depth_test && depth_write && !blend;
+
 	switch (mode)
 	{
 		case BlendMode::DISABLED:
@@ -186,32 +258,83 @@ void RenderInputScene::Render(GraphicsState & glstate, std::ostream & error_outp
 
 	last_transform_valid = false;
 
-	Draw(glstate, *dynamic_drawlist_ptr, false);
-	Draw(glstate, *static_drawlist_ptr, true);
+	queue.clear();
+	Enqueue(*dynamic_drawlist_ptr, false);
+	Enqueue(*static_drawlist_ptr, true);
+	SortQueue();
+	Draw(glstate);
 }
 
-void RenderInputScene::Draw(GraphicsState & glstate, const std::vector <Drawable*> & drawlist, bool preculled)
+void RenderInputScene::ResetStats()
+{
+	stats.draws = 0;
+	stats.texture_changes = 0;
+	stats.flag_changes = 0;
+	stats.transform_changes = 0;
+}
+
+void RenderInputScene::Enqueue(const std::vector <Drawable*> & drawlist, bool preculled)
 {
 	for (std::vector <Drawable*>::const_iterator ptr = drawlist.begin(); ptr != drawlist.end(); ++ptr)
 	{
 		const Drawable & d = **ptr;
 		if (preculled || !FrustumCull(d))
+		{
+			QueueEntry entry;
+			entry.key = sort_queue ? SortKey(d, CameraDistance(d)) : 0;
+			entry.drawable = &d;
+			queue.push_back(entry);
+		}
+	}
+}
+
+void RenderInputScene::SortQueue()
+{
+	if (sort_queue)
+		RadixSort(queue, queue_sorted);
+}
+
+void RenderInputScene::Draw(GraphicsState & glstate)
+{
+	const Drawable * last = NULL;
+	for (std::vector <QueueEntry>::const_iterator i = queue.begin(); i != queue.end(); ++i)
+	{
+		const Drawable & d = *i->drawable;
+
+		if (!last ||
+			d.GetDecal() != last->GetDecal() ||
+			d.GetCull() != last->GetCull() ||
+			d.GetCullFront() != last->GetCullFront())
 		{
 			SetFlags(d, glstate);
+			stats.flag_changes++;
+		}
 
+		if (!last ||
+			d.GetTexture0() != last->GetTexture0() ||
+			d.GetTexture1() != last->GetTexture1() ||
+			d.GetTexture2() != last->GetTexture2())
+		{
 			SetTextures(d, glstate);
+			stats.texture_changes++;
+		}
 
-			SetTransform(d, glstate);
+		const Vec4 & color = d.GetColor();
+		glstate.SetColor(color[0], color[1], color[2], color[3]);
 
-			if (d.GetDrawList())
-			{
-				glCallList(d.GetDrawList());
-			}
-			else if (d.GetVertArray())
-			{
-				DrawVertexArray(*d.GetVertArray(), d.GetLineSize());
-			}
+		SetTransform(d, glstate);
+
+		if (d.GetDrawList())
+		{
+			glCallList(d.GetDrawList());
+		}
+		else if (d.GetVertArray())
+		{
+			DrawVertexArray(*d.GetVertArray(), d.GetLineSize());
 		}
+		stats.draws++;
+
+		last = &d;
 	}
 }
 
@@ -281,6 +404,13 @@ void RenderInputScene::DrawVertexArray(const VertexArray & va, float linesize) c
 	}
 }
 
+float RenderInputScene::CameraDistance(const Drawable & d) const
+{
+	Vec3 objpos = d.GetObjectCenter();
+	d.GetTransform().TransformVectorOut(objpos[0], objpos[1], objpos[2]);
+	return (objpos - cam_position).MagnitudeSquared();
+}
+
 bool RenderInputScene::FrustumCull(const Drawable & d) const
 {
 	const float radius = d.GetRadius();
@@ -335,9 +465,6 @@ void RenderInputScene::SetFlags(const Drawable & d, GraphicsState & glstate)
 	{
 		glstate.CullFace(false);
 	}
-
-	const Vec4 & color = d.GetColor();
-	glstate.SetColor(color[0], color[1], color[2], color[3]);
 }
 
 void RenderInputScene::SetTextures(const Drawable & d, GraphicsState & glstate)
@@ -355,5 +482,80 @@ void RenderInputScene::SetTransform(const Drawable & d, GraphicsState & glstate)
 		glLoadMatrixf(worldTrans.GetArray());
 		last_transform = d.GetTransform();
 		last_transform_valid = true;
+		stats.transform_changes++;
+	}
+}
+
+#include "unittest.h"
+#include <algorithm>
+
+struct RadixTestEntry
+{
+	uint64_t key;
+	unsigned index;
+};
+
+static bool RadixTestLess(const RadixTestEntry & a, const RadixTestEntry & b)
+{
+	return a.key < b.key;
+}
+
+static bool RadixTestEqual(const std::vector <RadixTestEntry> & a, const std::vector <RadixTestEntry> & b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (unsigned i = 0; i < a.size(); ++i)
+	{
+		if (a[i].key != b[i].key || a[i].index != b[i].index)
+			return false;
 	}
+	return true;
+}
+
+QT_TEST(render_input_scene_sort_test)
+{
+	// random drawables, few textures and distances so that many keys are equal
+	const unsigned count = 2000;
+	std::vector <Drawable> drawables(count);
+	std::vector <RadixTestEntry> entries(count);
+	unsigned seed = 1;
+	for (unsigned i = 0; i < count; ++i)
+	{
+		unsigned r[4];
+		for (unsigned j = 0; j < 4; ++j)
+		{
+			seed = seed * 1103515245 + 12345;
+			r[j] = seed >> 16;
+		}
+		Drawable & d = drawables[i];
+		d.SetTextures(r[0] % 8, (r[1] % 3) * 0x1001, r[2] % 2);
+		d.SetDecal(r[3] & 1);
+		d.SetCull(r[3] & 2, r[3] & 4);
+		entries[i].key = SortKey(d, float((r[3] >> 3) % 50) * 7.5f);
+		entries[i].index = i;
+	}
+
+	std::vector <RadixTestEntry> expected(entries);
+	std::stable_sort(expected.begin(), expected.end(), RadixTestLess);
+
+	std::vector <RadixTestEntry> sorted(entries), scratch;
+	RadixSort(sorted, scratch);
+	QT_CHECK(RadixTestEqual(sorted, expected));
+
+	// sorting again keeps the order
+	RadixSort(sorted, scratch);
+	QT_CHECK(RadixTestEqual(sorted, expected));
+
+	// all passes skipped
+	std::vector <RadixTestEntry> same(entries);
+	for (unsigned i = 0; i < same.size(); ++i)
+		same[i].key = entries[0].key;
+	std::vector <RadixTestEntry> same_expected(same);
+	RadixSort(same, scratch);
+	QT_CHECK(RadixTestEqual(same, same_expected));
+
+	// a single entry
+	std::vector <RadixTestEntry> single(entries.begin(), entries.begin() + 1);
+	RadixSort(single, scratch);
+	QT_CHECK_EQUAL(single[0].index, 0u);
 }
@@ -26,6 +26,7 @@
 #include "matrix4.h"
 #include "frustum.h"
 #include "reseatable_reference.h"
+#include <stdint.h>
 #include <vector>
 
 struct GraphicsCamera;
@@ -37,6 +38,15 @@ class Shader;
 class RenderInputScene : public RenderInput
 {
 public:
+	/// draw statistics of the Render calls since the last ResetStats
+	struct Stats
+	{
+		unsigned draws;
+		unsigned texture_changes; ///< drawables with a different texture set than the previous one
+		unsigned flag_changes; ///< drawables with different decal or cull flags than the previous one
+		unsigned transform_changes;
+	};
+
 	RenderInputScene();
 
 	~RenderInputScene();
@@ -69,9 +79,24 @@ public:
 		const std::vector <Drawable*> & dl_dynamic,
 		const std::vector <Drawable*> & dl_static);
 
+	/// visible drawables are queued and sorted by state if the pass allows it
+	/// opaque depth tested passes are sorted, blended passes keep the drawlist order
 	virtual void Render(GraphicsState & glstate, std::ostream & error_output);
 
+	void ResetStats();
+
+	const Stats & GetStats() const {return stats;}
+
 private:
+	struct QueueEntry
+	{
+		uint64_t key;
+		const Drawable * drawable;
+	};
+	std::vector <QueueEntry> queue;
+	std::vector <QueueEntry> queue_sorted;
+	Stats stats;
+
 	reseatable_reference <const std::vector <Drawable*> > dynamic_drawlist_ptr;
 	reseatable_reference <const std::vector <Drawable*> > static_drawlist_ptr;
 	bool last_transform_valid;
@@ -86,11 +111,24 @@ private:
 	Shader * shader;
 	unsigned fsaa;
 	float contrast;
+	bool depth_test;
+	bool depth_write;
+	bool blend;
+	bool sort_queue;
 
-	void Draw(GraphicsState & glstate, const std::vector <Drawable*> & drawlist, bool preculled);
+	/// queue the visible drawables
+	void Enqueue(const std::vector <Drawable*> & drawlist, bool preculled);
+
+	/// radix sort the queue by key, if the pass allows it
+	void SortQueue();
+
+	void Draw(GraphicsState & glstate);
 
 	void DrawVertexArray(const VertexArray & va, float linesize) const;
 
+	/// squared camera distance of the object center
+	float CameraDistance(const Drawable & d) const;
+
 	/// returns true if the object was culled and should not be drawn
 	bool FrustumCull(const Drawable & d) const;
 
@@ -18,6 +18,7 @@
 /************************************************************************/
 
 #include "scenenode.h"
+#include "unittest.h"
 
 Vec3 SceneNode::TransformIntoWorldSpace(const Vec3 & localspace) const
 {
@@ -64,3 +65,43 @@ void SceneNode::DebugPrint(std::ostream & out, int curdepth) const
 		i->DebugPrint(out, curdepth+1);
 	}
 }
+
+QT_TEST(scenenode_traverse_test)
+{
+	SceneNode root;
+	keyed_container <SceneNode>::handle childhandle = root.AddNode();
+	keyed_container <Drawable>::handle drawhandle = root.GetNode(childhandle).GetDrawlist().normal_noblend.insert(Drawable());
+
+	Vec3 offset(1, 2, 3);
+	root.GetTransform().SetTranslation(offset);
+	root.GetNode(childhandle).GetTransform().SetTranslation(offset);
+
+	Mat4 identity;
+	DrawableContainer <PtrVector> output;
+	root.Traverse(output, identity);
+	QT_CHECK_EQUAL(output.normal_noblend.size(), 1);
+
+	const Drawable & d = root.GetNode(childhandle).GetDrawlist().normal_noblend.get(drawhandle);
+	Vec3 pos;
+	d.GetTransform().TransformVectorOut(pos[0], pos[1], pos[2]);
+	QT_CHECK_CLOSE(pos[0], 2, 0.0001);
+	QT_CHECK_CLOSE(pos[2], 6, 0.0001);
+
+	// moving the parent moves the child
+	root.GetTransform().SetTranslation(Vec3(0));
+	output.clear();
+	root.Traverse(output, identity);
+	pos.Set(0.0f);
+	d.GetTransform().TransformVectorOut(pos[0], pos[1], pos[2]);
+	QT_CHECK_CLOSE(pos[0], 1, 0.0001);
+	QT_CHECK_CLOSE(root.GetNode(childhandle).TransformIntoWorldSpace()[1], 2, 0.0001);
+
+	// unchanged nodes leave the drawable transforms alone
+	root.GetNode(childhandle).GetDrawlist().normal_noblend.get(drawhandle).SetTransform(identity);
+	output.clear();
+	root.Traverse(output, identity);
+	QT_CHECK_EQUAL(output.normal_noblend.size(), 1);
+	pos.Set(0.0f);
+	d.GetTransform().TransformVectorOut(pos[0], pos[1], pos[2]);
+	QT_CHECK_CLOSE(pos[0], 0, 0.0001);
+}
@@ -37,7 +37,7 @@ public:
 	const DrawableContainer <keyed_container> & GetDrawlist() const {return drawlist;}
 
 	Transform & GetTransform() {return transform;}
-	void SetTransform(const Transform & newtransform) {transform=newtransform;}
+	void SetTransform(const Transform & newtransform) {transform=newtransform;transform.SetChanged();}
 	const Transform & GetTransform() const {return transform;}
 	unsigned int Nodes() const {return childlist.size();}
 	unsigned int Drawables() const {return drawlist.size();}
@@ -50,30 +50,19 @@ public:
 	void SetChildAlpha(float a);
 	void DebugPrint(std::ostream & out, int curdepth = 0) const;
 
+	/// append the drawables to drawlist_output, world transforms are only
+	/// recomputed below nodes whose transform changed since the last traversal
 	template <template <typename U> class T>
 	void Traverse(DrawableContainer <T> & drawlist_output, const Mat4 & prev_transform)
 	{
-		Mat4 this_transform(prev_transform);
-
-		bool identitytransform = transform.IsIdentityTransform();
-		if (!identitytransform)
-		{
-			transform.GetRotation().GetMatrix4(this_transform);
-			this_transform.Translate(transform.GetTranslation()[0], transform.GetTranslation()[1], transform.GetTranslation()[2]);
-			this_transform = this_transform.Multiply(prev_transform);
-		}
-
-		if (this_transform != cached_transform)
-			drawlist.AppendTo<T,true>(drawlist_output, this_transform);
-		else
-			drawlist.AppendTo<T,false>(drawlist_output, this_transform);
-
-		for (keyed_container <SceneNode>::iterator i = childlist.begin(); i != childlist.end(); ++i)
-		{
-			i->Traverse(drawlist_output, this_transform);
-		}
+		// the parent transform of the root isn't cached, compare the result instead
+		Mat4 this_transform;
+		GetWorldTransform(prev_transform, this_transform);
+		transform.ClearChanged();
 
+		const bool changed = (this_transform != cached_transform);
 		cached_transform = this_transform;
+		TraverseChildren(drawlist_output, changed);
 	}
 
 	/// traverse all drawable containers applying the specified functor.
@@ -107,6 +96,46 @@ private:
 	DrawableContainer <keyed_container> drawlist;
 	Transform transform;
 	Mat4 cached_transform;
+
+	void GetWorldTransform(const Mat4 & parent_transform, Mat4 & world_transform) const
+	{
+		if (transform.IsIdentityTransform())
+		{
+			world_transform = parent_transform;
+			return;
+		}
+		const Vec3 & translation = transform.GetTranslation();
+		transform.GetRotation().GetMatrix4(world_transform);
+		world_transform.Translate(translation[0], translation[1], translation[2]);
+		world_transform = world_transform.Multiply(parent_transform);
+	}
+
+	template <template <typename U> class T>
+	void Traverse(DrawableContainer <T> & drawlist_output, const Mat4 & parent_transform, bool parent_changed)
+	{
+		const bool changed = parent_changed || transform.GetChanged();
+		if (changed)
+		{
+			GetWorldTransform(parent_transform, cached_transform);
+			transform.ClearChanged();
+		}
+		TraverseChildren(drawlist_output, changed);
+	}
+
+	// drawables only get their transform updated if it changed
+	template <template <typename U> class T>
+	void TraverseChildren(DrawableContainer <T> & drawlist_output, bool changed)
+	{
+		if (changed)
+			drawlist.AppendTo<T,true>(drawlist_output, cached_transform);
+		else
+			drawlist.AppendTo<T,false>(drawlist_output, cached_transform);
+
+		for (keyed_container <SceneNode>::iterator i = childlist.begin(); i != childlist.end(); ++i)
+		{
+			i->Traverse(drawlist_output, cached_transform, changed);
+		}
+	}
 };
 
 #endif // _SCENENODE_H
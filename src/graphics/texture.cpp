@@ -314,41 +314,58 @@ static void SetSampler(const TextureInfo & info, bool hasmiplevels = false)
 		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, (float)info.anisotropy);
 }
 
-Texture::Texture()
-{
-	// ctor
-}
-
-Texture::~Texture()
-{
-	Unload();
-}
-
-bool Texture::Load(const std::string & path, const TextureInfo & info, std::ostream & error)
+// read and parse a dds file, the texture data stays in the image buffer
+// the file position is restored if it isn't a dds file
+static bool DecodeDDS(SDL_RWops * file, Texture::Image & image)
 {
-
-	if (texid)
+	// test for dds magic value
+	const Sint64 start = SDL_RWtell(file);
+	char magic[4];
+	if (SDL_RWread(file, magic, 4, 1) != 1 || !IsDDS(magic, 4))
 	{
-		error << "Tried to double load texture " << path << std::endl;
+		SDL_RWseek(file, start, RW_SEEK_SET);
 		return false;
 	}
 
-	if (!info.data && path.empty())
-	{
-		error << "Tried to load a texture with an empty name" << std::endl;
+	// get length of file:
+	const Sint64 end = SDL_RWseek(file, 0, RW_SEEK_END);
+	SDL_RWseek(file, start, RW_SEEK_SET);
+	if (end <= start)
 		return false;
-	}
+	const unsigned long length = end - start;
 
-	if (!info.data && LoadDDS(path, info, error))
-	{
-		return true;
-	}
+	// read file into memory
+	std::vector<unsigned char> & data = image.data;
+	data.resize(length);
+	if (SDL_RWread(file, &data[0], length, 1) != 1)
+		return false;
 
-	if (info.cube)
+	// load dds
+	const unsigned char * texdata(0);
+	unsigned long texlen(0);
+	unsigned format(0), width(0), height(0), levels(0);
+	if (!ReadDDS(
+		(void*)&data[0], length,
+		(const void*&)texdata, texlen,
+		format, width, height, levels))
 	{
-		return LoadCube(path, info, error);
+		return false;
 	}
 
+	image.offset = texdata - &data[0];
+	image.size = texlen;
+	image.width = width;
+	image.height = height;
+	image.levels = levels;
+	image.format = format;
+	image.internalformat = format;
+	image.dds = true;
+	return true;
+}
+
+// load image file or raw data, resample it to the requested size
+static bool DecodeSurface(SDL_RWops * file, const std::string & path, const TextureInfo & info, Texture::Image & image, std::ostream & error)
+{
 	SDL_Surface * surface = 0;
 	if (info.data)
 	{
@@ -369,9 +386,9 @@ bool Texture::Load(const std::string & path, const TextureInfo & info, std::ostr
 			info.bytespp * 8, info.width * info.bytespp,
 			rmask, gmask, bmask, amask);
 	}
-	else
+	else if (file)
 	{
-		surface = IMG_Load(path.c_str());
+		surface = IMG_Load_RW(file, 0);
 	}
 
 	if (!surface)
@@ -439,9 +456,101 @@ bool Texture::Load(const std::string & path, const TextureInfo & info, std::ostr
 		h = hd;
 	}
 
+	// keep the final pixels, rows are pitch bytes apart
+	if (!pixelsd.empty())
+		image.data.swap(pixelsd);
+	else if (!pixelsu.empty())
+		image.data.swap(pixelsu);
+	else
+		image.data.assign(pixels, pixels + pitch * h);
+
+	image.offset = 0;
+	image.size = image.data.size();
+	image.width = w;
+	image.height = h;
+	image.levels = 1;
+	image.dds = false;
+	GetTextureFormat(surface, info, image.internalformat, image.format);
+
+	SDL_FreeSurface(surface);
+
+	return true;
+}
+
+Texture::Image::Image() :
+	offset(0),
+	size(0),
+	width(0),
+	height(0),
+	levels(0),
+	internalformat(0),
+	format(0),
+	dds(false)
+{
+	// ctor
+}
+
+Texture::Texture()
+{
+	// ctor
+}
+
+Texture::~Texture()
+{
+	Unload();
+}
+
+bool Texture::Load(const std::string & path, const TextureInfo & info, std::ostream & error)
+{
+	if (texid)
+	{
+		error << "Tried to double load texture " << path << std::endl;
+		return false;
+	}
+
+	if (!info.data && path.empty())
+	{
+		error << "Tried to load a texture with an empty name" << std::endl;
+		return false;
+	}
+
+	if (info.cube)
+	{
+		return LoadCube(path, info, error);
+	}
+
+	SDL_RWops * file = info.data ? 0 : SDL_RWFromFile(path.c_str(), "rb");
+	Image image;
+	bool success = Decode(file, path, info, image, error) && Upload(image, info, error);
+	if (file)
+		SDL_RWclose(file);
+	return success;
+}
+
+bool Texture::Decode(SDL_RWops * file, const std::string & path, const TextureInfo & info, Image & image, std::ostream & error)
+{
+	assert(!info.cube);
+
+	if (!info.data && path.empty())
+	{
+		error << "Tried to load a texture with an empty name" << std::endl;
+		return false;
+	}
+
+	return (!info.data && file && DecodeDDS(file, image)) || DecodeSurface(file, path, info, image, error);
+}
+
+bool Texture::Upload(const Image & image, const TextureInfo & info, std::ostream & error)
+{
+	if (texid)
+	{
+		error << "Tried to double load texture" << std::endl;
+		return false;
+	}
+
 	// store dimensions
-	width = w;
-	height = h;
+	width = image.width;
+	height = image.height;
 
 	target = GL_TEXTURE_2D;
 
@@ -451,21 +560,70 @@ bool Texture::Load(const std::string & path, const TextureInfo & info, std::ostr
 
 	// setup texture
 	glBindTexture(GL_TEXTURE_2D, texid);
-	SetSampler(info);
 
-	int internalformat, format;
-	GetTextureFormat(surface, info, internalformat, format);
+	if (!image.dds)
+	{
+		SetSampler(info);
 
-	// upload texture data
-	glTexImage2D(GL_TEXTURE_2D, 0, internalformat, w, h, 0, format, GL_UNSIGNED_BYTE, pixels);
-	CheckForOpenGLErrors("Texture creation", error);
+		// upload texture data
+		glTexImage2D(GL_TEXTURE_2D, 0, image.internalformat, image.width, image.height, 0, image.format, GL_UNSIGNED_BYTE, image.GetData());
+		CheckForOpenGLErrors("Texture creation", error);
 
-	// If we support generatemipmap, go ahead and do it regardless of the info.mipmap setting.
-	// In the GL3 renderer the sampler decides whether or not to do mip filtering,
-	// so we conservatively make mipmaps available for all textures.
-	GenerateMipmap(GL_TEXTURE_2D);
+		// If we support generatemipmap, go ahead and do it regardless of the info.mipmap setting.
+		// In the GL3 renderer the sampler decides whether or not to do mip filtering,
+		// so we conservatively make mipmaps available for all textures.
+		GenerateMipmap(GL_TEXTURE_2D);
 
-	SDL_FreeSurface(surface);
+		return true;
+	}
+
+	// gl3 renderer expects srgb
+	const unsigned format = image.format;
+	unsigned iformat = format;
+	if (info.srgb)
+	{
+		if (format == GL_BGR)
+			iformat = GL_SRGB8;
+		else if (format == GL_BGRA)
+			iformat = GL_SRGB8_ALPHA8;
+		else if (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT)
+			iformat = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+		else if (format == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT)
+			iformat = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT;
+		else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+			iformat = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+	}
+
+	SetSampler(info, image.levels > 1);
+
+	const unsigned char * idata = image.GetData();
+	unsigned blocklen = 16 * image.size / (image.width * image.height);
+	unsigned ilen = image.size;
+	unsigned iw = image.width;
+	unsigned ih = image.height;
+	for (unsigned i = 0; i < image.levels; ++i)
+	{
+		if (format == GL_BGR || format == GL_BGRA)
+		{
+			// fixme: support compression here?
+			ilen = iw * ih * blocklen / 16;
+			glTexImage2D(GL_TEXTURE_2D, i, iformat, iw, ih, 0, format, GL_UNSIGNED_BYTE, idata);
+		}
+		else
+		{
+			ilen = std::max(1u, iw / 4) * std::max(1u, ih / 4) * blocklen;
+			glCompressedTexImage2D(GL_TEXTURE_2D, i, iformat, iw, ih, 0, ilen, idata);
+		}
+		CheckForOpenGLErrors("Texture creation", error);
+
+		idata += ilen;
+		iw = std::max(1u, iw / 2);
+		ih = std::max(1u, ih / 2);
+	}
+
+	// force mipmaps for GL3
+	if (image.levels == 1)
+		GenerateMipmap(GL_TEXTURE_2D);
 
 	return true;
 }
@@ -724,98 +882,3 @@ bool Texture::LoadCube(const std::string & path, const TextureInfo & info, std::
 
 	return true;
 }
-
-bool Texture::LoadDDS(const std::string & path, const TextureInfo & info, std::ostream & error)
-{
-	std::ifstream file(path.c_str(), std::ifstream::in | std::ifstream::binary);
-	if (!file)
-		return false;
-
-	// test for dds magic value
-	char magic[4];
-	file.read(magic, 4);
-	if (!IsDDS(magic, 4))
-		return false;
-
-	// get length of file:
-	file.seekg (0, file.end);
-	const unsigned long length = file.tellg();
-	file.seekg (0, file.beg);
-
-	// read file into memory
-	std::vector<char> data(length);
-	file.read(&data[0], length);
-
-	// load dds
-	const char * texdata(0);
-	unsigned long texlen(0);
-	unsigned format(0), width(0), height(0), levels(0);
-	if (!ReadDDS(
-		(void*)&data[0], length,
-		(const void*&)texdata, texlen,
-		format, width, height, levels))
-	{
-		return false;
-	}
-
-	// set properties
-	width = width;
-	height = height;
-	target = GL_TEXTURE_2D;
-
-	// gl3 renderer expects srgb
-	unsigned iformat = format;
-	if (info.srgb)
-	{
-		if (format == GL_BGR)
-			iformat = GL_SRGB8;
-		else if (format == GL_BGRA)
-			iformat = GL_SRGB8_ALPHA8;
-		else if (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT)
-			iformat = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
-		else if (format == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT)
-			iformat = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT;
-		else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
-			iformat = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
-	}
-
-	// load texture
-	assert(!texid);
-	glGenTextures(1, &texid);
-	CheckForOpenGLErrors("Texture ID generation", error);
-
-	glBindTexture(GL_TEXTURE_2D, texid);
-
-	SetSampler(info, levels > 1);
-
-	const char * idata = texdata;
-	unsigned blocklen = 16 * texlen / (width * height);
-	unsigned ilen = texlen;
-	unsigned iw = width;
-	unsigned ih = height;
-	for (unsigned i = 0; i < levels; ++i)
-	{
-		if (format == GL_BGR || format == GL_BGRA)
-		{
-			// fixme: support compression here?
-			ilen = iw * ih * blocklen / 16;
-			glTexImage2D(GL_TEXTURE_2D, i, iformat, iw, ih, 0, format, GL_UNSIGNED_BYTE, idata);
-		}
-		else
-		{
-			ilen = std::max(1u, iw / 4) * std::max(1u, ih / 4) * blocklen;
-			glCompressedTexImage2D(GL_TEXTURE_2D, i, iformat, iw, ih, 0, ilen, idata);
-		}
-		CheckForOpenGLErrors("Texture creation", error);
-
-		idata += ilen;
-		iw = std::max(1u, iw / 2);
-		ih = std::max(1u, ih / 2);
-	}
-
-	// force mipmaps for GL3
-	if (levels == 1)
-		GenerateMipmap(GL_TEXTURE_2D);
-
-	return true;
-}
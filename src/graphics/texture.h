@@ -23,24 +23,51 @@
 #include "texture_interface.h"
 #include "textureinfo.h"
 #include <iosfwd>
+#include <string>
+#include <vector>
+
+struct SDL_RWops;
 
 class Texture : public TextureInterface
 {
 public:
+	/// decoded 2d texture data, ready for upload
+	struct Image
+	{
+		std::vector<unsigned char> data; ///< pixels or dds file contents
+		unsigned long offset; ///< start of the texture data
+		unsigned long size; ///< texture data size
+		unsigned width;
+		unsigned height;
+		unsigned levels; ///< mip levels
+		int internalformat;
+		int format;
+		bool dds;
+
+		Image();
+
+		const unsigned char * GetData() const { return &data[offset]; }
+	};
+
 	Texture();
 
 	virtual ~Texture();
 
 	bool Load(const std::string & path, const TextureInfo & info, std::ostream & error);
 
+	/// read and decode a 2d texture, doesn't touch gl so it can run on any thread
+	/// file can be null if the info holds the pixel data, path is only used for messages
+	static bool Decode(SDL_RWops * file, const std::string & path, const TextureInfo & info, Image & image, std::ostream & error);
+
+	/// create gl texture from decoded data
+	bool Upload(const Image & image, const TextureInfo & info, std::ostream & error);
+
 	void Unload();
 
 private:
 	bool LoadCubeVerticalCross(const std::string & path, const TextureInfo & info, std::ostream & error);
 
 	bool LoadCube(const std::string & path, const TextureInfo & info, std::ostream & error);
-
-	bool LoadDDS(const std::string & path, const TextureInfo & info, std::ostream & error);
 };
 
 #endif //_TEXTURE_H
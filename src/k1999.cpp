@@ -30,6 +30,7 @@
 #include "roadstrip.h"
 
 #include <cassert>
+#include <iostream>
 
 #define SecurityR   100.0 // Security radius
 #define SideDistExt 2.0 // Security distance wrt outside
@@ -344,3 +345,168 @@ void K1999::UpdateRoadStrip(RoadStrip & road)
 	tyRight.clear();
 	tLane.clear();
 }
+
+void K1999::WriteTo(std::ostream & out) const
+{
+	const unsigned int count = Divs;
+	out.write(reinterpret_cast<const char *>(&count), sizeof(count));
+	if (count)
+	{
+		out.write(reinterpret_cast<const char *>(&tLane[0]), count * sizeof(double));
+		out.write(reinterpret_cast<const char *>(&tRInverse[0]), count * sizeof(double));
+	}
+}
+
+bool K1999::ReadFrom(std::istream & in)
+{
+	unsigned int count = 0;
+	if (!in.read(reinterpret_cast<char *>(&count), sizeof(count)) || int(count) != Divs)
+		return false;
+
+	if (count)
+	{
+		std::vector<double> lane(count), rinverse(count);
+		if (!in.read(reinterpret_cast<char *>(&lane[0]), count * sizeof(double)) ||
+			!in.read(reinterpret_cast<char *>(&rinverse[0]), count * sizeof(double)))
+			return false;
+
+		tLane.swap(lane);
+		tRInverse.swap(rinverse);
+	}
+	return true;
+}
+
+// racing line cache layout: magic, byte order mark, key length, the key,
+// then the K1999 solution of every closed road in road order
+// bump the version if the layout or the racing line solver change
+static const std::string header_magic = "VDLINE01";
+static const unsigned int header_byte_order = 0x01020304;
+
+void K1999::WriteHeader(std::ostream & out, const std::string & key)
+{
+	const unsigned int header[] = {header_byte_order, (unsigned int)key.size()};
+	out.write(header_magic.c_str(), header_magic.size());
+	out.write(reinterpret_cast<const char *>(header), sizeof(header));
+	out.write(key.c_str(), key.size());
+}
+
+bool K1999::ReadHeader(std::istream & in, const std::string & key)
+{
+	std::string magic(header_magic.size(), 0);
+	unsigned int header[2];
+	if (!in.read(&magic[0], magic.size()) || magic != header_magic ||
+		!in.read(reinterpret_cast<char *>(header), sizeof(header)) ||
+		header[0] != header_byte_order || header[1] != key.size())
+		return false;
+
+	std::string filekey(key.size(), 0);
+	return key.empty() || (in.read(&filekey[0], filekey.size()) && filekey == key);
+}
+
+#include "unittest.h"
+#include <sstream>
+#include <cmath>
+
+// closed ring road with an oval outline, written in the track file layout
+static void ReadRingRoad(RoadStrip & road)
+{
+	const int num = 48;
+	const double pi = 3.14159265358979323846;
+	std::stringstream s;
+	s << num << "\n";
+	for (int i = 0; i < num; ++i)
+	{
+		for (int x = 0; x < 4; ++x)
+		{
+			// row 3 is the back of the patch, row 0 the front shared with the next patch
+			const double a = 2 * pi * (i + (3 - x) / 3.0) / num;
+			for (int y = 0; y < 4; ++y)
+			{
+				const double r = 100 + 4 * y;
+				s << r * 1.5 * sin(a) << " " << 0 << " " << r * cos(a) << "\n";
+			}
+		}
+	}
+	std::stringstream error;
+	road.ReadFrom(s, false, error);
+}
+
+QT_TEST(k1999_cache_test)
+{
+	RoadStrip roada, roadb;
+	ReadRingRoad(roada);
+	ReadRingRoad(roadb);
+	QT_CHECK_EQUAL(roada.GetPatches().size(), 48);
+
+	std::stringstream cache;
+	K1999::WriteHeader(cache, "roads");
+	{
+		K1999 k;
+		QT_CHECK(k.LoadData(roada));
+		k.CalcRaceLine();
+		k.WriteTo(cache);
+		k.UpdateRoadStrip(roada);
+	}
+
+	// the cached solution reproduces the solved one exactly
+	{
+		std::stringstream in(cache.str());
+		K1999 k;
+		QT_CHECK(K1999::ReadHeader(in, "roads"));
+		QT_CHECK(k.LoadData(roadb));
+		QT_CHECK(k.ReadFrom(in));
+		k.UpdateRoadStrip(roadb);
+
+		int mismatches = 0;
+		for (size_t i = 0; i < roada.GetPatches().size(); ++i)
+		{
+			const RoadPatch & a = roada.GetPatches()[i];
+			const RoadPatch & b = roadb.GetPatches()[i];
+			for (int n = 0; n < 3; ++n)
+				mismatches += a.GetRacingLine()[n] != b.GetRacingLine()[n];
+			mismatches += a.GetTrackCurvature() != b.GetTrackCurvature();
+		}
+		QT_CHECK_EQUAL(mismatches, 0);
+	}
+
+	// a solution for a road with a different patch count is rejected
+	{
+		RoadStrip road;
+		ReadRingRoad(road);
+		road.GetPatches().pop_back();
+		std::stringstream in(cache.str());
+		K1999 k;
+		QT_CHECK(K1999::ReadHeader(in, "roads"));
+		k.LoadData(road);
+		QT_CHECK(!k.ReadFrom(in));
+	}
+
+	// truncated solution
+	{
+		std::stringstream in(cache.str().substr(0, cache.str().size() - 1));
+		K1999 k;
+		QT_CHECK(K1999::ReadHeader(in, "roads"));
+		QT_CHECK(k.LoadData(roadb));
+		QT_CHECK(!k.ReadFrom(in));
+	}
+
+	// mismatched headers
+	{
+		std::stringstream in(cache.str());
+		QT_CHECK(!K1999::ReadHeader(in, "sdaor"));
+	}
+	{
+		std::stringstream in(cache.str());
+		QT_CHECK(!K1999::ReadHeader(in, "road"));
+	}
+	{
+		std::string data = cache.str();
+		data[7] = '2';
+		std::stringstream in(data);
+		QT_CHECK(!K1999::ReadHeader(in, "roads"));
+	}
+	{
+		std::stringstream in(cache.str().substr(0, 10));
+		QT_CHECK(!K1999::ReadHeader(in, "roads"));
+	}
+}
@@ -31,6 +31,7 @@
 
 #include <vector>
 #include <iosfwd>
+#include <string>
 
 class RoadStrip;
 
@@ -62,6 +63,19 @@ public:
 	bool LoadData(const RoadStrip & road);
 	void CalcRaceLine();
 	void UpdateRoadStrip(RoadStrip & road);
+
+	/// write the solved lanes and curvatures in binary, call before UpdateRoadStrip
+	void WriteTo(std::ostream & out) const;
+
+	/// read a solution written by WriteTo instead of calling CalcRaceLine
+	/// returns false if it doesn't match the loaded road
+	bool ReadFrom(std::istream & in);
+
+	/// cache file header identifying the format and the roads the solutions belong to
+	static void WriteHeader(std::ostream & out, const std::string & key);
+
+	/// returns false if the header doesn't match the format or the key
+	static bool ReadHeader(std::istream & in, const std::string & key);
 };
 
 #endif //_K1999_H
@@ -0,0 +1,167 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "lz4.h"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// lz4 block format: sequences of a literal run followed by a match
+// token: literal length in the high, match length - 4 in the low nibble, 15 means more length bytes follow
+// the last sequence has literals only, the last 5 bytes are always literals
+// and the last match starts at least 12 bytes before the end
+static const unsigned int lz4_min_match = 4;
+static const unsigned int lz4_last_literals = 5;
+static const unsigned int lz4_match_limit = 12;
+static const unsigned int lz4_hash_bits = 12;
+static const unsigned int lz4_max_offset = 65535;
+
+unsigned int Lz4Bound(unsigned int size)
+{
+	return size + size / 255 + 16;
+}
+
+static unsigned char * Lz4WriteLength(unsigned char * op, unsigned int length)
+{
+	for (; length >= 255; length -= 255)
+		*op++ = 255;
+	*op++ = length;
+	return op;
+}
+
+static uint32_t Lz4Read32(const unsigned char * p)
+{
+	uint32_t value;
+	std::memcpy(&value, p, 4);
+	return value;
+}
+
+unsigned int Lz4Compress(const unsigned char * src, unsigned int size, unsigned char * dst)
+{
+	std::vector<int> table(1 << lz4_hash_bits, -1);
+	unsigned char * op = dst;
+	unsigned int anchor = 0;
+	if (size > lz4_match_limit)
+	{
+		const unsigned int start_limit = size - lz4_match_limit;
+		const unsigned int end_limit = size - lz4_last_literals;
+		unsigned int i = 0;
+		while (i < start_limit)
+		{
+			const uint32_t sequence = Lz4Read32(src + i);
+			const unsigned int hash = (sequence * 2654435761u) >> (32 - lz4_hash_bits);
+			const int ref = table[hash];
+			table[hash] = i;
+			if (ref < 0 || i - ref > lz4_max_offset || Lz4Read32(src + ref) != sequence)
+			{
+				++i;
+				continue;
+			}
+
+			unsigned int match_end = i + lz4_min_match;
+			while (match_end < end_limit && src[match_end] == src[ref + match_end - i])
+				++match_end;
+
+			const unsigned int literals = i - anchor;
+			const unsigned int match = match_end - i - lz4_min_match;
+			unsigned char * token = op++;
+			*token = (std::min(literals, 15u) << 4) | std::min(match, 15u);
+			if (literals >= 15)
+				op = Lz4WriteLength(op, literals - 15);
+			std::memcpy(op, src + anchor, literals);
+			op += literals;
+			const unsigned int offset = i - ref;
+			*op++ = offset & 255;
+			*op++ = offset >> 8;
+			if (match >= 15)
+				op = Lz4WriteLength(op, match - 15);
+
+			i = anchor = match_end;
+		}
+	}
+
+	const unsigned int literals = size - anchor;
+	*op++ = std::min(literals, 15u) << 4;
+	if (literals >= 15)
+		op = Lz4WriteLength(op, literals - 15);
+	std::memcpy(op, src + anchor, literals);
+	op += literals;
+	return op - dst;
+}
+
+static bool Lz4ReadLength(const unsigned char *& ip, const unsigned char * iend, unsigned int & length)
+{
+	unsigned char value;
+	do
+	{
+		if (ip >= iend)
+			return false;
+		value = *ip++;
+		length += value;
+	}
+	while (value == 255);
+	return true;
+}
+
+bool Lz4Decompress(const unsigned char * src, unsigned int packed_size, unsigned char * dst, unsigned int size)
+{
+	const unsigned char * ip = src;
+	const unsigned char * iend = src + packed_size;
+	unsigned int op = 0;
+	while (ip < iend)
+	{
+		const unsigned int token = *ip++;
+
+		unsigned int literals = token >> 4;
+		if (literals == 15 && !Lz4ReadLength(ip, iend, literals))
+			return false;
+		if (literals > unsigned(iend - ip) || literals > size - op)
+			return false;
+		std::memcpy(dst + op, ip, literals);
+		ip += literals;
+		op += literals;
+
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return false;
+		const unsigned int offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > op)
+			return false;
+
+		unsigned int match = token & 15;
+		if (match == 15 && !Lz4ReadLength(ip, iend, match))
+			return false;
+		match += lz4_min_match;
+		if (match > size - op)
+			return false;
+
+		// matches can overlap their own output, copy bytewise
+		const unsigned char * ref = dst + op - offset;
+		for (unsigned int i = 0; i < match; ++i)
+			dst[op + i] = ref[i];
+		op += match;
+	}
+	return op == size;
+}
@@ -0,0 +1,34 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _LZ4_H
+#define _LZ4_H
+
+/// lz4 block format, no frame header or checksums
+
+/// worst case compressed size
+unsigned int Lz4Bound(unsigned int size);
+
+/// greedy single probe compressor, dst has to hold Lz4Bound(size) bytes, return compressed size
+unsigned int Lz4Compress(const unsigned char * src, unsigned int size, unsigned char * dst);
+
+/// return false if the data is corrupt or doesn't decompress to exactly size bytes
+bool Lz4Decompress(const unsigned char * src, unsigned int packed_size, unsigned char * dst, unsigned int size);
+
+#endif // _LZ4_H
@@ -53,3 +53,40 @@ QT_TEST(matrix4_test)
 	QT_CHECK_CLOSE(in[1], orig[1], 0.001);
 	QT_CHECK_CLOSE(in[2], orig[2], 0.001);
 }
+
+QT_TEST(matrix4_multiply_test)
+{
+	Quat quat;
+	quat.Rotate(0.3, 0, 0, 1);
+	quat.Rotate(-1.2, 0, 1, 0);
+
+	Mat4 a, b;
+	quat.GetMatrix4(a);
+	a.Translate(1, -2, 3);
+	b.Perspective(45, 1.5, 0.1, 1000);
+
+	// reference in the order of the generic version
+	Mat4 c = a.Multiply(b);
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			float sum = 0;
+			for (int k = 0; k < 4; k++)
+				sum += a[i*4+k] * b[k*4+j];
+			QT_CHECK_EQUAL(c[i*4+j], sum);
+		}
+	}
+	Mat4 d = a.MultiplyGeneric(b);
+	for (int i = 0; i < 16; i++)
+		QT_CHECK_EQUAL(c[i], d[i]);
+
+	float v[4] = {0.5, -1, 2, 1};
+	float w[4] = {0, 0, 0, 0};
+	for (int r = 0; r < 4; r++)
+		for (int i = 0; i < 4; i++)
+			w[r] += v[i] * a[i*4+r];
+	a.MultiplyVector4(v);
+	for (int r = 0; r < 4; r++)
+		QT_CHECK_EQUAL(v[r], w[r]);
+}
@@ -27,6 +27,16 @@
 #include <cmath>
 #include <cassert>
 
+// define MATRIX4_NO_SIMD to build the generic versions only
+#if defined(MATRIX4_NO_SIMD)
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MATRIX4_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define MATRIX4_NEON
+#include <arm_neon.h>
+#endif
+
 template <typename T>
 class Matrix4
 {
@@ -66,6 +76,12 @@ class Matrix4
 
 		// this is actually other * this, not this * other
 		Matrix4 <T> Multiply(const Matrix4 <T> & other) const
+		{
+			return MultiplyGeneric(other);
+		}
+
+		/// the plain version of Multiply, also used for float if there is no simd specialization
+		Matrix4 <T> MultiplyGeneric(const Matrix4 <T> & other) const
 		{
 			Matrix4 out;
 
@@ -88,6 +104,13 @@ class Matrix4
 		/// be careful
 		template <typename U>
 		void MultiplyVector4(U * vector) const
+		{
+			MultiplyVector4Generic(vector);
+		}
+
+		/// the plain version of MultiplyVector4
+		template <typename U>
+		void MultiplyVector4Generic(U * vector) const
 		{
 			U in[4];
 			for (int i = 0; i < 4; i++)
@@ -369,6 +392,71 @@ std::ostream & operator << (std::ostream &os, const Matrix4 <T> & m)
 	return os;
 }
 
+// float specializations, the rows are summed up in the same order as in the generic versions
+#if defined(MATRIX4_SSE)
+
+template <>
+inline Matrix4 <float> Matrix4 <float>::Multiply(const Matrix4 <float> & other) const
+{
+	Matrix4 out;
+	const __m128 r0 = _mm_loadu_ps(other.data);
+	const __m128 r1 = _mm_loadu_ps(other.data + 4);
+	const __m128 r2 = _mm_loadu_ps(other.data + 8);
+	const __m128 r3 = _mm_loadu_ps(other.data + 12);
+	for (int i4 = 0; i4 < 16; i4 += 4)
+	{
+		__m128 v = _mm_mul_ps(_mm_set1_ps(data[i4]), r0);
+		v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(data[i4+1]), r1));
+		v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(data[i4+2]), r2));
+		v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(data[i4+3]), r3));
+		_mm_storeu_ps(out.data + i4, v);
+	}
+	return out;
+}
+
+template <> template <>
+inline void Matrix4 <float>::MultiplyVector4(float * vector) const
+{
+	__m128 v = _mm_mul_ps(_mm_set1_ps(vector[0]), _mm_loadu_ps(data));
+	v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(vector[1]), _mm_loadu_ps(data + 4)));
+	v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(vector[2]), _mm_loadu_ps(data + 8)));
+	v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(vector[3]), _mm_loadu_ps(data + 12)));
+	_mm_storeu_ps(vector, v);
+}
+
+#elif defined(MATRIX4_NEON)
+
+template <>
+inline Matrix4 <float> Matrix4 <float>::Multiply(const Matrix4 <float> & other) const
+{
+	Matrix4 out;
+	const float32x4_t r0 = vld1q_f32(other.data);
+	const float32x4_t r1 = vld1q_f32(other.data + 4);
+	const float32x4_t r2 = vld1q_f32(other.data + 8);
+	const float32x4_t r3 = vld1q_f32(other.data + 12);
+	for (int i4 = 0; i4 < 16; i4 += 4)
+	{
+		float32x4_t v = vmulq_n_f32(r0, data[i4]);
+		v = vaddq_f32(v, vmulq_n_f32(r1, data[i4+1]));
+		v = vaddq_f32(v, vmulq_n_f32(r2, data[i4+2]));
+		v = vaddq_f32(v, vmulq_n_f32(r3, data[i4+3]));
+		vst1q_f32(out.data + i4, v);
+	}
+	return out;
+}
+
+template <> template <>
+inline void Matrix4 <float>::MultiplyVector4(float * vector) const
+{
+	float32x4_t v = vmulq_n_f32(vld1q_f32(data), vector[0]);
+	v = vaddq_f32(v, vmulq_n_f32(vld1q_f32(data + 4), vector[1]));
+	v = vaddq_f32(v, vmulq_n_f32(vld1q_f32(data + 8), vector[2]));
+	v = vaddq_f32(v, vmulq_n_f32(vld1q_f32(data + 12), vector[3]));
+	vst1q_f32(vector, v);
+}
+
+#endif
+
 typedef Matrix4 <float> Mat4;
 
 #endif
@@ -18,9 +18,246 @@
 /************************************************************************/
 
 #include "parallel_task.h"
+#include "profiler.h"
+#include <cassert>
 
-int Parallel::Dispatch(void * data)
+namespace Parallel
 {
-	((Task *) data)->Run();
+
+JobSystem::JobSystem() :
+	wake_mutex(NULL),
+	wake_cond(NULL),
+	next_queue(0)
+{
+	SDL_AtomicSet(&queued, 0);
+	SDL_AtomicSet(&pending, 0);
+	SDL_AtomicSet(&quit, 0);
+}
+
+JobSystem::~JobSystem()
+{
+	Deinit();
+}
+
+void JobSystem::Init(unsigned int num_threads)
+{
+	//don't allow double init
+	assert(queues.empty());
+
+	SDL_AtomicSet(&queued, 0);
+	SDL_AtomicSet(&pending, 0);
+	SDL_AtomicSet(&quit, 0);
+	next_queue = 0;
+
+	wake_mutex = SDL_CreateMutex();
+	wake_cond = SDL_CreateCond();
+
+	queues.resize(num_threads + 1);
+	for (unsigned int i = 0; i < queues.size(); ++i)
+	{
+		queues[i].mutex = SDL_CreateMutex();
+	}
+
+	workers.resize(num_threads);
+	for (unsigned int i = 0; i < workers.size(); ++i)
+	{
+		workers[i].system = this;
+		workers[i].id = i + 1;
+		workers[i].thread = NULL;
+	}
+	for (unsigned int i = 0; i < workers.size(); ++i)
+	{
+		workers[i].thread = SDL_CreateThread(Dispatch, "JobSystem", &workers[i]);
+	}
+}
+
+void JobSystem::Deinit()
+{
+	if (queues.empty())
+		return;
+
+	//finish outstanding work before shutting down
+	Wait();
+
+	SDL_LockMutex(wake_mutex);
+	SDL_AtomicSet(&quit, 1);
+	SDL_CondBroadcast(wake_cond);
+	SDL_UnlockMutex(wake_mutex);
+
+	for (unsigned int i = 0; i < workers.size(); ++i)
+	{
+		SDL_WaitThread(workers[i].thread, NULL);
+	}
+	workers.clear();
+
+	for (unsigned int i = 0; i < queues.size(); ++i)
+	{
+		SDL_DestroyMutex(queues[i].mutex);
+	}
+	queues.clear();
+
+	SDL_DestroyCond(wake_cond);
+	SDL_DestroyMutex(wake_mutex);
+	wake_cond = NULL;
+	wake_mutex = NULL;
+}
+
+unsigned int JobSystem::GetNumThreads() const
+{
+	return workers.size();
+}
+
+void JobSystem::Submit(Job & job)
+{
+	if (queues.empty())
+	{
+		job.Execute();
+		return;
+	}
+
+	SDL_AtomicAdd(&pending, 1);
+
+	Queue & queue = queues[next_queue];
+	next_queue = (next_queue + 1) % queues.size();
+
+	SDL_LockMutex(queue.mutex);
+	queue.jobs.push_back(&job);
+	SDL_UnlockMutex(queue.mutex);
+
+	//queued is incremented before the workers check it under the wake lock, so a wakeup can't get lost
+	SDL_AtomicAdd(&queued, 1);
+	SDL_LockMutex(wake_mutex);
+	SDL_CondSignal(wake_cond);
+	SDL_UnlockMutex(wake_mutex);
+}
+
+void JobSystem::Wait()
+{
+	//jobs are expected to be short (a fraction of a frame), so spin instead of sleeping
+	while (SDL_AtomicGet(&pending) > 0)
+	{
+		ExecuteNext(0);
+	}
+}
+
+Job * JobSystem::Pop(unsigned int id)
+{
+	Job * job = NULL;
+	Queue & queue = queues[id];
+	SDL_LockMutex(queue.mutex);
+	if (!queue.jobs.empty())
+	{
+		job = queue.jobs.back();
+		queue.jobs.pop_back();
+	}
+	SDL_UnlockMutex(queue.mutex);
+	return job;
+}
+
+Job * JobSystem::Steal(unsigned int id)
+{
+	for (unsigned int i = 1; i < queues.size(); ++i)
+	{
+		Queue & queue = queues[(id + i) % queues.size()];
+		Job * job = NULL;
+		SDL_LockMutex(queue.mutex);
+		if (!queue.jobs.empty())
+		{
+			job = queue.jobs.front();
+			queue.jobs.pop_front();
+		}
+		SDL_UnlockMutex(queue.mutex);
+		if (job)
+			return job;
+	}
+	return NULL;
+}
+
+bool JobSystem::ExecuteNext(unsigned int id)
+{
+	Job * job = Pop(id);
+	if (!job)
+		job = Steal(id);
+	if (!job)
+		return false;
+
+	SDL_AtomicAdd(&queued, -1);
+	{
+		PROFILE_ZONE("job");
+		job->Execute();
+	}
+	SDL_AtomicAdd(&pending, -1);
+	return true;
+}
+
+void JobSystem::Run(unsigned int id)
+{
+	while (!SDL_AtomicGet(&quit))
+	{
+		if (ExecuteNext(id))
+			continue;
+
+		SDL_LockMutex(wake_mutex);
+		while (!SDL_AtomicGet(&quit) && SDL_AtomicGet(&queued) <= 0)
+		{
+			SDL_CondWait(wake_cond, wake_mutex);
+		}
+		SDL_UnlockMutex(wake_mutex);
+	}
+}
+
+int JobSystem::Dispatch(void * data)
+{
+	Worker * worker = (Worker *) data;
+	worker->system->Run(worker->id);
 	return 0;
 }
+
+}
+
+#include "unittest.h"
+
+struct SquareJob : public Parallel::Job
+{
+	int value;
+	int result;
+
+	void Execute()
+	{
+		result = value * value;
+	}
+};
+
+QT_TEST(parallel_task_test)
+{
+	std::vector<SquareJob> jobs(64);
+	for (unsigned int i = 0; i < jobs.size(); ++i)
+	{
+		jobs[i].value = i;
+		jobs[i].result = -1;
+	}
+
+	Parallel::JobSystem system;
+	system.Init(3);
+	QT_CHECK_EQUAL(system.GetNumThreads(), 3u);
+
+	// run twice to make sure the pool is reusable after a wait
+	for (int n = 0; n < 2; ++n)
+	{
+		for (unsigned int i = 0; i < jobs.size(); ++i)
+		{
+			jobs[i].result = -1;
+			system.Submit(jobs[i]);
+		}
+		system.Wait();
+
+		// results are stored per job, so they don't depend on execution order
+		for (unsigned int i = 0; i < jobs.size(); ++i)
+		{
+			QT_CHECK_EQUAL(jobs[i].result, int(i * i));
+		}
+	}
+
+	system.Deinit();
+	QT_CHECK_EQUAL(system.GetNumThreads(), 0u);
+}
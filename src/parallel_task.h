@@ -17,153 +17,89 @@
 /*                                                                      */
 /************************************************************************/
 
-//a simple parallel task system where a task is its own worker thread
+//a job system with a fixed pool of worker threads and work-stealing job queues
 
 #ifndef _PARALLEL_TASK_H_
 #define _PARALLEL_TASK_H_
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_atomic.h>
 
-#include <cassert>
-#include <iostream>
-
-//#define VERBOSE
+#include <deque>
+#include <vector>
 
 namespace Parallel
 {
 
-int Dispatch(void * data);
+/// A unit of work, jobs are owned by the caller and have to stay alive until JobSystem::Wait returns.
+class Job
+{
+public:
+	virtual ~Job() {}
+	virtual void Execute() = 0;
+};
 
-class Task
+/// Each worker owns a job queue. Workers take their own jobs from the back
+/// and steal from the front of the other queues when they run out of work.
+/// The thread calling Wait is worker 0 and executes jobs too, so Init(0)
+/// runs everything on the calling thread.
+class JobSystem
 {
-	private:
-		bool quit;
+public:
+	JobSystem();
 
-		SDL_sem * sem_frame_start;
-		SDL_sem * sem_frame_end;
+	~JobSystem();
 
-		bool executing;
+	/// start the given number of worker threads in addition to the calling thread
+	void Init(unsigned int num_threads);
 
-		SDL_Thread * thread;
+	void Deinit();
 
-	public:
-		Task() : quit(false), sem_frame_start(NULL), sem_frame_end(NULL), executing(false), thread(NULL)
-		{}
-
-		void Init()
-		{
-			//don't allow double init
-			assert (!sem_frame_start);
-			assert (!sem_frame_end);
-			assert (!thread);
-
-			quit = false;
-			sem_frame_start = SDL_CreateSemaphore(0);
-			sem_frame_end = SDL_CreateSemaphore(0);
-			thread = SDL_CreateThread(Dispatch, NULL, this);
-		}
-
-		~Task()
-		{
-			Deinit();
-		}
-
-		void Deinit()
-		{
-			//don't allow double deinit, or deinit with no init
-			if (!(sem_frame_start && sem_frame_end && thread))
-				return;
-
-			quit = true;
-			//at this point our thread is waiting for the frame to start, so have it do one last iteration so it can see the quit flag
-#ifdef VERBOSE
-			std::cout << "telling child to exit" << std::endl;
-#endif
-			SDL_SemPost(sem_frame_start);
-#ifdef VERBOSE
-			std::cout << "waiting for thread to exit" << std::endl;
-#endif
-			//wait for the thread to exit
-			SDL_WaitThread(thread, NULL);
-#ifdef VERBOSE
-			std::cout << "thread has exited" << std::endl;
-#endif
-			thread = NULL;
+	/// number of worker threads, not counting the calling thread
+	unsigned int GetNumThreads() const;
 
-			SDL_DestroySemaphore(sem_frame_start);
-			SDL_DestroySemaphore(sem_frame_end);
-#ifdef VERBOSE
-			std::cout << "destroyed semaphores" << std::endl;
-#endif
+	/// queue job for execution, jobs are distributed round-robin over the queues
+	void Submit(Job & job);
 
-			sem_frame_start = NULL;
-			sem_frame_end = NULL;
-		}
+	/// execute jobs until all submitted jobs are done
+	void Wait();
 
-		void Run()
-		{
-#ifdef VERBOSE
-			std::cout << "child thread run" << std::endl;
-#endif
-			this->Setup();
+private:
+	struct Queue
+	{
+		SDL_mutex * mutex;
+		std::deque<Job *> jobs;
+	};
 
-#ifdef VERBOSE
-			std::cout << "posting end semaphore to allow the main loop to run through the first iteration" << std::endl;
-#endif
-			SDL_SemPost(sem_frame_end);
+	struct Worker
+	{
+		JobSystem * system;
+		unsigned int id;
+		SDL_Thread * thread;
+	};
 
-			while (!quit)
-			{
-#ifdef VERBOSE
-				std::cout << "waiting for start semaphore" << std::endl;
-#endif
-				SDL_SemWait(sem_frame_start);
-#ifdef VERBOSE
-				std::cout << "done waiting for start semaphore" << std::endl;
-#endif
+	std::vector<Queue> queues;
+	std::vector<Worker> workers;
+	SDL_mutex * wake_mutex;
+	SDL_cond * wake_cond;
+	SDL_atomic_t queued;
+	SDL_atomic_t pending;
+	SDL_atomic_t quit;
+	unsigned int next_queue;
 
-				executing = true;
-				if (!quit) //avoid doing the last tick if we don't have to
-					this->Execute();
-				executing = false;
+	// take a job from the back of the own queue
+	Job * Pop(unsigned int id);
 
-#ifdef VERBOSE
-				std::cout << "posting end semaphore" << std::endl;
-#endif
-				SDL_SemPost(sem_frame_end);
-			}
-#ifdef VERBOSE
-			std::cout << "child thread exit" << std::endl;
-#endif
-		}
+	// take a job from the front of another queue
+	Job * Steal(unsigned int id);
 
-		void Start()
-		{
-#ifdef VERBOSE
-			std::cout << "posting start semaphore" << std::endl;
-#endif
-			SDL_SemPost(sem_frame_start);
-		}
-
-		void End()
-		{
-#ifdef VERBOSE
-			std::cout << "waiting for end semaphore" << std::endl;
-#endif
-			SDL_SemWait(sem_frame_end);
-#ifdef VERBOSE
-			std::cout << "done waiting for end semaphore" << std::endl;
-#endif
-		}
+	// pop or steal a job and execute it, return false if there was nothing to do
+	bool ExecuteNext(unsigned int id);
 
-		virtual void Execute() = 0;
-		virtual void Setup() {}
+	void Run(unsigned int id);
 
-		bool GetExecuting() const
-		{
-			return executing;
-		}
+	static int Dispatch(void * data);
 };
 
 }
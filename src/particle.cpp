@@ -22,6 +22,8 @@
 #include "graphics/texture.h"
 #include "unittest.h"
 
+#include <cmath>
+
 static inline float clamp(float v, float vmin, float vmax)
 {
 	return std::max(vmin, std::min(vmax, v));
@@ -43,7 +45,14 @@ ParticleSystem::ParticleSystem() :
 	size_range(0.5,1),
 	direction(0,1,0)
 {
-	// ctor
+	varrays[0].SetTexCoordSets(1);
+	varrays[1].SetTexCoordSets(1);
+	SetParameters(max_particles,
+		transparency_range.first, transparency_range.second,
+		longevity_range.first, longevity_range.second,
+		speed_range.first, speed_range.second,
+		size_range.first, size_range.second,
+		direction);
 }
 
 void ParticleSystem::Load(
@@ -66,24 +75,20 @@ void ParticleSystem::Load(
 
 void ParticleSystem::Update(float dt)
 {
-	//  update particles
-	for (size_t i = 0; i < particles.size(); i++)
+	// update particles
+	const unsigned count = time.size();
+	for (unsigned i = 0; i < count; i++)
 	{
-		particles[i].time += dt;
+		time[i] += dt;
 	}
 
 	// remove expired particles
-	for (size_t i = 0; i < particles.size(); i++)
+	for (unsigned i = 0; i < time.size();)
 	{
-		if (particles[i].time > particles[i].longevity)
-		{
-			//only bother to swap if it's not already at the end
-			size_t last = particles.size() - 1;
-			if (i != last)
-				particles[i] = particles[last];
-
-			particles.pop_back();
-		}
+		if (time[i] > longevity[i])
+			Remove(i);
+		else
+			i++;
 	}
 }
 
@@ -91,7 +96,7 @@ void ParticleSystem::UpdateGraphics(
 	const Quat & camdir,
 	const Vec3 & campos,
 	float znear, float zfar,
-	float fovy, float fovz)
+	float fovy, float aspect)
 {
 	if (max_particles == 0)
 		return;
@@ -99,86 +104,113 @@ void ParticleSystem::UpdateGraphics(
 	node.GetTransform().SetTranslation(campos);
 	node.GetTransform().SetRotation(-camdir);
 
+	// camera space axes and origin in world space
+	Vec3 ax(1, 0, 0), ay(0, 1, 0), az(0, 0, 1), origin = -campos;
+	camdir.RotateVector(ax);
+	camdir.RotateVector(ay);
+	camdir.RotateVector(az);
+	camdir.RotateVector(origin);
+
 	// get particle position in camera space
-	distance_from_cam.clear();
-	for (unsigned i = 0; i < particles.size(); ++i)
+	const unsigned count = time.size();
+	distance_from_cam.resize(count);
+	for (unsigned i = 0; i < count; ++i)
 	{
-		Particle & p = particles[i];
-		Vec3 pos = p.start_position;
-		pos = pos + p.direction * p.time * p.speed - campos;
-		camdir.RotateVector(pos);
+		const float x = start_x[i] + velocity_x[i] * time[i];
+		const float y = start_y[i] + velocity_y[i] * time[i];
+		const float z = start_z[i] + velocity_z[i] * time[i];
+		cam_x[i] = x * ax[0] + y * ay[0] + z * az[0] + origin[0];
+		cam_y[i] = x * ax[1] + y * ay[1] + z * az[1] + origin[1];
+		cam_z[i] = x * ax[2] + y * ay[2] + z * az[2] + origin[2];
 
 		// signed distance along z-axis in camera space
-		distance_from_cam.push_back(-pos[2]);
-
-		// store camera space position
-		p.position = pos;
+		distance_from_cam[i] = -cam_z[i];
 	}
 
-	// sort particles by distance to camera
+	// sort particles by distance to camera, ranks of the last frame are
+	// reused as long as the particle count doesn't change
+	if (count > 0)
+		depth_sort.sort(distance_from_cam);
+	const std::vector<unsigned> & ranks = depth_sort.getRanks();
 
-	// update vertex data
-	varrays[cur_varray].Clear();
-	varrays[cur_varray].SetTexCoordSets(1);
-	for (size_t i = 0; i < particles.size(); ++i)
+	// view frustum half extents at unit distance
+	const bool cull_sides = (fovy > 0 && aspect > 0);
+	const float tan_y = std::tan(fovy * float(M_PI) / 360);
+	const float tan_x = tan_y * aspect;
+
+	// update vertex data back to front
+	unsigned visible = 0;
+	for (unsigned n = count; n-- > 0;)
 	{
-		// cull particles outside of [znear, zfar]
-		// todo: cull particles outside of view frustum
-		if (distance_from_cam[i] < znear || distance_from_cam[i] > zfar)
+		const unsigned i = ranks[n];
+		const float distance = distance_from_cam[i];
+		if (distance < znear || distance > zfar)
 			continue;
 
-		Particle & p = particles[i];
-		Vec3 pos = p.position;
-
-		float trans = p.transparency * std::pow((1.0f - p.time / p.longevity), 4);
-		trans = clamp(trans, 0.0f, 1.0f);
-
-		float sizescale = 0.2f * (p.time / p.longevity) + 0.4f;
-/*
-		// scale the alpha by the closeness to the camera. if we get too close, don't draw
-		// this prevents major slowdown when there are a lot of particles right next to the camera
-		float camdist = pos.Magnitude();
-		const float camdist_off = 3.0;
-		const float camdist_full = 4.0;
-		trans = lerp(0.f, trans, (camdist - camdist_off) / (camdist_full - camdist_off));
-*/
+		const float age = time[i] / longevity[i];
+		const float sizescale = 0.2f * age + 0.4f;
+		const float x1 = -sizescale;
+		const float y1 = -sizescale * 2 / 3.0f;
+		const float x2 = sizescale;
+		const float y2 = sizescale * 4 / 3.0f;
+
+		// y2 is the largest extent of the billboard
+		if (cull_sides && (
+			std::abs(cam_x[i]) > distance * tan_x + y2 ||
+			std::abs(cam_y[i]) > distance * tan_y + y2))
+			continue;
+
+		float fade = 1.0f - age;
+		fade = fade * fade;
+		const float trans = clamp(transparency[i] * fade * fade, 0.0f, 1.0f);
+		const unsigned char alpha = trans * 255;
+
 		// assume 9 tiles in texture atlas
-		int vi = p.tid / 3;
-		int ui = p.tid - vi * 3;
-		float u1 = ui * 1 / 3.0f;
-		float v1 = vi * 1 / 3.0f;
-		float u2 = u1 + 1 / 3.0f;
-		float v2 = v1 + 1 / 3.0f;
-		float x1 = -sizescale;
-		float y1 = -sizescale * 2 / 3.0f;
-		float x2 = sizescale;
-		float y2 = sizescale * 4 / 3.0f;
-		unsigned char alpha = trans * 255;
-
-		const int faces[6] = {
-			0, 2, 1,
-			0, 3, 2,
-		};
-		const float uvs[8] = {
-			u1, v1,
-			u2, v1,
-			u2, v2,
-			u1, v2,
-		};
-		const float verts[12] = {
-			pos[0] + x1, pos[1] + y1, pos[2],
-			pos[0] + x2, pos[1] + y1, pos[2],
-			pos[0] + x2, pos[1] + y2, pos[2],
-			pos[0] + x1, pos[1] + y2, pos[2],
-		};
-		const unsigned char cols[16] = {
-			255, 255, 255, alpha,
-			255, 255, 255, alpha,
-			255, 255, 255, alpha,
-			255, 255, 255, alpha,
-		};
-
-		varrays[cur_varray].Add(cols, 16, 0, 0, verts, 12, faces, 6, uvs, 8);
+		const int vi = tid[i] / 3;
+		const int ui = tid[i] - vi * 3;
+		const float u1 = ui * 1 / 3.0f;
+		const float v1 = vi * 1 / 3.0f;
+		const float u2 = u1 + 1 / 3.0f;
+		const float v2 = v1 + 1 / 3.0f;
+
+		const float px = cam_x[i];
+		const float py = cam_y[i];
+		const float pz = cam_z[i];
+		float * v = &vertices[visible * 12];
+		v[0] = px + x1; v[1] = py + y1; v[2] = pz;
+		v[3] = px + x2; v[4] = py + y1; v[5] = pz;
+		v[6] = px + x2; v[7] = py + y2; v[8] = pz;
+		v[9] = px + x1; v[10] = py + y2; v[11] = pz;
+
+		float * t = &texcoords[visible * 8];
+		t[0] = u1; t[1] = v1;
+		t[2] = u2; t[3] = v1;
+		t[4] = u2; t[5] = v2;
+		t[6] = u1; t[7] = v2;
+
+		unsigned char * c = &colors[visible * 16];
+		for (unsigned k = 0; k < 16; k += 4)
+		{
+			c[k] = c[k + 1] = c[k + 2] = 255;
+			c[k + 3] = alpha;
+		}
+
+		visible++;
+	}
+
+	// faces are the same for all frames, the arrays keep their capacity
+	VertexArray & varray = varrays[cur_varray];
+	if (visible > 0)
+	{
+		varray.SetFaces(&faces[0], visible * 6);
+		varray.SetVertices(&vertices[0], visible * 12);
+		varray.SetColors(&colors[0], visible * 16);
+		varray.SetTexCoords(0, &texcoords[0], visible * 8);
+	}
+	else
+	{
+		varray.Clear();
+		varray.SetTexCoordSets(1);
 	}
 }
 
@@ -200,26 +232,64 @@ void ParticleSystem::AddParticle(
 	if (max_particles == 0)
 		return;
 
-	while (particles.size() >= max_particles)
-		particles.pop_back();
-
-	particles.push_back(Particle());
-	Particle & p = particles.back();
-	p.start_position = position;
-	p.direction = direction;
-	p.transparency = transparency_range.first + newspeed * (transparency_range.second - transparency_range.first);
-	p.speed = speed_range.first + newspeed * (speed_range.second - speed_range.first);
-	p.size = size_range.first + newspeed * (size_range.second - size_range.first);
-	p.longevity = longevity_range.first + newspeed * (longevity_range.second - longevity_range.first);
-	p.time = 0;
-	p.tid = cur_texture_tile;
+	while (time.size() >= max_particles)
+		Remove(time.size() - 1);
+
+	const float speed = speed_range.first + newspeed * (speed_range.second - speed_range.first);
+	start_x.push_back(position[0]);
+	start_y.push_back(position[1]);
+	start_z.push_back(position[2]);
+	velocity_x.push_back(direction[0] * speed);
+	velocity_y.push_back(direction[1] * speed);
+	velocity_z.push_back(direction[2] * speed);
+	transparency.push_back(transparency_range.first + newspeed * (transparency_range.second - transparency_range.first));
+	longevity.push_back(longevity_range.first + newspeed * (longevity_range.second - longevity_range.first));
+	time.push_back(0);
+	tid.push_back(cur_texture_tile);
 
 	cur_texture_tile = (cur_texture_tile + 1) % texture_tiles;
 }
 
+void ParticleSystem::Remove(unsigned i)
+{
+	const unsigned last = time.size() - 1;
+	if (i != last)
+	{
+		start_x[i] = start_x[last];
+		start_y[i] = start_y[last];
+		start_z[i] = start_z[last];
+		velocity_x[i] = velocity_x[last];
+		velocity_y[i] = velocity_y[last];
+		velocity_z[i] = velocity_z[last];
+		transparency[i] = transparency[last];
+		longevity[i] = longevity[last];
+		time[i] = time[last];
+		tid[i] = tid[last];
+	}
+	start_x.pop_back();
+	start_y.pop_back();
+	start_z.pop_back();
+	velocity_x.pop_back();
+	velocity_y.pop_back();
+	velocity_z.pop_back();
+	transparency.pop_back();
+	longevity.pop_back();
+	time.pop_back();
+	tid.pop_back();
+}
+
 void ParticleSystem::Clear()
 {
-	particles.clear();
+	start_x.clear();
+	start_y.clear();
+	start_z.clear();
+	velocity_x.clear();
+	velocity_y.clear();
+	velocity_z.clear();
+	transparency.clear();
+	longevity.clear();
+	time.clear();
+	tid.clear();
 }
 
 void ParticleSystem::SetParameters(
@@ -234,9 +304,35 @@ void ParticleSystem::SetParameters(
 	float sizemax,
 	Vec3 newdir)
 {
-	max_particles = maxparticles < 0 ? 0 : (maxparticles > 1024 ? 1024 : maxparticles);
-	particles.reserve(max_particles);
+	max_particles = maxparticles < 0 ? 0 : (maxparticles > 16384 ? 16384 : maxparticles);
+	while (time.size() > max_particles)
+		Remove(time.size() - 1);
+
+	start_x.reserve(max_particles);
+	start_y.reserve(max_particles);
+	start_z.reserve(max_particles);
+	velocity_x.reserve(max_particles);
+	velocity_y.reserve(max_particles);
+	velocity_z.reserve(max_particles);
+	transparency.reserve(max_particles);
+	longevity.reserve(max_particles);
+	time.reserve(max_particles);
+	tid.reserve(max_particles);
+
+	cam_x.resize(max_particles);
+	cam_y.resize(max_particles);
+	cam_z.resize(max_particles);
 	distance_from_cam.reserve(max_particles);
+	vertices.resize(max_particles * 12);
+	texcoords.resize(max_particles * 8);
+	colors.resize(max_particles * 16);
+	faces.resize(max_particles * 6);
+	for (unsigned i = 0; i < max_particles; ++i)
+	{
+		int * f = &faces[i * 6];
+		f[0] = i * 4 + 0; f[1] = i * 4 + 2; f[2] = i * 4 + 1;
+		f[3] = i * 4 + 0; f[4] = i * 4 + 3; f[5] = i * 4 + 2;
+	}
 
 	transparency_range.first = transmin;
 	transparency_range.second = transmax;
@@ -269,4 +365,25 @@ QT_TEST(particle_test)
 	QT_CHECK_EQUAL(s.NumParticles(),1);
 	s.Update(0.50);
 	QT_CHECK_EQUAL(s.NumParticles(),0);
+
+	//test culling and back to front order of stationary particles
+	s.SetParameters(8,1.0,1.0,10.0,10.0,0.0,0.0,1.0,1.0,Vec3(0,1,0));
+	s.AddParticle(Vec3(0,0,-5),0);
+	s.AddParticle(Vec3(0,0,-20),0);
+	s.AddParticle(Vec3(0,0,5),0);
+	s.AddParticle(Vec3(50,0,-5),0);
+	s.UpdateGraphics(Quat(), Vec3(0,0,0), 0.1, 100, 90, 1);
+	s.SyncGraphics();
+	QT_CHECK(s.GetNode().GetDrawlist().particle.size() == 1);
+	const VertexArray * va = s.GetNode().GetDrawlist().particle.begin()->GetVertArray();
+	const float * verts = 0;
+	int vcount = 0;
+	va->GetVertices(verts, vcount);
+	QT_CHECK_EQUAL(vcount, 24);
+	QT_CHECK_EQUAL(va->GetNumFaces(), 12);
+	if (vcount == 24)
+	{
+		QT_CHECK_EQUAL(verts[2], -20);
+		QT_CHECK_EQUAL(verts[14], -5);
+	}
 }
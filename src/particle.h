@@ -24,6 +24,7 @@
 #include "graphics/vertexarray.h"
 #include "mathvector.h"
 #include "quaternion.h"
+#include "radix.h"
 #include "memory.h"
 
 #include <string>
@@ -54,12 +55,14 @@ public:
 	void Update(float dt);
 
 	/// Partcles graphics update based on last physics state.
+	/// Particles are culled against the view frustum and sorted back to front.
+	/// fovy in degrees, fovy or aspect of 0 only culls by znear, zfar.
 	/// Call once per frame.
 	void UpdateGraphics(
 		const Quat & camdir,
 		const Vec3 & campos,
 		float znear, float zfar,
-		float fovy = 0, float fovz = 0);
+		float fovy = 0, float aspect = 0);
 
 	/// Particle system is double buffered
 	/// Call SyncGraphics between FinishDraw and BeginDraw
@@ -80,25 +83,28 @@ public:
 		float sizemax,
 		Vec3 newdir);
 
-	unsigned NumParticles() { return particles.size(); }
+	unsigned NumParticles() { return time.size(); }
 
 	SceneNode & GetNode() { return node; }
 
 private:
-	struct Particle
-	{
-		Vec3 start_position; ///< start position in world space
-		Vec3 direction;		///< direction in world space
-		Vec3 position;		///< position in camera space
-		float transparency; ///< transparency factor
-		float speed;		///< initial velocity along direction
-		float size;			///< initial size
-		float longevity;	///< particle age limit
-		float time;			///< particle age, time since the particle was created
-		int tid;			///< particle texture atlas tile id 0-8
-	};
-	std::vector<Particle> particles;
-	std::vector<float> distance_from_cam;
+	// particle state as structure of arrays, particles are swapped out when they expire
+	std::vector<float> start_x, start_y, start_z; ///< start position in world space
+	std::vector<float> velocity_x, velocity_y, velocity_z; ///< velocity in world space
+	std::vector<float> transparency; ///< transparency factor
+	std::vector<float> longevity; ///< particle age limit
+	std::vector<float> time; ///< particle age, time since the particle was created
+	std::vector<unsigned char> tid; ///< particle texture atlas tile id 0-8
+
+	// graphics update scratch space, preallocated for max_particles
+	std::vector<float> cam_x, cam_y, cam_z; ///< position in camera space
+	std::vector<float> distance_from_cam; ///< signed distance along the view direction
+	std::vector<float> vertices;
+	std::vector<float> texcoords;
+	std::vector<unsigned char> colors;
+	std::vector<int> faces;
+	Radix depth_sort; ///< keeps the order of the last frame, usually still sorted
+
 	unsigned max_particles;
 	unsigned texture_tiles;
 	unsigned cur_texture_tile;
@@ -115,6 +121,9 @@ private:
 	VertexArray varrays[2]; ///< use double buffered vertex array
 	SceneNode node;
 
+	/// Move the last particle into slot i.
+	void Remove(unsigned i);
+
 	static keyed_container<Drawable> & GetDrawlist(SceneNode & node)
 	{
 		return node.GetDrawlist().particle;
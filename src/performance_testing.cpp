@@ -23,6 +23,8 @@
 #include "physics/tracksurface.h"
 #include "content/contentmanager.h"
 #include "cfg/ptree.h"
+#include "quickprof.h"
+#include "random.h"
 
 #include <vector>
 #include <iostream>
@@ -38,6 +40,24 @@ static inline float ConvertToFeet(float meters)
 	return meters * 3.2808399;
 }
 
+PerformanceResults::PerformanceResults() :
+	mass(0),
+	max_speed(0),
+	max_speed_time(0),
+	downforce(0),
+	lift_drag(0),
+	time_0_60(0),
+	quarter_mile_time(0),
+	quarter_mile_speed(0),
+	stopping_distance(0),
+	stopping_distance_abs(0),
+	steps(0),
+	sim_time(0),
+	wall_time(0)
+{
+	// ctor
+}
+
 PerformanceTesting::PerformanceTesting(DynamicsWorld & world) :
 	world(world), track(0), plane(0)
 {
@@ -72,6 +92,24 @@ void PerformanceTesting::Test(
 {
 	info_output << "Beginning car performance test on " << carname << std::endl;
 
+	if (!Load(cardir, carname, content, info_output, error_output))
+	{
+		return;
+	}
+
+	Run(info_output, error_output);
+	TestTires(info_output, error_output);
+
+	info_output << "Car performance test complete." << std::endl;
+}
+
+bool PerformanceTesting::Load(
+	const std::string & cardir,
+	const std::string & carname,
+	ContentManager & content,
+	std::ostream & info_output,
+	std::ostream & error_output)
+{
 	// init track
 	assert(!track);
 	assert(!plane);
@@ -90,7 +128,7 @@ void PerformanceTesting::Test(
 	content.load(cfg, cardir, carname + ".car");
 	if (!cfg->size())
 	{
-		return;
+		return false;
 	}
 
 	// position is the center of a 2 x 4 x 1 meter box on track surface
@@ -102,9 +140,12 @@ void PerformanceTesting::Test(
 	bool damage = false;
 	if (!car.Load(error_output, content, world, *cfg, cardir, "", size, center, pos, rot, damage))
 	{
-		return;
+		return false;
 	}
 
+	results = PerformanceResults();
+	results.mass = 1 / car.GetInvMass();
+
 	info_output << "Car dynamics loaded" << std::endl;
 	info_output << carname << " Summary:\n" <<
 			"Mass (kg) including driver and fuel: " << 1 / car.GetInvMass() << "\n" <<
@@ -119,11 +160,19 @@ void PerformanceTesting::Test(
 	//else info_output << "Car state: " << statestream.str();
 	carstate = statestream.str();
 
+	return true;
+}
+
+void PerformanceTesting::Run(std::ostream & info_output, std::ostream & error_output)
+{
+	quickprof::Clock clock;
+	clock.reset();
+
 	TestMaxSpeed(info_output, error_output);
 	TestStoppingDistance(false, info_output, error_output);
 	TestStoppingDistance(true, info_output, error_output);
 
-	info_output << "Car performance test complete." << std::endl;
+	results.wall_time += clock.getTimeMicroseconds() * 1E-6;
 }
 
 void PerformanceTesting::ResetCar()
@@ -167,6 +216,8 @@ void PerformanceTesting::TestMaxSpeed(std::ostream & info_output, std::ostream &
 	float quarterspeed = 0;
 
 	std::string downforcestr = "N/A";
+	float downforce = 0;
+	float liftdrag = 0;
 
 	ResetCar();
 
@@ -181,6 +232,8 @@ void PerformanceTesting::TestMaxSpeed(std::ostream & info_output, std::ostream &
 		car.Update(carinput);
 
 		world.update(dt);
+		results.steps++;
+		results.sim_time += dt;
 
 		float car_speed = car.GetSpeed();
 
@@ -188,8 +241,10 @@ void PerformanceTesting::TestMaxSpeed(std::ostream & info_output, std::ostream &
 		{
 			maxspeed.first = t;
 			maxspeed.second = car.GetSpeed();
+			downforce = -car.GetTotalAero()[2];
+			liftdrag = -car.GetTotalAero()[2]/car.GetTotalAero()[0];
 			std::stringstream dfs;
-			dfs << -car.GetTotalAero()[2] << " N; " << -car.GetTotalAero()[2]/car.GetTotalAero()[0] << ":1 lift/drag";
+			dfs << downforce << " N; " << liftdrag << ":1 lift/drag";
 			downforcestr = dfs.str();
 		}
 
@@ -229,6 +284,14 @@ void PerformanceTesting::TestMaxSpeed(std::ostream & info_output, std::ostream &
 		i++;
 	}
 
+	results.max_speed = maxspeed.second;
+	results.max_speed_time = maxspeed.first;
+	results.downforce = downforce;
+	results.lift_drag = liftdrag;
+	results.time_0_60 = timeto60 - timeto60start;
+	results.quarter_mile_time = timetoquarter;
+	results.quarter_mile_speed = quarterspeed;
+
 	info_output << "Maximum speed: " << ConvertToMPH(maxspeed.second) << " MPH at " << maxspeed.first << " s" << std::endl;
 	info_output << "Downforce at maximum speed: " << downforcestr << std::endl;
 	info_output << "0-60 MPH time: " << timeto60-timeto60start << " s" << std::endl;
@@ -270,6 +333,8 @@ void PerformanceTesting::TestStoppingDistance(bool abs, std::ostream & info_outp
 		car.Update(carinput);
 
 		world.update(dt);
+		results.steps++;
+		results.sim_time += dt;
 
 		float car_speed = car.GetSpeed();
 
@@ -301,11 +366,103 @@ void PerformanceTesting::TestStoppingDistance(bool abs, std::ostream & info_outp
 	}
 
 	btVector3 stopend = car.GetWheelPosition(WheelPosition(0));
+	float stopdistance = (stopend-stopstart).length();
+	if (abs)
+		results.stopping_distance_abs = stopdistance;
+	else
+		results.stopping_distance = stopdistance;
 
 	info_output << "60-0 stopping distance ";
 	if (abs)
 		info_output << "(ABS)";
 	else
 		info_output << "(no ABS)";
-	info_output << ": " << ConvertToFeet((stopend-stopstart).length()) << " ft" << std::endl;
+	info_output << ": " << ConvertToFeet(stopdistance) << " ft" << std::endl;
+}
+
+void PerformanceTesting::TestTires(std::ostream & info_output, std::ostream & error_output)
+{
+#ifndef VDRIFTN
+	info_output << "Testing tire lookup tables" << std::endl;
+
+	CarTire tires[WHEEL_POSITION_SIZE];
+	CarTire * tirep[WHEEL_POSITION_SIZE];
+	quickprof::Clock clock;
+	clock.reset();
+	for (int i = 0; i < WHEEL_POSITION_SIZE; ++i)
+	{
+		tires[i] = car.GetTire(WheelPosition(i));
+		tires[i].initTables();
+		tirep[i] = &tires[i];
+	}
+	double buildtime = clock.getTimeMicroseconds() * 1E-3;
+
+	// reproducible driving conditions: up to 60 m/s, wheel spin and lock, sideslip
+	const int count = 100000;
+	std::vector<btScalar> inputs(count * WHEEL_POSITION_SIZE * 6);
+	Random random;
+	random.ReSeed(0);
+	for (unsigned int i = 0; i < inputs.size(); i += 6)
+	{
+		btScalar velocity = 60 * random.Get();
+		inputs[i + 0] = 500 + 7500 * random.Get();
+		inputs[i + 1] = 0.6 + 0.5 * random.Get();
+		inputs[i + 2] = 0.2 * random.Get() - 0.1;
+		inputs[i + 3] = velocity * (0.4 + 1.2 * random.Get());
+		inputs[i + 4] = velocity;
+		inputs[i + 5] = velocity * (0.4 * random.Get() - 0.2);
+	}
+
+	std::vector<btVector3> analytic(count * WHEEL_POSITION_SIZE);
+	clock.reset();
+	for (int i = 0; i < count * WHEEL_POSITION_SIZE; ++i)
+	{
+		const btScalar * in = &inputs[i * 6];
+		analytic[i] = tires[i % WHEEL_POSITION_SIZE].getForce(in[0], in[1], in[2], in[3], in[4], in[5]);
+	}
+	double analytictime = clock.getTimeMicroseconds() * 1E-6;
+
+	std::vector<btVector3> tabulated(count * WHEEL_POSITION_SIZE);
+	clock.reset();
+	for (int i = 0; i < count; ++i)
+	{
+		btScalar in[6][WHEEL_POSITION_SIZE];
+		for (int j = 0; j < WHEEL_POSITION_SIZE; ++j)
+		{
+			for (int k = 0; k < 6; ++k)
+			{
+				in[k][j] = inputs[(i * WHEEL_POSITION_SIZE + j) * 6 + k];
+			}
+		}
+		CarTire::getForces(tirep, in[0], in[1], in[2], in[3], in[4], in[5], &tabulated[i * WHEEL_POSITION_SIZE]);
+	}
+	double tabulatedtime = clock.getTimeMicroseconds() * 1E-6;
+
+	// deviation relative to the peak analytic value
+	btVector3 peak(1E-3, 1E-3, 1E-3), deviation(0, 0, 0);
+	for (unsigned int i = 0; i < analytic.size(); ++i)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			peak[k] = btMax(peak[k], btFabs(analytic[i][k]));
+			deviation[k] = btMax(deviation[k], btFabs(analytic[i][k] - tabulated[i][k]));
+		}
+	}
+
+	unsigned int tablesize = 0;
+	btScalar tableerror = 0;
+	for (int i = 0; i < WHEEL_POSITION_SIZE; ++i)
+	{
+		tablesize += tires[i].getTableSize();
+		tableerror = btMax(tableerror, tires[i].getTableError());
+	}
+
+	const double forces = count * WHEEL_POSITION_SIZE;
+	info_output << "Tire table build time: " << buildtime << " ms, size: " << tablesize / 1024 << " KiB, error bound: " << tableerror * 100 << " %" << std::endl;
+	info_output << "Analytic tire forces/s: " << forces / analytictime << std::endl;
+	info_output << "Tabulated tire forces/s: " << forces / tabulatedtime << std::endl;
+	info_output << "Max deviation Fx: " << deviation[0] << " N (" << deviation[0] / peak[0] * 100 << " %), " <<
+		"Fy: " << deviation[1] << " N (" << deviation[1] / peak[1] * 100 << " %), " <<
+		"Mz: " << deviation[2] << " Nm (" << deviation[2] / peak[2] * 100 << " %)" << std::endl;
+#endif
 }
@@ -24,12 +24,35 @@
 
 class ContentManager;
 
+/// car performance test results, times in s, speeds in m/s, distances in m
+struct PerformanceResults
+{
+	float mass;
+	float max_speed;
+	float max_speed_time;
+	float downforce;
+	float lift_drag;
+	float time_0_60;
+	float quarter_mile_time;
+	float quarter_mile_speed;
+	float stopping_distance;
+	float stopping_distance_abs;
+
+	/// simulation throughput: physics steps, simulated and wall clock time
+	unsigned int steps;
+	double sim_time;
+	double wall_time;
+
+	PerformanceResults();
+};
+
 class PerformanceTesting
 {
 public:
 	PerformanceTesting(DynamicsWorld & world);
 	~PerformanceTesting();
 
+	/// load the car and run all tests
 	void Test(
 		const std::string & cardir,
 		const std::string & carname,
@@ -37,6 +60,19 @@ public:
 		std::ostream & info_output,
 		std::ostream & error_output);
 
+	/// set up the test track and load the car, only the loading accesses content
+	bool Load(
+		const std::string & cardir,
+		const std::string & carname,
+		ContentManager & content,
+		std::ostream & info_output,
+		std::ostream & error_output);
+
+	/// run acceleration and braking tests on the loaded car
+	void Run(std::ostream & info_output, std::ostream & error_output);
+
+	const PerformanceResults & GetResults() const {return results;}
+
 private:
 	DynamicsWorld & world;
 	TrackSurface surface;
@@ -44,6 +80,7 @@ private:
 	std::vector<float> carinput;
 	std::string carstate;
 	CarDynamics car;
+	PerformanceResults results;
 
 	/// flat plane test track
 	btCollisionObject * track;
@@ -54,6 +91,9 @@ private:
 	void TestMaxSpeed(std::ostream & info_output, std::ostream & error_output);
 
 	void TestStoppingDistance(bool abs, std::ostream & info_output, std::ostream & error_output);
+
+	/// compare tabulated and analytic tire model speed and accuracy
+	void TestTires(std::ostream & info_output, std::ostream & error_output);
 };
 
 #endif
@@ -473,6 +473,8 @@ CarDynamics::CarDynamics() :
 	transform(btTransform::getIdentity()),
 	linear_velocity(0,0,0),
 	angular_velocity(0,0,0),
+	contact_force(0,0,0),
+	contact_torque(0,0,0),
 	drive(NONE),
 	driveshaft_rpm(0),
 	tacho_rpm(0),
@@ -485,6 +487,7 @@ CarDynamics::CarDynamics() :
 	brake_value(0),
 	abs(false),
 	tcs(false),
+	tire_tables(false),
 	maxangle(0),
 	maxspeed(0),
 	feedback(0)
@@ -752,6 +755,21 @@ void CarDynamics::SetTCS(bool value)
 	tcs = value;
 }
 
+void CarDynamics::SetTireTables(bool value)
+{
+#ifndef VDRIFTN
+	if (value)
+	{
+		for (int i = 0; i < tire.size(); ++i)
+		{
+			if (!tire[i].hasTables())
+				tire[i].initTables();
+		}
+	}
+	tire_tables = value;
+#endif
+}
+
 void CarDynamics::Update(const std::vector<float> & inputs)
 {
 	assert(inputs.size() >= CarInput::INVALID);
@@ -1453,41 +1471,61 @@ btVector3 CarDynamics::ApplySuspensionForceToBody ( int i, btScalar dt, btVector
 	return suspension_force;
 }
 
-btVector3 CarDynamics::ComputeTireFrictionForce (int i, btScalar dt, btScalar normal_force,
-        btScalar rotvel, const btVector3 & linvel, const btQuaternion & wheel_orientation)
+void CarDynamics::ComputeTireFrictionForces ( btVector3 friction_force[] )
 {
-	btMatrix3x3 wheel_mat(wheel_orientation);
-	btVector3 xw = wheel_mat.getColumn(0);
-	btVector3 yw = wheel_mat.getColumn(1);
-	btVector3 z = wheel_contact[i].GetNormal();
-
-	btScalar coszxw = z.dot(xw);
-	btScalar coszyw = z.dot(yw);
-	btVector3 x = (xw - z * coszxw).normalized();
-	btVector3 y = (yw - z * coszyw).normalized();
-
-	btScalar camber = M_PI_2 - btAcos(coszxw);
-	btScalar lonvel = y.dot(linvel);
-	btScalar latvel = -x.dot(linvel);
+	btScalar normal_force[WHEEL_POSITION_SIZE];
+	btScalar friction_coeff[WHEEL_POSITION_SIZE];
+	btScalar camber[WHEEL_POSITION_SIZE];
+	btScalar rotvel[WHEEL_POSITION_SIZE];
+	btScalar lonvel[WHEEL_POSITION_SIZE];
+	btScalar latvel[WHEEL_POSITION_SIZE];
+	for ( int i = 0; i < WHEEL_POSITION_SIZE; ++i )
+	{
+		btMatrix3x3 wheel_mat(wheel_orientation[i]);
+		btVector3 xw = wheel_mat.getColumn(0);
+		btVector3 yw = wheel_mat.getColumn(1);
+		btVector3 z = wheel_contact[i].GetNormal();
 
-	btScalar friction_coeff =
-		tire[i].getTread() * wheel_contact[i].GetSurface().frictionTread +
-		(1.0 - tire[i].getTread()) * wheel_contact[i].GetSurface().frictionNonTread;
+		btScalar coszxw = z.dot(xw);
+		btScalar coszyw = z.dot(yw);
+		btVector3 x = (xw - z * coszxw).normalized();
+		btVector3 y = (yw - z * coszyw).normalized();
 
-	btVector3 friction_force = tire[i].getForce(
-		normal_force, friction_coeff, camber, rotvel, lonvel, latvel);
+		normal_force[i] = suspension_force[i].length();
+		rotvel[i] = wheel[i].GetAngularVelocity() * wheel[i].GetRadius();
+		camber[i] = M_PI_2 - btAcos(coszxw);
+		lonvel[i] = y.dot(wheel_velocity[i]);
+		latvel[i] = -x.dot(wheel_velocity[i]);
+		friction_coeff[i] =
+			tire[i].getTread() * wheel_contact[i].GetSurface().frictionTread +
+			(1.0 - tire[i].getTread()) * wheel_contact[i].GetSurface().frictionNonTread;
+	}
 
-	for (int n = 0; n < 3; ++n) assert(!isnan(friction_force[n]));
+#ifndef VDRIFTN
+	if (tire_tables)
+	{
+		assert(WHEEL_POSITION_SIZE == 4);
+		CarTire * tires[] = {&tire[0], &tire[1], &tire[2], &tire[3]};
+		CarTire::getForces(tires, normal_force, friction_coeff, camber, rotvel, lonvel, latvel, friction_force);
+	}
+	else
+#endif
+	{
+		for ( int i = 0; i < WHEEL_POSITION_SIZE; ++i )
+		{
+			friction_force[i] = tire[i].getForce(
+				normal_force[i], friction_coeff[i], camber[i], rotvel[i], lonvel[i], latvel[i]);
+		}
+	}
 
-	return friction_force;
+	for ( int i = 0; i < WHEEL_POSITION_SIZE; ++i )
+	{
+		for ( int n = 0; n < 3; ++n ) assert ( !isnan ( friction_force[i][n] ) );
+	}
 }
 
-void CarDynamics::ApplyWheelForces ( btScalar dt, btScalar wheel_drive_torque, int i, const btVector3 & suspension_force, btVector3 & force, btVector3 & torque )
+void CarDynamics::ApplyWheelForces ( btScalar dt, btScalar wheel_drive_torque, int i, const btVector3 & friction_force, btVector3 & force, btVector3 & torque )
 {
-	btScalar normal_force = suspension_force.length();
-	btScalar rotvel = wheel[i].GetAngularVelocity() * wheel[i].GetRadius();
-	btVector3 friction_force = ComputeTireFrictionForce ( i, dt, normal_force, rotvel, wheel_velocity[i], wheel_orientation[i] );
-
 	//calculate friction torque
 	btVector3 tire_force = Direction::forward * friction_force[0] - Direction::right * friction_force[1];
 	btScalar tire_friction_torque = friction_force[0] * wheel[i].GetRadius();
@@ -1588,10 +1626,14 @@ void CarDynamics::ApplyForces ( btScalar dt, const btVector3 & ext_force, const
 		}
 	}
 
+	//compute tire friction forces, tires only depend on their own wheel state
+	btVector3 friction_force[WHEEL_POSITION_SIZE];
+	ComputeTireFrictionForces ( friction_force );
+
 	//compute wheel forces
 	for ( int i = 0; i < WHEEL_POSITION_SIZE; ++i )
 	{
-		ApplyWheelForces ( dt, wheel_drive_torque[i], i, suspension_force[i], force, torque );
+		ApplyWheelForces ( dt, wheel_drive_torque[i], i, friction_force[i], force, torque );
 	}
 
 	for ( int n = 0; n < 3; ++n ) assert ( !isnan ( force[n] ) );
@@ -1617,23 +1659,34 @@ void CarDynamics::Tick(btScalar dt, const btVector3 & force, const btVector3 & t
 
 // executed as last function(after integration) in bullet singlestepsimulation
 void CarDynamics::updateAction(btCollisionWorld * collisionWorld, btScalar dt)
+{
+	btAlignedObjectArray<RayQuery> rays;
+	updateContacts(dt, rays);
+	world->castRays(rays);
+	updateSubsteps(dt);
+}
+
+void CarDynamics::updateContacts(btScalar dt, btAlignedObjectArray<RayQuery> & rays)
 {
 	// reset transform, before processing tire/suspension constraints
 	// will break bullets collision clamping, tunneling prevention
 	body->setCenterOfMassTransform(transform);
 	btVector3 dv = body->getLinearVelocity() - linear_velocity;
 	btVector3 dw = body->getAngularVelocity() - angular_velocity;
-	btVector3 force = 1.0 / body->getInvMass() * dv / dt;
-	btVector3 torque = body->getInvInertiaTensorWorld().inverse() * dw / dt;
+	contact_force = 1.0 / body->getInvMass() * dv / dt;
+	contact_torque = body->getInvInertiaTensorWorld().inverse() * dw / dt;
 	body->setLinearVelocity(linear_velocity);
 	body->setAngularVelocity(angular_velocity);
-	UpdateWheelContacts();
+	GetWheelRays(rays);
+}
 
+void CarDynamics::updateSubsteps(btScalar dt)
+{
 	feedback = 0;
 	int repeats = 10;
 	for (int i = 0; i < repeats; ++i)
 	{
-		Tick(dt / repeats, force, torque);
+		Tick(dt / repeats, contact_force, contact_torque);
 
 		feedback += tire[FRONT_LEFT].getMz() + tire[FRONT_RIGHT].getMz();
 	}
@@ -1654,6 +1707,13 @@ void CarDynamics::updateAction(btCollisionWorld * collisionWorld, btScalar dt)
 }
 
 void CarDynamics::UpdateWheelContacts()
+{
+	btAlignedObjectArray<RayQuery> rays;
+	GetWheelRays(rays);
+	world->castRays(rays);
+}
+
+void CarDynamics::GetWheelRays(btAlignedObjectArray<RayQuery> & rays)
 {
 	btVector3 raydir = GetDownVector();
 	btScalar raylen = 4;
@@ -1667,7 +1727,7 @@ void CarDynamics::UpdateWheelContacts()
 		}
 		else
 		{
-			world->castRay(raystart, raydir, raylen, body, wheel_contact[i]);
+			rays.push_back(RayQuery(raystart, raydir, raylen, body, &wheel_contact[i]));
 		}
 	}
 }
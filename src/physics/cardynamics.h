@@ -86,6 +86,9 @@ public:
 	void SetABS(bool value);
 	void SetTCS(bool value);
 
+	// evaluate the tires from precomputed lookup tables, faster but less accurate
+	void SetTireTables(bool value);
+
 	// update dynamics from car input vector
 	void Update(const std::vector<float> & inputs);
 
@@ -93,6 +96,12 @@ public:
 	void updateAction(btCollisionWorld * collisionWorld, btScalar dt);
 	void debugDraw(btIDebugDraw * debugDrawer);
 
+	// updateAction split in two: wheel ray casts query the shared collision world
+	// and are appended to rays to be cast by the world in one batch, sub-stepping
+	// only modifies this car's state and can run concurrently with other cars
+	void updateContacts(btScalar dt, btAlignedObjectArray<RayQuery> & rays);
+	void updateSubsteps(btScalar dt);
+
 	// graphics interpolated
 	btVector3 GetEnginePosition() const;
 	const btVector3 & GetPosition() const;
@@ -188,6 +197,10 @@ protected:
 	btVector3 angular_velocity;
 	btAlignedObjectArray<MotionState> motion_state;
 
+	// constraint force, torque applied by bullet during the last step
+	btVector3 contact_force;
+	btVector3 contact_torque;
+
 	// driveline state
 	CarEngine engine;
 	CarFuelTank fuel_tank;
@@ -228,6 +241,9 @@ protected:
 	std::vector<int> tcs_active;
 	std::list<CarTelemetry> telemetry;
 
+	// tires are evaluated from lookup tables
+	bool tire_tables;
+
 	btScalar maxangle;
 	btScalar maxspeed;
 	btScalar feedback;
@@ -254,10 +270,9 @@ protected:
 
 	btVector3 ApplySuspensionForceToBody ( int i, btScalar dt, btVector3 & force, btVector3 & torque );
 
-	btVector3 ComputeTireFrictionForce ( int i, btScalar dt, btScalar normal_force,
-        btScalar rotvel, const btVector3 & linvel, const btQuaternion & wheel_orientation );
+	void ComputeTireFrictionForces ( btVector3 friction_force[] );
 
-	void ApplyWheelForces ( btScalar dt, btScalar wheel_drive_torque, int i, const btVector3 & suspension_force, btVector3 & force, btVector3 & torque );
+	void ApplyWheelForces ( btScalar dt, btScalar wheel_drive_torque, int i, const btVector3 & friction_force, btVector3 & force, btVector3 & torque );
 
 	void ApplyForces ( btScalar dt, const btVector3 & force, const btVector3 & torque);
 
@@ -265,6 +280,9 @@ protected:
 
 	void UpdateWheelContacts();
 
+	// append wheel rays, separated wheels get an empty contact
+	void GetWheelRays(btAlignedObjectArray<RayQuery> & rays);
+
 	void InterpolateWheelContacts();
 
 	// update engine, return wheel drive torque
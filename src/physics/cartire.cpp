@@ -23,6 +23,11 @@
 
 #ifndef VDRIFTN
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define CARTIRE_SSE
+#include <xmmintrin.h>
+#endif
+
 CarTireInfo::CarTireInfo() :
 	longitudinal(11),
 	lateral(15),
@@ -48,6 +53,17 @@ CarTire::CarTire() :
 	// ctor
 }
 
+CarTire::Tables::Tables() :
+	slip_size(0),
+	load_size(0),
+	camber_size(0),
+	sigma_scale(1),
+	alpha_scale(1),
+	error(0)
+{
+	// ctor
+}
+
 void CarTire::init(const CarTireInfo & info)
 {
 	CarTireInfo::operator=(info);
@@ -344,4 +360,428 @@ void CarTire::initSigmaHatAlphaHat(int tablesize)
 	}
 }
 
+// table axis ranges, load in kN and camber in degrees as clamped by getForce
+static const float table_load_max = 30;
+static const float table_camber_max = 18;
+
+// slip value of a compressed slip axis sample, the ends are mapped to a large finite slip
+static inline float TableSlip(float u, float scale)
+{
+	float d = btMax(1 - btFabs(u), 1E-4f);
+	return scale * u / d;
+}
+
+static inline float TableCoord(float slip, float scale)
+{
+	return slip / (btFabs(slip) + scale);
+}
+
+void CarTire::initTables(btScalar max_error)
+{
+	// slip scale is the ideal slip at the nominal load, so that half the samples cover the grip peak
+	btScalar sh(0), ah(0);
+	getSigmaHatAlphaHat(4000, sh, ah);
+	tables.sigma_scale = btMax(btFabs(sh), btScalar(1E-2));
+	tables.alpha_scale = btMax(btFabs(ah), btScalar(1E-1));
+
+	// camber size is odd to sample the |gamma| kink at zero
+	tables.slip_size = 33;
+	tables.load_size = 16;
+	tables.camber_size = 5;
+	sampleTables();
+
+	// keep the tables of a car small enough to stay in cache
+	const int max_slip_size = 129;
+	const int max_load_size = 64;
+	const int max_camber_size = 17;
+	while (true)
+	{
+		float error[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			error[k] = getTableError(k);
+		}
+		tables.error = btMax(error[0], btMax(error[1], error[2]));
+		if (tables.error <= max_error)
+			break;
+
+		// refine the axis with the largest error
+		bool refined = false;
+		int axis = (error[0] >= error[1] && error[0] >= error[2]) ? 0 : (error[1] >= error[2] ? 1 : 2);
+		for (int n = 0; n < 3 && !refined; ++n, axis = (axis + 1) % 3)
+		{
+			if (axis == 0 && tables.slip_size < max_slip_size)
+			{
+				tables.slip_size = tables.slip_size * 2 - 1;
+				refined = true;
+			}
+			else if (axis == 1 && tables.load_size < max_load_size)
+			{
+				tables.load_size = tables.load_size * 2;
+				refined = true;
+			}
+			else if (axis == 2 && tables.camber_size < max_camber_size)
+			{
+				tables.camber_size = tables.camber_size * 2 - 1;
+				refined = true;
+			}
+		}
+		if (!refined)
+			break;
+
+		sampleTables();
+	}
+}
+
+unsigned int CarTire::getTableSize() const
+{
+	return (tables.fx.size() + tables.fy.size() + tables.mz.size()) * sizeof(float);
+}
+
+void CarTire::sampleTables()
+{
+	const int ns = tables.slip_size;
+	const int nl = tables.load_size;
+	const int nc = tables.camber_size;
+	tables.fx.resize(nl * ns);
+	tables.fy.resize(nc * nl * ns);
+	tables.mz.resize(nc * nl * ns);
+
+	btScalar junk;
+	for (int l = 0; l < nl; ++l)
+	{
+		btScalar Fz = btMax(table_load_max * l / (nl - 1), 1E-3f);
+		for (int s = 0; s < ns; ++s)
+		{
+			float u = -1 + 2.0f * s / (ns - 1);
+			tables.fx[l * ns + s] = PacejkaFx(TableSlip(u, tables.sigma_scale), Fz, 1, junk);
+		}
+		for (int c = 0; c < nc; ++c)
+		{
+			btScalar gamma = -table_camber_max + 2 * table_camber_max * c / (nc - 1);
+			for (int s = 0; s < ns; ++s)
+			{
+				float u = -1 + 2.0f * s / (ns - 1);
+				btScalar alpha = TableSlip(u, tables.alpha_scale);
+				tables.fy[(c * nl + l) * ns + s] = PacejkaFy(alpha, Fz, gamma, 1, junk);
+				tables.mz[(c * nl + l) * ns + s] = PacejkaMz(alpha, Fz, gamma, 1, junk);
+			}
+		}
+	}
+}
+
+float CarTire::getTableError(int axis) const
+{
+	const int ns = tables.slip_size;
+	const int nl = tables.load_size;
+	const int nc = tables.camber_size;
+
+	// the error is measured over the load range of the ideal slip table (HAT_LOAD steps),
+	// the pacejka coefficients aren't fitted to loads beyond it and tend to oscillate there
+	const float max_load = 0.5f * sigma_hat.size();
+	const int max_l = btMin(int(max_load / table_load_max * (nl - 1)) + 1, nl - 1);
+
+	// errors are relative to the peak values
+	float peak[3] = {1E-3f, 1E-3f, 1E-3f};
+	for (int c = 0; c < nc; ++c)
+	{
+		for (int i = c * nl * ns, e = (c * nl + max_l + 1) * ns; i < e; ++i)
+		{
+			peak[1] = btMax(peak[1], btFabs(tables.fy[i]));
+			peak[2] = btMax(peak[2], btFabs(tables.mz[i]));
+		}
+	}
+	for (int i = 0, e = (max_l + 1) * ns; i < e; ++i)
+	{
+		peak[0] = btMax(peak[0], btFabs(tables.fx[i]));
+	}
+
+	// linear interpolation error is largest between samples, compare the
+	// analytic value at the cell midpoints with the mean of the two samples
+	const int ds = (axis == 0), dl = (axis == 1), dc = (axis == 2);
+	float error = 0;
+	btScalar junk;
+	for (int c = 0; c < nc - dc; ++c)
+	{
+		btScalar gamma = -table_camber_max + 2 * table_camber_max * (c + 0.5f * dc) / (nc - 1);
+		for (int l = 0; l < max_l + 1 - dl; ++l)
+		{
+			btScalar Fz = btMax(table_load_max * (l + 0.5f * dl) / (nl - 1), 1E-3f);
+			for (int s = 0; s < ns - ds; ++s)
+			{
+				float u = -1 + 2.0f * (s + 0.5f * ds) / (ns - 1);
+				int i0 = (c * nl + l) * ns + s;
+				int i1 = ((c + dc) * nl + l + dl) * ns + s + ds;
+				btScalar alpha = TableSlip(u, tables.alpha_scale);
+				btScalar Fy = PacejkaFy(alpha, Fz, gamma, 1, junk);
+				btScalar Mz = PacejkaMz(alpha, Fz, gamma, 1, junk);
+				error = btMax(error, btFabs(Fy - 0.5f * (tables.fy[i0] + tables.fy[i1])) / peak[1]);
+				error = btMax(error, btFabs(Mz - 0.5f * (tables.mz[i0] + tables.mz[i1])) / peak[2]);
+				if (c == 0 && !dc)
+				{
+					btScalar Fx = PacejkaFx(TableSlip(u, tables.sigma_scale), Fz, 1, junk);
+					int j0 = l * ns + s;
+					int j1 = (l + dl) * ns + s + ds;
+					error = btMax(error, btFabs(Fx - 0.5f * (tables.fx[j0] + tables.fx[j1])) / peak[0]);
+				}
+			}
+		}
+	}
+	return error;
+}
+
+namespace
+{
+
+/// four floats, one per tire
+struct Float4
+{
+#ifdef CARTIRE_SSE
+	__m128 v;
+	Float4() {}
+	Float4(__m128 v) : v(v) {}
+	explicit Float4(float f) : v(_mm_set1_ps(f)) {}
+	explicit Float4(const float f[4]) : v(_mm_loadu_ps(f)) {}
+	void store(float f[4]) const {_mm_storeu_ps(f, v);}
+	Float4 operator+(const Float4 & o) const {return _mm_add_ps(v, o.v);}
+	Float4 operator-(const Float4 & o) const {return _mm_sub_ps(v, o.v);}
+	Float4 operator*(const Float4 & o) const {return _mm_mul_ps(v, o.v);}
+	Float4 operator/(const Float4 & o) const {return _mm_div_ps(v, o.v);}
+	friend Float4 min(const Float4 & a, const Float4 & b) {return _mm_min_ps(a.v, b.v);}
+	friend Float4 max(const Float4 & a, const Float4 & b) {return _mm_max_ps(a.v, b.v);}
+	friend Float4 sqrt(const Float4 & a) {return _mm_sqrt_ps(a.v);}
+	friend Float4 abs(const Float4 & a) {return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v);}
+	/// -1 for negative values, 1 otherwise
+	friend Float4 sign(const Float4 & a)
+	{
+		__m128 neg = _mm_and_ps(_mm_cmplt_ps(a.v, _mm_setzero_ps()), _mm_set1_ps(-0.0f));
+		return _mm_or_ps(neg, _mm_set1_ps(1.0f));
+	}
+#else
+	float v[4];
+	Float4() {}
+	explicit Float4(float f) {for (int i = 0; i < 4; ++i) v[i] = f;}
+	explicit Float4(const float f[4]) {for (int i = 0; i < 4; ++i) v[i] = f[i];}
+	void store(float f[4]) const {for (int i = 0; i < 4; ++i) f[i] = v[i];}
+	Float4 operator+(const Float4 & o) const {Float4 r; for (int i = 0; i < 4; ++i) r.v[i] = v[i] + o.v[i]; return r;}
+	Float4 operator-(const Float4 & o) const {Float4 r; for (int i = 0; i < 4; ++i) r.v[i] = v[i] - o.v[i]; return r;}
+	Float4 operator*(const Float4 & o) const {Float4 r; for (int i = 0; i < 4; ++i) r.v[i] = v[i] * o.v[i]; return r;}
+	Float4 operator/(const Float4 & o) const {Float4 r; for (int i = 0; i < 4; ++i) r.v[i] = v[i] / o.v[i]; return r;}
+	friend Float4 min(const Float4 & a, const Float4 & b) {Float4 r; for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return r;}
+	friend Float4 max(const Float4 & a, const Float4 & b) {Float4 r; for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return r;}
+	friend Float4 sqrt(const Float4 & a) {Float4 r; for (int i = 0; i < 4; ++i) r.v[i] = std::sqrt(a.v[i]); return r;}
+	friend Float4 abs(const Float4 & a) {Float4 r; for (int i = 0; i < 4; ++i) r.v[i] = std::fabs(a.v[i]); return r;}
+	friend Float4 sign(const Float4 & a) {Float4 r; for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] < 0 ? -1 : 1; return r;}
+#endif
+};
+
+inline Float4 Lerp(const Float4 & a, const Float4 & b, const Float4 & t)
+{
+	return a + (b - a) * t;
+}
+
+/// split a table coordinate into cell index and blend factor, x is clamped to [0, n - 1]
+inline void TableCell(float x, int n, int & i, float & f)
+{
+	x = btMin(btMax(x, 0.0f), float(n - 1));
+	i = btMin(int(x), n - 2);
+	f = x - i;
+}
+
+}
+
+void CarTire::getForces(
+	CarTire * tire[4],
+	const btScalar normal_force[4],
+	const btScalar friction_coeff[4],
+	const btScalar inclination[4],
+	const btScalar rot_velocity[4],
+	const btScalar lon_velocity[4],
+	const btScalar lat_velocity[4],
+	btVector3 force[4])
+{
+	// per tire inputs, see getForce
+	float load[4], mu[4], incl[4], rotvel[4], lonvel[4], alpha[4];
+	float sigma_hat[4], alpha_hat[4];
+	float sigma_scale[4], alpha_scale[4], slip_coord[4], load_coord[4], camber_coord[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		assert(tire[i]->hasTables());
+		const Tables & t = tire[i]->tables;
+		load[i] = normal_force[i];
+		mu[i] = friction_coeff[i];
+		incl[i] = inclination[i];
+		rotvel[i] = rot_velocity[i];
+		lonvel[i] = lon_velocity[i];
+		btScalar denom = btMax(btFabs(lon_velocity[i]), btScalar(1E-3));
+		alpha[i] = -btAtan(lat_velocity[i] / denom) * SIMD_DEGS_PER_RAD;
+		btScalar sh(0), ah(0);
+		tire[i]->getSigmaHatAlphaHat(normal_force[i], sh, ah);
+		sigma_hat[i] = sh;
+		alpha_hat[i] = ah;
+		sigma_scale[i] = t.sigma_scale;
+		alpha_scale[i] = t.alpha_scale;
+		slip_coord[i] = 0.5f * (t.slip_size - 1);
+		load_coord[i] = (t.load_size - 1) / table_load_max;
+		camber_coord[i] = 0.5f * (t.camber_size - 1);
+	}
+
+	// limit input
+	Float4 Fz = min(Float4(load) * Float4(0.001f), Float4(table_load_max));
+	Float4 max_incl(float(0.1 * M_PI));
+	Float4 gamma = max(min(Float4(incl), max_incl), Float4(0.0f) - max_incl) * Float4(float(SIMD_DEGS_PER_RAD));
+
+	// slip ratio
+	Float4 lon(lonvel);
+	Float4 denom = max(abs(lon), Float4(1E-3f));
+	Float4 sigma = (Float4(rotvel) - lon) / denom;
+	Float4 a(alpha);
+
+	// beckman method for pre-combining longitudinal and lateral forces
+	Float4 sh(sigma_hat), ah(alpha_hat);
+	Float4 sigma_sign = sign(sigma);
+	Float4 alpha_sign = sign(a);
+	Float4 s = sigma / sh;
+	Float4 an = a / ah;
+	Float4 rho = max(sqrt(s * s + an * an), Float4(1E-4f));
+	Float4 sp = rho * sh * sigma_sign;
+	Float4 ap = rho * ah * alpha_sign;
+	Float4 gx = s / rho * sigma_sign;
+	Float4 gy = an / rho * alpha_sign;
+
+	// table coordinates
+	Float4 one(1.0f);
+	Float4 ss(sigma_scale), as(alpha_scale), sc(slip_coord);
+	Float4 xs = (sp / (abs(sp) + ss) + one) * sc;
+	Float4 xa = (ap / (abs(ap) + as) + one) * sc;
+	Float4 xm = (a / (abs(a) + as) + one) * sc;
+	Float4 xl = Fz * Float4(load_coord);
+	Float4 xc = (gamma * Float4(1 / table_camber_max) + one) * Float4(camber_coord);
+
+	float cs[4], ca[4], cm[4], cl[4], cc[4];
+	xs.store(cs);
+	xa.store(ca);
+	xm.store(cm);
+	xl.store(cl);
+	xc.store(cc);
+
+	// gather cell corners, the blending is done for all tires at once
+	float ts[4], ta[4], tm[4], tl[4], tc[4];
+	float fx[4][4], fy[8][4], mz[8][4];
+	for (int i = 0; i < 4; ++i)
+	{
+		const Tables & t = tire[i]->tables;
+		const int ns = t.slip_size, nl = t.load_size;
+		int is, ia, im, il, ic;
+		TableCell(cs[i], ns, is, ts[i]);
+		TableCell(ca[i], ns, ia, ta[i]);
+		TableCell(cm[i], ns, im, tm[i]);
+		TableCell(cl[i], nl, il, tl[i]);
+		TableCell(cc[i], t.camber_size, ic, tc[i]);
+
+		const float * x = &t.fx[il * ns + is];
+		fx[0][i] = x[0];
+		fx[1][i] = x[1];
+		fx[2][i] = x[ns];
+		fx[3][i] = x[ns + 1];
+
+		for (int c = 0; c < 2; ++c)
+		{
+			const float * y = &t.fy[((ic + c) * nl + il) * ns + ia];
+			const float * z = &t.mz[((ic + c) * nl + il) * ns + im];
+			fy[c * 4 + 0][i] = y[0];
+			fy[c * 4 + 1][i] = y[1];
+			fy[c * 4 + 2][i] = y[ns];
+			fy[c * 4 + 3][i] = y[ns + 1];
+			mz[c * 4 + 0][i] = z[0];
+			mz[c * 4 + 1][i] = z[1];
+			mz[c * 4 + 2][i] = z[ns];
+			mz[c * 4 + 3][i] = z[ns + 1];
+		}
+	}
+
+	Float4 bs(ts), ba(ta), bm(tm), bl(tl), bc(tc);
+	Float4 Fx0 = Lerp(Lerp(Float4(fx[0]), Float4(fx[1]), bs), Lerp(Float4(fx[2]), Float4(fx[3]), bs), bl);
+	Float4 Fy0 = Lerp(
+		Lerp(Lerp(Float4(fy[0]), Float4(fy[1]), ba), Lerp(Float4(fy[2]), Float4(fy[3]), ba), bl),
+		Lerp(Lerp(Float4(fy[4]), Float4(fy[5]), ba), Lerp(Float4(fy[6]), Float4(fy[7]), ba), bl), bc);
+	Float4 Mz0 = Lerp(
+		Lerp(Lerp(Float4(mz[0]), Float4(mz[1]), bm), Lerp(Float4(mz[2]), Float4(mz[3]), bm), bl),
+		Lerp(Lerp(Float4(mz[4]), Float4(mz[5]), bm), Lerp(Float4(mz[6]), Float4(mz[7]), bm), bl), bc);
+
+	Float4 m(mu);
+	float Fx[4], Fy[4], Mz[4], Fzs[4], sigmas[4];
+	(gx * Fx0 * m).store(Fx);
+	(gy * Fy0 * m).store(Fy);
+	(Mz0 * m).store(Mz);
+	Fz.store(Fzs);
+	sigma.store(sigmas);
+
+	for (int i = 0; i < 4; ++i)
+	{
+		if (normal_force[i] * friction_coeff[i] < 1E-6)
+		{
+			force[i].setValue(0, 0, 0);
+			continue;
+		}
+
+		CarTire & t = *tire[i];
+		t.camber = inclination[i];
+		btClamp(t.camber, btScalar(-0.1 * M_PI), btScalar(0.1 * M_PI));
+		t.slide = sigmas[i];
+		t.slip = alpha[i] * SIMD_RADS_PER_DEG;
+		t.ideal_slide = sigma_hat[i];
+		t.ideal_slip = alpha_hat[i] * SIMD_RADS_PER_DEG;
+		t.fx = Fx[i];
+		t.fy = Fy[i];
+		t.fz = Fzs[i];
+		t.mz = Mz[i];
+		force[i].setValue(Fx[i], Fy[i], Mz[i]);
+	}
+}
+
+#include "unittest.h"
+
+QT_TEST(cartire_table_test)
+{
+	const btScalar a[] = {1.5, -40, 1600, 2600, 8.7, 0.014, -0.24, 1.0, 0, 0, 0, -0.02, 0.01, 0, 0};
+	const btScalar b[] = {1.5, 0, 1100, 0, 300, 0, 0, 0, -2, 0, 0};
+	const btScalar c[] = {2.3, -3.8, -3.14, -1.16, -7.2, 0, 0, 0.044, -0.58, 0.18, 0.043, 0.048, -0.0035, -0.18, 0.14, -1.029, 0.27, -1.1};
+	CarTireInfo info;
+	info.lateral.assign(a, a + 15);
+	info.longitudinal.assign(b, b + 11);
+	info.aligning.assign(c, c + 18);
+
+	CarTire analytic[4], tabulated[4];
+	CarTire * tires[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		analytic[i].init(info);
+		tabulated[i].init(info);
+		tabulated[i].initTables(0.01);
+		tires[i] = &tabulated[i];
+	}
+	QT_CHECK(tabulated[0].hasTables());
+	QT_CHECK(tabulated[0].getTableError() <= 0.01);
+
+	// straight, braking, accelerating and sliding tire, the last one has no load
+	const btScalar load[] = {4000, 3000, 5000, 0};
+	const btScalar mu[] = {1, 0.9, 1.1, 1};
+	const btScalar camber[] = {0, 0.02, -0.05, 0};
+	const btScalar rotvel[] = {20, 15, 35, 10};
+	const btScalar lonvel[] = {20, 20, 30, 10};
+	const btScalar latvel[] = {0.5, -1, 2, 5};
+	btVector3 force[4];
+	CarTire::getForces(tires, load, mu, camber, rotvel, lonvel, latvel, force);
+	for (int i = 0; i < 3; ++i)
+	{
+		btVector3 expected = analytic[i].getForce(load[i], mu[i], camber[i], rotvel[i], lonvel[i], latvel[i]);
+		QT_CHECK_CLOSE(force[i][0], expected[0], 0.02 * analytic[i].getMaxFx(load[i]));
+		QT_CHECK_CLOSE(force[i][1], expected[1], 0.02 * analytic[i].getMaxFy(load[i], 0));
+		QT_CHECK_CLOSE(tabulated[i].getSlip(), analytic[i].getSlip(), 1E-4);
+	}
+	QT_CHECK_EQUAL(force[3][0], 0);
+	QT_CHECK_EQUAL(force[3][1], 0);
+}
+
 #endif
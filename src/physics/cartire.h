@@ -93,6 +93,31 @@ public:
 	/// load is the normal force in newtons, camber is in degrees
 	btScalar getMaxMz(btScalar load, btScalar camber) const;
 
+	/// build lookup tables for the pacejka functions, the resolution is increased until
+	/// the interpolation error is below max_error (relative to the peak force) or the size limit is hit
+	void initTables(btScalar max_error = 0.01);
+
+	/// true if initTables has been called
+	bool hasTables() const;
+
+	/// max interpolation error of the lookup tables relative to the peak force
+	btScalar getTableError() const;
+
+	/// lookup table memory in bytes
+	unsigned int getTableSize() const;
+
+	/// getForce for four tires at once using their lookup tables, all tires need tables
+	/// parameters are arrays of per tire values, see getForce
+	static void getForces(
+		CarTire * tire[4],
+		const btScalar normal_force[4],
+		const btScalar friction_coeff[4],
+		const btScalar inclination[4],
+		const btScalar rot_velocity[4],
+		const btScalar lon_velocity[4],
+		const btScalar lat_velocity[4],
+		btVector3 force[4]);
+
 	bool Serialize(joeserialize::Serializer & s);
 
 private:
@@ -103,6 +128,29 @@ private:
 	btScalar ideal_slip; ///< ideal slip angle
 	btScalar fx, fy, fz, mz;
 
+	/// pacejka function samples at unit friction, slip axes are compressed by u = s / (|s| + scale)
+	/// to cover the unbounded slip range with dense sampling around the peak
+	struct Tables
+	{
+		std::vector<float> fx; ///< [load][sigma]
+		std::vector<float> fy; ///< [camber][load][alpha]
+		std::vector<float> mz; ///< [camber][load][alpha]
+		int slip_size;
+		int load_size;
+		int camber_size;
+		float sigma_scale;
+		float alpha_scale;
+		float error;
+		Tables();
+	};
+	Tables tables;
+
+	/// fill the tables at the current resolution
+	void sampleTables();
+
+	/// max interpolation error of the tables at the cell midpoints along the given axis
+	float getTableError(int axis) const;
+
 	/// pacejka magic formula function, longitudinal
 	btScalar PacejkaFx(btScalar sigma, btScalar Fz, btScalar friction_coeff, btScalar & max_Fx) const;
 
@@ -165,6 +213,16 @@ inline btScalar CarTire::getMz() const
 	return mz;
 }
 
+inline bool CarTire::hasTables() const
+{
+	return !tables.fx.empty();
+}
+
+inline btScalar CarTire::getTableError() const
+{
+	return tables.error;
+}
+
 inline bool CarTire::Serialize(joeserialize::Serializer & s)
 {
 	//_SERIALIZE_(s, mz);
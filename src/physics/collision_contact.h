@@ -123,4 +123,31 @@ private:
 	const btCollisionObject * col;
 };
 
+// ray cast request, the contact patch id is used as a hint and the result is written to contact
+struct RayQuery
+{
+	RayQuery() : length(0), caster(0), contact(0) {}
+
+	RayQuery(
+		const btVector3 & origin,
+		const btVector3 & direction,
+		const btScalar length,
+		const btCollisionObject * caster,
+		CollisionContact * contact) :
+		origin(origin),
+		direction(direction),
+		length(length),
+		caster(caster),
+		contact(contact)
+	{
+		// ctor
+	}
+
+	btVector3 origin;
+	btVector3 direction;
+	btScalar length;
+	const btCollisionObject * caster;
+	CollisionContact * contact;
+};
+
 #endif // _COLLISION_CONTACT_H
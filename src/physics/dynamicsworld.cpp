@@ -18,10 +18,12 @@
 /************************************************************************/
 
 #include "dynamicsworld.h"
+#include "cardynamics.h"
 #include "fracturebody.h"
 #include "collision_contact.h"
 #include "tobullet.h"
 #include "track.h"
+#include "raypacket.h"
 
 #define EXTBULLET
 
@@ -93,6 +95,7 @@ DynamicsWorld::DynamicsWorld(
 	btScalar timeStep,
 	int maxSubSteps) :
 	btDiscreteDynamicsWorld(dispatcher, broadphase, constraintSolver, collisionConfig),
+	jobs(0),
 	track(0),
 	timeStep(timeStep),
 	maxSubSteps(maxSubSteps)
@@ -117,25 +120,109 @@ bool DynamicsWorld::castRay(
 	const btCollisionObject * caster,
 	CollisionContact & contact) const
 {
-	btVector3 p = origin + direction * length;
-	btVector3 n = -direction;
-	btScalar d = length;
-	int patch_id = -1;
-	const Bezier * b = 0;
+	RayQuery ray(origin, direction, length, caster, &contact);
+	if (!rayTestGeometry(ray, contact))
+		return false;
+
+	// track bezierpatch collision
+	if (track)
+	{
+		Vec3 org = ToMathVector<float>(origin);
+		Vec3 dir = ToMathVector<float>(direction);
+		Vec3 colpoint;
+		Vec3 colnormal;
+		const Bezier * b = 0;
+		int patch_id = contact.GetPatchId();
+		if (track->CastRay(org, dir, length, patch_id, colpoint, b, colnormal))
+		{
+			contact = CollisionContact(
+				ToBulletVector(colpoint), ToBulletVector(colnormal), (colpoint - org).Magnitude(),
+				patch_id, b, &contact.GetSurface(), contact.GetObject());
+		}
+		else
+		{
+			contact = CollisionContact(
+				contact.GetPosition(), contact.GetNormal(), contact.GetDepth(),
+				patch_id, 0, &contact.GetSurface(), contact.GetObject());
+		}
+	}
+	return true;
+}
+
+void DynamicsWorld::castRays(const btAlignedObjectArray<RayQuery> & rays)
+{
+	int i = 0;
+	while (i < rays.size())
+	{
+		// group consecutive rays of the same caster into a packet
+		const btCollisionObject * caster = rays[i].caster;
+		const int first = i;
+		RayPacket packet;
+		int patch_id[RayPacket::SIZE];
+		int mask = 0;
+		while (i < rays.size() && rays[i].caster == caster && packet.Size() < RayPacket::SIZE)
+		{
+			const RayQuery & ray = rays[i];
+			int n = packet.Add(ToMathVector<float>(ray.origin), ToMathVector<float>(ray.direction), ray.length);
+			if (rayTestGeometry(ray, *ray.contact))
+			{
+				patch_id[n] = ray.contact->GetPatchId();
+				mask |= 1 << n;
+			}
+			++i;
+		}
+
+		// track bezierpatch collision for rays that hit geometry
+		if (!track || !mask)
+			continue;
+
+		Vec3 colpoint[RayPacket::SIZE];
+		Vec3 colnormal[RayPacket::SIZE];
+		const Bezier * b[RayPacket::SIZE];
+		int hits = track->CastRays(packet, mask, patch_id, colpoint, b, colnormal, m_roadCandidates);
+		for (int n = 0; mask >> n; ++n)
+		{
+			const int bit = 1 << n;
+			if (!(mask & bit))
+				continue;
+
+			CollisionContact & contact = *rays[first + n].contact;
+			if (hits & bit)
+			{
+				contact = CollisionContact(
+					ToBulletVector(colpoint[n]), ToBulletVector(colnormal[n]),
+					(colpoint[n] - packet.GetOrigin(n)).Magnitude(),
+					patch_id[n], b[n], &contact.GetSurface(), contact.GetObject());
+			}
+			else
+			{
+				contact = CollisionContact(
+					contact.GetPosition(), contact.GetNormal(), contact.GetDepth(),
+					patch_id[n], 0, &contact.GetSurface(), contact.GetObject());
+			}
+		}
+	}
+}
+
+bool DynamicsWorld::rayTestGeometry(const RayQuery & ray, CollisionContact & contact) const
+{
+	btVector3 p = ray.origin + ray.direction * ray.length;
+	btVector3 n = -ray.direction;
+	btScalar d = ray.length;
 	const TrackSurface * s = TrackSurface::None();
 	const btCollisionObject * c = 0;
 
-	MyRayResultCallback ray(origin, p, caster);
-	rayTest(origin, p, ray);
+	MyRayResultCallback result(ray.origin, p, ray.caster);
+	rayTest(ray.origin, p, result);
 
 	// track geometry collision
-	bool geometryHit = ray.hasHit();
+	bool geometryHit = result.hasHit();
 	if (geometryHit)
 	{
-		p = ray.m_hitPointWorld;
-		n = ray.m_hitNormalWorld;
-		d = ray.m_closestHitFraction * length;
-		c = ray.m_collisionObject;
+		p = result.m_hitPointWorld;
+		n = result.m_hitNormalWorld;
+		d = result.m_closestHitFraction * ray.length;
+		c = result.m_collisionObject;
 		if (c->isStaticObject())
 		{
 			TrackSurface* tsc = static_cast<TrackSurface*>(c->getUserPointer());
@@ -147,7 +234,7 @@ bool DynamicsWorld::castRay(
 #ifndef EXTBULLET
 			else if (c->getCollisionShape()->isCompound())
 			{
-				TRACKSURFACE* tss = static_cast<TRACKSURFACE*>(ray.m_shape->getUserPointer());
+				TRACKSURFACE* tss = static_cast<TRACKSURFACE*>(result.m_shape->getUserPointer());
 				if (tss >= &surfaces[0] && tss <= &surfaces[surfaces.size()-1])
 				{
 					s = tss;
@@ -157,28 +244,13 @@ bool DynamicsWorld::castRay(
 			//std::cerr << "static object without surface" << std::endl;
 		}
 
-		// track bezierpatch collision
-		if (track)
-		{
-			Vec3 org = ToMathVector<float>(origin);
-			Vec3 dir = ToMathVector<float>(direction);
-			Vec3 colpoint;
-			Vec3 colnormal;
-			patch_id = contact.GetPatchId();
-			if (track->CastRay(org, dir, length, patch_id, colpoint, b, colnormal))
-			{
-				p = ToBulletVector(colpoint);
-				n = ToBulletVector(colnormal);
-				d = (colpoint - org).Magnitude();
-			}
-		}
-
-		contact = CollisionContact(p, n, d, patch_id, b, s, c);
+		// keep the previous patch id, it is used as hint by the road test
+		contact = CollisionContact(p, n, d, contact.GetPatchId(), 0, s, c);
 		return true;
 	}
 
 	// should only happen on vehicle rollover
-	contact = CollisionContact(p, n, d, patch_id, b, s, c);
+	contact = CollisionContact(p, n, d, -1, 0, s, c);
 	return false;
 }
 
@@ -188,6 +260,11 @@ void DynamicsWorld::update(btScalar dt)
 	//CProfileManager::dumpAll();
 }
 
+void DynamicsWorld::setJobSystem(Parallel::JobSystem * value)
+{
+	jobs = value;
+}
+
 void DynamicsWorld::debugPrint(std::ostream & out) const
 {
 	out << "Collision objects: " << getNumCollisionObjects() << std::endl;
@@ -205,6 +282,50 @@ void DynamicsWorld::solveConstraints(btContactSolverInfo& solverInfo)
 	fractureCallback();
 }
 
+void DynamicsWorld::CarJob::Execute()
+{
+	car->updateSubsteps(dt);
+}
+
+void DynamicsWorld::updateActions(btScalar timeStep)
+{
+	// wheel rays of all cars are gathered and cast as one batch before any
+	// car is sub-stepped, sub-stepping only writes to its own car, so the
+	// result does not depend on job scheduling and replays stay deterministic
+	m_carJobs.resize(0);
+	m_wheelRays.resize(0);
+	for (int i = 0; i < m_actions.size(); ++i)
+	{
+		CarDynamics* car = dynamic_cast<CarDynamics*>(m_actions[i]);
+		if (car)
+		{
+			car->updateContacts(timeStep, m_wheelRays);
+			m_carJobs.push_back(CarJob(car, timeStep));
+		}
+		else
+		{
+			m_actions[i]->updateAction(this, timeStep);
+		}
+	}
+
+	castRays(m_wheelRays);
+
+	if (!jobs || !jobs->GetNumThreads())
+	{
+		for (int i = 0; i < m_carJobs.size(); ++i)
+		{
+			m_carJobs[i].Execute();
+		}
+		return;
+	}
+
+	for (int i = 0; i < m_carJobs.size(); ++i)
+	{
+		jobs->Submit(m_carJobs[i]);
+	}
+	jobs->Wait();
+}
+
 void DynamicsWorld::addCollisionObject(btCollisionObject* object)
 {
 	// disable shape drawing for meshes
@@ -22,13 +22,16 @@
 
 #include "btBulletCollisionCommon.h"
 #include "btBulletDynamicsCommon.h"
+#include "collision_contact.h"
+#include "parallel_task.h"
 
 #include <iosfwd>
+#include <vector>
 
 class Track;
-class CollisionContact;
 class FractureBody;
 class Bezier;
+class CarDynamics;
 
 class DynamicsWorld  : public btDiscreteDynamicsWorld
 {
@@ -61,8 +64,15 @@ public:
 		const btCollisionObject * caster,
 		CollisionContact & contact) const;
 
+	// cast a batch of rays, consecutive rays of the same caster are tested
+	// against the road patches as packets of up to four rays
+	void castRays(const btAlignedObjectArray<RayQuery> & rays);
+
 	void update(btScalar dt);
 
+	// run car sub-stepping on the job system, pass null to update cars sequentially
+	void setJobSystem(Parallel::JobSystem * jobs);
+
 	void draw();
 
 	void debugPrint(std::ostream & out) const;
@@ -75,15 +85,32 @@ protected:
 		FractureBody* body;
 		int id;
 	};
+	struct CarJob : public Parallel::Job
+	{
+		CarJob() : car(0), dt(0) {}
+		CarJob(CarDynamics* car, btScalar dt) : car(car), dt(dt) {}
+		void Execute();
+		CarDynamics* car;
+		btScalar dt;
+	};
 	btAlignedObjectArray<ActiveCon> m_activeConnections;
+	btAlignedObjectArray<CarJob> m_carJobs;
+	btAlignedObjectArray<RayQuery> m_wheelRays;
+	std::vector<int> m_roadCandidates;
+	Parallel::JobSystem * jobs;
 	const Track * track;
 	btScalar timeStep;
 	int maxSubSteps;
 
 	void reset();
 
+	// bullet ray test, the contact patch is left to the road test
+	bool rayTestGeometry(const RayQuery & ray, CollisionContact & contact) const;
+
 	void solveConstraints(btContactSolverInfo& solverInfo);
 
+	void updateActions(btScalar timeStep);
+
 	void fractureCallback();
 };
 
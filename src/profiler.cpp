@@ -0,0 +1,446 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "profiler.h"
+#include "spscqueue.h"
+
+#include <SDL2/SDL.h>
+
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <sstream>
+
+// events a thread can record between two collections
+static const unsigned int thread_capacity = 16384;
+
+// bar width of a zone taking the whole frame
+static const unsigned int summary_bar = 40;
+
+struct Profiler::Event
+{
+	Uint64 time;
+	ZoneId zone;
+	bool begin;
+};
+
+struct Profiler::ThreadBuffer
+{
+	SpscQueue<Event> events;
+	SDL_atomic_t dropped;
+
+	ThreadBuffer() : events(thread_capacity)
+	{
+		SDL_AtomicSet(&dropped, 0);
+	}
+};
+
+struct Profiler::Node
+{
+	ZoneId zone;
+	int parent;
+	int child;
+	int sibling;
+	Uint64 ticks;
+	float ms;
+
+	Node(ZoneId zone, int parent) :
+		zone(zone), parent(parent), child(-1), sibling(-1), ticks(0), ms(0)
+	{
+		// ctor
+	}
+};
+
+/// call tree of a thread, the first node is the root
+struct Profiler::ThreadTree
+{
+	std::vector<Node> nodes;
+	std::vector<std::pair<int, Uint64> > stack;
+	unsigned int dropped;
+
+	ThreadTree() : dropped(0)
+	{
+		nodes.push_back(Node(0, -1));
+		stack.push_back(std::make_pair(0, Uint64(0)));
+	}
+};
+
+struct Profiler::TraceEvent
+{
+	Uint64 time;
+	ZoneId zone;
+	unsigned short thread;
+	bool begin;
+};
+
+// zone names are registered from any thread, once per call site
+static std::vector<const char *> zone_names;
+static SDL_mutex * zone_mutex = SDL_CreateMutex();
+
+// buffer of the calling thread, registered on its first event
+static SDL_TLSID thread_buffer = SDL_TLSCreate();
+
+Profiler Profiler::instance;
+
+Profiler & Profiler::Get()
+{
+	return instance;
+}
+
+Profiler::ZoneId Profiler::RegisterZone(const char * name)
+{
+	SDL_LockMutex(zone_mutex);
+	const ZoneId id = zone_names.size();
+	zone_names.push_back(name);
+	SDL_UnlockMutex(zone_mutex);
+	assert(zone_names.size() <= 65536);
+	return id;
+}
+
+void Profiler::Begin(ZoneId zone)
+{
+	if (!SDL_AtomicGet(&instance.enabled))
+		return;
+
+	ThreadBuffer * buffer = instance.GetThreadBuffer();
+	if (!buffer)
+		return;
+
+	Event & event = buffer->events.getBack();
+	event.time = SDL_GetPerformanceCounter();
+	event.zone = zone;
+	event.begin = true;
+	if (!buffer->events.push())
+		SDL_AtomicAdd(&buffer->dropped, 1);
+}
+
+void Profiler::End(ZoneId zone)
+{
+	if (!SDL_AtomicGet(&instance.enabled))
+		return;
+
+	ThreadBuffer * buffer = instance.GetThreadBuffer();
+	if (!buffer)
+		return;
+
+	Event & event = buffer->events.getBack();
+	event.time = SDL_GetPerformanceCounter();
+	event.zone = zone;
+	event.begin = false;
+	if (!buffer->events.push())
+		SDL_AtomicAdd(&buffer->dropped, 1);
+}
+
+Profiler::Profiler() :
+	capture_size(0),
+	smoothing(0),
+	frame_ms(0),
+	frame_start(0),
+	capture_start(0)
+{
+	SDL_AtomicSet(&enabled, 0);
+	SDL_AtomicSet(&thread_count, 0);
+	for (unsigned int i = 0; i < max_threads; ++i)
+	{
+		threads[i] = 0;
+	}
+}
+
+Profiler::~Profiler()
+{
+	// threads might still record, buffers are only released at exit
+	SDL_AtomicSet(&enabled, 0);
+	for (unsigned int i = 0; i < max_threads; ++i)
+	{
+		delete threads[i];
+	}
+}
+
+Profiler::ThreadBuffer * Profiler::GetThreadBuffer()
+{
+	ThreadBuffer * buffer = (ThreadBuffer *)SDL_TLSGet(thread_buffer);
+	if (buffer)
+		return buffer;
+
+	// slots are claimed once and never reused, threads beyond the limit aren't recorded
+	const int slot = SDL_AtomicAdd(&thread_count, 1);
+	if (slot >= int(max_threads))
+	{
+		SDL_AtomicAdd(&thread_count, -1);
+		return 0;
+	}
+
+	buffer = new ThreadBuffer();
+	SDL_TLSSet(thread_buffer, buffer, 0);
+
+	// the collector skips the slot until the buffer is published
+	SDL_AtomicSetPtr((void **)&threads[slot], buffer);
+	return buffer;
+}
+
+void Profiler::Enable(float new_smoothing)
+{
+	smoothing = new_smoothing;
+	frame_start = SDL_GetPerformanceCounter();
+
+	// register the main thread first
+	GetThreadBuffer();
+	SDL_AtomicSet(&enabled, 1);
+}
+
+void Profiler::Disable()
+{
+	SDL_AtomicSet(&enabled, 0);
+}
+
+bool Profiler::Enabled() const
+{
+	return SDL_AtomicGet(const_cast<SDL_atomic_t *>(&enabled));
+}
+
+void Profiler::StartCapture(unsigned int max_events)
+{
+	capture.clear();
+	capture.reserve(max_events);
+	capture_size = max_events;
+	capture_start = SDL_GetPerformanceCounter();
+}
+
+void Profiler::Collect(unsigned int thread, const Event & event)
+{
+	ThreadTree & tree = trees[thread];
+	if (event.begin)
+	{
+		// find the zone below the current one, new zones are appended to keep the call order
+		const int parent = tree.stack.back().first;
+		int node = tree.nodes[parent].child;
+		int last = -1;
+		while (node >= 0 && tree.nodes[node].zone != event.zone)
+		{
+			last = node;
+			node = tree.nodes[node].sibling;
+		}
+		if (node < 0)
+		{
+			node = tree.nodes.size();
+			tree.nodes.push_back(Node(event.zone, parent));
+			if (last < 0)
+				tree.nodes[parent].child = node;
+			else
+				tree.nodes[last].sibling = node;
+		}
+		tree.stack.push_back(std::make_pair(node, event.time));
+	}
+	else
+	{
+		// unwind to the matching zone, begin events might have been dropped
+		size_t depth = tree.stack.size();
+		while (depth > 1 && tree.nodes[tree.stack[depth - 1].first].zone != event.zone)
+		{
+			--depth;
+		}
+		if (depth > 1)
+		{
+			const std::pair<int, Uint64> & entry = tree.stack[depth - 1];
+			tree.nodes[entry.first].ticks += event.time - entry.second;
+			tree.stack.resize(depth - 1);
+		}
+	}
+
+	if (capture.size() < capture_size)
+	{
+		TraceEvent trace;
+		trace.time = event.time;
+		trace.zone = event.zone;
+		trace.thread = thread;
+		trace.begin = event.begin;
+		capture.push_back(trace);
+	}
+}
+
+void Profiler::EndFrame()
+{
+	if (!SDL_AtomicGet(&enabled))
+		return;
+
+	unsigned int count = SDL_AtomicGet(&thread_count);
+	if (count > max_threads)
+		count = max_threads;
+	if (trees.size() < count)
+		trees.resize(count);
+
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		ThreadBuffer * buffer = (ThreadBuffer *)SDL_AtomicGetPtr((void **)&threads[i]);
+		if (!buffer)
+			continue;
+
+		while (!buffer->events.empty())
+		{
+			Collect(i, buffer->events.getFront());
+			buffer->events.pop();
+		}
+		trees[i].dropped = SDL_AtomicGet(&buffer->dropped);
+	}
+
+	// zones spanning the frame end are accounted for in the frame they end
+	const Uint64 now = SDL_GetPerformanceCounter();
+	const double tick_ms = 1E3 / SDL_GetPerformanceFrequency();
+	frame_ms = frame_ms * smoothing + (now - frame_start) * tick_ms * (1 - smoothing);
+	frame_start = now;
+	for (unsigned int i = 0; i < trees.size(); ++i)
+	{
+		std::vector<Node> & nodes = trees[i].nodes;
+		for (unsigned int n = 0; n < nodes.size(); ++n)
+		{
+			nodes[n].ms = nodes[n].ms * smoothing + nodes[n].ticks * tick_ms * (1 - smoothing);
+			nodes[n].ticks = 0;
+		}
+	}
+}
+
+void Profiler::WriteSummary(std::ostream & out, const ThreadTree & tree, int node, int depth) const
+{
+	const std::vector<Node> & nodes = tree.nodes;
+	for (int n = nodes[node].child; n >= 0; n = nodes[n].sibling)
+	{
+		const float ms = nodes[n].ms;
+		const float share = frame_ms > 0 ? std::min(ms / frame_ms, 1.0f) : 0;
+		out << std::string(depth * 2, ' ') << zone_names[nodes[n].zone] << " " << ms << " " <<
+			std::string(unsigned(share * summary_bar + 0.5f), '|') << "\n";
+		WriteSummary(out, tree, n, depth + 1);
+	}
+}
+
+std::string Profiler::GetSummary() const
+{
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(2);
+	out << "frame " << frame_ms << " ms\n";
+
+	SDL_LockMutex(zone_mutex);
+	for (unsigned int i = 0; i < trees.size(); ++i)
+	{
+		const ThreadTree & tree = trees[i];
+		if (tree.nodes[0].child < 0)
+			continue;
+
+		out << (i == 0 ? "main" : "thread ") ;
+		if (i > 0)
+			out << i;
+		if (tree.dropped)
+			out << " (" << tree.dropped << " events dropped)";
+		out << "\n";
+		WriteSummary(out, tree, 0, 1);
+	}
+	SDL_UnlockMutex(zone_mutex);
+
+	return out.str();
+}
+
+void Profiler::WriteCapture(std::ostream & out) const
+{
+	// timestamps in microseconds since the capture start
+	const double tick_us = 1E6 / SDL_GetPerformanceFrequency();
+	out << "{\"traceEvents\":[\n";
+	SDL_LockMutex(zone_mutex);
+	for (unsigned int i = 0; i < capture.size(); ++i)
+	{
+		const TraceEvent & e = capture[i];
+		const double ts = e.time > capture_start ? (e.time - capture_start) * tick_us : 0;
+		out << "{\"name\":\"" << zone_names[e.zone] << "\",\"ph\":\"" << (e.begin ? 'B' : 'E') <<
+			"\",\"ts\":" << std::fixed << std::setprecision(3) << ts <<
+			",\"pid\":0,\"tid\":" << e.thread << "}" << (i + 1 < capture.size() ? ",\n" : "\n");
+	}
+	SDL_UnlockMutex(zone_mutex);
+	out << "]}\n";
+}
+
+#include "unittest.h"
+#include "parallel_task.h"
+
+struct ProfiledJob : public Parallel::Job
+{
+	void Execute()
+	{
+		PROFILE_ZONE("profiler_test_job");
+	}
+};
+
+static int CountEvents(const std::string & trace, const std::string & phase)
+{
+	const std::string key = "\"ph\":\"" + phase + "\"";
+	int count = 0;
+	for (size_t n = trace.find(key); n != std::string::npos; n = trace.find(key, n + 1))
+		++count;
+	return count;
+}
+
+QT_TEST(profiler_test)
+{
+	PROFILER.Enable(0);
+	PROFILER.StartCapture(1024);
+	{
+		PROFILE_ZONE("profiler_test_outer");
+		for (int i = 0; i < 3; ++i)
+		{
+			PROFILE_ZONE("profiler_test_inner");
+		}
+	}
+
+	// jobs are recorded on the worker threads
+	std::vector<ProfiledJob> jobs(16);
+	Parallel::JobSystem system;
+	system.Init(2);
+	for (unsigned int i = 0; i < jobs.size(); ++i)
+	{
+		system.Submit(jobs[i]);
+	}
+	system.Wait();
+	system.Deinit();
+
+	PROFILER.EndFrame();
+	PROFILER.Disable();
+
+	// repeated zones are merged, nested zones are indented below their parent
+	const std::string summary = PROFILER.GetSummary();
+	QT_CHECK(summary.find("main\n  profiler_test_outer") != std::string::npos);
+	QT_CHECK(summary.find("\n    profiler_test_inner") != std::string::npos);
+	QT_CHECK(summary.find("profiler_test_inner", summary.find("profiler_test_inner") + 1) == std::string::npos);
+	QT_CHECK(summary.find("    profiler_test_job") != std::string::npos);
+
+	std::ostringstream trace;
+	PROFILER.WriteCapture(trace);
+	const int begins = CountEvents(trace.str(), "B");
+	QT_CHECK_EQUAL(begins, CountEvents(trace.str(), "E"));
+	QT_CHECK(begins >= 4 + 2 * int(jobs.size()));
+
+	// nothing is queued while disabled, collect with the profiler enabled again to see it
+	{
+		PROFILE_ZONE("profiler_test_disabled");
+	}
+	PROFILER.Enable(0);
+	PROFILER.StartCapture(1024);
+	PROFILER.EndFrame();
+	PROFILER.Disable();
+	QT_CHECK(PROFILER.GetSummary().find("profiler_test_disabled") == std::string::npos);
+	std::ostringstream disabled_trace;
+	PROFILER.WriteCapture(disabled_trace);
+	QT_CHECK_EQUAL(CountEvents(disabled_trace.str(), "B"), 0);
+}
@@ -0,0 +1,140 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include <SDL2/SDL_atomic.h>
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+/// Use this macro to access the profiler singleton.
+#define PROFILER Profiler::Get()
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+/// Time the rest of the enclosing scope, name has to be a string literal.
+/// The zone id is interned once per call site.
+/// void Foo()
+/// {
+///     PROFILE_ZONE("foo");
+///     ...
+/// }
+#define PROFILE_ZONE(name) \
+	static const Profiler::ZoneId PROFILE_CONCAT(profile_zone_, __LINE__) = Profiler::RegisterZone(name); \
+	const ProfileZone PROFILE_CONCAT(profile_scope_, __LINE__)(PROFILE_CONCAT(profile_zone_, __LINE__))
+
+/// Hierarchical, thread aware profiler which is cheap enough to stay compiled in.
+/// Zones are recorded as begin and end events into a lock free ring buffer of the
+/// calling thread. The main thread collects them once per frame into a call tree per
+/// thread with smoothed zone durations. Events can also be captured into a trace, written
+/// in the chrome trace event format (chrome://tracing, perfetto).
+/// While the profiler is disabled a zone costs a flag check.
+class Profiler
+{
+public:
+	typedef unsigned short ZoneId;
+
+	static Profiler & Get();
+
+	/// intern a zone name, the name has to outlive the profiler
+	static ZoneId RegisterZone(const char * name);
+
+	/// record events of the calling thread, used by ProfileZone
+	static void Begin(ZoneId zone);
+	static void End(ZoneId zone);
+
+	/// start recording, the calling thread is the main thread collecting the events
+	/// smoothing is the weight of the previous average, between 0 and 1
+	void Enable(float smoothing = 0.9f);
+
+	void Disable();
+
+	bool Enabled() const;
+
+	/// capture events for WriteCapture until max_events are recorded
+	void StartCapture(unsigned int max_events);
+
+	/// write the captured events as chrome trace json
+	void WriteCapture(std::ostream & out) const;
+
+	/// collect the events of all threads and update the zone averages, once per frame
+	void EndFrame();
+
+	/// zone call tree of every thread with average durations in ms
+	/// and a bar per zone showing its share of the frame
+	std::string GetSummary() const;
+
+private:
+	struct Event;
+	struct ThreadBuffer;
+	struct Node;
+	struct ThreadTree;
+	struct TraceEvent;
+
+	static const unsigned int max_threads = 64;
+	static Profiler instance;
+
+	SDL_atomic_t enabled;
+	SDL_atomic_t thread_count;
+	ThreadBuffer * threads[max_threads];
+	std::vector<ThreadTree> trees;
+	std::vector<TraceEvent> capture;
+	unsigned int capture_size;
+	float smoothing;
+	float frame_ms;
+	Uint64 frame_start;
+	Uint64 capture_start;
+
+	Profiler();
+
+	~Profiler();
+
+	ThreadBuffer * GetThreadBuffer();
+
+	void Collect(unsigned int thread, const Event & event);
+
+	void WriteSummary(std::ostream & out, const ThreadTree & tree, int node, int depth) const;
+
+	Profiler(const Profiler & other);
+	Profiler & operator=(const Profiler & other);
+};
+
+/// Scope guard recording a zone, use PROFILE_ZONE.
+class ProfileZone
+{
+public:
+	ProfileZone(Profiler::ZoneId zone) : zone(zone)
+	{
+		Profiler::Begin(zone);
+	}
+
+	~ProfileZone()
+	{
+		Profiler::End(zone);
+	}
+
+private:
+	Profiler::ZoneId zone;
+};
+
+#endif // _PROFILER_H
@@ -0,0 +1,158 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _RAYPACKET_H
+#define _RAYPACKET_H
+
+#include "mathvector.h"
+#include "aabb.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define RAYPACKET_SSE
+#include <xmmintrin.h>
+#endif
+
+/// Up to four ray segments tested together against bounding boxes.
+/// Rays are stored as structure of arrays so that one box test covers the whole packet.
+/// Methods taking a mask only consider rays whose bit (1 << index) is set.
+class RayPacket
+{
+public:
+	static const int SIZE = 4;
+
+	RayPacket() : count(0)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			for (int i = 0; i < SIZE; ++i)
+			{
+				org[k][i] = 0;
+				inv[k][i] = 0;
+			}
+		}
+		for (int i = 0; i < SIZE; ++i)
+		{
+			len[i] = 0;
+		}
+	}
+
+	/// add the segment origin + direction * [0, seglen], return its index
+	int Add(const Vec3 & origin, const Vec3 & direction, float seglen)
+	{
+		assert(count < SIZE);
+		origins[count] = origin;
+		directions[count] = direction;
+		for (int k = 0; k < 3; ++k)
+		{
+			// avoid infinities, a tiny direction component gives a huge but finite slab distance
+			float d = direction[k];
+			if (std::fabs(d) < 1E-9f)
+				d = (d < 0) ? -1E-9f : 1E-9f;
+			org[k][count] = origin[k];
+			inv[k][count] = 1 / d;
+		}
+		len[count] = seglen;
+		return count++;
+	}
+
+	int Size() const {return count;}
+
+	int GetMask() const {return (1 << count) - 1;}
+
+	const Vec3 & GetOrigin(int i) const {return origins[i];}
+
+	const Vec3 & GetDirection(int i) const {return directions[i];}
+
+	float GetSegLen(int i) const {return len[i];}
+
+	/// bounding box of the masked ray segments
+	Aabb <float> GetAabb(int mask) const
+	{
+		Vec3 bmin, bmax;
+		bool first = true;
+		for (int i = 0; i < count; ++i)
+		{
+			if (!(mask & (1 << i))) continue;
+			Vec3 end = origins[i] + directions[i] * len[i];
+			for (int k = 0; k < 3; ++k)
+			{
+				float lo = std::min(origins[i][k], end[k]);
+				float hi = std::max(origins[i][k], end[k]);
+				if (first || lo < bmin[k]) bmin[k] = lo;
+				if (first || hi > bmax[k]) bmax[k] = hi;
+			}
+			first = false;
+		}
+		Aabb <float> box;
+		box.SetFromCorners(bmin, bmax);
+		return box;
+	}
+
+	/// slab test of all rays against the box, return mask of intersecting rays
+	int Intersect(const Aabb <float> & box, int mask) const
+	{
+		const float margin = 1E-3f;
+		const Vec3 & bmin = box.GetPos();
+		const Vec3 bmax = bmin + box.GetSize();
+#ifdef RAYPACKET_SSE
+		__m128 tmin = _mm_setzero_ps();
+		__m128 tmax = _mm_loadu_ps(len);
+		for (int k = 0; k < 3; ++k)
+		{
+			__m128 o = _mm_loadu_ps(org[k]);
+			__m128 id = _mm_loadu_ps(inv[k]);
+			__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bmin[k] - margin), o), id);
+			__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bmax[k] + margin), o), id);
+			tmin = _mm_max_ps(tmin, _mm_min_ps(t0, t1));
+			tmax = _mm_min_ps(tmax, _mm_max_ps(t0, t1));
+		}
+		return _mm_movemask_ps(_mm_cmple_ps(tmin, tmax)) & mask;
+#else
+		int hits = 0;
+		for (int i = 0; i < SIZE; ++i)
+		{
+			float tmin = 0;
+			float tmax = len[i];
+			for (int k = 0; k < 3; ++k)
+			{
+				float t0 = (bmin[k] - margin - org[k][i]) * inv[k][i];
+				float t1 = (bmax[k] + margin - org[k][i]) * inv[k][i];
+				tmin = std::max(tmin, std::min(t0, t1));
+				tmax = std::min(tmax, std::max(t0, t1));
+			}
+			hits |= (tmin <= tmax) << i;
+		}
+		return hits & mask;
+#endif
+	}
+
+private:
+	float org[3][SIZE];
+	float inv[3][SIZE];
+	float len[SIZE];
+	Vec3 origins[SIZE];
+	Vec3 directions[SIZE];
+	int count;
+};
+
+#endif // _RAYPACKET_H
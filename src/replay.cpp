@@ -22,12 +22,99 @@
 #include "cfg/ptree.h"
 #include "physics/carinput.h"
 #include "car.h"
+#include "endian_utility.h"
+#include "lz4.h"
 
+#include <SDL2/SDL.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <sstream>
 #include <fstream>
 
+// replay file layout
+// header: format version, inputs supported, framerate, track, car info
+// followed by chunks: raw size, packed size (0 if stored), lz4 compressed frame records
+// records start with type, car id and frame delta to the previous record of the car
+// input record: bit mask of the changed inputs, then their values
+// state record: state size, then the state xor the previous state of the car,
+// split into byte planes of 4 byte words, so that unchanged high bytes end up in long zero runs
+// the input snapshot of a state frame is rebuilt from the input records
+// all fixed size values are 32 bit little endian, the others are varints
+static const char legacy_format_version[] = "VDRIFTREPLAYV16";
+static const unsigned int replay_chunk_size = 1 << 16;
+static const unsigned int replay_chunk_limit = 1 << 24;
+enum {RECORD_INPUT, RECORD_STATE};
+
+static void WriteU32(std::string & out, uint32_t value)
+{
+	value = ENDIAN_SWAP_32(value);
+	out.append((const char *)&value, 4);
+}
+
+static bool ReadU32(const char *& p, const char * end, uint32_t & value)
+{
+	if (end - p < 4)
+		return false;
+	std::memcpy(&value, p, 4);
+	value = ENDIAN_SWAP_32(value);
+	p += 4;
+	return true;
+}
+
+static void WriteVarint(std::string & out, unsigned int value)
+{
+	for (; value >= 128; value >>= 7)
+		out.push_back(char((value & 127) | 128));
+	out.push_back(char(value));
+}
+
+static bool ReadVarint(const char *& p, const char * end, unsigned int & value)
+{
+	value = 0;
+	for (unsigned int shift = 0; p < end && shift < 32; shift += 7)
+	{
+		const unsigned char byte = *p++;
+		value |= unsigned(byte & 127) << shift;
+		if (byte < 128)
+			return true;
+	}
+	return false;
+}
+
+// index of byte i in its byte plane, the tail which isn't a full word stays in place
+static unsigned int PlaneIndex(unsigned int i, unsigned int words)
+{
+	return (i < words * 4) ? (i % 4) * words + i / 4 : i;
+}
+
+static void EncodeState(const std::string & state, const std::string & prev, std::string & out)
+{
+	const unsigned int size = state.size();
+	const unsigned int words = size / 4;
+	const unsigned int start = out.size();
+	out.resize(start + size);
+	for (unsigned int i = 0; i < size; ++i)
+	{
+		const char ref = (i < prev.size()) ? prev[i] : 0;
+		out[start + PlaneIndex(i, words)] = state[i] ^ ref;
+	}
+}
+
+static void DecodeState(const char * data, unsigned int size, const std::string & prev, std::string & state)
+{
+	const unsigned int words = size / 4;
+	state.resize(size);
+	for (unsigned int i = 0; i < size; ++i)
+	{
+		const char ref = (i < prev.size()) ? prev[i] : 0;
+		state[i] = data[PlaneIndex(i, words)] ^ ref;
+	}
+}
+
 Replay::Replay(float framerate) :
-	version_info("VDRIFTREPLAYV16", CarInput::INVALID, framerate),
+	version_info("VDRIFTREPLAYV17", CarInput::INVALID, framerate),
 	replaymode(IDLE)
 {
 	// ctor
@@ -60,6 +147,15 @@ bool Replay::StartPlaying(const std::string & replayfilename, std::ostream & err
 void Replay::Reset()
 {
 	replaymode = IDLE;
+	if (recordstream.is_open())
+	{
+		// unfinished recording
+		recordstream.close();
+		std::remove(recordfilename.c_str());
+	}
+	recordstream.clear();
+	recordfilename.clear();
+	recordchunk.clear();
 	track.clear();
 	carinfo.clear();
 	carstate.clear();
@@ -68,10 +164,20 @@ void Replay::Reset()
 void Replay::StartRecording(
 	const std::vector<CarInfo> & ncarinfo,
 	const std::string & trackname,
+	const std::string & recordingfilename,
 	std::ostream & error_log)
 {
 	Reset();
 
+	recordstream.open(recordingfilename.c_str(), std::ios::binary);
+	if (!recordstream)
+	{
+		error_log << "Error creating replay file: " << recordingfilename << std::endl;
+		recordstream.clear();
+		return;
+	}
+	recordfilename = recordingfilename;
+
 	replaymode = RECORDING;
 	carinfo = ncarinfo;
 	track = trackname;
@@ -81,19 +187,52 @@ void Replay::StartRecording(
 	{
 		carstate[i].Reset();
 	}
+
+	SaveHeader(recordstream);
 }
 
 void Replay::StopRecording(const std::string & replayfilename)
 {
 	replaymode = IDLE;
-	if (!replayfilename.empty())
+	if (recordstream.is_open() && !replayfilename.empty())
 	{
-		std::ofstream f(replayfilename.c_str(), std::ios::binary);
-		if (f)
-		{
-			Save(f);
-		}
+		WriteChunk(recordchunk, recordstream);
+		recordstream.close();
+		std::remove(replayfilename.c_str());
+		std::rename(recordfilename.c_str(), replayfilename.c_str());
+	}
+	Reset();
+}
+
+bool Replay::Convert(
+	const std::string & infilename,
+	const std::string & outfilename,
+	std::ostream & error_output)
+{
+	Reset();
+
+	std::ifstream instream(infilename.c_str(), std::ios::binary);
+	if (!instream)
+	{
+		error_output << "Error loading replay file: " << infilename << std::endl;
+		return false;
 	}
+	if (!Load(instream, error_output))
+	{
+		Reset();
+		return false;
+	}
+	instream.close();
+
+	std::ofstream outstream(outfilename.c_str(), std::ios::binary);
+	if (!outstream)
+	{
+		error_output << "Error creating replay file: " << outfilename << std::endl;
+		Reset();
+		return false;
+	}
+	Save(outstream);
+	return outstream.good();
 }
 
 const std::vector<float> & Replay::PlayFrame(unsigned carid, Car & car)
@@ -120,9 +259,67 @@ void Replay::RecordFrame(unsigned carid, const std::vector <float> & inputs, Car
 			replaymode = IDLE;
 
 		carstate[carid].RecordFrame(inputs, car);
+		carstate[carid].WriteFrames(carid, recordchunk, recordstream);
 	}
 }
 
+void Replay::CarState::WriteFrames(unsigned carid, std::string & chunk, std::ostream & outstream)
+{
+	std::vector<InputFrame>::const_iterator input = inputframes.begin();
+	std::vector<StateFrame>::const_iterator state = stateframes.begin();
+	while (input != inputframes.end() || state != stateframes.end())
+	{
+		// inputs of a frame go first, the state frame input snapshot is rebuilt from them
+		if (input != inputframes.end() &&
+			(state == stateframes.end() || input->GetFrame() <= state->GetFrame()))
+		{
+			WriteVarint(chunk, RECORD_INPUT);
+			WriteVarint(chunk, carid);
+			WriteVarint(chunk, input->GetFrame() - lastframe);
+			lastframe = input->GetFrame();
+
+			uint32_t mask = 0;
+			float values[CarInput::INVALID];
+			for (unsigned i = 0; i < input->GetNumInputs(); ++i)
+			{
+				const std::pair<int, float> & value = input->GetInput(i);
+				assert(value.first >= 0 && value.first < CarInput::INVALID);
+				mask |= 1u << value.first;
+				values[value.first] = value.second;
+			}
+			WriteU32(chunk, mask);
+			for (unsigned i = 0; i < CarInput::INVALID; ++i)
+			{
+				if (mask & (1u << i))
+				{
+					uint32_t value;
+					std::memcpy(&value, &values[i], 4);
+					WriteU32(chunk, value);
+				}
+			}
+			++input;
+		}
+		else
+		{
+			WriteVarint(chunk, RECORD_STATE);
+			WriteVarint(chunk, carid);
+			WriteVarint(chunk, state->GetFrame() - lastframe);
+			lastframe = state->GetFrame();
+
+			const std::string & data = state->GetBinaryStateData();
+			WriteVarint(chunk, data.size());
+			EncodeState(data, laststate, chunk);
+			laststate = data;
+			++state;
+		}
+
+		if (chunk.size() >= replay_chunk_size)
+			Replay::WriteChunk(chunk, outstream);
+	}
+	inputframes.clear();
+	stateframes.clear();
+}
+
 void Replay::CarState::RecordFrame(const std::vector <float> & inputs, Car & car)
 {
 	assert(inputbuffer.size() == CarInput::INVALID);
@@ -154,6 +351,114 @@ void Replay::CarState::RecordFrame(const std::vector <float> & inputs, Car & car
 	frame++;
 }
 
+unsigned Replay::GetFrame() const
+{
+	return carstate.empty() ? 0 : carstate[0].frame;
+}
+
+unsigned Replay::GetLength() const
+{
+	unsigned length = 0;
+	for (size_t i = 0; i < carstate.size(); ++i)
+	{
+		length = std::max(length, carstate[i].GetLength());
+	}
+	return length;
+}
+
+unsigned Replay::Seek(unsigned frame, std::list<Car> & cars)
+{
+	assert(GetSeekable());
+	assert(cars.size() == carstate.size());
+
+	// cars record their state frames together, so they end up on the same frame
+	unsigned restored = 0;
+	unsigned carid = 0;
+	for (std::list<Car>::iterator i = cars.begin(); i != cars.end(); ++i, ++carid)
+	{
+		restored = carstate[carid].Seek(frame, *i);
+	}
+	replaymode = PLAYING;
+	return restored;
+}
+
+template <class Frame>
+static bool FrameLess(unsigned frame, const Frame & other)
+{
+	return frame < other.GetFrame();
+}
+
+// playback position after seeking, state is the index of the state frame to restore,
+// stateframes.size() if there is none at or before the target and playback starts over
+struct SeekPosition
+{
+	unsigned state;
+	unsigned frame;
+	unsigned cur_stateframe;
+	unsigned cur_inputframe;
+};
+
+template <class Input, class State>
+static SeekPosition FindSeekPosition(
+	const std::vector<Input> & inputframes,
+	const std::vector<State> & stateframes,
+	unsigned target)
+{
+	SeekPosition pos = {unsigned(stateframes.size()), 0, 0, 0};
+
+	// first state frame after the target, the one before it is restored
+	typename std::vector<State>::const_iterator state = std::upper_bound(
+		stateframes.begin(), stateframes.end(), target, FrameLess<State>);
+	if (state == stateframes.begin())
+		return pos;
+	--state;
+	pos.state = state - stateframes.begin();
+
+	// rewind to the frame before the state frame, so that the next PlayFrame
+	// replays it exactly like uninterrupted playback does
+	pos.cur_stateframe = pos.state;
+	pos.frame = state->GetFrame();
+	if (pos.frame > 0)
+		pos.frame--;
+	else
+		pos.cur_stateframe++;
+
+	typename std::vector<Input>::const_iterator input = std::upper_bound(
+		inputframes.begin(), inputframes.end(), pos.frame, FrameLess<Input>);
+	pos.cur_inputframe = input - inputframes.begin();
+
+	return pos;
+}
+
+unsigned Replay::CarState::Seek(unsigned target, Car & car)
+{
+	assert(inputbuffer.size() == CarInput::INVALID);
+
+	const SeekPosition pos = FindSeekPosition(inputframes, stateframes, target);
+	if (pos.state == stateframes.size())
+	{
+		// nothing to restore from, start over
+		Reset();
+		return frame;
+	}
+	ProcessPlayStateFrame(stateframes[pos.state], car);
+	cur_stateframe = pos.cur_stateframe;
+	cur_inputframe = pos.cur_inputframe;
+	frame = pos.frame;
+
+	return frame;
+}
+
+unsigned Replay::CarState::GetLength() const
+{
+	unsigned length = 0;
+	if (!inputframes.empty())
+		length = inputframes.back().GetFrame();
+	if (!stateframes.empty())
+		length = std::max(length, stateframes.back().GetFrame());
+	return length;
+}
+
 bool Replay::CarState::PlayFrame(Car & car)
 {
 	frame++;
@@ -204,14 +509,37 @@ void Replay::CarState::ProcessPlayStateFrame(const StateFrame & frame, Car & car
 }
 
 bool Replay::Serialize(joeserialize::Serializer & s)
+{
+	if (!SerializeHeader(s))
+		return false;
+	_SERIALIZE_(s, carstate);
+	return true;
+}
+
+bool Replay::SerializeHeader(joeserialize::Serializer & s)
 {
 	_SERIALIZE_(s, track);
 	_SERIALIZE_(s, carinfo);
-	_SERIALIZE_(s, carstate);
 	return true;
 }
 
 void Replay::Save(std::ostream & outstream)
+{
+	SaveHeader(outstream);
+
+	std::string chunk;
+	for (size_t i = 0; i < carstate.size(); ++i)
+	{
+		carstate[i].lastframe = 0;
+		carstate[i].laststate.clear();
+		carstate[i].WriteFrames(i, chunk, outstream);
+	}
+	WriteChunk(chunk, outstream);
+
+	Reset();
+}
+
+void Replay::SaveHeader(std::ostream & outstream)
 {
 	// write the file format version data manually
 	// if the serialization functions were used,
@@ -220,9 +548,30 @@ void Replay::Save(std::ostream & outstream)
 	version_info.Save(outstream);
 
 	joeserialize::BinaryOutputSerializer serialize_output(outstream);
-	Serialize(serialize_output);
+	SerializeHeader(serialize_output);
+}
 
-	Reset();
+void Replay::WriteChunk(std::string & chunk, std::ostream & outstream)
+{
+	if (chunk.empty())
+		return;
+
+	std::vector<unsigned char> packed(Lz4Bound(chunk.size()));
+	unsigned int packed_size = Lz4Compress(
+		(const unsigned char *)chunk.data(), chunk.size(), &packed[0]);
+	if (packed_size >= chunk.size())
+		packed_size = 0;
+
+	std::string header;
+	WriteU32(header, chunk.size());
+	WriteU32(header, packed_size);
+	outstream.write(header.data(), header.size());
+	if (packed_size)
+		outstream.write((const char *)&packed[0], packed_size);
+	else
+		outstream.write(chunk.data(), chunk.size());
+
+	chunk.clear();
 }
 
 bool Replay::Load(std::istream & instream, std::ostream & error_output)
@@ -230,6 +579,11 @@ bool Replay::Load(std::istream & instream, std::ostream & error_output)
 	Version stream_version;
 	stream_version.Load(instream);
 
+	// the previous format is the joeserialize dump of all frames
+	const bool legacy = (stream_version.format_version == legacy_format_version);
+	if (legacy)
+		stream_version.format_version = version_info.format_version;
+
 	if (!(stream_version == version_info))
 	{
 		error_output << "Stream version " <<
@@ -244,12 +598,129 @@ bool Replay::Load(std::istream & instream, std::ostream & error_output)
 	}
 
 	joeserialize::BinaryInputSerializer serialize_input(instream);
-	if (!Serialize(serialize_input))
+	if (legacy ? !Serialize(serialize_input) : !SerializeHeader(serialize_input))
 	{
 		error_output << "Error loading replay." << std::endl;
 		return false;
 	}
 
+	if (legacy)
+		return true;
+
+	carstate.resize(carinfo.size());
+	return LoadFrames(instream, error_output);
+}
+
+bool Replay::LoadFrames(std::istream & instream, std::ostream & error_output)
+{
+	std::vector<unsigned> lastframe(carstate.size(), 0);
+	std::vector<std::string> laststate(carstate.size());
+	std::vector< std::vector<float> > inputs(carstate.size(), std::vector<float>(CarInput::INVALID, 0));
+	std::string chunk, packed, state;
+	char header[8];
+	while (instream.read(header, sizeof(header)))
+	{
+		const char * h = header;
+		uint32_t size, packed_size;
+		ReadU32(h, header + sizeof(header), size);
+		ReadU32(h, header + sizeof(header), packed_size);
+		if (size > replay_chunk_limit || packed_size > Lz4Bound(size))
+		{
+			error_output << "Error loading replay, corrupt chunk." << std::endl;
+			return false;
+		}
+
+		packed.resize(packed_size ? packed_size : size);
+		if (!instream.read(&packed[0], packed.size()))
+		{
+			// an interrupted recording, keep the complete chunks
+			error_output << "Replay is truncated." << std::endl;
+			break;
+		}
+
+		if (packed_size)
+		{
+			chunk.resize(size);
+			if (!Lz4Decompress((const unsigned char *)packed.data(), packed_size, (unsigned char *)&chunk[0], size))
+			{
+				error_output << "Error loading replay, corrupt chunk." << std::endl;
+				return false;
+			}
+		}
+		else
+		{
+			chunk.swap(packed);
+		}
+
+		const char * p = chunk.data();
+		const char * end = p + size;
+		while (p < end)
+		{
+			unsigned type, carid, delta;
+			if (!ReadVarint(p, end, type) ||
+				!ReadVarint(p, end, carid) ||
+				!ReadVarint(p, end, delta) ||
+				carid >= carstate.size())
+			{
+				error_output << "Error loading replay, corrupt frame." << std::endl;
+				return false;
+			}
+
+			lastframe[carid] += delta;
+			const unsigned frame = lastframe[carid];
+			if (type == RECORD_INPUT)
+			{
+				uint32_t mask;
+				if (!ReadU32(p, end, mask) || (mask >> CarInput::INVALID))
+				{
+					error_output << "Error loading replay, corrupt input frame." << std::endl;
+					return false;
+				}
+
+				InputFrame inputframe(frame);
+				for (unsigned i = 0; i < CarInput::INVALID; ++i)
+				{
+					if (!(mask & (1u << i)))
+						continue;
+
+					uint32_t bits;
+					if (!ReadU32(p, end, bits))
+					{
+						error_output << "Error loading replay, corrupt input frame." << std::endl;
+						return false;
+					}
+					float value;
+					std::memcpy(&value, &bits, 4);
+					inputframe.AddInput(i, value);
+					inputs[carid][i] = value;
+				}
+				carstate[carid].inputframes.push_back(inputframe);
+			}
+			else if (type == RECORD_STATE)
+			{
+				unsigned state_size;
+				if (!ReadVarint(p, end, state_size) || state_size > unsigned(end - p))
+				{
+					error_output << "Error loading replay, corrupt state frame." << std::endl;
+					return false;
+				}
+
+				DecodeState(p, state_size, laststate[carid], state);
+				laststate[carid] = state;
+				p += state_size;
+
+				carstate[carid].stateframes.push_back(StateFrame(frame));
+				carstate[carid].stateframes.back().SetBinaryStateData(state);
+				carstate[carid].stateframes.back().SetInputSnapshot(inputs[carid]);
+			}
+			else
+			{
+				error_output << "Error loading replay, unknown frame type " << type << "." << std::endl;
+				return false;
+			}
+		}
+	}
+
 	return true;
 }
 
@@ -408,6 +879,8 @@ void Replay::CarState::Reset()
 	cur_inputframe = 0;
 	cur_stateframe = 0;
 	frame = 0;
+	laststate.clear();
+	lastframe = 0;
 }
 
 bool Replay::CarState::Serialize(joeserialize::Serializer & s)
@@ -417,13 +890,104 @@ bool Replay::CarState::Serialize(joeserialize::Serializer & s)
 	return true;
 }
 
+// stand-in for the input and state frames when testing seeking
+struct SeekTestFrame
+{
+	unsigned frame;
+	unsigned GetFrame() const {return frame;}
+};
+
 QT_TEST(replay_test)
 {
-	/*//basic version validity check
+	// varints
+	{
+		const unsigned values[] = {0, 127, 128, 300, 0xffffffff};
+		std::string out;
+		for (unsigned i = 0; i < 5; ++i)
+			WriteVarint(out, values[i]);
+		QT_CHECK_EQUAL(out.size(), 1 + 1 + 2 + 2 + 5);
+
+		const char * p = out.data();
+		const char * end = p + out.size();
+		for (unsigned i = 0; i < 5; ++i)
+		{
+			unsigned value = 0;
+			QT_CHECK(ReadVarint(p, end, value));
+			QT_CHECK_EQUAL(value, values[i]);
+		}
+		unsigned value = 0;
+		QT_CHECK(!ReadVarint(p, end, value));
+	}
+
+	// state deltas, the state size may change between frames
+	{
+		const std::string states[] = {
+			std::string("\x01\x02\x03\x04\x05\x06\x07\x08\x09", 9),
+			std::string("\x01\x02\x03\x05\x05\x06\x07\x09\x09", 9),
+			std::string("\x01\x02\x00\x04\x05", 5),
+			std::string("\x0a\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c", 12)};
+		std::string prev, decoded;
+		for (unsigned i = 0; i < 4; ++i)
+		{
+			std::string encoded("x");
+			EncodeState(states[i], prev, encoded);
+			QT_CHECK_EQUAL(encoded.size(), states[i].size() + 1);
+			DecodeState(encoded.data() + 1, states[i].size(), decoded, decoded);
+			QT_CHECK(decoded == states[i]);
+			prev = states[i];
+		}
+
+		// unchanged bytes are zero, grouped by byte plane
+		std::string encoded;
+		EncodeState(states[1], states[0], encoded);
+		QT_CHECK(encoded == std::string("\0\0\0\0\0\0\x01\x01\0", 9));
+	}
+
+	// seeking, state frames every 30 frames, inputs whenever they changed
 	{
-		REPLAY replay(0.004);
-		stringstream teststream;
-		replay.Save(teststream);
-		QT_CHECK(replay.Load(teststream, std::cerr));
-	}*/
+		const SeekTestFrame inputs[] = {{0}, {5}, {31}, {45}, {70}};
+		const SeekTestFrame states[] = {{0}, {30}, {60}};
+		const std::vector<SeekTestFrame> inputframes(inputs, inputs + 5);
+		std::vector<SeekTestFrame> stateframes(states, states + 3);
+
+		// on the first frame the state frame 0 is restored and playback continues after it
+		SeekPosition pos = FindSeekPosition(inputframes, stateframes, 0);
+		QT_CHECK_EQUAL(pos.state, 0);
+		QT_CHECK_EQUAL(pos.frame, 0);
+		QT_CHECK_EQUAL(pos.cur_stateframe, 1);
+		QT_CHECK_EQUAL(pos.cur_inputframe, 1);
+
+		// between state frames the earlier one is restored, the next PlayFrame replays it
+		pos = FindSeekPosition(inputframes, stateframes, 45);
+		QT_CHECK_EQUAL(pos.state, 1);
+		QT_CHECK_EQUAL(pos.frame, 29);
+		QT_CHECK_EQUAL(pos.cur_stateframe, 1);
+		QT_CHECK_EQUAL(pos.cur_inputframe, 2);
+
+		pos = FindSeekPosition(inputframes, stateframes, 59);
+		QT_CHECK_EQUAL(pos.state, 1);
+		pos = FindSeekPosition(inputframes, stateframes, 60);
+		QT_CHECK_EQUAL(pos.state, 2);
+		QT_CHECK_EQUAL(pos.frame, 59);
+		QT_CHECK_EQUAL(pos.cur_inputframe, 4);
+
+		// past the end the last state frame is restored
+		pos = FindSeekPosition(inputframes, stateframes, 1000);
+		QT_CHECK_EQUAL(pos.state, 2);
+		QT_CHECK_EQUAL(pos.frame, 59);
+		QT_CHECK_EQUAL(pos.cur_stateframe, 2);
+		QT_CHECK_EQUAL(pos.cur_inputframe, 4);
+
+		// before the first state frame there is nothing to restore
+		stateframes.erase(stateframes.begin());
+		pos = FindSeekPosition(inputframes, stateframes, 10);
+		QT_CHECK_EQUAL(pos.state, stateframes.size());
+		QT_CHECK_EQUAL(pos.frame, 0);
+		QT_CHECK_EQUAL(pos.cur_stateframe, 0);
+		QT_CHECK_EQUAL(pos.cur_inputframe, 0);
+
+		stateframes.clear();
+		pos = FindSeekPosition(inputframes, stateframes, 10);
+		QT_CHECK_EQUAL(pos.state, 0);
+	}
 }
@@ -25,6 +25,8 @@
 #include "macros.h"
 
 #include <iosfwd>
+#include <fstream>
+#include <list>
 #include <string>
 
 class Car;
@@ -45,20 +47,42 @@ public:
 	/// true if the replay system is currently playing
 	bool GetPlaying() const;
 
+	/// frames are written to recordingfilename in chunks while recording
 	void StartRecording(
 		const std::vector<CarInfo> & carinfo,
 		const std::string & trackname,
+		const std::string & recordingfilename,
 		std::ostream & error_log);
 
-	/// if replayfilename is empty, do not save the data
+	/// move the recording to replayfilename, if replayfilename is empty, do not save the data
 	void StopRecording(const std::string & replayfilename);
 
+	/// rewrite a replay in the current format, older formats are converted
+	bool Convert(
+		const std::string & infilename,
+		const std::string & outfilename,
+		std::ostream & error_output);
+
 	/// true if the replay system is currently recording
 	bool GetRecording() const;
 
 	/// set car state, return car inputs
 	const std::vector<float> & PlayFrame(unsigned carid, Car & car);
 
+	/// true if a loaded replay can be repositioned, also after playback has finished
+	bool GetSeekable() const;
+
+	/// current playback frame
+	unsigned GetFrame() const;
+
+	/// last recorded frame
+	unsigned GetLength() const;
+
+	/// restore the cars from the last state frame at or before frame and resume playing there
+	/// state frames are found by binary search, returns the new playback frame
+	/// the simulation has to be stepped with PlayFrame from there to reach the requested frame
+	unsigned Seek(unsigned frame, std::list<Car> & cars);
+
 	/// record car inputs and state
 	void RecordFrame(unsigned carid, const std::vector <float> & inputs, Car & car);
 
@@ -153,6 +177,8 @@ private:
 		unsigned cur_inputframe;
 		unsigned cur_stateframe;
 		unsigned frame;
+		std::string laststate; // previous written state frame, state frames are stored as delta
+		unsigned lastframe; // frame of the previous written frame
 
 		/// true if we have zero recorded frames
 		bool Empty() const;
@@ -166,9 +192,20 @@ private:
 		/// set car, update inputbuffer, false if we are out of frames
 		bool PlayFrame(Car & car);
 
+		/// restore car and inputbuffer from the last state frame at or before the given frame
+		/// return the restored frame
+		unsigned Seek(unsigned frame, Car & car);
+
+		/// last recorded frame
+		unsigned GetLength() const;
+
 		/// get car state, save input delta frame
 		void RecordFrame(const std::vector<float> & inputs, Car & car);
 
+		/// append the input and state frames to chunk and clear them
+		/// full chunks are written to outstream
+		void WriteFrames(unsigned carid, std::string & chunk, std::ostream & outstream);
+
 		void ProcessPlayInputFrame(const InputFrame & frame);
 
 		void ProcessPlayStateFrame(const StateFrame & frame, Car & car);
@@ -182,12 +219,27 @@ private:
 
 	/// not serialized
 	enum {IDLE, RECORDING, PLAYING} replaymode;
+	std::ofstream recordstream;
+	std::string recordfilename;
+	std::string recordchunk;
+
+	/// track and car info, the frames follow in the current format
+	bool SerializeHeader(joeserialize::Serializer & s);
 
-	/// load all input and state frames to the stream
+	/// load all input and state frames from the stream
 	bool Load(std::istream & instream, std::ostream & error_output);
 
+	/// read compressed frame chunks up to the end of the stream
+	bool LoadFrames(std::istream & instream, std::ostream & error_output);
+
 	/// save all input and state frames to the stream and then clear them
 	void Save(std::ostream & outstream);
+
+	/// save version, track and car info
+	void SaveHeader(std::ostream & outstream);
+
+	/// compress and write the chunk to the stream and clear it
+	static void WriteChunk(std::string & chunk, std::ostream & outstream);
 };
 
 // implementation
@@ -202,6 +254,11 @@ inline bool Replay::GetRecording() const
 	return (replaymode == RECORDING);
 }
 
+inline bool Replay::GetSeekable() const
+{
+	return (replaymode != RECORDING && !carstate.empty());
+}
+
 inline const std::vector<CarInfo> & Replay::GetCarInfo() const
 {
 	return carinfo;
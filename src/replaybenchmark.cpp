@@ -0,0 +1,336 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "replaybenchmark.h"
+#include "pathmanager.h"
+#include "quickprof.h"
+#include "replay.h"
+#include "track.h"
+#include "car.h"
+#include "physics/carinput.h"
+#include "ai/ai.h"
+#include "sound/sound.h"
+#include "graphics/graphics.h"
+#include "graphics/scenenode.h"
+#include "physics/dynamicsworld.h"
+#include "content/contentmanager.h"
+#include "cfg/ptree.h"
+
+#include <algorithm>
+#include <list>
+#include <sstream>
+#include <iostream>
+
+enum BenchmarkZone
+{
+	ZONE_AI,
+	ZONE_PHYSICS,
+	ZONE_CAR,
+	ZONE_SOUND,
+	ZONE_RENDER,
+	ZONE_TOTAL,
+	ZONE_COUNT
+};
+
+static const char * zone_names[ZONE_COUNT] =
+{
+	"ai",
+	"physics",
+	"car",
+	"sound",
+	"render_setup",
+	"total"
+};
+
+static const double timestep = 1 / 90.0;
+
+// device buffers are mixed at the rate the sound thread would consume them
+static const int mix_rate = 44100;
+
+/// dynamics world with its own broadphase, dispatcher and solver
+struct BenchmarkWorld
+{
+	btDefaultCollisionConfiguration config;
+	btCollisionDispatcher dispatcher;
+	btDbvtBroadphase broadphase;
+	btSequentialImpulseConstraintSolver solver;
+	DynamicsWorld world;
+
+	BenchmarkWorld(btScalar timestep) :
+		dispatcher(&config),
+		world(&dispatcher, &broadphase, &solver, &config, timestep)
+	{
+		world.setContactAddedCallback(&CarDynamics::WheelContactCallback);
+	}
+};
+
+static bool LoadCar(
+	const CarInfo & info,
+	const PathManager & pathmanager,
+	ContentManager & content,
+	DynamicsWorld & world,
+	Sound & sound,
+	const Vec3 & position,
+	const Quat & orientation,
+	Car & car,
+	std::ostream & error_output)
+{
+	const size_t n0 = info.name.find("/");
+	const size_t n1 = info.name.length();
+	const std::string carname = info.name.substr(n0 + 1, n1 - n0 - 1);
+	const std::string cardir = pathmanager.GetCarsDir() + "/" + info.name.substr(0, n0);
+
+	std::tr1::shared_ptr<PTree> carconf;
+	if (info.config.empty())
+	{
+		content.load(carconf, cardir, carname + ".car");
+		if (!carconf->size())
+		{
+			error_output << "Failed to load " << info.name << std::endl;
+			return false;
+		}
+	}
+	else
+	{
+		carconf.reset(new PTree());
+		std::stringstream carstream(info.config);
+		read_ini(carstream, *carconf);
+	}
+
+	// graphics load mesh data only, the scene graph is traversed like with a renderer
+	Vec3 color;
+	if (!car.LoadGraphics(
+		*carconf, cardir, carname, info.wheel, info.paint, color,
+		0, 1.0f, content, error_output))
+	{
+		error_output << "Error loading car: " << info.name << std::endl;
+		return false;
+	}
+
+	if (!car.LoadSounds(cardir, carname, sound, content, error_output))
+	{
+		error_output << "Failed to load sounds for car " << info.name << std::endl;
+		return false;
+	}
+
+	const bool isai = (info.driver != "user");
+	if (!car.LoadPhysics(
+		error_output, content, world,
+		*carconf, cardir, info.tire, position, orientation,
+		isai, isai, false))
+	{
+		error_output << "Failed to load physics for car " << info.name << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+static void JsonString(std::ostream & out, const std::string & str)
+{
+	out << '"';
+	for (size_t i = 0; i < str.size(); ++i)
+	{
+		if (str[i] == '"' || str[i] == '\\')
+			out << '\\';
+		out << str[i];
+	}
+	out << '"';
+}
+
+static float Percentile(const std::vector<float> & sorted, float p)
+{
+	if (sorted.empty())
+		return 0;
+	return sorted[size_t(p * (sorted.size() - 1) + 0.5f)];
+}
+
+static void WriteZone(std::ostream & out, const char * name, std::vector<float> & samples)
+{
+	std::sort(samples.begin(), samples.end());
+	double sum = 0;
+	for (size_t i = 0; i < samples.size(); ++i)
+		sum += samples[i];
+	const double mean = samples.empty() ? 0 : sum / samples.size();
+
+	out << "\t\t\"" << name << "\": {" <<
+		"\"mean_us\": " << mean << ", " <<
+		"\"p50_us\": " << Percentile(samples, 0.5f) << ", " <<
+		"\"p90_us\": " << Percentile(samples, 0.9f) << ", " <<
+		"\"p99_us\": " << Percentile(samples, 0.99f) << ", " <<
+		"\"max_us\": " << (samples.empty() ? 0 : samples.back()) << "}";
+}
+
+bool ReplayBenchmark(
+	const std::string & replayfile,
+	const PathManager & pathmanager,
+	ContentManager & content,
+	std::ostream & report_output,
+	std::ostream & info_output,
+	std::ostream & error_output)
+{
+	Replay replay(timestep);
+	info_output << "Loading replay file: " << replayfile << std::endl;
+	if (!replay.StartPlaying(replayfile, error_output))
+		return false;
+
+	const std::string trackname = replay.GetTrack();
+	const std::vector<CarInfo> & carinfo = replay.GetCarInfo();
+
+	// sources are mixed on this thread, no device is opened
+	Sound sound;
+	sound.SetVolume(1.0);
+
+	BenchmarkWorld world(timestep);
+	Track track;
+	bool loaded = track.DeferredLoad(
+		content, world.world,
+		info_output, error_output,
+		pathmanager.GetTracksPath(trackname),
+		pathmanager.GetTracksDir() + "/" + trackname,
+		pathmanager.GetEffectsTextureDir(),
+		pathmanager.GetTrackPartsPath(),
+		0, false, false, false);
+	while (loaded && !track.Loaded())
+	{
+		loaded = track.ContinueDeferredLoad();
+	}
+	if (!loaded)
+	{
+		error_output << "Error loading track: " << trackname << std::endl;
+		return false;
+	}
+
+	Ai ai;
+	std::list<Car> cars;
+	for (size_t i = 0; i < carinfo.size(); ++i)
+	{
+		cars.push_back(Car());
+		if (!LoadCar(
+			carinfo[i], pathmanager, content, world.world, sound,
+			track.GetStart(i).first, track.GetStart(i).second,
+			cars.back(), error_output))
+		{
+			return false;
+		}
+		if (carinfo[i].driver != "user")
+		{
+			ai.add_car(&cars.back(), carinfo[i].ailevel, carinfo[i].driver);
+		}
+	}
+	content.sweep();
+
+	info_output << "Benchmarking replay of " << cars.size() << " cars on " << trackname << std::endl;
+
+	// the replay stops on its own, the limit guards against truncated files
+	const unsigned int maxticks = 90 * 60 * 60;
+	std::vector<float> samples[ZONE_COUNT];
+	for (int z = 0; z < ZONE_COUNT; ++z)
+		samples[z].reserve(4096);
+
+	std::vector<unsigned char> mixbuffer(size_t(mix_rate * timestep) * 4);
+	std::vector<float> carinputs(CarInput::INVALID, 0.0f);
+	Graphics::dynamicdrawlist_type drawlist;
+	Mat4 identity;
+
+	quickprof::Clock clock;
+	clock.reset();
+	unsigned long long start = clock.getTimeMicroseconds();
+	unsigned int ticks = 0;
+	while (replay.GetPlaying() && ticks < maxticks)
+	{
+		unsigned long long t[ZONE_COUNT + 1];
+		t[0] = clock.getTimeMicroseconds();
+
+		ai.update(timestep, cars);
+		t[1] = clock.getTimeMicroseconds();
+
+		world.world.update(timestep);
+		t[2] = clock.getTimeMicroseconds();
+
+		// same order as Game::UpdateCar, replay inputs override the ai
+		unsigned carid = 0;
+		for (std::list<Car>::iterator i = cars.begin(); i != cars.end(); ++i, ++carid)
+		{
+			i->Update(timestep);
+			const std::vector<float> & inputs = replay.PlayFrame(carid, *i);
+			// short frames leave the remaining inputs at zero, not at the previous car's values
+			std::fill(carinputs.begin(), carinputs.end(), 0.0f);
+			std::copy(inputs.begin(), inputs.begin() + std::min(inputs.size(), carinputs.size()), carinputs.begin());
+			i->Update(carinputs);
+		}
+		track.Update();
+		t[3] = clock.getTimeMicroseconds();
+
+		const Vec3 pos = cars.empty() ? Vec3() : cars.front().GetPosition();
+		sound.SetListenerPosition(pos[0], pos[1], pos[2]);
+		sound.Update(false);
+		sound.Mix(&mixbuffer[0], mixbuffer.size());
+		t[4] = clock.getTimeMicroseconds();
+
+		drawlist.clear();
+		track.GetTrackNode().Traverse(drawlist, identity);
+		track.GetBodyNode().Traverse(drawlist, identity);
+		for (std::list<Car>::iterator i = cars.begin(); i != cars.end(); ++i)
+		{
+			i->GetNode().Traverse(drawlist, identity);
+		}
+		t[5] = clock.getTimeMicroseconds();
+
+		for (int z = 0; z < ZONE_TOTAL; ++z)
+			samples[z].push_back(float(t[z + 1] - t[z]));
+		samples[ZONE_TOTAL].push_back(float(t[5] - t[0]));
+		ticks++;
+	}
+	const double wall_time = (clock.getTimeMicroseconds() - start) * 1E-6;
+	const double sim_time = ticks * timestep;
+
+	info_output << "Replay benchmark complete: " << ticks << " ticks, " << sim_time << " s simulated in " <<
+		wall_time << " s, " << (wall_time > 0 ? ticks / wall_time : 0) << " ticks/s" << std::endl;
+
+	report_output << "{\n";
+	report_output << "\t\"replay\": ";
+	JsonString(report_output, replayfile);
+	report_output << ",\n\t\"track\": ";
+	JsonString(report_output, trackname);
+	report_output << ",\n\t\"cars\": " << cars.size() << ",\n";
+	report_output << "\t\"ticks\": " << ticks << ",\n";
+	report_output << "\t\"sim_time_s\": " << sim_time << ",\n";
+	report_output << "\t\"wall_time_s\": " << wall_time << ",\n";
+	report_output << "\t\"ticks_per_s\": " << (wall_time > 0 ? ticks / wall_time : 0) << ",\n";
+	report_output << "\t\"zones\": {\n";
+	for (int z = 0; z < ZONE_COUNT; ++z)
+	{
+		WriteZone(report_output, zone_names[z], samples[z]);
+		report_output << (z + 1 < ZONE_COUNT ? ",\n" : "\n");
+	}
+	report_output << "\t},\n";
+
+	// final state to check that runs are deterministic
+	report_output << "\t\"final_positions\": [";
+	for (std::list<Car>::iterator i = cars.begin(); i != cars.end(); ++i)
+	{
+		const Vec3 pos = i->GetPosition();
+		report_output << (i == cars.begin() ? "" : ", ") <<
+			"[" << pos[0] << ", " << pos[1] << ", " << pos[2] << "]";
+	}
+	report_output << "]\n}\n" << std::flush;
+
+	return ticks > 0;
+}
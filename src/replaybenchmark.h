@@ -0,0 +1,44 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _REPLAYBENCHMARK_H
+#define _REPLAYBENCHMARK_H
+
+#include <iosfwd>
+#include <string>
+
+class PathManager;
+class ContentManager;
+
+/// Headless replay playback for regression runs, no window, gl or audio device required.
+/// The replay is stepped at the game timestep as fast as possible, every tick runs the ai,
+/// physics, car updates with the replay inputs, sound source updates with inline mixing and
+/// the scene graph traversal that sets up rendering, each timed separately.
+/// Content has to be initialized headless, sound buffers for a 44.1 kHz stereo output.
+/// Per tick latency percentiles and the final car positions are written to report_output as JSON.
+/// Returns false if the replay couldn't be played.
+bool ReplayBenchmark(
+	const std::string & replayfile,
+	const PathManager & pathmanager,
+	ContentManager & content,
+	std::ostream & report_output,
+	std::ostream & info_output,
+	std::ostream & error_output);
+
+#endif // _REPLAYBENCHMARK_H
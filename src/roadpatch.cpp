@@ -26,7 +26,7 @@ bool RoadPatch::Collide(
 	float seglen, Vec3 & outtri,
 	Vec3 & normal) const
 {
-	bool col = patch.CollideSubDivQuadSimpleNorm(origin, direction, outtri, normal);
+	bool col = patch.CollideSubDivQuadSimpleNorm(origin, direction, grid, outtri, normal);
 	float len = (outtri - origin).Magnitude();
 	return col && len <= seglen;
 }
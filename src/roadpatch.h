@@ -35,6 +35,9 @@ public:
 
 	Bezier & GetPatch() {return patch;}
 
+	///evaluate the surface grid used by Collide, has to be repeated if the patch changes
+	void Tessellate() {patch.Tessellate(grid);}
+
 	///return true if the ray starting at the given origin going in the given direction intersects this patch.
 	/// output the contact point and normal to the given outtri and normal variables.
 	bool Collide(
@@ -73,6 +76,7 @@ public:
 
 private:
 	Bezier patch;
+	Bezier::Grid grid;
 	float track_curvature;
 	Vec3 racing_line;
 	VertexArray racingline_vertexarray;
@@ -96,9 +96,12 @@ bool RoadStrip::ReadFrom(
 void RoadStrip::GenerateSpacePartitioning()
 {
 	aabb_part.Clear();
+	patch_aabbs.resize(patches.size());
 	for (unsigned i = 0; i < patches.size(); ++i)
 	{
-		aabb_part.Add(i, patches[i].GetPatch().GetAABB());
+		patches[i].Tessellate();
+		patch_aabbs[i] = patches[i].GetPatch().GetAABB();
+		aabb_part.Add(i, patch_aabbs[i]);
 	}
 	aabb_part.Optimize();
 }
@@ -146,6 +149,69 @@ bool RoadStrip::Collide(
 	return col;
 }
 
+int RoadStrip::Collide(
+	const RayPacket & packet,
+	int mask,
+	int patch_id[],
+	Vec3 outtri[],
+	const Bezier * colpatch[],
+	Vec3 normal[],
+	std::vector<int> & candidates) const
+{
+	// try the last known patch of each ray first
+	int col = 0;
+	for (int n = 0; n < packet.Size(); ++n)
+	{
+		const int bit = 1 << n;
+		if (!(mask & bit) || patch_id[n] < 0 || patch_id[n] >= (int)patches.size())
+			continue;
+
+		Vec3 coltri, colnorm;
+		if (patches[patch_id[n]].Collide(packet.GetOrigin(n), packet.GetDirection(n), packet.GetSegLen(n), coltri, colnorm))
+		{
+			outtri[n] = coltri;
+			normal[n] = colnorm;
+			colpatch[n] = &patches[patch_id[n]].GetPatch();
+			col |= bit;
+		}
+	}
+
+	const int todo = mask & ~col;
+	if (!todo)
+		return col;
+
+	// one tree query for the bounds of the remaining rays, then a packet test per candidate
+	candidates.clear();
+	aabb_part.Query(packet.GetAabb(todo), candidates);
+	int found = 0;
+	for (std::vector<int>::const_iterator i = candidates.begin(); i != candidates.end(); ++i)
+	{
+		const int hits = packet.Intersect(patch_aabbs[*i], todo);
+		for (int n = 0; hits >> n; ++n)
+		{
+			const int bit = 1 << n;
+			if (!(hits & bit))
+				continue;
+
+			const Vec3 & origin = packet.GetOrigin(n);
+			Vec3 coltri, colnorm;
+			if (patches[*i].Collide(origin, packet.GetDirection(n), packet.GetSegLen(n), coltri, colnorm))
+			{
+				if (!(found & bit) || (coltri - origin).MagnitudeSquared() < (outtri[n] - origin).MagnitudeSquared())
+				{
+					outtri[n] = coltri;
+					normal[n] = colnorm;
+					colpatch[n] = &patches[*i].GetPatch();
+					patch_id[n] = *i;
+				}
+				found |= bit;
+			}
+		}
+	}
+
+	return col | found;
+}
+
 void RoadStrip::CreateRacingLine(
 	SceneNode & parentnode,
 	const std::tr1::shared_ptr<Texture> & texture)
@@ -21,7 +21,8 @@
 #define _ROADSTRIP_H
 
 #include "roadpatch.h"
-#include "aabbtree.h"
+#include "aabbbvh.h"
+#include "raypacket.h"
 #include "optional.h"
 #include "memory.h"
 
@@ -49,6 +50,17 @@ public:
 		const Bezier * & colpatch,
 		Vec3 & normal) const;
 
+	/// collide the masked rays of the packet, the patch tree is queried once for all of them
+	/// candidates is a scratch buffer, returns the mask of rays that hit the strip
+	int Collide(
+		const RayPacket & packet,
+		int mask,
+		int patch_id[],
+		Vec3 outtri[],
+		const Bezier * colpatch[],
+		Vec3 normal[],
+		std::vector<int> & candidates) const;
+
 	void CreateRacingLine(
 		SceneNode & parentnode,
 		const std::tr1::shared_ptr<Texture> & texture);
@@ -71,7 +83,8 @@ public:
 private:
 	std::tr1::shared_ptr<Texture> racingline_texture;
 	std::vector<RoadPatch> patches;
-	AabbTreeNode <unsigned> aabb_part;
+	std::vector<Aabb <float> > patch_aabbs;
+	AabbBvh <unsigned> aabb_part;
 	bool closed;
 
 	void GenerateSpacePartitioning();
@@ -51,6 +51,7 @@ Settings::Settings() :
 	music_volume(0.5),
 	sound_volume(0.5),
 	sound_sources(64),
+	sound_cubic(false),
 	mph(true),
 	track("ruudskogen"),
 	antialiasing(0),
@@ -104,6 +105,7 @@ Settings::Settings() :
 	hgateshifter(false),
 	ai_level(1.0),
 	vehicle_damage(false),
+	tire_tables(false),
 	particles(512),
 	sky_dynamic(false),
 	sky_time(17),
@@ -127,6 +129,7 @@ void Settings::Serialize(bool write, Config & config)
 
 	config.get("game", section);
 	Param(config, write, section, "vehicle_damage", vehicle_damage);
+	Param(config, write, section, "tire_tables", tire_tables);
 	Param(config, write, section, "ai_level", ai_level);
 	Param(config, write, section, "track", track);
 	Param(config, write, section, "antilock", abs);
@@ -185,6 +188,7 @@ void Settings::Serialize(bool write, Config & config)
 
 	config.get("sound", section);
 	Param(config, write, section, "sources", sound_sources);
+	Param(config, write, section, "cubic_interpolation", sound_cubic);
 	Param(config, write, section, "volume", sound_volume);
 	Param(config, write, section, "music_volume", music_volume);
 
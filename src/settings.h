@@ -99,6 +99,11 @@ public:
 		return sound_sources;
 	}
 
+	bool GetSoundCubicInterpolation() const
+	{
+		return sound_cubic;
+	}
+
 	bool GetMPH() const
 	{
 		return mph;
@@ -371,6 +376,11 @@ public:
 		return vehicle_damage;
 	}
 
+	bool GetTireTables() const
+	{
+		return tire_tables;
+	}
+
 	void SetResolution(unsigned w, unsigned h)
 	{
 		resolution[0] = w;
@@ -405,6 +415,7 @@ private:
 	float music_volume;
 	float sound_volume;
 	int sound_sources;
+	bool sound_cubic;
 	bool mph; //if false, KPH
 	std::string track;
 	int antialiasing; //0 or 1 mean off
@@ -458,6 +469,7 @@ private:
 	bool hgateshifter;
 	float ai_level;
 	bool vehicle_damage;
+	bool tire_tables;
 	int particles;
 	bool sky_dynamic;
 	int sky_time;
@@ -19,9 +19,17 @@
 
 #include "sound.h"
 #include "coordinatesystem.h"
+#include "quickprof.h"
 #include <SDL2/SDL.h>
 #include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOUND_SSE
+#include <emmintrin.h>
+#endif
 
 //static std::ofstream logso("logso.txt");
 //static std::ofstream logsa("logsa.txt");
@@ -32,6 +40,109 @@ static inline T clamp(T val, T min, T max)
 	return val > min ? (val < max ? val : max) : min;
 }
 
+// gain change limit per frame, 256 frames from min to max gain
+static const float max_gain_delta = 1.0f / 256;
+
+// step to ramp last_gain towards gain over len frames, last_gain is set to the gain at the block end
+static inline float GainStep(float gain, float & last_gain, int len)
+{
+	const float max_delta = max_gain_delta * len;
+	const float delta = clamp(gain - last_gain, -max_delta, max_delta);
+	last_gain += delta;
+	return delta / len;
+}
+
+// samples around the playback position of four consecutive frames, one array per channel
+// s1 is the sample at the position, s0 the one before, s2 and s3 the ones after it
+struct SampleBlock
+{
+	float s0[2][4];
+	float s1[2][4];
+	float s2[2][4];
+	float s3[2][4];
+	float frac[4];
+};
+
+static inline float Interpolate(float s0, float s1, float s2, float s3, float t, bool cubic)
+{
+	if (!cubic)
+		return s1 + t * (s2 - s1);
+
+	// catmull-rom spline through the four samples
+	return s1 + 0.5f * t * (s2 - s0 + t * (2 * s0 - 5 * s1 + 4 * s2 - s3 + t * (3 * (s1 - s2) + s3 - s0)));
+}
+
+// interpolate count <= 4 frames, apply the gain ramps and add them to the interleaved stereo mix
+static inline void MixBlock(
+	const SampleBlock & b, float gain1, float gain2, float step1, float step2,
+	bool cubic, int count, float * mix)
+{
+#ifdef SOUND_SSE
+	if (count == 4)
+	{
+		const __m128 ramp = _mm_set_ps(3, 2, 1, 0);
+		const __m128 gain[2] = {
+			_mm_add_ps(_mm_set1_ps(gain1), _mm_mul_ps(ramp, _mm_set1_ps(step1))),
+			_mm_add_ps(_mm_set1_ps(gain2), _mm_mul_ps(ramp, _mm_set1_ps(step2)))};
+		const __m128 t = _mm_loadu_ps(b.frac);
+		__m128 val[2];
+		for (int c = 0; c < 2; ++c)
+		{
+			const __m128 s1 = _mm_loadu_ps(b.s1[c]);
+			const __m128 s2 = _mm_loadu_ps(b.s2[c]);
+			__m128 v;
+			if (!cubic)
+			{
+				v = _mm_add_ps(s1, _mm_mul_ps(t, _mm_sub_ps(s2, s1)));
+			}
+			else
+			{
+				const __m128 s0 = _mm_loadu_ps(b.s0[c]);
+				const __m128 s3 = _mm_loadu_ps(b.s3[c]);
+				__m128 a = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(3), _mm_sub_ps(s1, s2)), s3), s0);
+				__m128 k = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(2), s0), _mm_mul_ps(_mm_set1_ps(4), s2)),
+					_mm_add_ps(_mm_mul_ps(_mm_set1_ps(5), s1), s3));
+				v = _mm_add_ps(k, _mm_mul_ps(t, a));
+				v = _mm_add_ps(_mm_sub_ps(s2, s0), _mm_mul_ps(t, v));
+				v = _mm_add_ps(s1, _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), t), v));
+			}
+			val[c] = _mm_mul_ps(v, gain[c]);
+		}
+		const __m128 lo = _mm_unpacklo_ps(val[0], val[1]);
+		const __m128 hi = _mm_unpackhi_ps(val[0], val[1]);
+		_mm_storeu_ps(mix, _mm_add_ps(_mm_loadu_ps(mix), lo));
+		_mm_storeu_ps(mix + 4, _mm_add_ps(_mm_loadu_ps(mix + 4), hi));
+		return;
+	}
+#endif
+	for (int k = 0; k < count; ++k)
+	{
+		mix[k * 2] += (gain1 + k * step1) *
+			Interpolate(b.s0[0][k], b.s1[0][k], b.s2[0][k], b.s3[0][k], b.frac[k], cubic);
+		mix[k * 2 + 1] += (gain2 + k * step2) *
+			Interpolate(b.s0[1][k], b.s1[1][k], b.s2[1][k], b.s3[1][k], b.frac[k], cubic);
+	}
+}
+
+// convert the mix to 16 bit samples, saturating
+static void SaturateToS16(const float * mix, int16_t * stream, int count)
+{
+	int i = 0;
+#ifdef SOUND_SSE
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i a = _mm_cvtps_epi32(_mm_loadu_ps(mix + i));
+		__m128i b = _mm_cvtps_epi32(_mm_loadu_ps(mix + i + 4));
+		_mm_storeu_si128((__m128i *)(stream + i), _mm_packs_epi32(a, b));
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		float val = clamp(mix[i], -32768.0f, 32767.0f);
+		stream[i] = int16_t(val < 0 ? val - 0.5f : val + 0.5f);
+	}
+}
+
 // add item to a compactifying vector
 template <class T>
 static inline size_t AddItem(T & item, std::vector<T> & items, size_t & item_num)
@@ -142,29 +253,23 @@ Sound::Sound() :
 	initdone(false),
 	disable(false),
 	set_pause(true),
-	sampler_lock(0),
-	source_lock(0),
 	max_active_sources(64),
 	sources_num(0),
 	update_id(0),
-	sources_pause(true),
 	samplers_num(0),
-	samplers_pause(true)
+	samplers_pause(true),
+	samplers_fade(false)
 {
 	sources.reserve(64);
 	samplers.reserve(64);
+	SDL_AtomicSet(&sources_pause, 1);
+	SDL_AtomicSet(&cubic_interpolation, 0);
 }
 
 Sound::~Sound()
 {
 	if (initdone)
 		SDL_CloseAudio();
-
-	if (sampler_lock)
-		SDL_DestroyMutex(sampler_lock);
-
-	if (source_lock)
-		SDL_DestroyMutex(source_lock);
 }
 
 bool Sound::Init(int buffersize, std::ostream & info_output, std::ostream & error_output)
@@ -172,9 +277,6 @@ bool Sound::Init(int buffersize, std::ostream & info_output, std::ostream & erro
 	if (disable || initdone)
 		return false;
 
-	sampler_lock = SDL_CreateMutex();
-	source_lock = SDL_CreateMutex();
-
 	SDL_AudioSpec desired, obtained;
 
 	desired.freq = 44100;
@@ -257,6 +359,14 @@ void Sound::SetMaxActiveSources(size_t value)
 
 size_t Sound::AddSource(std::tr1::shared_ptr<SoundBuffer> buffer, float offset, bool is3d, bool loop)
 {
+	// a stream has a single read position, every source gets its own
+	if (buffer->GetStreaming() && GetBufferUsed(buffer.get()))
+	{
+		std::tr1::shared_ptr<SoundBuffer> copy(new SoundBuffer());
+		if (copy->CopyStream(*buffer, log_error ? *log_error : std::cerr))
+			buffer = copy;
+	}
+
 	Source src;
 	src.buffer = buffer;
 	src.position.Set(0, 0, 0);
@@ -275,15 +385,26 @@ size_t Sound::AddSource(std::tr1::shared_ptr<SoundBuffer> buffer, float offset,
 	ns.offset = offset * Sampler::denom;
 	ns.loop = loop;
 	ns.id = -1;
-	samplers_update.getFirst().sadd.push_back(ns);
+	samplers_update.getBack().sadd.push_back(ns);
 
 	//*log_error << "Add sound source: " << id << " " << buffer->GetName() << std::endl;
 	return id;
 }
 
+bool Sound::GetBufferUsed(const SoundBuffer * buffer) const
+{
+	// sources waiting for removal still have a sampler
+	for (size_t i = 0; i < sources_num; ++i)
+	{
+		if (sources[i].buffer.get() == buffer)
+			return true;
+	}
+	return false;
+}
+
 void Sound::RemoveSource(size_t id)
 {
-	samplers_update.getFirst().sremove.push_back(id);
+	samplers_update.getBack().sremove.push_back(id);
 	sources_remove.push_back(id);
 }
 
@@ -299,7 +420,7 @@ void Sound::ResetSource(size_t id)
 	ns.offset = src.offset * Sampler::denom;
 	ns.loop = src.loop;
 	ns.id = idn;
-	samplers_update.getFirst().sadd.push_back(ns);
+	samplers_update.getBack().sadd.push_back(ns);
 }
 
 bool Sound::GetSourcePlaying(size_t id) const
@@ -347,16 +468,18 @@ void Sound::SetVolume(float value)
 	sound_volume = value;
 }
 
+void Sound::SetCubicInterpolation(bool value)
+{
+	SDL_AtomicSet(&cubic_interpolation, value);
+}
+
 void Sound::Update(bool pause)
 {
 	if (disable) return;
 
 	set_pause = pause;
 
-	// get source stop messages from sound thread
-	GetSourceChanges();
-
-	// process source stop messages
+	// process source stop messages from sound thread
 	ProcessSourceStop();
 
 	// ProcessSourceAdd is implicit
@@ -364,10 +487,10 @@ void Sound::Update(bool pause)
 	// calculate sampler changes from sources
 	ProcessSources();
 /*
-	logso << "id: " <<samplers_update.getFirst().id;
-	logso << " add: " << samplers_update.getFirst().sadd.size();
-	logso << " del: " << samplers_update.getFirst().sremove.size();
-	logso << " set: " << samplers_update.getFirst().sset.size();
+	logso << "id: " <<samplers_update.getBack().id;
+	logso << " add: " << samplers_update.getBack().sadd.size();
+	logso << " del: " << samplers_update.getBack().sremove.size();
+	logso << " set: " << samplers_update.getBack().sset.size();
 	logso << " sources: " << sources_num;
 	logso << std::endl;
 */
@@ -383,32 +506,26 @@ void Sound::Update(bool pause)
 	}
 }
 
-void Sound::GetSourceChanges()
-{
-	SDL_LockMutex(source_lock);
-	if (!sources_stop.getSecond().empty())
-	{
-		sources_stop.swapFirst();
-	}
-	SDL_UnlockMutex(source_lock);
-}
-
 void Sound::ProcessSourceStop()
 {
-	std::vector<size_t> & sstop = sources_stop.getFirst();
-	for (size_t i = 0; i < sstop.size(); ++i)
+	while (!sources_stop.empty())
 	{
-		size_t id = sstop[i];
-		size_t idn = sources[id].id;
-		if (idn < sources_num)
+		std::vector<size_t> & sstop = sources_stop.getFront();
+		for (size_t i = 0; i < sstop.size(); ++i)
 		{
-			// if source is still there, stop playing
-			// this still might cause issues if the source has been replaced
-			// will need unique identifiers eventually
-			sources[idn].playing = false;
+			size_t id = sstop[i];
+			size_t idn = sources[id].id;
+			if (idn < sources_num)
+			{
+				// if source is still there, stop playing
+				// this still might cause issues if the source has been replaced
+				// will need unique identifiers eventually
+				sources[idn].playing = false;
+			}
 		}
+		sstop.clear();
+		sources_stop.pop();
 	}
-	sstop.clear();
 }
 
 void Sound::ProcessSourceRemove()
@@ -423,7 +540,7 @@ void Sound::ProcessSourceRemove()
 
 void Sound::ProcessSources()
 {
-	std::vector<SamplerSet> & supdate = samplers_update.getFirst().sset;
+	std::vector<SamplerSet> & supdate = samplers_update.getBack().sset;
 	supdate.resize(sources_num);
 
 	sources_active.clear();
@@ -479,8 +596,8 @@ void Sound::ProcessSources()
 		// fade sound volume
 		float volume = set_pause ? 0 : sound_volume;
 
-		supdate[i].gain1 = volume * gain1 * Sampler::denom;
-		supdate[i].gain2 = volume * gain2 * Sampler::denom;
+		supdate[i].gain1 = volume * gain1;
+		supdate[i].gain2 = volume * gain2;
 		supdate[i].pitch = src.pitch * Sampler::denom;
 	}
 
@@ -500,7 +617,7 @@ void Sound::LimitActiveSources()
 		sources_active.end());
 
 	// mute remaining sources
-	std::vector<SamplerSet> & supdate = samplers_update.getFirst().sset;
+	std::vector<SamplerSet> & supdate = samplers_update.getBack().sset;
 	for (size_t i = max_active_sources; i < sources_active.size(); ++i)
 	{
 		supdate[sources_active[i].id].gain1 = 0;
@@ -510,34 +627,41 @@ void Sound::LimitActiveSources()
 
 void Sound::SetSamplerChanges()
 {
-	if (samplers_update.getFirst().empty())
+	SDL_AtomicSet(&sources_pause, set_pause);
+
+	if (samplers_update.getBack().empty())
 		return;
 
-	SDL_LockMutex(sampler_lock);
-	if (samplers_update.getSecond().empty())
+	// if the queue is full the changes are merged into the next update
+	samplers_update.getBack().id = update_id;
+	if (samplers_update.push())
 	{
-		samplers_update.getFirst().id = update_id++;
-		samplers_update.swapFirst();
+		update_id++;
 	}
-	sources_pause = set_pause;
-	SDL_UnlockMutex(sampler_lock);
 }
 
 void Sound::GetSamplerChanges()
 {
-	SDL_LockMutex(sampler_lock);
-	if (!samplers_update.getSecond().empty())
+	bool pause = SDL_AtomicGet(&sources_pause);
+	samplers_fade = (samplers_pause != pause);
+	samplers_pause = pause;
+
+	// apply updates in order, the sampler ids of an update are only valid after its predecessors
+	while (!samplers_update.empty())
 	{
-		samplers_update.swapLast();
+		ProcessSamplerAdd();
+
+		ProcessSamplerUpdate();
+
+		ProcessSamplerRemove();
+
+		samplers_update.pop();
 	}
-	samplers_fade = (samplers_pause != sources_pause);
-	samplers_pause = sources_pause;
-	SDL_UnlockMutex(sampler_lock);
 }
 
 void Sound::ProcessSamplerUpdate()
 {
-	std::vector<SamplerSet> & supdate = samplers_update.getLast().sset;
+	std::vector<SamplerSet> & supdate = samplers_update.getFront().sset;
 	if (supdate.empty())
 		return;
 
@@ -553,20 +677,19 @@ void Sound::ProcessSamplerUpdate()
 
 void Sound::ProcessSamplers(unsigned char *stream, int len)
 {
-	// clear stream
-	memset(stream, 0, len);
-
 	// pause sampling
 	if (samplers_pause && !samplers_fade)
+	{
+		memset(stream, 0, len);
 		return;
+	}
 
-	// init sampling buffers
+	// clear mixing buffer, interleaved stereo
 	int len4 = len / 4;
-	buffer1.resize(len4);
-	buffer2.resize(len4);
+	mix_buffer.assign(len4 * 2, 0.0f);
 
 	// run samplers
-	short * sstream = (short*)stream;
+	bool cubic = SDL_AtomicGet(&cubic_interpolation);
 	for (size_t i = 0; i < samplers_num; ++i)
 	{
 		Sampler & smp = samplers[i];
@@ -574,36 +697,30 @@ void Sound::ProcessSamplers(unsigned char *stream, int len)
 		if (!smp.playing)
 			continue;
 
-		if (smp.gain1 | smp.gain2 | smp.last_gain1 | smp.last_gain2)
+		const bool audible = smp.gain1 > 0 || smp.gain2 > 0 || smp.last_gain1 > 0 || smp.last_gain2 > 0;
+		if (smp.buffer->GetStreaming())
 		{
-			SampleAndAdvanceWithPitch16bit(smp, &buffer1[0], &buffer2[0], len4);
-
-			for (int n = 0; n < len4; ++n)
-			{
-				int pos = n * 2;
-				int val1 = sstream[pos] + buffer1[n];
-				int val2 = sstream[pos + 1] + buffer2[n];
-
-				val1 = clamp(val1, -32768, 32767);
-				val2 = clamp(val2, -32768, 32767);
-
-				sstream[pos] = val1;
-				sstream[pos + 1] = val2;
-			}
+			SampleStream(smp, audible ? &mix_buffer[0] : 0, len4);
+		}
+		else if (audible)
+		{
+			SampleAndAdvanceWithPitch(smp, &mix_buffer[0], len4, cubic);
 		}
 		else
 		{
-			AdvanceWithPitch(smp, len);
+			AdvanceWithPitch(smp, len4);
 		}
 
 		if (!smp.playing)
-			sources_stop.getLast().push_back(smp.id);
+			sources_stop.getBack().push_back(smp.id);
 	}
+
+	SaturateToS16(&mix_buffer[0], (int16_t *)stream, len4 * 2);
 }
 
 void Sound::ProcessSamplerRemove()
 {
-	std::vector<size_t> & sremove = samplers_update.getLast().sremove;
+	std::vector<size_t> & sremove = samplers_update.getFront().sremove;
 	for (size_t i = 0; i < sremove.size(); ++i)
 	{
 		size_t id = sremove[i];
@@ -615,7 +732,7 @@ void Sound::ProcessSamplerRemove()
 
 void Sound::ProcessSamplerAdd()
 {
-	std::vector<SamplerAdd> & sadd = samplers_update.getLast().sadd;
+	std::vector<SamplerAdd> & sadd = samplers_update.getFront().sadd;
 	for (size_t i = 0; i < sadd.size(); ++i)
 	{
 		Sampler smp;
@@ -631,6 +748,10 @@ void Sound::ProcessSamplerAdd()
 		smp.playing = true;
 		smp.loop = sadd[i].loop;
 
+		// the decoder thread seeks to the offset and rewinds looping streams
+		if (smp.buffer->GetStreaming())
+			smp.buffer->RestartStream(sadd[i].offset, smp.loop);
+
 		if (sadd[i].id == -1)
 		{
 			AddItem(smp, samplers, samplers_num);
@@ -646,12 +767,11 @@ void Sound::ProcessSamplerAdd()
 
 void Sound::SetSourceChanges()
 {
-	if (sources_stop.getLast().empty())
+	if (sources_stop.getBack().empty())
 		return;
 
-	SDL_LockMutex(source_lock);
-	sources_stop.swapLast();
-	SDL_UnlockMutex(source_lock);
+	// if the queue is full the stopped samplers are reported with the next callback
+	sources_stop.push();
 }
 
 void Sound::Callback16bitStereo(void *myself, Uint8 *stream, int len)
@@ -659,23 +779,18 @@ void Sound::Callback16bitStereo(void *myself, Uint8 *stream, int len)
 	assert(this == myself);
 	assert(initdone);
 
+	Mix(stream, len);
+}
+
+void Sound::Mix(unsigned char * stream, int len)
+{
 	GetSamplerChanges();
 /*
-	logsa << "id: " << samplers_update.getLast().id;
-	logsa << " add: " << samplers_update.getLast().sadd.size();
-	logsa << " del: " << samplers_update.getLast().sremove.size();
-	logsa << " set: " << samplers_update.getLast().sset.size();
 	logsa << " samplers: " << samplers_num;
 	logsa << std::endl;
 */
-	ProcessSamplerAdd();
-
-	ProcessSamplerUpdate();
-
 	ProcessSamplers(stream, len);
 
-	ProcessSamplerRemove();
-
 	SetSourceChanges();
 }
 
@@ -684,88 +799,126 @@ void Sound::CallbackWrapper(void *sound, unsigned char *stream, int len)
 	static_cast<Sound*>(sound)->Callback16bitStereo(sound, stream, len);
 }
 
-void Sound::SampleAndAdvanceWithPitch16bit(
-	Sampler & sampler, int * chan1, int * chan2, int len)
+void Sound::SampleAndAdvanceWithPitch(
+	Sampler & sampler, float * mix, int len, bool cubic)
 {
 	assert(len > 0);
 	assert(sampler.buffer);
-
-	// if not playing, fill output buffers with silence
-	if (!sampler.playing)
-	{
-		// should be dealt with before getting here
-		assert(0);
-		for (int i = 0; i < len; ++i)
-		{
-			chan1[i] = chan2[i] = 0;
-		}
-		return;
-	}
-
-	// start samlping
-	int chan = sampler.buffer->GetInfo().channels;
-	int samples = sampler.samples_per_channel * chan;
-	int chaninc = chan - 1;
+	assert(sampler.playing);
+
+	// ramp gains linearly over the block, the change rate is limited
+	const float gain1 = sampler.last_gain1;
+	const float gain2 = sampler.last_gain2;
+	const float step1 = GainStep(sampler.gain1, sampler.last_gain1, len);
+	const float step2 = GainStep(sampler.gain2, sampler.last_gain2, len);
+
+	// start sampling
+	const int chan = sampler.buffer->GetInfo().channels;
+	const int chaninc = chan - 1;
+	const int frames = sampler.samples_per_channel;
+	const float scale = 1.0f / sampler.denom;
+	const int16_t * buf = (const int16_t *)sampler.buffer->GetRawBuffer();
 	int nr = sampler.sample_pos_remainder;
 	int ni = sampler.sample_pos;
-	const int16_t * buf = (const int16_t *)sampler.buffer->GetRawBuffer();
-
-	for (int i = 0; i < len; ++i)
+	if (ni >= frames)
 	{
-		// limit gain change rate
-		int gain_delta1 = sampler.gain1 - sampler.last_gain1;
-		int gain_delta2 = sampler.gain2 - sampler.last_gain2;
-		gain_delta1 = clamp(gain_delta1, -sampler.max_gain_delta, sampler.max_gain_delta);
-		gain_delta2 = clamp(gain_delta2, -sampler.max_gain_delta, sampler.max_gain_delta);
-		sampler.last_gain1 += gain_delta1;
-		sampler.last_gain2 += gain_delta2;
+		// start offset past the buffer end
+		if (sampler.loop)
+			ni %= frames;
+		else
+			sampler.playing = false;
+	}
 
-		if (ni >= sampler.samples_per_channel && !sampler.loop)
+	SampleBlock block;
+	for (int i = 0; i < len; i += 4)
+	{
+		// gather samples, the playback position advances by pitch per frame
+		const int count = std::min(4, len - i);
+		const int last = ni + (nr + count * sampler.pitch) / sampler.denom + 2;
+		if (sampler.playing && ni > 0 && last < frames)
 		{
-			// finish playing the buffer if looping is not enabled
-			chan1[i] = chan2[i] = 0;
-			sampler.playing = false;
+			// all frames of the block and their neighbours are inside the buffer
+			for (int k = 0; k < count; ++k)
+			{
+				const int16_t * p = buf + ni * chan;
+				block.s1[0][k] = p[0]; block.s1[1][k] = p[chaninc];
+				block.s2[0][k] = p[chan]; block.s2[1][k] = p[chan + chaninc];
+				if (cubic)
+				{
+					block.s0[0][k] = p[-chan]; block.s0[1][k] = p[-chan + chaninc];
+					block.s3[0][k] = p[2 * chan]; block.s3[1][k] = p[2 * chan + chaninc];
+				}
+				block.frac[k] = nr * scale;
+
+				nr += sampler.pitch;
+				ni += unsigned(nr) / sampler.denom;
+				nr = unsigned(nr) % sampler.denom;
+			}
+			MixBlock(block, gain1 + i * step1, gain2 + i * step2, step1, step2, cubic, count, mix + i * 2);
+			continue;
 		}
-		else
+
+		for (int k = 0; k < count; ++k)
 		{
-			// the sample to the left of the playback position, channel 0 and 1
-			int id1 = (ni * chan) % samples;
-			int samp10 = buf[id1];
-			int samp11 = buf[id1 + chaninc];
-
-			// the sample to the right of the playback position, channel 0 and 1
-			int id2 = (id1 + chan) % samples;
-			int samp20 = buf[id2];
-			int samp21 = buf[id2 + chaninc];
-
-			// interpolated sample at playback position
-			int val1 = (nr * samp20 + (sampler.denom - nr) * samp10) / sampler.denom;
-			int val2 = (nr * samp21 + (sampler.denom - nr) * samp11) / sampler.denom;
-			val1 = (val1 * sampler.last_gain1) / sampler.denom;
-			val2 = (val2 * sampler.last_gain2) / sampler.denom;
-
-			// fill output buffers
-			chan1[i] = val1;
-			chan2[i] = val2;
-
-			// advance playback position
+			if (!sampler.playing)
+			{
+				// finished playing the buffer, fill with silence
+				for (int c = 0; c < 2; ++c)
+				{
+					block.s0[c][k] = block.s1[c][k] = block.s2[c][k] = block.s3[c][k] = 0;
+				}
+				block.frac[k] = 0;
+				continue;
+			}
+
+			// neighbour frames wrap around in looping buffers and are clamped otherwise
+			int n0 = ni - 1, n2 = ni + 1, n3 = ni + 2;
+			if (sampler.loop)
+			{
+				if (n0 < 0) n0 += frames;
+				if (n2 >= frames) n2 -= frames;
+				if (n3 >= frames) n3 %= frames;
+			}
+			else
+			{
+				if (n0 < 0) n0 = 0;
+				if (n2 >= frames) n2 = frames - 1;
+				if (n3 >= frames) n3 = frames - 1;
+			}
+
+			const int16_t * p0 = buf + n0 * chan;
+			const int16_t * p1 = buf + ni * chan;
+			const int16_t * p2 = buf + n2 * chan;
+			const int16_t * p3 = buf + n3 * chan;
+			block.s0[0][k] = p0[0]; block.s0[1][k] = p0[chaninc];
+			block.s1[0][k] = p1[0]; block.s1[1][k] = p1[chaninc];
+			block.s2[0][k] = p2[0]; block.s2[1][k] = p2[chaninc];
+			block.s3[0][k] = p3[0]; block.s3[1][k] = p3[chaninc];
+			block.frac[k] = nr * scale;
+
+			// advance playback position, denom is a power of two
 			nr += sampler.pitch;
-			int ninc = nr / sampler.denom;
-			nr -= ninc * sampler.denom;
-			ni += ninc;
+			ni += unsigned(nr) / sampler.denom;
+			nr = unsigned(nr) % sampler.denom;
+			if (ni >= frames)
+			{
+				if (sampler.loop)
+				{
+					while (ni >= frames) ni -= frames;
+				}
+				else
+				{
+					// finish playing the buffer if looping is not enabled
+					sampler.playing = false;
+				}
+			}
 		}
+
+		MixBlock(block, gain1 + i * step1, gain2 + i * step2, step1, step2, cubic, count, mix + i * 2);
 	}
 
 	sampler.sample_pos = ni;
 	sampler.sample_pos_remainder = nr;
-	if (!sampler.loop)
-	{
-		sampler.playing = (sampler.sample_pos < sampler.samples_per_channel);
-	}
-	else
-	{
-		sampler.sample_pos = sampler.sample_pos % sampler.samples_per_channel;
-	}
 }
 
 void Sound::AdvanceWithPitch(Sampler & sampler, int len)
@@ -786,3 +939,91 @@ void Sound::AdvanceWithPitch(Sampler & sampler, int len)
 		sampler.sample_pos = sampler.sample_pos % sampler.samples_per_channel;
 	}
 }
+
+void Sound::SampleStream(Sampler & sampler, float * mix, int len)
+{
+	assert(len > 0);
+	assert(sampler.buffer);
+	assert(sampler.playing);
+
+	const float gain1 = sampler.last_gain1;
+	const float gain2 = sampler.last_gain2;
+	const float step1 = GainStep(sampler.gain1, sampler.last_gain1, len);
+	const float step2 = GainStep(sampler.gain2, sampler.last_gain2, len);
+
+	// the ring buffer is read in up to two contiguous pieces
+	// on underrun the rest of the block stays silent
+	const int chan = sampler.buffer->GetInfo().channels;
+	const int chaninc = chan - 1;
+	int i = 0;
+	while (i < len)
+	{
+		const short * frames = 0;
+		const int count = sampler.buffer->PeekStream(frames, len - i);
+		if (count == 0)
+			break;
+
+		if (mix)
+		{
+			for (int k = 0; k < count; ++k)
+			{
+				const int n = i + k;
+				mix[n * 2] += (gain1 + n * step1) * frames[k * chan];
+				mix[n * 2 + 1] += (gain2 + n * step2) * frames[k * chan + chaninc];
+			}
+		}
+		sampler.buffer->PopStream(count);
+		i += count;
+	}
+
+	if (sampler.buffer->GetStreamEnded())
+		sampler.playing = false;
+}
+
+void Sound::Benchmark(std::tr1::shared_ptr<SoundBuffer> buffer, std::ostream & info_output)
+{
+	// typical callback size, 11.6 ms at 44.1 kHz
+	const int frames = 512;
+	const int callbacks = 200;
+	const double callback_us = 1E6 * frames / 44100;
+	const int source_counts[] = {1, 16, 64, 128};
+	std::vector<unsigned char> stream(frames * 4);
+
+	info_output << "Sound mixing benchmark, " << frames << " frames per callback" << std::endl;
+	for (int cubic = 0; cubic < 2; ++cubic)
+	{
+		for (int n = 0; n < 4; ++n)
+		{
+			const int count = source_counts[n];
+
+			// sources spread around the listener with varying pitch
+			Sound sound;
+			sound.SetVolume(1.0);
+			sound.SetMaxActiveSources(count);
+			sound.SetCubicInterpolation(cubic);
+			for (int i = 0; i < count; ++i)
+			{
+				size_t id = sound.AddSource(buffer, 0, true, true);
+				float angle = i * 0.7f;
+				float distance = 2.0f + (i % 8) * 5.0f;
+				sound.SetSourcePosition(id, distance * std::cos(angle), distance * std::sin(angle), 0);
+				sound.SetSourcePitch(id, 0.5f + (i % 16) * 0.1f);
+				sound.SetSourceGain(id, 1.0f);
+			}
+			sound.Update(false);
+			sound.GetSamplerChanges();
+
+			quickprof::Clock clock;
+			clock.reset();
+			for (int i = 0; i < callbacks; ++i)
+			{
+				sound.ProcessSamplers(&stream[0], stream.size());
+			}
+			double us = clock.getTimeMicroseconds() / double(callbacks);
+
+			info_output << (cubic ? "Cubic" : "Linear") << " resampling, " << count << " sources: " <<
+				us << " us per callback (" << us / callback_us * 100 << " % of playback time), " <<
+				us * 1E3 / (count * frames) << " ns per source and frame" << std::endl;
+		}
+	}
+}
@@ -22,7 +22,7 @@
 
 #include "soundbuffer.h"
 #include "soundfilter.h"
-#include "tripplebuffer.h"
+#include "spscqueue.h"
 #include "mathvector.h"
 #include "quaternion.h"
 #include "memory.h"
@@ -30,8 +30,6 @@
 #include <iosfwd>
 #include <vector>
 
-struct SDL_mutex;
-
 class Sound
 {
 public:
@@ -78,9 +76,18 @@ public:
 
 	void SetVolume(float value);
 
+	// use cubic instead of linear interpolation for resampling
+	void SetCubicInterpolation(bool value);
+
+	// measure sound thread mixing cost for an increasing number of 3d sources playing buffer
+	static void Benchmark(std::tr1::shared_ptr<SoundBuffer> buffer, std::ostream & info_output);
+
 	// commit state changes
 	void Update(bool pause);
 
+	// mix len bytes of 16 bit stereo output on the calling thread, used without a sound device
+	void Mix(unsigned char * stream, int len);
+
 private:
 	std::ostream * log_error;
 	SoundInfo deviceinfo;
@@ -116,16 +123,15 @@ private:
 	struct Sampler
 	{
 		static const int denom = 32768;
-		static const int max_gain_delta = (denom * 173) / 44100; // 256 samples from min to max gain
-		const SoundBuffer * buffer;
+		SoundBuffer * buffer;
 		int samples_per_channel;
 		int sample_pos;
 		int sample_pos_remainder;
 		int pitch;
-		int gain1;
-		int gain2;
-		int last_gain1;
-		int last_gain2;
+		float gain1;
+		float gain2;
+		float last_gain1;
+		float last_gain2;
 		bool playing;
 		bool loop;
 		size_t id;
@@ -134,7 +140,7 @@ private:
 	// message structs
 	struct SamplerAdd
 	{
-		const SoundBuffer * buffer;
+		SoundBuffer * buffer;
 		int offset;
 		bool loop;
 		int id;
@@ -142,7 +148,8 @@ private:
 
 	struct SamplerSet
 	{
-		int gain1, gain2, pitch;
+		float gain1, gain2;
+		int pitch;
 	};
 
 	struct SamplersUpdate
@@ -154,11 +161,11 @@ private:
 		bool empty() const;
 	};
 
-	// sound thread message system
-	TrippleBuffer<SamplersUpdate> samplers_update;
-	TrippleBuffer<std::vector<size_t> > sources_stop;
-	SDL_mutex * sampler_lock;
-	SDL_mutex * source_lock;
+	// sound thread message system, lock free so that the callback never waits for the main thread
+	SpscQueue<SamplersUpdate> samplers_update;
+	SpscQueue<std::vector<size_t> > sources_stop;
+	SDL_atomic_t sources_pause;
+	SDL_atomic_t cubic_interpolation;
 
 	// sound sources state
 	std::vector<SourceActive> sources_active;
@@ -167,17 +174,16 @@ private:
 	size_t max_active_sources;
 	size_t sources_num;
 	size_t update_id;
-	bool sources_pause;
 
 	// sound thread state
-	std::vector<int> buffer1, buffer2;
+	std::vector<float> mix_buffer;
 	std::vector<Sampler> samplers;
 	size_t samplers_num;
 	bool samplers_pause;
 	bool samplers_fade;
 
 	// main thread methods
-	void GetSourceChanges();
+	bool GetBufferUsed(const SoundBuffer * buffer) const;
 
 	void ProcessSourceStop();
 
@@ -206,10 +212,13 @@ private:
 
 	static void CallbackWrapper(void *sound, unsigned char *stream, int len);
 
-	static void SampleAndAdvanceWithPitch16bit(
-		Sampler & sampler, int * chan1, int * chan2, int len);
+	static void SampleAndAdvanceWithPitch(
+		Sampler & sampler, float * mix, int len, bool cubic);
 
 	static void AdvanceWithPitch(Sampler & sampler, int len);
+
+	// play streaming buffer at its own rate, a null mix skips the frames
+	static void SampleStream(Sampler & sampler, float * mix, int len);
 };
 
 #endif
@@ -20,6 +20,10 @@
 #include "soundbuffer.h"
 #include "endian_utility.h"
 
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_atomic.h>
+
 #ifdef __APPLE__
 #define __MACOSX__
 #include <Vorbis/vorbisfile.h>
@@ -28,14 +32,243 @@
 #endif
 
 #include <fstream>
+#include <algorithm>
+#include <vector>
+#include <cassert>
 #include <cstdio>
 #include <cstring>
 
+// vorbis reads through SDL_RWops, the file is closed by its owner
+static size_t ReadRW(void * ptr, size_t size, size_t count, void * source)
+{
+	return SDL_RWread((SDL_RWops *)source, ptr, size, count);
+}
+
+static int SeekRW(void * source, ogg_int64_t offset, int whence)
+{
+	return SDL_RWseek((SDL_RWops *)source, offset, whence) < 0 ? -1 : 0;
+}
+
+static long TellRW(void * source)
+{
+	return SDL_RWtell((SDL_RWops *)source);
+}
+
+static const ov_callbacks OV_CALLBACKS_RWOPS = {ReadRW, SeekRW, NULL, TellRW};
+
+// linear resampler for 16 bit frames, the input can be fed in chunks
+// output lags the input by one frame, the last input frame is kept to interpolate across chunks
+struct Resampler
+{
+	static const int denom = 32768;
+	int channels;
+	int step; // input frames per output frame, fixed point
+	int index; // input frame of the next output frame
+	int frac; // position of the next output frame between index - 1 and index
+	short prev[2];
+
+	Resampler(int chan = 1, int in_rate = 1, int out_rate = 1) :
+		channels(chan),
+		step(int(double(denom) * in_rate / out_rate + 0.5)),
+		index(1),
+		frac(0)
+	{
+		assert(channels > 0 && channels <= 2);
+		prev[0] = prev[1] = 0;
+	}
+
+	// upper bound of the output frames for count input frames
+	int GetMaxOutput(int count) const
+	{
+		return int(double(count) * denom / step) + 2;
+	}
+
+	// resample count input frames into out, return the number of output frames
+	int Process(const short * in, int count, short * out)
+	{
+		if (count <= 0)
+			return 0;
+
+		int n = 0;
+		while (index < count)
+		{
+			const short * b = in + index * channels;
+			const short * a = (index > 0) ? b - channels : prev;
+			for (int c = 0; c < channels; ++c)
+			{
+				out[c] = a[c] + (b[c] - a[c]) * frac / denom;
+			}
+			out += channels;
+			++n;
+
+			frac += step;
+			index += frac / denom;
+			frac = frac % denom;
+		}
+		index -= count;
+
+		for (int c = 0; c < channels; ++c)
+		{
+			prev[c] = in[(count - 1) * channels + c];
+		}
+		return n;
+	}
+};
+
+// streaming state, the decoder thread writes frames to the ring buffer, the sound thread reads them
+// read and write are frame counters, the ring size is a power of two so they can wrap around
+// the compressed file is kept in memory, so the decoder never waits for the disk
+// and copies of the stream share it
+struct SoundBuffer::Stream
+{
+	static const unsigned int capacity = 32768; // frames, 0.74 s at 44.1 kHz
+	static const unsigned int chunk = 4096; // samples per ov_read call
+	std::tr1::shared_ptr<std::vector<char> > data;
+	SDL_RWops * rw;
+	OggVorbis_File file;
+	Resampler resampler;
+	std::vector<short> ring;
+	std::vector<short> decoded;
+	std::vector<short> resampled;
+	SDL_atomic_t read;
+	SDL_atomic_t write;
+	SDL_atomic_t ended;
+	SDL_atomic_t quit;
+	SDL_atomic_t loop;
+	SDL_atomic_t restart; // output frame + 1 to restart the stream at, 0 if no restart is pending
+	SDL_Thread * thread;
+	int channels;
+	int in_rate;
+	int out_rate;
+	bool played; // only used by the sound thread
+
+	Stream() :
+		rw(0),
+		thread(0),
+		channels(1),
+		in_rate(1),
+		out_rate(1),
+		played(false)
+	{
+		SDL_AtomicSet(&read, 0);
+		SDL_AtomicSet(&write, 0);
+		SDL_AtomicSet(&ended, 0);
+		SDL_AtomicSet(&quit, 0);
+		SDL_AtomicSet(&loop, 0);
+		SDL_AtomicSet(&restart, 0);
+	}
+
+	// allocate buffers once the file is open
+	void Init(int chan, int file_rate, int device_rate)
+	{
+		resampler = Resampler(chan, file_rate, device_rate);
+		ring.resize(capacity * chan);
+		decoded.resize(chunk);
+		resampled.resize(resampler.GetMaxOutput(chunk / chan) * chan);
+		channels = chan;
+		in_rate = file_rate;
+		out_rate = device_rate;
+	}
+
+	// drop the decoded frames and continue decoding at the requested frame
+	// the reader doesn't touch the ring while the restart is pending
+	void Restart(int request)
+	{
+		SDL_MemoryBarrierAcquire();
+
+		ogg_int64_t frame = ogg_int64_t(request - 1) * in_rate / out_rate;
+		const ogg_int64_t total = ov_pcm_total(&file, -1);
+		if (SDL_AtomicGet(&loop) && total > 0)
+			frame %= total;
+
+		resampler = Resampler(channels, in_rate, out_rate);
+		SDL_AtomicSet(&ended, ov_pcm_seek(&file, frame) != 0);
+		SDL_AtomicSet(&write, SDL_AtomicGet(&read));
+
+		// a newer request is handled with the next chunk
+		SDL_MemoryBarrierRelease();
+		SDL_AtomicCAS(&restart, request, 0);
+	}
+
+	// decode a chunk into the ring buffer, return false if there is nothing to do
+	bool Decode()
+	{
+		const int request = SDL_AtomicGet(&restart);
+		if (request)
+			Restart(request);
+
+		if (SDL_AtomicGet(&ended))
+			return false;
+
+		// make sure a whole chunk fits
+		const unsigned int w = SDL_AtomicGet(&write);
+		const unsigned int used = w - (unsigned int)SDL_AtomicGet(&read);
+		if (capacity - used < resampled.size() / channels)
+			return false;
+
+		// frames released by the reader are free to be overwritten
+		SDL_MemoryBarrierAcquire();
+
+		int bitstream;
+		int endian = 0; //0 for Little-Endian, 1 for Big-Endian
+		long bytes = ov_read(&file, (char *)&decoded[0], decoded.size() * sizeof(short), endian, 2, 1, &bitstream);
+		if (bytes == OV_HOLE)
+		{
+			// interruption in the data, skip it
+			return true;
+		}
+		if (bytes == 0 && SDL_AtomicGet(&loop) && ov_pcm_seek(&file, 0) == 0)
+		{
+			return true;
+		}
+		if (bytes <= 0)
+		{
+			SDL_AtomicSet(&ended, 1);
+			return false;
+		}
+
+		int count = bytes / (sizeof(short) * channels);
+		const short * frames = &decoded[0];
+		if (in_rate != out_rate)
+		{
+			count = resampler.Process(frames, count, &resampled[0]);
+			frames = &resampled[0];
+		}
+
+		for (int i = 0; i < count; ++i)
+		{
+			short * frame = &ring[((w + i) & (capacity - 1)) * channels];
+			for (int c = 0; c < channels; ++c)
+			{
+				frame[c] = frames[i * channels + c];
+			}
+		}
+
+		// publish the frames
+		SDL_MemoryBarrierRelease();
+		SDL_AtomicSet(&write, w + count);
+		return true;
+	}
+
+	static int Run(void * data)
+	{
+		Stream * stream = static_cast<Stream *>(data);
+		while (!SDL_AtomicGet(&stream->quit))
+		{
+			// the ring holds several sound callbacks worth of frames, poll to refill it
+			if (!stream->Decode())
+				SDL_Delay(10);
+		}
+		return 0;
+	}
+};
+
 SoundBuffer::SoundBuffer() :
 	info(0, 0, 0, 0),
 	size(0),
 	loaded(false),
-	sound_buffer(0)
+	sound_buffer(0),
+	stream(0)
 {
 	// ctor
 }
@@ -46,11 +279,24 @@ SoundBuffer::~SoundBuffer()
 }
 
 bool SoundBuffer::Load(const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output)
+{
+	SDL_RWops * file = SDL_RWFromFile(filename.c_str(), "rb");
+	if (!file)
+	{
+		error_output << "Can't open sound file: "+filename << std::endl;
+		return false;
+	}
+	bool success = Load(file, filename, sound_device_info, error_output);
+	SDL_RWclose(file);
+	return success;
+}
+
+bool SoundBuffer::Load(SDL_RWops * file, const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output)
 {
 	if (filename.find(".wav") != std::string::npos)
-		return LoadWAV(filename, sound_device_info, error_output);
+		return LoadWAV(file, filename, sound_device_info, error_output);
 	else if (filename.find(".ogg") != std::string::npos)
-		return LoadOGG(filename, sound_device_info, error_output);
+		return LoadOGG(file, filename, sound_device_info, error_output);
 	else
 	{
 		error_output << "Unable to determine file type from filename: " << filename << std::endl;
@@ -58,57 +304,218 @@ bool SoundBuffer::Load(const std::string & filename, const SoundInfo & sound_dev
 	}
 }
 
+bool SoundBuffer::LoadStream(const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output)
+{
+	SDL_RWops * file = SDL_RWFromFile(filename.c_str(), "rb");
+	if (!file)
+	{
+		error_output << "Can't open sound file: "+filename << std::endl;
+		return false;
+	}
+	bool success = LoadStream(file, filename, sound_device_info, error_output);
+	SDL_RWclose(file);
+	return success;
+}
+
+bool SoundBuffer::LoadStream(SDL_RWops * file, const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output)
+{
+	const Sint64 file_size = SDL_RWsize(file);
+	std::tr1::shared_ptr<std::vector<char> > data(new std::vector<char>(std::max(file_size, Sint64(1))));
+	if (file_size <= 0 || SDL_RWread(file, &(*data)[0], file_size, 1) != 1)
+	{
+		error_output << "Can't read sound file: "+filename << std::endl;
+		return false;
+	}
+	return OpenStream(data, filename, sound_device_info, error_output);
+}
+
+bool SoundBuffer::CopyStream(const SoundBuffer & other, std::ostream & error_output)
+{
+	assert(other.stream);
+	const SoundInfo device_info(0, other.info.frequency, other.info.channels, other.info.bytespersample);
+	return OpenStream(other.stream->data, other.name, device_info, error_output);
+}
+
+bool SoundBuffer::OpenStream(const std::tr1::shared_ptr<std::vector<char> > & data, const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output)
+{
+	if (loaded)
+		Unload();
+
+	name = filename;
+
+	// the vorbis file state can't be copied, open it in place
+	Stream * new_stream = new Stream();
+	new_stream->data = data;
+	new_stream->rw = SDL_RWFromConstMem(&(*data)[0], data->size());
+	if (!new_stream->rw || ov_open_callbacks(new_stream->rw, &new_stream->file, NULL, 0, OV_CALLBACKS_RWOPS) < 0)
+	{
+		if (new_stream->rw)
+			SDL_RWclose(new_stream->rw);
+		delete new_stream;
+		error_output << "Sound file isn't an ogg vorbis stream: "+filename << std::endl;
+		return false;
+	}
+
+	vorbis_info * pInfo = ov_info(&new_stream->file, -1);
+	long samples = ov_pcm_total(&new_stream->file, -1);
+	if (samples < 0)
+		samples = 0;
+	SoundInfo original_info(samples * pInfo->channels, pInfo->rate, pInfo->channels, 2);
+	if (pInfo->channels > 2 || !CheckFormat(original_info, sound_device_info, error_output))
+	{
+		error_output << "Sound file isn't in desired format: "+filename << std::endl;
+		ov_clear(&new_stream->file);
+		SDL_RWclose(new_stream->rw);
+		delete new_stream;
+		return false;
+	}
+
+	// decoding starts right away to fill the ring buffer before playback
+	new_stream->Init(pInfo->channels, pInfo->rate, sound_device_info.frequency);
+	info = SoundInfo(
+		double(samples) * sound_device_info.frequency / pInfo->rate * pInfo->channels,
+		sound_device_info.frequency, pInfo->channels, 2);
+	new_stream->thread = SDL_CreateThread(Stream::Run, "SoundStream", new_stream);
+	stream = new_stream;
+	loaded = true;
+
+	return true;
+}
+
 void SoundBuffer::Unload()
 {
-	if (loaded && sound_buffer)
-		delete [] sound_buffer;
+	if (stream)
+	{
+		SDL_AtomicSet(&stream->quit, 1);
+		SDL_WaitThread(stream->thread, NULL);
+		ov_clear(&stream->file);
+		SDL_RWclose(stream->rw);
+		delete stream;
+		stream = 0;
+	}
+	delete [] sound_buffer;
 	sound_buffer = 0;
+	loaded = false;
+}
+
+void SoundBuffer::RestartStream(int offset, bool loop)
+{
+	assert(stream);
+	SDL_AtomicSet(&stream->loop, loop);
+
+	// the first play from the start uses the frames decoded on load
+	const bool played = stream->played;
+	stream->played = true;
+	if (!played && offset == 0)
+		return;
+
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&stream->restart, std::max(offset, 0) + 1);
 }
 
-bool SoundBuffer::LoadWAV(const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output)
+int SoundBuffer::PeekStream(const short * & frames, int max) const
+{
+	assert(stream);
+	if (SDL_AtomicGet(&stream->restart))
+		return 0;
+
+	const unsigned int r = SDL_AtomicGet(&stream->read);
+	const unsigned int available = (unsigned int)SDL_AtomicGet(&stream->write) - r;
+	SDL_MemoryBarrierAcquire();
+
+	const unsigned int begin = r & (Stream::capacity - 1);
+	const unsigned int count = std::min(std::min(available, Stream::capacity - begin), (unsigned int)max);
+	frames = &stream->ring[begin * stream->channels];
+	return count;
+}
+
+void SoundBuffer::PopStream(int count)
+{
+	assert(stream);
+	// done reading the frames before the writer may reuse them
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicAdd(&stream->read, count);
+}
+
+bool SoundBuffer::GetStreamEnded() const
+{
+	assert(stream);
+	return !SDL_AtomicGet(&stream->restart) && SDL_AtomicGet(&stream->ended) &&
+		SDL_AtomicGet(&stream->write) == SDL_AtomicGet(&stream->read);
+}
+
+bool SoundBuffer::CheckFormat(const SoundInfo & original_info, const SoundInfo & sound_device_info, std::ostream & error_output) const
+{
+	// frequency is converted, channels are mixed by the sound thread
+	SoundInfo desired_info(original_info.samples, original_info.frequency, original_info.channels, sound_device_info.bytespersample);
+	if (desired_info == original_info)
+		return true;
+
+	error_output << "SOUND FORMAT:" << std::endl;
+	original_info.DebugPrint(error_output);
+	error_output << "DESIRED FORMAT:" << std::endl;
+	desired_info.DebugPrint(error_output);
+	return false;
+}
+
+void SoundBuffer::Resample(int frequency)
+{
+	if (info.frequency == frequency)
+		return;
+
+	const int frames = info.samples / info.channels;
+	Resampler resampler(info.channels, info.frequency, frequency);
+	char * buffer = new char[resampler.GetMaxOutput(frames) * info.channels * sizeof(short)];
+	int count = resampler.Process((const short *)sound_buffer, frames, (short *)buffer);
+
+	delete [] sound_buffer;
+	sound_buffer = buffer;
+	info.samples = count * info.channels;
+	info.frequency = frequency;
+	size = info.samples * sizeof(short);
+}
+
+bool SoundBuffer::LoadWAV(SDL_RWops * file, const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output)
 {
 	if (loaded)
 		Unload();
 
 	name = filename;
 
-	FILE *fp;
-
 	unsigned int size;
 
-	fp = fopen(filename.c_str(), "rb");
-	if (fp)
+	if (file)
 	{
 		char id[5]; //four bytes to hold 'RIFF'
 
-		if (fread(id,sizeof(char),4,fp) != 4) return false; //read in first four bytes
+		if (SDL_RWread(file, id,sizeof(char),4) != 4) return false; //read in first four bytes
 		id[4] = '\0';
 		if (!strcmp(id,"RIFF"))
 		{ //we had 'RIFF' let's continue
-			if (fread(&size,sizeof(unsigned int),1,fp) != 1) return false; //read in 32bit size value
+			if (SDL_RWread(file, &size,sizeof(unsigned int),1) != 1) return false; //read in 32bit size value
 			size = ENDIAN_SWAP_32(size);
-			if (fread(id,sizeof(char),4,fp)!= 4) return false; //read in 4 byte string now
+			if (SDL_RWread(file, id,sizeof(char),4)!= 4) return false; //read in 4 byte string now
 			if (!strcmp(id,"WAVE"))
 			{ //this is probably a wave file since it contained "WAVE"
-				if (fread(id,sizeof(char),4,fp)!= 4) return false; //read in 4 bytes "fmt ";
+				if (SDL_RWread(file, id,sizeof(char),4)!= 4) return false; //read in 4 bytes "fmt ";
 				if (!strcmp(id,"fmt "))
 				{
 					unsigned int format_length, sample_rate, avg_bytes_sec;
 					short format_tag, channels, block_align, bits_per_sample;
 
-					if (fread(&format_length, sizeof(unsigned int),1,fp) != 1) return false;
+					if (SDL_RWread(file, &format_length, sizeof(unsigned int),1) != 1) return false;
 					format_length = ENDIAN_SWAP_32(format_length);
-					if (fread(&format_tag, sizeof(short), 1, fp) != 1) return false;
+					if (SDL_RWread(file, &format_tag, sizeof(short), 1) != 1) return false;
 					format_tag = ENDIAN_SWAP_16(format_tag);
-					if (fread(&channels, sizeof(short),1,fp) != 1) return false;
+					if (SDL_RWread(file, &channels, sizeof(short),1) != 1) return false;
 					channels = ENDIAN_SWAP_16(channels);
-					if (fread(&sample_rate, sizeof(unsigned int), 1, fp) != 1) return false;
+					if (SDL_RWread(file, &sample_rate, sizeof(unsigned int), 1) != 1) return false;
 					sample_rate = ENDIAN_SWAP_32(sample_rate);
-					if (fread(&avg_bytes_sec, sizeof(unsigned int), 1, fp) != 1) return false;
+					if (SDL_RWread(file, &avg_bytes_sec, sizeof(unsigned int), 1) != 1) return false;
 					avg_bytes_sec = ENDIAN_SWAP_32(avg_bytes_sec);
-					if (fread(&block_align, sizeof(short), 1, fp) != 1) return false;
+					if (SDL_RWread(file, &block_align, sizeof(short), 1) != 1) return false;
 					block_align = ENDIAN_SWAP_16(block_align);
-					if (fread(&bits_per_sample, sizeof(short), 1, fp) != 1) return false;
+					if (SDL_RWread(file, &bits_per_sample, sizeof(short), 1) != 1) return false;
 					bits_per_sample = ENDIAN_SWAP_16(bits_per_sample);
 
 
@@ -119,9 +526,9 @@ bool SoundBuffer::LoadWAV(const std::string & filename, const SoundInfo & sound_
 					int chunknum = 0;
 					while (!found_data_chunk && chunknum < 10)
 					{
-						fseek(fp, filepos, SEEK_SET); //seek to the next chunk
-						if (fread(id, sizeof(char), 4, fp) != 4) return false; //read in 'data'
-						if (fread(&size, sizeof(unsigned int), 1, fp) != 1) return false; //how many bytes of sound data we have
+						SDL_RWseek(file, filepos, RW_SEEK_SET); //seek to the next chunk
+						if (SDL_RWread(file, id, sizeof(char), 4) != 4) return false; //read in 'data'
+						if (SDL_RWread(file, &size, sizeof(unsigned int), 1) != 1) return false; //how many bytes of sound data we have
 						size = ENDIAN_SWAP_32(size);
 						if (!strcmp(id,"data"))
 						{
@@ -144,7 +551,7 @@ bool SoundBuffer::LoadWAV(const std::string & filename, const SoundInfo & sound_
 
 					sound_buffer = new char[size];
 
-					if (fread(sound_buffer, sizeof(char), size, fp) != size) return false; //read in our whole sound data chunk
+					if (SDL_RWread(file, sound_buffer, sizeof(char), size) != size) return false; //read in our whole sound data chunk
 
 #if SDL_BYTEORDER == SDL_BIG_ENDIAN
 					if (bits_per_sample == 16)
@@ -173,18 +580,12 @@ bool SoundBuffer::LoadWAV(const std::string & filename, const SoundInfo & sound_
 					SoundInfo original_info(size/(bits_per_sample/8), sample_rate, channels, bits_per_sample/8);
 
 					loaded = true;
-					SoundInfo desired_info(original_info.samples, sound_device_info.frequency, original_info.channels, sound_device_info.bytespersample);
-					//ConvertTo(desired_info);
-					if (desired_info == original_info)
+					if (CheckFormat(original_info, sound_device_info, error_output))
 					{
-
+						Resample(sound_device_info.frequency);
 					}
 					else
 					{
-						error_output << "SOUND FORMAT:" << std::endl;
-						original_info.DebugPrint(error_output);
-						error_output << "DESIRED FORMAT:" << std::endl;
-						desired_info.DebugPrint(error_output);
 						//throw EXCEPTION(__FILE__, __LINE__, "Sound file isn't in desired format: " + filename);
 						//cerr << __FILE__ << "," << __LINE__ << ": Sound file isn't in desired format: " + filename << std::endl;
 						error_output << "Sound file isn't in desired format: "+filename << std::endl;
@@ -214,7 +615,6 @@ bool SoundBuffer::LoadWAV(const std::string & filename, const SoundInfo & sound_
 			error_output << "Sound file doesn't have RIFF header: "+filename << std::endl;
 			return false;
 		}
-		fclose(fp);
 	}
 	else
 	{
@@ -228,24 +628,25 @@ bool SoundBuffer::LoadWAV(const std::string & filename, const SoundInfo & sound_
 	return true;
 }
 
-bool SoundBuffer::LoadOGG(const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output)
+bool SoundBuffer::LoadOGG(SDL_RWops * file, const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output)
 {
 	if (loaded)
 		Unload();
 
 	name = filename;
 
-	FILE *fp;
-
 	unsigned int samples;
 
-	fp = fopen(filename.c_str(), "rb");
-	if (fp)
+	if (file)
 	{
 		vorbis_info *pInfo;
 		OggVorbis_File oggFile;
 
-		ov_open_callbacks(fp, &oggFile, NULL, 0, OV_CALLBACKS_DEFAULT);
+		if (ov_open_callbacks(file, &oggFile, NULL, 0, OV_CALLBACKS_RWOPS) < 0)
+		{
+			error_output << "Sound file isn't an ogg vorbis stream: "+filename << std::endl;
+			return false;
+		}
 
 		pInfo = ov_info(&oggFile, -1);
 
@@ -253,15 +654,8 @@ bool SoundBuffer::LoadOGG(const std::string & filename, const SoundInfo & sound_
 		samples = ov_pcm_total(&oggFile,-1);
 		info = SoundInfo(samples*pInfo->channels, pInfo->rate, pInfo->channels, 2);
 
-		SoundInfo desired_info(info.samples, sound_device_info.frequency, info.channels, sound_device_info.bytespersample);
-
-		if (!(desired_info == info))
+		if (!CheckFormat(info, sound_device_info, error_output))
 		{
-			error_output << "SOUND FORMAT:" << std::endl;
-			info.DebugPrint(error_output);
-			error_output << "DESIRED FORMAT:" << std::endl;
-			desired_info.DebugPrint(error_output);
-
 			error_output << "Sound file isn't in desired format: "+filename << std::endl;
 			ov_clear(&oggFile);
 			return false;
@@ -286,9 +680,11 @@ bool SoundBuffer::LoadOGG(const std::string & filename, const SoundInfo & sound_
 
 		loaded = true;
 
-		//note: no need to call fclose(); ov_clear does it for us
+		//the file is closed by the caller
 		ov_clear(&oggFile);
 
+		Resample(sound_device_info.frequency);
+
 		return true;
 	}
 	else
@@ -297,3 +693,122 @@ bool SoundBuffer::LoadOGG(const std::string & filename, const SoundInfo & sound_
 		return false;
 	}
 }
+
+#include "unittest.h"
+
+QT_TEST(soundbuffer_resampler_test)
+{
+	// upsample a stereo ramp by two, fed in uneven chunks
+	const int frames = 1000;
+	std::vector<short> in(frames * 2);
+	for (int i = 0; i < frames; ++i)
+	{
+		in[i * 2] = i * 20;
+		in[i * 2 + 1] = -i * 20;
+	}
+
+	Resampler resampler(2, 22050, 44100);
+	std::vector<short> out(resampler.GetMaxOutput(frames) * 2);
+	int count = 0;
+	int chunks[] = {1, 7, 300, 2, 690};
+	int pos = 0;
+	for (int i = 0; i < 5; ++i)
+	{
+		count += resampler.Process(&in[pos * 2], chunks[i], &out[count * 2]);
+		pos += chunks[i];
+	}
+	QT_CHECK_EQUAL(pos, frames);
+
+	// every input frame but the last one produces two output frames
+	QT_CHECK_EQUAL(count, (frames - 1) * 2);
+	bool ramp = true;
+	for (int i = 0; i < count; ++i)
+	{
+		ramp = ramp && out[i * 2] == i * 10 && out[i * 2 + 1] == -i * 10;
+	}
+	QT_CHECK(ramp);
+
+	// same rate is a copy
+	Resampler copy(1, 44100, 44100);
+	std::vector<short> mono(frames + 2);
+	count = copy.Process(&in[0], frames, &mono[0]);
+	QT_CHECK_EQUAL(count, frames - 1);
+	QT_CHECK_EQUAL(mono[count - 1], in[count - 1]);
+}
+
+#include "pathmanager.h"
+#include <iostream>
+
+// play the stream from the start like a new source, return all frames
+static std::vector<short> PlayStream(SoundBuffer & stream)
+{
+	stream.RestartStream(0, false);
+
+	// the decoder polls when the ring is full, give up if it stalls for a second
+	std::vector<short> streamed;
+	int waits = 0;
+	while (!stream.GetStreamEnded() && waits < 1000)
+	{
+		const short * frames = 0;
+		const int count = stream.PeekStream(frames, 4096);
+		if (count == 0)
+		{
+			SDL_Delay(1);
+			++waits;
+			continue;
+		}
+		streamed.insert(streamed.end(), frames, frames + count * stream.GetInfo().channels);
+		stream.PopStream(count);
+		waits = 0;
+	}
+	return streamed;
+}
+
+QT_TEST(soundbuffer_stream_test)
+{
+	std::stringbuf log;
+	std::ostream info(&log), error(&log);
+	PathManager path;
+	path.Init(info, error);
+
+	// the test file isn't generated, vdrift can't encode vorbis
+	const std::string filename = path.GetDataPath() + "/test/stream.ogg";
+	if (!std::ifstream(filename.c_str()))
+	{
+		std::cerr << "soundbuffer_stream_test: missing test file " << filename << std::endl;
+		QT_CHECK(!"stream.ogg missing");
+		return;
+	}
+
+	// decode the file through the stream and compare it with the loaded buffer
+	// once at the file rate and once resampled
+	const int frequencies[] = {44100, 48000};
+	for (int f = 0; f < 2; ++f)
+	{
+		const SoundInfo device_info(0, frequencies[f], 2, 2);
+		SoundBuffer full;
+		QT_CHECK(full.Load(filename, device_info, error));
+
+		SoundBuffer stream;
+		QT_CHECK(stream.LoadStream(filename, device_info, error));
+		QT_CHECK(stream.GetStreaming());
+		if (!full.GetLoaded() || !stream.GetStreaming()) return;
+		QT_CHECK_EQUAL(stream.GetInfo().channels, full.GetInfo().channels);
+		QT_CHECK_EQUAL(stream.GetInfo().frequency, full.GetInfo().frequency);
+
+		// a stream can be played again after it ended, a copy plays on its own
+		SoundBuffer copy;
+		QT_CHECK(copy.CopyStream(stream, error));
+		const std::vector<short> first = PlayStream(stream);
+		const std::vector<short> second = PlayStream(stream);
+		const std::vector<short> copied = PlayStream(copy);
+		QT_CHECK(stream.GetStreamEnded());
+
+		const short * samples = (const short *)full.GetRawBuffer();
+		const bool same_size = first.size() == (size_t)full.GetInfo().samples;
+		QT_CHECK(same_size);
+		QT_CHECK(same_size && std::equal(first.begin(), first.end(), samples));
+		QT_CHECK(second == first);
+		QT_CHECK(copied == first);
+	}
+}
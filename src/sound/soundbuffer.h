@@ -21,10 +21,20 @@
 #define SOUNDBUFFER_H
 
 #include "soundinfo.h"
+#include "memory.h"
 
 #include <iosfwd>
 #include <string>
+#include <vector>
 
+struct SDL_RWops;
+
+/// Sound samples, either fully decoded or streamed.
+/// Files which don't match the device frequency are resampled when loaded.
+/// A streaming buffer decodes an ogg file on a background thread into a ring buffer
+/// read by the sound thread, so it can only be played by a single source at a time.
+/// Sound gives every further source its own copy of the stream.
+/// The stream restarts at the source offset when a source starts, pitch is ignored.
 class SoundBuffer
 {
 public:
@@ -34,6 +44,18 @@ public:
 
 	bool Load(const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output);
 
+	/// load wav or ogg from an open file, the type is taken from the filename
+	bool Load(SDL_RWops * file, const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output);
+
+	/// open ogg file for streaming, only the header is read here
+	bool LoadStream(const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output);
+
+	/// stream from an open ogg file, the compressed file is read into memory
+	bool LoadStream(SDL_RWops * file, const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output);
+
+	/// open another stream of the file streamed by other, so that it can be played by a second source
+	bool CopyStream(const SoundBuffer & other, std::ostream & error_output);
+
 	void Unload();
 
 	const SoundInfo & GetInfo() const
@@ -61,16 +83,43 @@ public:
 		return loaded;
 	}
 
+	bool GetStreaming() const
+	{
+		return stream != 0;
+	}
+
+	/// sound thread stream access, get up to max contiguous decoded frames
+	/// returns the number of frames available, 0 on underrun or when the stream ended
+	int PeekStream(const short * & frames, int max) const;
+
+	/// sound thread stream access, release frames returned by PeekStream
+	void PopStream(int count);
+
+	/// sound thread stream access, play the stream from offset (in frames) when a source starts
+	void RestartStream(int offset, bool loop);
+
+	/// all frames of a non-looping stream have been played
+	bool GetStreamEnded() const;
+
 private:
+	struct Stream;
+
 	SoundInfo info;
 	unsigned int size;
 	bool loaded;
 	char * sound_buffer;
+	Stream * stream;
 	std::string name;
 
-	bool LoadWAV(const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output);
+	bool CheckFormat(const SoundInfo & original_info, const SoundInfo & sound_device_info, std::ostream & error_output) const;
+
+	void Resample(int frequency);
+
+	bool LoadWAV(SDL_RWops * file, const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output);
+
+	bool LoadOGG(SDL_RWops * file, const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output);
 
-	bool LoadOGG(const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output);
+	bool OpenStream(const std::tr1::shared_ptr<std::vector<char> > & data, const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output);
 
 };
 
@@ -0,0 +1,76 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "spscqueue.h"
+#include "unittest.h"
+
+#include <SDL2/SDL_thread.h>
+
+struct SpscQueueTestData
+{
+	SpscQueue<std::vector<int> > queue;
+	int count;
+};
+
+static int SpscQueueTestProducer(void * data)
+{
+	SpscQueueTestData & test = *(SpscQueueTestData *)data;
+	for (int i = 0; i < test.count; ++i)
+	{
+		// values are batched while the queue is full
+		test.queue.getBack().push_back(i);
+		test.queue.push();
+	}
+	while (!test.queue.getBack().empty() && !test.queue.push())
+	{
+		SDL_Delay(0);
+	}
+	return 0;
+}
+
+QT_TEST(spscqueue_test)
+{
+	SpscQueueTestData test;
+	test.count = 100000;
+
+	SDL_Thread * producer = SDL_CreateThread(SpscQueueTestProducer, "SpscQueueTest", &test);
+
+	// values have to arrive complete and in order
+	int expected = 0;
+	bool ordered = true;
+	while (expected < test.count)
+	{
+		if (test.queue.empty())
+			continue;
+
+		std::vector<int> & values = test.queue.getFront();
+		for (size_t i = 0; i < values.size(); ++i)
+		{
+			ordered = ordered && (values[i] == expected);
+			expected++;
+		}
+		values.clear();
+		test.queue.pop();
+	}
+	SDL_WaitThread(producer, NULL);
+
+	QT_CHECK(ordered);
+	QT_CHECK_EQUAL(expected, test.count);
+	QT_CHECK(test.queue.empty());
+}
@@ -0,0 +1,124 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _SPSCQUEUE_H
+#define _SPSCQUEUE_H
+
+#include <SDL2/SDL_atomic.h>
+
+#include <cassert>
+#include <vector>
+
+/// Bounded lock-free queue between one producer and one consumer thread.
+/// Items are preallocated and recycled: the producer fills getBack() and publishes it
+/// with push(), the consumer reads getFront() and hands it back with pop().
+/// Recycled items keep their contents, so the consumer has to reset them before pop,
+/// containers inside the items only allocate while they grow.
+template <class T>
+class SpscQueue
+{
+public:
+	/// capacity is the number of items which can be queued at once
+	SpscQueue(unsigned int capacity = 4);
+
+	/// producer: item being filled, the consumer doesn't see it until push
+	T & getBack();
+
+	/// producer: publish the back item, returns false if the queue is full
+	/// the back item is kept and can be extended in this case
+	bool push();
+
+	/// consumer: no published items pending
+	bool empty();
+
+	/// consumer: oldest published item
+	T & getFront();
+
+	/// consumer: release the front item
+	void pop();
+
+private:
+	std::vector<T> items;
+	SDL_atomic_t head;
+	SDL_atomic_t tail;
+
+	unsigned int next(unsigned int index) const;
+};
+
+
+template <class T>
+inline SpscQueue<T>::SpscQueue(unsigned int capacity) :
+	items(capacity + 1)
+{
+	SDL_AtomicSet(&head, 0);
+	SDL_AtomicSet(&tail, 0);
+}
+
+template <class T>
+inline unsigned int SpscQueue<T>::next(unsigned int index) const
+{
+	return (index + 1) % items.size();
+}
+
+template <class T>
+inline T & SpscQueue<T>::getBack()
+{
+	return items[SDL_AtomicGet(&tail)];
+}
+
+template <class T>
+inline bool SpscQueue<T>::push()
+{
+	const unsigned int t = SDL_AtomicGet(&tail);
+	const unsigned int n = next(t);
+	if (n == (unsigned int)SDL_AtomicGet(&head))
+		return false;
+
+	// item writes have to be visible before the new tail
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&tail, n);
+	return true;
+}
+
+template <class T>
+inline bool SpscQueue<T>::empty()
+{
+	return SDL_AtomicGet(&head) == SDL_AtomicGet(&tail);
+}
+
+template <class T>
+inline T & SpscQueue<T>::getFront()
+{
+	assert(!empty());
+	// don't read the item before the tail that published it
+	SDL_MemoryBarrierAcquire();
+	return items[SDL_AtomicGet(&head)];
+}
+
+template <class T>
+inline void SpscQueue<T>::pop()
+{
+	assert(!empty());
+	const unsigned int h = SDL_AtomicGet(&head);
+	// item reads have to be done before the producer can reuse it
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&head, next(h));
+}
+
+#endif // _SPSCQUEUE_H
@@ -33,6 +33,9 @@ bool Timer::Load(const std::string & trackrecordspath, float stagingtime)
 	Unload();
 
 	car.clear();
+	standings.clear();
+	places.clear();
+	leader_splits.clear();
 
 	pretime = stagingtime;
 
@@ -48,7 +51,14 @@ bool Timer::Load(const std::string & trackrecordspath, float stagingtime)
 int Timer::AddCar(const std::string & cartype)
 {
 	car.push_back(LapInfo(cartype));
-	return car.size()-1;
+
+	// new cars start out last
+	const int carid = car.size()-1;
+	places.push_back(standings.size());
+	standings.push_back(carid);
+	UpdatePlace(carid);
+
+	return carid;
 }
 
 void Timer::Unload()
@@ -106,14 +116,29 @@ void Timer::Lap(const unsigned int carid, const int nextsector, const bool count
 			trackrecords.set(car[carid].GetCarType(), secstr.str(), (float) car[carid].GetTime());
 	}
 
+	// the first car to cross a sector line sets the time the others are split against
+	// uncounted crossings, like the start line right after loading, don't take a split
+	LapInfo & info = car[carid];
+	if (countit)
+	{
+		const unsigned int splitid = info.GetNumSplits();
+		if (splitid == leader_splits.size())
+			leader_splits.push_back(info.GetRaceTime());
+		info.AddSplit(info.GetRaceTime() - leader_splits[splitid]);
+	}
+
 	if (nextsector == 0)
-		car[carid].Lap(countit);
+	{
+		info.Lap(countit);
+		UpdatePlace(carid);
+	}
 }
 
 void Timer::UpdateDistance(const unsigned int carid, const double newdistance)
 {
 	assert(carid < car.size());
 	car[carid].UpdateLapDistance(newdistance);
+	UpdatePlace(carid);
 }
 
 void Timer::DebugPrint(std::ostream & out) const
@@ -125,52 +150,111 @@ void Timer::DebugPrint(std::ostream & out) const
 	}
 }
 
-class Place
+bool Timer::Ahead(int a, int b) const
 {
-private:
-	int index;
-	int laps;
-	double distance;
-
-public:
-	Place(int newindex, int newlaps, double newdistance) : index(newindex), laps(newlaps), distance(newdistance) {}
-
-	int GetIndex() const {return index;}
+	if (car[a].GetCurrentLap() != car[b].GetCurrentLap())
+		return car[a].GetCurrentLap() > car[b].GetCurrentLap();
+	if (car[a].GetLapDistance() != car[b].GetLapDistance())
+		return car[a].GetLapDistance() > car[b].GetLapDistance();
+	return a < b;
+}
 
-	bool operator< (const Place & other) const
+void Timer::UpdatePlace(int carid)
+{
+	// only this car moved and the order rarely changes,
+	// so shift it past the cars it overtook or that overtook it
+	int place = places[carid];
+	while (place > 0 && Ahead(carid, standings[place - 1]))
+	{
+		standings[place] = standings[place - 1];
+		places[standings[place]] = place;
+		--place;
+	}
+	while (place + 1 < (int)standings.size() && Ahead(standings[place + 1], carid))
 	{
-		if (laps == other.laps)
-			return distance > other.distance;
-		else
-			return laps > other.laps;
+		standings[place] = standings[place + 1];
+		places[standings[place]] = place;
+		++place;
 	}
-};
+	standings[place] = carid;
+	places[carid] = place;
+}
 
-std::pair <int, int> Timer::GetCarPlace(int index)
+QT_TEST(timer_standings_test)
 {
-    assert(index<(int)car.size());
-    assert(index >= 0);
-
-    int place = 1;
-    int total = car.size();
-
-	std::list <Place> distances;
-
-    for (int i = 0; i < (int)car.size(); i++)
-    {
-		distances.push_back(Place(i, car[i].GetCurrentLap(), car[i].GetLapDistance()));
-    }
-
-    distances.sort();
-
-    int curplace = 1;
-	for (std::list <Place>::iterator i = distances.begin(); i != distances.end(); ++i)
-    {
-        if (i->GetIndex() == index)
-            place = curplace;
-
-        curplace++;
-    }
-
-    return std::make_pair(place, total);
+	Timer timer;
+	const int count = 12;
+	for (int i = 0; i < count; ++i)
+		timer.AddCar("car");
+
+	// all cars start on the line, ties keep the grid order
+	for (int i = 0; i < count; ++i)
+		QT_CHECK_EQUAL(timer.GetCarPlace(i).first, i + 1);
+
+	std::vector <int> laps(count, 0);
+	std::vector <double> distance(count, 0.0);
+	unsigned int seed = 1;
+	int errors = 0;
+	for (int step = 0; step < 2000; ++step)
+	{
+		seed = seed * 1103515245 + 12345;
+		const int carid = (seed >> 16) % count;
+		distance[carid] += ((seed >> 8) % 100) * 0.1;
+		if (distance[carid] > 500)
+		{
+			distance[carid] -= 500;
+			laps[carid]++;
+			timer.Lap(carid, 0, true);
+		}
+		timer.UpdateDistance(carid, distance[carid]);
+
+		// compare against counting the cars ahead
+		for (int i = 0; i < count; ++i)
+		{
+			int place = 1;
+			for (int j = 0; j < count; ++j)
+			{
+				if (laps[j] > laps[i] || (laps[j] == laps[i] &&
+					(distance[j] > distance[i] || (distance[j] == distance[i] && j < i))))
+					place++;
+			}
+			errors += (timer.GetCarPlace(i).first != place);
+			errors += (timer.GetCarAtPlace(place - 1) != i);
+		}
+	}
+	QT_CHECK_EQUAL(errors, 0);
+	QT_CHECK_EQUAL(timer.GetCarPlace(0).second, count);
+
+	// splits are taken against the first car across each counted sector line
+	Timer splits;
+	for (int i = 0; i < 3; ++i)
+		splits.AddCar("car");
+
+	// uncounted start line crossings at different times don't take a split
+	splits.Lap(0, 1, false);
+	splits.Tick(2);
+	splits.Lap(2, 1, false);
+	splits.Lap(1, 1, false);
+	for (int i = 0; i < 3; ++i)
+		QT_CHECK_EQUAL(splits.GetCarSplit(i), 0);
+
+	splits.Tick(1);
+	splits.Lap(1, 2, true);
+	QT_CHECK_EQUAL(splits.GetCarSplit(1), 0);
+	splits.Tick(0.5);
+	splits.Lap(0, 2, true);
+	QT_CHECK_EQUAL(splits.GetCarSplit(0), 0.5);
+	splits.Tick(0.25);
+	splits.Lap(2, 2, true);
+	QT_CHECK_EQUAL(splits.GetCarSplit(2), 0.75);
+
+	// the leader at the next sector line can change
+	splits.Tick(1);
+	splits.Lap(0, 0, true);
+	QT_CHECK_EQUAL(splits.GetCarSplit(0), 0);
+	QT_CHECK_EQUAL(splits.GetCarSplit(1), 0);
+	splits.Tick(1);
+	splits.Lap(1, 0, true);
+	QT_CHECK_EQUAL(splits.GetCarSplit(1), 1);
+	QT_CHECK_EQUAL(splits.GetCarSplit(2), 0.75);
 }
@@ -87,9 +87,27 @@ public:
 	float GetStagingTimeLeft() const {return pretime;}
 
 	///return the place (first element) out of total (second element)
-	std::pair <int, int> GetCarPlace(int index);
+	std::pair <int, int> GetCarPlace(int index) const
+	{
+		assert(index >= 0 && index < (int)car.size());
+		return std::make_pair(places[index] + 1, (int)car.size());
+	}
 
-	std::pair <int, int> GetPlayerPlace() {return GetCarPlace(playercarindex);}
+	///return the car index at the given place, starting at zero for the leader
+	int GetCarAtPlace(int place) const
+	{
+		assert(place >= 0 && place < (int)standings.size());
+		return standings[place];
+	}
+
+	///return the time behind the first car at the last sector line the car crossed
+	float GetCarSplit(unsigned int index) const
+	{
+		assert(index<car.size());
+		return car[index].GetSplit();
+	}
+
+	std::pair <int, int> GetPlayerPlace() const {return GetCarPlace(playercarindex);}
 
 	float GetDriftScore(unsigned int index) const
 	{
@@ -134,6 +152,21 @@ private:
 	class LapInfo;
 	std::vector <LapInfo> car;
 
+	// car indices ordered by place, kept sorted as the cars progress
+	std::vector <int> standings;
+
+	// place of each car, the index into standings
+	std::vector <int> places;
+
+	// race time of the first car at each sector line, by number of lines crossed
+	std::vector <double> leader_splits;
+
+	///true if car a is ahead of car b
+	bool Ahead(int a, int b) const;
+
+	///move the car to its place after its laps or distance changed
+	void UpdatePlace(int carid);
+
 	Config trackrecords; //the track records configfile
 	std::string trackrecordsfile; //the filename for the track records
 	float pretime; //amount of time left in staging
@@ -273,6 +306,8 @@ private:
 		int num_laps; //current lap
 		std::string cartype;
 		double lapdistance; //total track distance driven this lap in meters
+		unsigned int num_splits; //number of sector lines crossed
+		double split; //time behind the first car at the last sector line
 		DriftScore driftscore;
 
 	public:
@@ -284,6 +319,9 @@ private:
 			lastlap.Reset();
 			bestlap.Reset();
 			num_laps = 0;
+			lapdistance = 0.0;
+			num_splits = 0;
+			split = 0.0;
 		}
 
 		void Tick(float dt)
@@ -318,6 +356,27 @@ private:
 			return time;
 		}
 
+		double GetRaceTime() const
+		{
+			return totaltime + time;
+		}
+
+		unsigned int GetNumSplits() const
+		{
+			return num_splits;
+		}
+
+		void AddSplit(double newsplit)
+		{
+			split = newsplit;
+			num_splits++;
+		}
+
+		double GetSplit() const
+		{
+			return split;
+		}
+
 		double GetLastLap() const
 		{
 			return lastlap.GetTimeInSeconds();
@@ -149,6 +149,40 @@ bool Track::CastRay(
 	return col;
 }
 
+int Track::CastRays(
+	const RayPacket & packet,
+	int mask,
+	int patch_id[],
+	Vec3 outtri[],
+	const Bezier * colpatch[],
+	Vec3 normal[],
+	std::vector<int> & candidates) const
+{
+	int col = 0;
+	for (std::list <RoadStrip>::const_iterator i = data.roads.begin(); i != data.roads.end(); ++i)
+	{
+		Vec3 coltri[RayPacket::SIZE], colnorm[RayPacket::SIZE];
+		const Bezier * colbez[RayPacket::SIZE];
+		int hits = i->Collide(packet, mask, patch_id, coltri, colbez, colnorm, candidates);
+		for (int n = 0; hits >> n; ++n)
+		{
+			const int bit = 1 << n;
+			if (!(hits & bit))
+				continue;
+
+			const Vec3 & origin = packet.GetOrigin(n);
+			if (!(col & bit) || (coltri[n] - origin).MagnitudeSquared() < (outtri[n] - origin).MagnitudeSquared())
+			{
+				outtri[n] = coltri[n];
+				normal[n] = colnorm[n];
+				colpatch[n] = colbez[n];
+			}
+			col |= bit;
+		}
+	}
+	return col;
+}
+
 void Track::Update()
 {
 	if (!data.loaded) return;
@@ -31,6 +31,7 @@
 #include <iosfwd>
 #include <list>
 #include <set>
+#include <string>
 #include <vector>
 
 class Model;
@@ -91,6 +92,17 @@ public:
 		const Bezier * & colpatch,
 		Vec3 & normal) const;
 
+	/// Cast the masked rays of the packet, candidates is a scratch buffer.
+	/// Returns the mask of rays that hit a road.
+	int CastRays(
+		const RayPacket & packet,
+		int mask,
+		int patch_id[],
+		Vec3 outtri[],
+		const Bezier * colpatch[],
+		Vec3 normal[],
+		std::vector<int> & candidates) const;
+
 	/// Synchronize graphics and physics.
 	void Update();
 
@@ -117,6 +129,12 @@ public:
 		return data.lap[sector];
 	}
 
+	/// Directory the solved racing lines are kept in, they aren't cached if empty.
+	void SetCachePath(const std::string & path)
+	{
+		data.cachepath = path;
+	}
+
 	void SetRacingLineVisibility(bool newvis)
 	{
 		racingline_visible = newvis;
@@ -179,6 +197,7 @@ private:
 		// racing line data
 		SceneNode racingline_node;
 		std::tr1::shared_ptr<Texture> racingline_texture;
+		std::string cachepath;
 
 		// track state
 		bool reverse;
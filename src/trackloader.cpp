@@ -27,8 +27,37 @@
 #include "graphics/texture.h"
 #include "graphics/model.h"
 
+#include <SDL2/SDL.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+
 #define EXTBULLET
 
+// time spent per ContinueLoad call in milliseconds, keeps the loading screen responsive
+static const unsigned int load_budget = 20;
+
+// number of objects whose content is decoded ahead of the object being loaded
+static const int prefetch_objects = 64;
+
+// the racing line only depends on the roads and the direction they are driven in
+static std::string GetRacingLineKey(const std::string & roads, bool reverse)
+{
+	// 64 bit fnv-1a
+	unsigned long long hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < roads.size(); ++i)
+	{
+		hash ^= (unsigned char)roads[i];
+		hash *= 1099511628211ULL;
+	}
+	std::ostringstream key;
+	key << std::hex << std::setfill('0') << std::setw(16) << hash << "-" << std::dec << roads.size();
+	if (reverse)
+		key << "-r";
+	return key.str();
+}
+
 static inline std::istream & operator >> (std::istream & lhs, btVector3 & rhs)
 {
 	std::string str;
@@ -75,6 +104,46 @@ static btIndexedMesh GetIndexedMesh(const Model & model)
 	return mesh;
 }
 
+static TextureInfo GetTextureInfo(bool mipmap, int clampuv, int anisotropy)
+{
+	TextureInfo texinfo;
+	texinfo.mipmap = mipmap || anisotropy; //always mipmap if anisotropy is on
+	texinfo.anisotropy = anisotropy;
+	texinfo.repeatu = clampuv != 1 && clampuv != 2;
+	texinfo.repeatv = clampuv != 1 && clampuv != 3;
+	return texinfo;
+}
+
+static std::string GetMiscTextureName(const std::string & texture, const std::string & suffix)
+{
+	return texture.substr(0, std::max<int>(0, texture.length()-4)) + suffix;
+}
+
+// set relative path for models and textures, ugly hack
+// need to identify body references
+// return the body name
+static std::string SetBodyPaths(const PTree & cfg, std::string & model_name, std::vector<std::string> & texture_names)
+{
+	if (cfg.value() == "body" && cfg.parent())
+	{
+		return cfg.parent()->value();
+	}
+
+	std::string name = cfg.value();
+	size_t npos = name.rfind("/");
+	if (npos < name.length())
+	{
+		std::string rel_path = name.substr(0, npos+1);
+		model_name = rel_path + model_name;
+		texture_names[0] = rel_path + texture_names[0];
+		if (!texture_names[1].empty())
+			texture_names[1] = rel_path + texture_names[1];
+		if (!texture_names[2].empty())
+			texture_names[2] = rel_path + texture_names[2];
+	}
+	return name;
+}
+
 struct Track::Loader::Object
 {
 	std::tr1::shared_ptr<Model> model;
@@ -118,6 +187,7 @@ Track::Loader::Loader(
 	packload(false),
 	numobjects(0),
 	numloaded(0),
+	numprefetched(0),
 	params_per_object(17),
 	expected_params(17),
 	min_params(14),
@@ -138,7 +208,10 @@ Track::Loader::~Loader()
 void Track::Loader::Clear()
 {
 	bodies.clear();
-	objectfile.close();
+	objectfile.str("");
+	objectfile.clear();
+	prefetchfile.str("");
+	prefetchfile.clear();
 	pack.Close();
 }
 
@@ -166,12 +239,13 @@ bool Track::Loader::BeginLoad()
 
 	// load info
 	std::string info_path = trackpath + "/track.txt";
-	std::ifstream file(info_path.c_str());
-	if (!file.good())
+	std::string info_text;
+	if (!content.getArchives().Read(info_path, info_text))
 	{
 		error_output << "Can't find track configfile: " << info_path << std::endl;
 		return false;
 	}
+	std::istringstream file(info_text);
 
 	// parse info
 	PTree info;
@@ -204,7 +278,16 @@ bool Track::Loader::ContinueLoad()
 		return true;
 	}
 
-	std::pair <bool, bool> loadstatus = ContinueObjectLoad();
+	// objects are loaded until the time budget is used up
+	// their content is decoded on the loader threads, only gl objects are created here
+	const unsigned int start = SDL_GetTicks();
+	std::pair <bool, bool> loadstatus;
+	do
+	{
+		loadstatus = ContinueObjectLoad();
+	}
+	while (!loadstatus.first && loadstatus.second && SDL_GetTicks() - start < load_budget);
+
 	if (loadstatus.first)
 	{
 		return false;
@@ -221,6 +304,9 @@ bool Track::Loader::ContinueLoad()
 		data.shapes.push_back(track_shape);
 		track_shape = 0;
 #endif
+		// create prefetched content nobody asked for yet
+		content.finish();
+
 		data.loaded = true;
 		Clear();
 	}
@@ -236,12 +322,16 @@ bool Track::Loader::BeginObjectLoad()
 #endif
 
 	list = true;
-	packload = pack.Load(objectpath + "/objects.jpk");
 
-	std::string objectlist = objectpath + "/list.txt";
-	objectfile.open(objectlist.c_str());
-	if (objectfile.good())
+	// a packed objects directory (objects.vda) is read through the content manager
+	packload = !std::ifstream((objectpath + ".vda").c_str()) &&
+		pack.Load(objectpath + "/objects.jpk");
+
+	std::string objectlist;
+	if (content.getArchives().Read(objectpath + "/list.txt", objectlist))
 	{
+		objectfile.str(objectlist);
+		prefetchfile.str(objectlist);
 		return BeginOld();
 	}
 
@@ -278,6 +368,7 @@ bool Track::Loader::Begin()
 		if (track_config->get("object", nodes))
 		{
 			node_it = nodes->begin();
+			prefetch_it = nodes->begin();
 			numobjects = nodes->size();
 			data.meshes.reserve(numobjects);
 			return true;
@@ -293,12 +384,15 @@ std::pair<bool, bool> Track::Loader::Continue()
 		return std::make_pair(false, false);
 	}
 
+	Prefetch();
+
 	if (!LoadNode(node_it->second))
 	{
 		return std::make_pair(true, false);
 	}
 
 	node_it++;
+	numloaded++;
 
 	return std::make_pair(false, true);
 }
@@ -381,28 +475,7 @@ Track::Loader::body_iterator Track::Loader::LoadBody(const PTree & cfg)
 	std::stringstream s(texture_str);
 	s >> texture_names;
 
-	// set relative path for models and textures, ugly hack
-	// need to identify body references
-	std::string name;
-	if (cfg.value() == "body" && cfg.parent())
-	{
-		name = cfg.parent()->value();
-	}
-	else
-	{
-		name = cfg.value();
-		size_t npos = name.rfind("/");
-		if (npos < name.length())
-		{
-			std::string rel_path = name.substr(0, npos+1);
-			model_name = rel_path + model_name;
-			texture_names[0] = rel_path + texture_names[0];
-			if (!texture_names[1].empty())
-				texture_names[1] = rel_path + texture_names[1];
-			if (!texture_names[2].empty())
-				texture_names[2] = rel_path + texture_names[2];
-		}
-	}
+	std::string name = SetBodyPaths(cfg, model_name, texture_names);
 
 	if (dynamic_shadows && isashadow)
 	{
@@ -429,11 +502,7 @@ Track::Loader::body_iterator Track::Loader::LoadBody(const PTree & cfg)
 
 	// load textures
 	std::tr1::shared_ptr<Texture> tex[3];
-	TextureInfo texinfo;
-	texinfo.mipmap = mipmap || anisotropy; //always mipmap if anisotropy is on
-	texinfo.anisotropy = anisotropy;
-	texinfo.repeatu = clampuv != 1 && clampuv != 2;
-	texinfo.repeatv = clampuv != 1 && clampuv != 3;
+	TextureInfo texinfo = GetTextureInfo(mipmap, clampuv, anisotropy);
 	content.load(tex[0], objectdir, texture_names[0], texinfo);
 	if (!texture_names[1].empty())
 	{
@@ -614,7 +683,7 @@ bool Track::Loader::LoadNode(const PTree & sec)
 /// read from the file stream and put it in "output".
 /// return true if the get was successful, else false
 template <typename T>
-static bool get(std::ifstream & f, T & output)
+static bool get(std::istream & f, T & output)
 {
 	if (!f.good()) return false;
 
@@ -638,8 +707,7 @@ static bool get(std::ifstream & f, T & output)
 void Track::Loader::CalculateNumOld()
 {
 	numobjects = 0;
-	std::string objectlist = objectpath + "/list.txt";
-	std::ifstream f(objectlist.c_str());
+	std::istringstream f(objectfile.str());
 	int params_per_object;
 	if (get(f, params_per_object))
 	{
@@ -670,18 +738,102 @@ bool Track::Loader::BeginOld()
 		return false;
 	}
 
+	// second reader of the object list for prefetching
+	int prefetch_params;
+	get(prefetchfile, prefetch_params);
+
 	return true;
 }
 
+void Track::Loader::Prefetch()
+{
+	while (prefetch_it != nodes->end() && numprefetched - numloaded < prefetch_objects)
+	{
+		const PTree * sec_body;
+		if (prefetch_it->second.get("body", sec_body))
+		{
+			PrefetchBody(*sec_body);
+		}
+		prefetch_it++;
+		numprefetched++;
+	}
+}
+
+void Track::Loader::PrefetchBody(const PTree & cfg)
+{
+	std::string texture_str;
+	std::string model_name;
+	int clampuv = 0;
+	bool mipmap = true;
+	bool isashadow = false;
+	cfg.get("texture", texture_str);
+	cfg.get("model", model_name);
+	cfg.get("clampuv", clampuv);
+	cfg.get("mipmap", mipmap);
+	cfg.get("isashadow", isashadow);
+
+	if (dynamic_shadows && isashadow)
+	{
+		return;
+	}
+
+	std::vector<std::string> texture_names(3);
+	std::stringstream s(texture_str);
+	s >> texture_names;
+	SetBodyPaths(cfg, model_name, texture_names);
+
+	// pack file access isn't thread safe, pack models are loaded on demand
+	if (!packload)
+	{
+		content.loadAsync<Model>(objectdir, model_name);
+	}
+
+	TextureInfo texinfo = GetTextureInfo(mipmap, clampuv, anisotropy);
+	content.loadAsync<Texture>(objectdir, texture_names[0], texinfo);
+	if (!texture_names[1].empty())
+	{
+		content.loadAsync<Texture>(objectdir, texture_names[1], texinfo);
+	}
+	if (!texture_names[2].empty())
+	{
+		texinfo.compress = false;
+		content.loadAsync<Texture>(objectdir, texture_names[2], texinfo);
+	}
+}
+
+void Track::Loader::PrefetchOld()
+{
+	std::string model_name;
+	Object object;
+	bool isashadow;
+	while (numprefetched - numloaded < prefetch_objects &&
+		ReadObjectOld(prefetchfile, model_name, object, isashadow))
+	{
+		numprefetched++;
+		if (dynamic_shadows && isashadow)
+		{
+			continue;
+		}
+
+		if (!packload)
+		{
+			content.loadAsync<Model>(objectdir, model_name);
+		}
+
+		// misc textures are optional, missing ones are skipped by the factory
+		TextureInfo texinfo = GetTextureInfo(object.mipmap, object.clamptexture, anisotropy);
+		content.loadAsync<Texture>(objectdir, object.texture, texinfo);
+		content.loadAsync<Texture>(objectdir, GetMiscTextureName(object.texture, "-misc1.png"), texinfo);
+		texinfo.compress = false;
+		content.loadAsync<Texture>(objectdir, GetMiscTextureName(object.texture, "-misc2.png"), texinfo);
+	}
+}
+
 bool Track::Loader::AddObject(const Object & object)
 {
 	data.models.insert(object.model);
 
-	TextureInfo texinfo;
-	texinfo.mipmap = object.mipmap || anisotropy; //always mipmap if anisotropy is on
-	texinfo.anisotropy = anisotropy;
-	texinfo.repeatu = object.clamptexture != 1 && object.clamptexture != 2;
-	texinfo.repeatv = object.clamptexture != 1 && object.clamptexture != 3;
+	TextureInfo texinfo = GetTextureInfo(object.mipmap, object.clamptexture, anisotropy);
 
 	std::tr1::shared_ptr<Texture> texture0, texture1, texture2;
 	{
@@ -689,9 +841,9 @@ bool Track::Loader::AddObject(const Object & object)
 		data.textures.insert(texture0);
 	}
 	{
-		std::string texname = object.texture.substr(0, std::max<int>(0, object.texture.length()-4)) + "-misc1.png";
+		std::string texname = GetMiscTextureName(object.texture, "-misc1.png");
 		std::string filepath = objectpath + "/" + texname;
-		if (std::ifstream(filepath.c_str()))
+		if (content.getArchives().Exists(filepath))
 		{
 			content.load(texture1, objectdir, texname, texinfo);
 			data.textures.insert(texture1);
@@ -703,9 +855,9 @@ bool Track::Loader::AddObject(const Object & object)
 	}
 	{
 		texinfo.compress = false;
-		std::string texname = object.texture.substr(0, std::max<int>(0, object.texture.length()-4)) + "-misc2.png";
+		std::string texname = GetMiscTextureName(object.texture, "-misc2.png");
 		std::string filepath = objectpath + "/" + texname;
-		if (std::ifstream(filepath.c_str()))
+		if (content.getArchives().Exists(filepath))
 		{
 			content.load(texture2, objectdir, texname, texinfo);
 			data.textures.insert(texture2);
@@ -773,38 +925,49 @@ bool Track::Loader::AddObject(const Object & object)
 	return true;
 }
 
-std::pair<bool, bool> Track::Loader::ContinueOld()
+bool Track::Loader::ReadObjectOld(std::istream & f, std::string & model_name, Object & object, bool & isashadow)
 {
-	std::string model_name;
-	if (!get(objectfile, model_name))
+	if (!get(f, model_name))
 	{
-		return std::make_pair(false, false);
+		return false;
 	}
 
-	Object object;
-	bool isashadow;
 	std::string junk;
-
-	get(objectfile, object.texture);
-	get(objectfile, object.mipmap);
-	get(objectfile, object.nolighting);
-	get(objectfile, object.skybox);
-	get(objectfile, object.transparent_blend);
-	get(objectfile, junk);//bump_wavelength);
-	get(objectfile, junk);//bump_amplitude);
-	get(objectfile, junk);//driveable);
-	get(objectfile, object.collideable);
-	get(objectfile, junk);//friction_notread);
-	get(objectfile, junk);//friction_tread);
-	get(objectfile, junk);//rolling_resistance);
-	get(objectfile, junk);//rolling_drag);
-	get(objectfile, isashadow);
-	get(objectfile, object.clamptexture);
-	get(objectfile, object.surface);
+	get(f, object.texture);
+	get(f, object.mipmap);
+	get(f, object.nolighting);
+	get(f, object.skybox);
+	get(f, object.transparent_blend);
+	get(f, junk);//bump_wavelength);
+	get(f, junk);//bump_amplitude);
+	get(f, junk);//driveable);
+	get(f, object.collideable);
+	get(f, junk);//friction_notread);
+	get(f, junk);//friction_tread);
+	get(f, junk);//rolling_resistance);
+	get(f, junk);//rolling_drag);
+	get(f, isashadow);
+	get(f, object.clamptexture);
+	get(f, object.surface);
 	for (int i = 0; i < params_per_object - expected_params; i++)
 	{
-		get(objectfile, junk);
+		get(f, junk);
+	}
+	return true;
+}
+
+std::pair<bool, bool> Track::Loader::ContinueOld()
+{
+	PrefetchOld();
+
+	std::string model_name;
+	Object object;
+	bool isashadow;
+	if (!ReadObjectOld(objectfile, model_name, object, isashadow))
+	{
+		return std::make_pair(false, false);
 	}
+	numloaded++;
 
 	if (dynamic_shadows && isashadow)
 	{
@@ -825,9 +988,13 @@ std::pair<bool, bool> Track::Loader::ContinueOld()
 	if (object.skybox && data.vertical_tracking_skyboxes)
 	{
 		const bool genlist = object.model->HaveListID();
+		const bool headless = !genlist && !object.model->HaveVertexArrayObject();
 		VertexArray va = object.model->GetVertexArray();
 		va.Translate(0, 0, -object.model->GetCenter()[2]);
-		object.model->Load(va, error_output, genlist);
+		if (headless)
+			object.model->LoadMesh(va);
+		else
+			object.model->Load(va, error_output, genlist);
 	}
 
 	if (!AddObject(object))
@@ -841,12 +1008,13 @@ std::pair<bool, bool> Track::Loader::ContinueOld()
 bool Track::Loader::LoadSurfaces()
 {
 	std::string path = trackpath + "/surfaces.txt";
-	std::ifstream file(path.c_str());
-	if (!file.good())
+	std::string text;
+	if (!content.getArchives().Read(path, text))
 	{
 		info_output << "Can't find surfaces configfile: " << path << std::endl;
 		return false;
 	}
+	std::istringstream file(text);
 
 	PTree param;
 	read_ini(file, param);
@@ -899,12 +1067,14 @@ bool Track::Loader::LoadRoads()
 	data.roads.clear();
 
 	std::string roadpath = trackpath + "/roads.trk";
-	std::ifstream trackfile(roadpath.c_str());
-	if (!trackfile.good())
+	std::string roadtext;
+	if (!content.getArchives().Read(roadpath, roadtext))
 	{
 		error_output << "Error opening roads file: " << trackpath + "/roads.trk" << std::endl;
 		return false;
 	}
+	std::istringstream trackfile(roadtext);
+	racingline_key = GetRacingLineKey(roadtext, data.reverse);
 
 	int numroads = 0;
 	trackfile >> numroads;
@@ -922,12 +1092,31 @@ bool Track::Loader::CreateRacingLines()
 	TextureInfo texinfo;
 	content.load(data.racingline_texture, texturedir, "racingline.png", texinfo);
 
+	// solving the racing lines is slow on big tracks, reuse the solution of an earlier load
+	std::string cachefile;
+	std::ifstream cachein;
+	bool cached = false;
+	if (!data.cachepath.empty() && !racingline_key.empty())
+	{
+		cachefile = data.cachepath + "/" + racingline_key + ".vdl";
+		cachein.open(cachefile.c_str(), std::ios_base::binary);
+		cached = cachein && K1999::ReadHeader(cachein, racingline_key);
+	}
+
+	std::ostringstream cacheout;
+	K1999::WriteHeader(cacheout, racingline_key);
+
 	K1999 k1999data;
 	for (std::list <RoadStrip>::iterator i = data.roads.begin(); i != data.roads.end(); ++i)
 	{
 		if (k1999data.LoadData(*i))
 		{
-			k1999data.CalcRaceLine();
+			if (!cached || !k1999data.ReadFrom(cachein))
+			{
+				cached = false;
+				k1999data.CalcRaceLine();
+			}
+			k1999data.WriteTo(cacheout);
 			k1999data.UpdateRoadStrip(*i);
 		}
 		//else error_output << "Couldn't create racing line for roadstrip " << n << std::endl;
@@ -935,6 +1124,18 @@ bool Track::Loader::CreateRacingLines()
 		i->CreateRacingLine(data.racingline_node, data.racingline_texture);
 	}
 
+	if (!cached && !cachefile.empty())
+	{
+		// write into a temporary first, a failed write must not leave a truncated cache behind
+		const std::string tmppath = cachefile + ".tmp";
+		std::ofstream out(tmppath.c_str(), std::ios_base::binary);
+		const std::string cachedata = cacheout.str();
+		out.write(cachedata.c_str(), cachedata.size());
+		out.close();
+		if (!out || std::rename(tmppath.c_str(), cachefile.c_str()))
+			std::remove(tmppath.c_str());
+	}
+
 	return true;
 }
 
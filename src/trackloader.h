@@ -24,6 +24,8 @@
 #include "cfg/ptree.h"
 #include "joepack.h"
 
+#include <sstream>
+
 /*
 [object.foo]
 #position = 0, 0, 0
@@ -95,13 +97,16 @@ private:
 	const bool dynamic_objects;
 	const bool dynamic_shadows;
 
+	std::string racingline_key;
 	std::string objectpath;
 	std::string objectdir;
-	std::ifstream objectfile;
+	std::istringstream objectfile;
+	std::istringstream prefetchfile;
 	JoePack pack;
 	bool packload;
 	int numobjects;
 	int numloaded;
+	int numprefetched;
 	int params_per_object;
 	const int expected_params;
 	const int min_params;
@@ -137,6 +142,7 @@ private:
 	std::tr1::shared_ptr<PTree> track_config;
 	const PTree * nodes;
 	PTree::const_iterator node_it;
+	PTree::const_iterator prefetch_it;
 
 	bool LoadSurfaces();
 
@@ -162,6 +168,13 @@ private:
 
 	void CalculateNumOld();
 
+	/// start decoding the content of the objects ahead of the current one on the loader threads
+	void Prefetch();
+
+	void PrefetchOld();
+
+	void PrefetchBody(const PTree & cfg);
+
 	bool LoadNode(const PTree & sec);
 
 	bool LoadShape(const PTree & body_cfg, const Model & body_model, Body & body);
@@ -173,6 +186,8 @@ private:
 	struct Object;
 	bool AddObject(const Object & object);
 
+	bool ReadObjectOld(std::istream & f, std::string & model_name, Object & object, bool & isashadow);
+
 	void Clear();
 };
 
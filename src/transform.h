@@ -23,19 +23,34 @@
 #include "quaternion.h"
 #include "mathvector.h"
 
+/// rotation and translation, the setters flag the transform as changed
 class Transform
 {
 public:
+	Transform() : identity(true), changed(true) {}
 	const Quat & GetRotation() const {return rotation;}
 	const Vec3 & GetTranslation() const {return translation;}
-	void SetRotation(const Quat & rot) {rotation = rot;}
-	void SetTranslation(const Vec3 & trans) {translation = trans;}
-	bool IsIdentityTransform() const {return (rotation == Quat() && translation == Vec3());}
-	void Clear() {rotation.LoadIdentity();translation.Set(0.0f);}
+	void SetRotation(const Quat & rot) {rotation = rot;Update();}
+	void SetTranslation(const Vec3 & trans) {translation = trans;Update();}
+	bool IsIdentityTransform() const {return identity;}
+	void Clear() {rotation.LoadIdentity();translation.Set(0.0f);Update();}
+
+	/// set since the last ClearChanged call
+	bool GetChanged() const {return changed;}
+	void SetChanged() {changed = true;}
+	void ClearChanged() {changed = false;}
 
 private:
 	Quat rotation;
 	Vec3 translation;
+	bool identity;
+	bool changed;
+
+	void Update()
+	{
+		identity = (rotation == Quat() && translation == Vec3());
+		changed = true;
+	}
 };
 
 #endif // _TRANSFORM_H